@@ -0,0 +1,265 @@
+#pragma once
+
+#include "Png.h"
+#include "Raster.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// Writes an animated PNG in which every frame after the first holds only the rectangle that
+// changed since the one before. A frame that repeats its predecessor is not stored at all; the
+// predecessor is simply shown for longer. Frames are compressed on a worker pool, one task per
+// frame, and written in order as they complete, so compression of a run of frames proceeds on
+// all cores while memory stays bounded to a few frames in flight.
+//
+// The frame count is only known at the end, so the file must be seekable for finish() to fill
+// it in.
+
+// Shrinks candidate to the pixels that actually differ between the frames, which share a stride
+// in pixels. Returns an empty rect if none do.
+
+inline PixelRect changed_bounds(uint32_t const* previous, uint32_t const* current, uint32_t const stride, PixelRect const& candidate) noexcept
+{
+    PixelRect bounds{ candidate.right, candidate.bottom, candidate.left, candidate.top };
+
+    for (auto y = candidate.top; y < candidate.bottom; ++y)
+    {
+        auto const offset = size_t{ static_cast<uint32_t>(y) } * stride;
+        auto left = candidate.left;
+        auto right = candidate.right;
+
+        while (left < right && previous[offset + left] == current[offset + left])
+        {
+            ++left;
+        }
+
+        if (left == right)
+        {
+            continue;
+        }
+
+        while (previous[offset + right - 1] == current[offset + right - 1])
+        {
+            --right;
+        }
+
+        bounds.left = std::min(bounds.left, left);
+        bounds.right = std::max(bounds.right, right);
+        bounds.top = std::min(bounds.top, y);
+        bounds.bottom = y + 1;
+    }
+
+    return bounds.left < bounds.right ? bounds : PixelRect{};
+}
+
+struct ApngWriter
+{
+    ApngWriter(FILE* file, uint32_t const width, uint32_t const height, uint16_t const fps, WorkerPool& pool) :
+        m_file(file),
+        m_width(width),
+        m_height(height),
+        m_fps(fps),
+        m_pool(pool)
+    {
+        auto png = png_start(width, height);
+        m_control = png.size();
+        uint8_t const control[8] = {};
+        png_chunk(png, "acTL", control, sizeof(control));
+        write(png);
+    }
+
+    ApngWriter(ApngWriter const&) = delete;
+    ApngWriter& operator=(ApngWriter const&) = delete;
+
+    ~ApngWriter()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_changed.wait(lock, [&] { return m_running == 0; });
+    }
+
+    uint64_t frames() const noexcept
+    {
+        return m_frames;
+    }
+
+    uint64_t bytes() const noexcept
+    {
+        return m_bytes;
+    }
+
+    // Adds a frame, of which only rect differs from the previous one. pixels is the whole frame
+    // with the given stride in pixels; the first frame is always stored in full.
+
+    void add(uint32_t const* pixels, uint32_t const stride, PixelRect rect)
+    {
+        if (m_pending.empty() && !m_frames)
+        {
+            rect = { 0, 0, static_cast<int32_t>(m_width), static_cast<int32_t>(m_height) };
+        }
+
+        auto const frame = std::make_shared<Pending>();
+        frame->rect = rect;
+        frame->ticks = 1;
+
+        auto const width = static_cast<uint32_t>(rect.right - rect.left);
+        auto const height = static_cast<uint32_t>(rect.bottom - rect.top);
+        std::vector<uint32_t> crop(size_t{ width } * height);
+
+        for (uint32_t y = 0; y != height; ++y)
+        {
+            memcpy(crop.data() + size_t{ y } * width, pixels + size_t{ static_cast<uint32_t>(rect.top) + y } * stride + rect.left, size_t{ width } * 4);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            ++m_running;
+        }
+
+        m_pool.submit([this, frame, width, height, crop = std::move(crop)]
+        {
+            auto data = png_image_data(crop.data(), width, width, height);
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                frame->data = std::move(data);
+                frame->done = true;
+                --m_running;
+            }
+
+            m_changed.notify_all();
+        });
+
+        m_pending.push_back(frame);
+        drain(std::max<size_t>(2, m_pool.size() * 2));
+    }
+
+    // Shows the previous frame for one more tick instead of storing a copy of it.
+
+    void repeat() noexcept
+    {
+        if (!m_pending.empty())
+        {
+            ++m_pending.back()->ticks;
+        }
+    }
+
+    // Writes the remaining frames and the frame count. Returns false if anything failed to write.
+
+    bool finish()
+    {
+        drain(0);
+        write_chunk("IEND", nullptr, 0);
+
+        uint8_t control[8] = {};
+        put32(control, static_cast<uint32_t>(m_frames));
+
+        std::vector<uint8_t> chunk;
+        png_chunk(chunk, "acTL", control, sizeof(control));
+
+        m_failed = m_failed || fseek(m_file, static_cast<long>(m_control), SEEK_SET) ||
+            chunk.size() != fwrite(chunk.data(), 1, chunk.size(), m_file) ||
+            fseek(m_file, 0, SEEK_END);
+
+        return !m_failed;
+    }
+
+private:
+
+    struct Pending
+    {
+        PixelRect rect;
+        uint32_t ticks;
+        std::vector<uint8_t> data;
+        bool done{};
+    };
+
+    static void put32(uint8_t* bytes, uint32_t const value) noexcept
+    {
+        bytes[0] = static_cast<uint8_t>(value >> 24);
+        bytes[1] = static_cast<uint8_t>(value >> 16);
+        bytes[2] = static_cast<uint8_t>(value >> 8);
+        bytes[3] = static_cast<uint8_t>(value);
+    }
+
+    // Writes frames from the front until no more than keep remain in flight. add() always keeps
+    // the newest frame back since it may yet be repeated.
+
+    void drain(size_t const keep)
+    {
+        while (m_pending.size() > keep)
+        {
+            auto const frame = m_pending.front();
+
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_changed.wait(lock, [&] { return frame->done; });
+            }
+
+            m_pending.pop_front();
+            write_frame(*frame);
+        }
+    }
+
+    void write_frame(Pending const& frame)
+    {
+        uint8_t control[26];
+        put32(control, m_sequence++);
+        put32(control + 4, static_cast<uint32_t>(frame.rect.right - frame.rect.left));
+        put32(control + 8, static_cast<uint32_t>(frame.rect.bottom - frame.rect.top));
+        put32(control + 12, static_cast<uint32_t>(frame.rect.left));
+        put32(control + 16, static_cast<uint32_t>(frame.rect.top));
+        auto const ticks = std::min<uint32_t>(frame.ticks, 0xffff);
+        control[20] = static_cast<uint8_t>(ticks >> 8);
+        control[21] = static_cast<uint8_t>(ticks);
+        control[22] = static_cast<uint8_t>(m_fps >> 8);
+        control[23] = static_cast<uint8_t>(m_fps);
+        control[24] = 0; // APNG_DISPOSE_OP_NONE
+        control[25] = 0; // APNG_BLEND_OP_SOURCE
+        write_chunk("fcTL", control, sizeof(control));
+
+        // The first frame is the default image; the rest carry a sequence number ahead of the data.
+
+        if (!m_frames++)
+        {
+            write_chunk("IDAT", frame.data.data(), frame.data.size());
+        }
+        else
+        {
+            std::vector<uint8_t> data(4 + frame.data.size());
+            put32(data.data(), m_sequence++);
+            std::copy(frame.data.begin(), frame.data.end(), data.begin() + 4);
+            write_chunk("fdAT", data.data(), data.size());
+        }
+    }
+
+    void write_chunk(char const (&type)[5], uint8_t const* data, size_t const size)
+    {
+        std::vector<uint8_t> chunk;
+        chunk.reserve(size + 12);
+        png_chunk(chunk, type, data, size);
+        write(chunk);
+    }
+
+    void write(std::vector<uint8_t> const& bytes)
+    {
+        m_failed = m_failed || bytes.size() != fwrite(bytes.data(), 1, bytes.size(), m_file);
+        m_bytes += bytes.size();
+    }
+
+    FILE* m_file;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint16_t m_fps;
+    WorkerPool& m_pool;
+    size_t m_control{};
+    std::deque<std::shared_ptr<Pending>> m_pending;
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    size_t m_running{};
+    uint32_t m_sequence{};
+    uint64_t m_frames{};
+    uint64_t m_bytes{};
+    bool m_failed{};
+};
@@ -1,4 +1,23 @@
 #include "pch.h"
+#include "Config.h"
+#include "Control.h"
+#include "Curves.h"
+#include "FrameRing.h"
+#include "Glyphs.h"
+#include "Http.h"
+#include "Power.h"
+#include "Raster.h"
+#include "Rebuild.h"
+#include "Resources.h"
+#include "Rfb.h"
+#include "Snapshot.h"
+#include "Startup.h"
+#include "Tick.h"
+#include "TimeSource.h"
+#include "TimeZones.h"
+#include "Visibility.h"
+#include "Wall.h"
+#include "ZoneClocks.h"
 
 using namespace winrt;
 using namespace D2D1;
@@ -14,13 +33,125 @@ com_ptr<ID2D1Factory1> create_factory()
     com_ptr<ID2D1Factory1> factory;
 
     check_hresult(D2D1CreateFactory(
-        D2D1_FACTORY_TYPE_SINGLE_THREADED,
+        D2D1_FACTORY_TYPE_MULTI_THREADED,
         fo,
         factory.put()));
 
     return factory;
 }
 
+com_ptr<IDWriteFactory> create_write_factory()
+{
+    com_ptr<IDWriteFactory> factory;
+
+    check_hresult(DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED,
+        __uuidof(factory),
+        reinterpret_cast<IUnknown**>(factory.put())));
+
+    return factory;
+}
+
+com_ptr<IDWriteFontFace> create_font_face(IDWriteFactory* const factory)
+{
+    com_ptr<IDWriteFontCollection> fonts;
+    check_hresult(factory->GetSystemFontCollection(fonts.put()));
+
+    UINT32 index = 0;
+    BOOL exists = FALSE;
+    check_hresult(fonts->FindFamilyName(L"Segoe UI", &index, &exists));
+
+    com_ptr<IDWriteFontFamily> family;
+    check_hresult(fonts->GetFontFamily(exists ? index : 0, family.put()));
+
+    com_ptr<IDWriteFont> font;
+
+    check_hresult(family->GetFirstMatchingFont(DWRITE_FONT_WEIGHT_NORMAL,
+        DWRITE_FONT_STRETCH_NORMAL,
+        DWRITE_FONT_STYLE_NORMAL,
+        font.put()));
+
+    com_ptr<IDWriteFontFace> face;
+    check_hresult(font->CreateFontFace(face.put()));
+    return face;
+}
+
+constexpr uint32_t dwrite_font = builtin_font + 1;
+
+// Posted by the configuration's watching thread once it has loaded a change.
+
+constexpr UINT wm_config = WM_USER + 1;
+
+// Posted by the control socket's I/O thread once it has commands for the render loop.
+
+constexpr UINT wm_control = WM_USER + 2;
+
+// Set while a costlier power level waits out its dwell, so that it applies even if nothing else
+// wakes the window.
+
+constexpr UINT_PTR power_timer = 1;
+
+constexpr wchar_t window_class[] = L"Sample";
+
+// The glyphs for the numerals and the readout, rasterised by DirectWrite. These headers predate
+// grayscale glyph run analysis, so the glyphs are rendered for ClearType and the coverage of
+// their three subpixels averaged.
+
+GlyphAtlas dwrite_atlas(IDWriteFactory* const factory, IDWriteFontFace* const face, float const size, float const dpi)
+{
+    DWRITE_FONT_METRICS metrics;
+    face->GetMetrics(&metrics);
+    auto const pixels = size * dpi / 96.0f;
+
+    return build_atlas(size, dpi, "0123456789: ", [&](uint8_t const code, std::vector<uint8_t>& coverage, GlyphBox& box)
+    {
+        UINT32 const point = code;
+        UINT16 index = 0;
+        check_hresult(face->GetGlyphIndices(&point, 1, &index));
+
+        DWRITE_GLYPH_METRICS glyph;
+        check_hresult(face->GetDesignGlyphMetrics(&index, 1, &glyph));
+        box.advance = glyph.advanceWidth * pixels / metrics.designUnitsPerEm;
+
+        DWRITE_GLYPH_RUN run{};
+        run.fontFace = face;
+        run.fontEmSize = pixels;
+        run.glyphCount = 1;
+        run.glyphIndices = &index;
+
+        com_ptr<IDWriteGlyphRunAnalysis> analysis;
+
+        check_hresult(factory->CreateGlyphRunAnalysis(&run,
+            1.0f,
+            nullptr,
+            DWRITE_RENDERING_MODE_NATURAL_SYMMETRIC,
+            DWRITE_MEASURING_MODE_NATURAL,
+            0.0f, 0.0f,
+            analysis.put()));
+
+        RECT bounds;
+        check_hresult(analysis->GetAlphaTextureBounds(DWRITE_TEXTURE_CLEARTYPE_3x1, &bounds));
+
+        if (bounds.left >= bounds.right || bounds.top >= bounds.bottom)
+        {
+            return;
+        }
+
+        box.left = static_cast<int16_t>(bounds.left);
+        box.top = static_cast<int16_t>(bounds.top);
+        box.width = static_cast<uint16_t>(bounds.right - bounds.left);
+        box.height = static_cast<uint16_t>(bounds.bottom - bounds.top);
+
+        std::vector<uint8_t> texture(size_t{ box.width } * box.height * 3);
+        check_hresult(analysis->CreateAlphaTexture(DWRITE_TEXTURE_CLEARTYPE_3x1, &bounds, texture.data(), static_cast<UINT32>(texture.size())));
+        coverage.resize(size_t{ box.width } * box.height);
+
+        for (size_t pixel = 0; pixel != coverage.size(); ++pixel)
+        {
+            coverage[pixel] = static_cast<uint8_t>((texture[pixel * 3] + texture[pixel * 3 + 1] + texture[pixel * 3 + 2] + 1) / 3);
+        }
+    });
+}
+
 HRESULT create_device(D3D_DRIVER_TYPE const type, com_ptr<ID3D11Device>& device)
 {
     UINT flags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
@@ -121,16 +252,144 @@ com_ptr<IDXGISwapChain1> create_swapchain(com_ptr<ID3D11Device> const& device, H
     return swapChain;
 }
 
+// The offscreen bitmaps for one DPI and size bucket, and the size in DIPs the dials bitmap was
+// last drawn for.
+
+struct GlyphResources
+{
+    GlyphAtlas atlas;
+    com_ptr<ID2D1Bitmap1> bitmap;
+};
+
+struct SizeResources
+{
+    com_ptr<ID2D1Bitmap1> clock;
+    com_ptr<ID2D1Bitmap1> dials;
+    D2D1_SIZE_F drawn{};
+    DetailTier tier{};
+    FaceTheme theme{};
+};
+
+struct DeviceResources
+{
+    com_ptr<ID3D11Device> device;
+    com_ptr<ID2D1DeviceContext> target;
+    com_ptr<ID2D1SolidColorBrush> brush;
+    com_ptr<ID2D1Effect> shadow;
+};
+
+D2D1_COLOR_F to_color(Color const& color)
+{
+    return { color.r, color.g, color.b, color.a };
+}
+
+std::vector<RebuildStep> device_steps(
+    com_ptr<ID2D1Factory1> const& factory,
+    float const dpi,
+    std::shared_ptr<DeviceResources> const& resources)
+{
+    enum { device, target };
+
+    return
+    {
+        { "device", 0, [=]
+        {
+            resources->device = create_device();
+        }},
+        { "target", 1 << device, [=]
+        {
+            resources->target = create_render_target(factory, resources->device);
+            resources->target->SetDpi(dpi, dpi);
+        }},
+        { "brush", 1 << target, [=]
+        {
+            check_hresult(resources->target->CreateSolidColorBrush(to_color(color_orange),
+                BrushProperties(hand_opacity),
+                resources->brush.put()));
+        }},
+        { "shadow", 1 << target, [=]
+        {
+            struct __declspec(uuid("C67EA361-1863-4e69-89DB-695D3E9A5B6B")) Direct2DShadow;
+
+            check_hresult(resources->target->CreateEffect(__uuidof(Direct2DShadow),
+                resources->shadow.put()));
+        }},
+    };
+}
+
+int32_t local_offset()
+{
+    TIME_ZONE_INFORMATION zone;
+    auto const id = GetTimeZoneInformation(&zone);
+    auto bias = zone.Bias;
+
+    if (TIME_ZONE_ID_DAYLIGHT == id)
+    {
+        bias += zone.DaylightBias;
+    }
+    else if (TIME_ZONE_ID_STANDARD == id)
+    {
+        bias += zone.StandardBias;
+    }
+
+    return -bias * 60;
+}
+
+static_assert(sizeof(Transform) == sizeof(D2D1_MATRIX_3X2_F));
+
+struct DeviceContextTarget
+{
+    ID2D1DeviceContext* target;
+    ID2D1Brush* brush;
+    ID2D1StrokeStyle* style;
+    GlyphResources const* glyphs{};
+
+    void set_transform(Transform const& transform) const
+    {
+        target->SetTransform(reinterpret_cast<D2D1_MATRIX_3X2_F const*>(&transform));
+    }
+
+    void draw_ellipse(float const x, float const y, float const rx, float const ry, float const stroke) const
+    {
+        target->DrawEllipse(Ellipse(Point2F(x, y), rx, ry), brush, stroke);
+    }
+
+    void draw_line(float const x0, float const y0, float const x1, float const y1, float const stroke) const
+    {
+        target->DrawLine(Point2F(x0, y0), Point2F(x1, y1), brush, stroke, style);
+    }
+
+    // Glyphs are the atlas's coverage through the brush, which Direct2D only does aliased.
+
+    void draw_glyph(uint16_t const code, float const x0, float const y0, float const x1, float const y1) const
+    {
+        auto const& box = glyphs->atlas.glyph(code);
+        auto const scale = 96.0f / glyphs->atlas.dpi;
+        auto const mode = target->GetAntialiasMode();
+        target->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+
+        target->FillOpacityMask(glyphs->bitmap.get(),
+            brush,
+            RectF(x0, y0, x1, y1),
+            RectF(box.x * scale, box.y * scale, (box.x + box.width) * scale, (box.y + box.height) * scale));
+
+        target->SetAntialiasMode(mode);
+    }
+};
+
 struct Window
 {
     HWND m_window{};
 
-    Window()
+    explicit Window(uint32_t const count = 1) :
+        m_count(count),
+        m_offsets(wall_offsets(count)),
+        m_angles(count)
     {
         WNDCLASS wc{};
         wc.hCursor = LoadCursorW(nullptr, IDC_ARROW);
         wc.hInstance = GetModuleHandleW(nullptr);
-        wc.lpszClassName = L"Sample";
+        wc.lpszClassName = window_class;
         wc.style = CS_HREDRAW | CS_VREDRAW;
         wc.lpfnWndProc = window_proc;
         RegisterClassW(&wc);
@@ -140,6 +399,8 @@ struct Window
             WS_OVERLAPPEDWINDOW | WS_VISIBLE,
             CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT,
             nullptr, nullptr, wc.hInstance, this);
+
+        m_startup.mark(StartupPhase::window);
     }
 
     static LRESULT __stdcall window_proc(HWND const window, UINT const message, WPARAM const wparam, LPARAM const lparam) noexcept
@@ -171,56 +432,147 @@ struct Window
         {
             PAINTSTRUCT ps;
             check_bool(BeginPaint(m_window, &ps));
-            render();
+
+            // Nothing is drawn while the window is hidden, but being painted suggests that it
+            // may no longer be covered, which the swap chain can confirm.
+
+            if (m_visibility.hidden_by(HiddenBy::occlusion))
+            {
+                probe_occlusion();
+            }
+
+            if (m_visible)
+            {
+                render();
+            }
+
             EndPaint(m_window, &ps);
             return 0;
         }
 
         if (WM_SIZE == message)
         {
+            // Resizing is deferred to the next frame so that a storm of WM_SIZE messages during
+            // a live drag results in at most one ResizeBuffers per presented frame.
+
             if (m_target && SIZE_MINIMIZED != wparam)
             {
-                resize_swapchain_bitmap();
-                render();
+                m_resize = true;
+                m_composed = false;
+            }
+
+            if (SIZE_MINIMIZED == wparam || SIZE_RESTORED == wparam || SIZE_MAXIMIZED == wparam)
+            {
+                update_visibility(HiddenBy::minimized, SIZE_MINIMIZED == wparam);
             }
 
             return 0;
         }
 
-        if (WM_DISPLAYCHANGE == message)
+        // The window takes the size Windows suggests for the new monitor. Its resize then picks
+        // up the device-size resources for the new DPI, from the cache if the window has been on
+        // such a monitor before.
+
+        if (WM_DPICHANGED == message)
         {
-            render();
+            m_dpi = static_cast<float>(LOWORD(wparam));
+
+            if (m_target)
+            {
+                m_target->SetDpi(m_dpi, m_dpi);
+                m_resize = true;
+                m_composed = false;
+            }
+
+            trace_sizes();
+
+            auto const rect = reinterpret_cast<RECT const*>(lparam);
+
+            SetWindowPos(m_window, nullptr,
+                rect->left, rect->top, rect->right - rect->left, rect->bottom - rect->top,
+                SWP_NOZORDER | SWP_NOACTIVATE);
+
             return 0;
         }
 
-        if (WM_USER == message)
+        if (WM_DISPLAYCHANGE == message)
         {
-            if (S_OK == m_swapChain->Present(0, DXGI_PRESENT_TEST))
+            m_refresh = refresh_rate();
+
+            if (m_visible)
             {
-                m_dxfactory->UnregisterOcclusionStatus(m_occlusion);
-                m_occlusion = 0;
-                m_visible = true;
+                render();
             }
 
             return 0;
         }
 
-        if (WM_POWERBROADCAST == message)
+        if (wm_config == message)
+        {
+            update_config();
+            trace_config();
+            return 0;
+        }
+
+        if (wm_control == message)
+        {
+            serve_control();
+            return 0;
+        }
+
+        if (WM_USER == message)
+        {
+            probe_occlusion();
+            return 0;
+        }
+
+        if (WM_POWERBROADCAST == message && PBT_POWERSETTINGCHANGE == wparam)
         {
             auto const ps = reinterpret_cast<POWERBROADCAST_SETTING*>(lparam);
-            m_visible = 0 != *reinterpret_cast<DWORD const*>(ps->Data);
+            auto const data = *reinterpret_cast<DWORD const*>(ps->Data);
 
-            if (m_visible)
+            if (GUID_SESSION_DISPLAY_STATUS == ps->PowerSetting)
+            {
+                m_power_inputs.display = data <= 2 ? static_cast<DisplayState>(data) : DisplayState::on;
+                update_visibility(HiddenBy::display, DisplayState::off == m_power_inputs.display);
+            }
+            else if (GUID_ACDC_POWER_SOURCE == ps->PowerSetting)
             {
-                PostMessageW(m_window, WM_NULL, 0, 0);
+                m_power_inputs.source = PoAc == data ? PowerSource::ac : PowerSource::battery;
+            }
+            else if (GUID_POWER_SAVING_STATUS == ps->PowerSetting)
+            {
+                m_saver = 0 != data;
             }
 
+            update_power();
             return TRUE;
         }
 
         if (WM_ACTIVATE == message)
         {
-            m_visible = !HIWORD(wparam);
+            m_power_inputs.foreground = WA_INACTIVE != LOWORD(wparam);
+            update_power();
+            return 0;
+        }
+
+        if (WM_TIMER == message && power_timer == wparam)
+        {
+            update_power();
+            return 0;
+        }
+
+        if (WM_KEYDOWN == message)
+        {
+            if ('C' == wparam && GetKeyState(VK_CONTROL) < 0)
+            {
+                copy_snapshot();
+            }
+            else if ('T' == wparam)
+            {
+                next_theme();
+            }
+
             return 0;
         }
 
@@ -235,303 +587,1632 @@ struct Window
         return DefWindowProcW(m_window, message, wparam, lparam);
     }
 
-    void resize_swapchain_bitmap()
-    {
-        m_target->SetTarget(nullptr);
+    // A PNG of the clock as of the current second, at the window's size unless given one. The
+    // pool and cache are only created once the first snapshot is taken.
 
-        if (S_OK == m_swapChain->ResizeBuffers(0,
-            0, 0,
-            DXGI_FORMAT_UNKNOWN,
-            0))
+    SnapshotBytes snapshot(uint32_t width = 0, uint32_t height = 0)
+    {
+        if (!width || !height)
         {
-            create_swapchain_bitmap(m_swapChain, m_target);
-            create_device_size_resources();
+            RECT rect;
+            check_bool(GetClientRect(m_window, &rect));
+            width = static_cast<uint32_t>(rect.right);
+            height = static_cast<uint32_t>(rect.bottom);
         }
-        else
+
+        if (!width || !height)
         {
-            release_device();
+            return nullptr;
         }
-    }
 
-    void render()
-    {
-        if (!m_target)
+        if (!m_snapshots)
         {
-            auto device = create_device();
-            m_target = create_render_target(m_factory, device);
-            m_swapChain = create_swapchain(device, m_window);
-            create_swapchain_bitmap(m_swapChain, m_target);
+            m_workers = std::make_unique<WorkerPool>();
+            m_snapshots = std::make_unique<SnapshotCache>(m_workers.get());
+        }
 
-            m_target->SetDpi(m_dpi, m_dpi);
+        // The frame's time may be well behind while the compositor turns the hands, or the clock
+        // is hidden, paused or resting between ticks.
 
-            create_device_resources();
-            create_device_size_resources();
-        }
+        auto const time = m_time.sample();
 
-        m_target->BeginDraw();
-        draw();
-        m_target->EndDraw();
+        SnapshotKey const key =
+        {
+            width,
+            height,
+            m_count,
+            m_dpi,
+            1 == m_count ? time.offset : 0,
+            utc_seconds(time),
+            *m_theme,
+            m_show_numerals,
+            m_show_readout
+        };
+
+        return m_snapshots->snapshot(key);
+    }
 
-        auto const hr = m_swapChain->Present(1, 0);
+    // Copies a snapshot to the clipboard.
 
-        if (S_OK == hr)
+    void copy_snapshot()
+    {
+        auto const png = snapshot();
+
+        if (!png)
         {
-            // Do nothing
+            return;
         }
-        else if (DXGI_STATUS_OCCLUDED == hr)
+
+        auto const memory = GlobalAlloc(GMEM_MOVEABLE, png->size());
+
+        if (!memory)
         {
-            check_hresult(m_dxfactory->RegisterOcclusionStatusWindow(m_window, WM_USER, &m_occlusion));
-            m_visible = false;
+            return;
         }
-        else
+
+        memcpy(GlobalLock(memory), png->data(), png->size());
+        GlobalUnlock(memory);
+
+        if (OpenClipboard(m_window))
         {
-            release_device();
+            EmptyClipboard();
+
+            if (SetClipboardData(RegisterClipboardFormatW(L"PNG"), memory))
+            {
+                CloseClipboard();
+                return;
+            }
+
+            CloseClipboard();
         }
+
+        GlobalFree(memory);
     }
 
-    void release_device()
+    // Reads back only what changed since the previous frame into a copy of the frame kept in
+    // memory, which then feeds the frame ring and the VNC server: where the hands were and are,
+    // and whatever else was drawn again, as m_redrawn collects it. The copy is made to a staging
+    // texture and mapped straight away, which waits for the GPU to finish the frame; that cost is
+    // only paid while exporting.
+
+    void export_frame()
     {
-        m_target = nullptr;
-        m_swapChain = nullptr;
+        com_ptr<ID3D11Texture2D> buffer;
+        check_hresult(m_swapChain->GetBuffer(0, __uuidof(buffer), buffer.put_void()));
 
-        release_device_resources();
-    }
+        com_ptr<ID3D11Device> device;
+        buffer->GetDevice(device.put());
+        com_ptr<ID3D11DeviceContext> context;
+        device->GetImmediateContext(context.put());
 
-    void run()
-    {
-        m_factory = create_factory();
+        D3D11_TEXTURE2D_DESC desc;
+        buffer->GetDesc(&desc);
 
-        check_hresult(CreateDXGIFactory1(__uuidof(m_dxfactory),
-            reinterpret_cast<void**>(m_dxfactory.put())));
+        if (m_staging)
+        {
+            D3D11_TEXTURE2D_DESC current;
+            m_staging->GetDesc(&current);
 
-        float dpiY;
-        m_factory->GetDesktopDpi(&m_dpi, &dpiY);
+            if (current.Width != desc.Width || current.Height != desc.Height)
+            {
+                m_staging = nullptr;
+            }
+        }
 
-        create_device_independent_resources();
+        PixelRect const full{ 0, 0, static_cast<int32_t>(desc.Width), static_cast<int32_t>(desc.Height) };
+        auto const hands = damage_bounds(m_scene.hands, m_dpi, *m_theme);
+        auto dirty = unite(unite(m_exported, hands), m_redrawn);
+        m_exported = hands;
+        m_redrawn = {};
 
-        check_bool(RegisterPowerSettingNotification(m_window,
-            &GUID_SESSION_DISPLAY_STATUS,
-            DEVICE_NOTIFY_WINDOW_HANDLE));
+        if (!m_staging)
+        {
+            desc.Usage = D3D11_USAGE_STAGING;
+            desc.BindFlags = 0;
+            desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+            desc.MiscFlags = 0;
+            check_hresult(device->CreateTexture2D(&desc, nullptr, m_staging.put()));
+            m_readback.assign(size_t{ desc.Width } * desc.Height, 0);
+            dirty = full;
+        }
 
-        MSG message = {};
+        dirty = intersect(dirty, full);
 
-        while (true)
+        if (!dirty.empty())
         {
-            if (m_visible)
-            {
-                render();
+            D3D11_BOX const box = { static_cast<UINT>(dirty.left), static_cast<UINT>(dirty.top), 0, static_cast<UINT>(dirty.right), static_cast<UINT>(dirty.bottom), 1 };
+            context->CopySubresourceRegion(m_staging.get(), 0, box.left, box.top, 0, buffer.get(), 0, &box);
 
-                while (PeekMessageW(&message, nullptr, 0, 0, PM_REMOVE))
-                {
-                    DispatchMessageW(&message);
-                }
+            D3D11_MAPPED_SUBRESOURCE mapped;
+            check_hresult(context->Map(m_staging.get(), 0, D3D11_MAP_READ, 0, &mapped));
+
+            for (auto y = dirty.top; y < dirty.bottom; ++y)
+            {
+                memcpy(m_readback.data() + size_t{ static_cast<uint32_t>(y) } * desc.Width + dirty.left,
+                    static_cast<uint8_t const*>(mapped.pData) + size_t{ static_cast<uint32_t>(y) } * mapped.RowPitch + size_t{ static_cast<uint32_t>(dirty.left) } * 4,
+                    size_t{ static_cast<uint32_t>(dirty.right - dirty.left) } * 4);
             }
-            else
+
+            context->Unmap(m_staging.get(), 0);
+        }
+
+        if (m_export)
+        {
+            m_export->publish(desc.Width, desc.Height, dirty, [&](uint32_t* pixels, uint32_t const stride, PixelRect const& region)
             {
-                if (BOOL result = GetMessageW(&message, 0, 0, 0))
+                for (auto y = region.top; y < region.bottom; ++y)
                 {
-                    if (-1 != result)
-                    {
-                        DispatchMessageW(&message);
-                    }
+                    memcpy(pixels + size_t{ static_cast<uint32_t>(y) } * stride + region.left,
+                        m_readback.data() + size_t{ static_cast<uint32_t>(y) } * desc.Width + region.left,
+                        size_t{ static_cast<uint32_t>(region.right - region.left) } * 4);
                 }
-            }
+            });
+        }
 
-            if (WM_QUIT == message.message)
-            {
-                break;
-            }
+        if (m_rfb)
+        {
+            m_rfb->publish(m_readback.data(), desc.Width, desc.Height, desc.Width, dirty);
         }
     }
 
-    double get_time() const
+    void resize_swapchain_bitmap()
     {
-        LARGE_INTEGER time;
-        check_bool(QueryPerformanceCounter(&time));
+        m_target->SetTarget(nullptr);
 
-        return static_cast<double>(time.QuadPart) / m_frequency.QuadPart;
+        if (S_OK == m_swapChain->ResizeBuffers(0,
+            0, 0,
+            DXGI_FORMAT_UNKNOWN,
+            0))
+        {
+            create_swapchain_bitmap(m_swapChain, m_target);
+            create_device_size_resources();
+        }
+        else
+        {
+            release_device();
+        }
     }
 
-    void schedule_animation()
+    void render()
     {
-        m_manager = create_instance<IUIAnimationManager>(__uuidof(UIAnimationManager));
+        auto const start = std::chrono::steady_clock::now();
+        update_config();
+        serve_control();
+
+        if (m_composed)
+        {
+            return;
+        }
+
+        if (!m_target && !m_rebuild.valid())
+        {
+            start_rebuild();
+        }
+
+        if (m_rebuild.valid())
+        {
+            // The last presented frame stays on screen until the new device is ready.
+
+            if (std::future_status::ready != m_rebuild.wait_for(std::chrono::milliseconds(15)))
+            {
+                if (!m_swapChain)
+                {
+                    present_software_frame();
+                }
+
+                return;
+            }
+
+            trace_rebuild(m_rebuild.get());
+            attach_device();
+        }
+
+        if (m_resize)
+        {
+            m_resize = false;
+            resize_swapchain_bitmap();
+
+            if (!m_target)
+            {
+                return;
+            }
+        }
+
+        // Each frame drawn on the GPU moves time on by one frame. Once a replayed trace runs out
+        // there is nothing more to show.
+
+        if (!m_time.advance())
+        {
+            PostQuitMessage(0);
+            return;
+        }
+
+        m_target->BeginDraw();
+        draw();
+        m_target->EndDraw();
+
+        if (m_export || m_rfb)
+        {
+            export_frame();
+        }
+
+        auto const hr = m_swapChain->Present(std::max(m_interval, present_interval(m_policy.policy().max_fps, m_refresh)), 0);
+
+        if (S_OK == hr)
+        {
+            publish_stats(start);
+
+            // A ticking clock rests once the second hand has made its step. The intro swing and
+            // virtual time move on every frame, so they keep rendering.
+
+            auto const ticking = HandMotion::tick == motion() && !m_swinging && TimeKind::real == m_time.kind();
+            m_wake = ticking ? next_tick(m_time.now().utc, m_tick) : 0;
+
+            if (!m_startup.reached(StartupPhase::gpu_frame))
+            {
+                m_startup.mark(StartupPhase::first_pixel);
+                m_startup.mark(StartupPhase::gpu_frame);
+                trace_startup();
+            }
+
+            if (composing())
+            {
+                compose();
+            }
+        }
+        else if (DXGI_STATUS_OCCLUDED == hr)
+        {
+            check_hresult(m_dxfactory->RegisterOcclusionStatusWindow(m_window, WM_USER, &m_occlusion));
+            update_visibility(HiddenBy::occlusion, true);
+        }
+        else
+        {
+            release_device();
+        }
+    }
+
+    // Until the GPU device is ready the scene is rendered on the CPU and copied to the window
+    // with GDI so that a clock appears as soon as possible.
+
+    void present_software_frame()
+    {
+        RECT rect;
+        check_bool(GetClientRect(m_window, &rect));
+        auto const width = static_cast<uint32_t>(rect.right);
+        auto const height = static_cast<uint32_t>(rect.bottom);
+
+        if (!width || !height)
+        {
+            return;
+        }
+
+        if (m_manager)
+        {
+            check_hresult(m_manager->Update(get_time()));
+        }
+
+        auto const scale = 96.0f / m_dpi;
+        auto scene = record_wall(m_count, width * scale, height * scale, true, *m_theme);
+        update_angles();
+        patch_wall(scene, m_angles.data());
+
+        Canvas frame(width, height, m_dpi);
+        Canvas layer(width, height, m_dpi);
+        draw_scene(frame, layer, *m_theme, scene.dials, scene.hands);
+
+        BITMAPINFO info = {};
+        info.bmiHeader.biSize = sizeof(info.bmiHeader);
+        info.bmiHeader.biWidth = static_cast<LONG>(width);
+        info.bmiHeader.biHeight = -static_cast<LONG>(height);
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+
+        auto const dc = GetDC(m_window);
+
+        SetDIBitsToDevice(dc,
+            0, 0, width, height,
+            0, 0, 0, height,
+            frame.data(),
+            &info,
+            DIB_RGB_COLORS);
+
+        ReleaseDC(m_window, dc);
+        m_startup.mark(StartupPhase::first_pixel);
+    }
+
+    void trace_startup() const
+    {
+        wchar_t message[128];
+
+        swprintf_s(message, L"startup: window %.1f ms, first pixel %.1f ms, gpu frame %.1f ms\n",
+            m_startup.seconds(StartupPhase::window) * 1000.0,
+            m_startup.seconds(StartupPhase::first_pixel) * 1000.0,
+            m_startup.seconds(StartupPhase::gpu_frame) * 1000.0);
+
+        OutputDebugStringW(message);
+    }
+
+    void start_rebuild()
+    {
+        m_rebuilt = std::make_shared<DeviceResources>();
+        m_rebuild = rebuild_async(device_steps(m_factory, m_dpi, m_rebuilt));
+    }
+
+    void attach_device()
+    {
+        // Only one flip model swap chain may be bound to a window, so the old one is released
+        // just before its replacement is created.
+
+        m_swapChain = nullptr;
+        m_swapChain = create_swapchain(m_rebuilt->device, m_window);
+
+        m_target = std::move(m_rebuilt->target);
+        m_brush = std::move(m_rebuilt->brush);
+        m_shadow = std::move(m_rebuilt->shadow);
+        m_rebuilt = nullptr;
+
+        // The DPI may have changed while the device was being built.
+
+        m_target->SetDpi(m_dpi, m_dpi);
+
+        create_swapchain_bitmap(m_swapChain, m_target);
+        create_device_size_resources();
+    }
+
+    static void trace_rebuild(std::vector<RebuildTiming> const& timings)
+    {
+        for (auto&& timing : timings)
+        {
+            wchar_t message[128];
+            swprintf_s(message, L"rebuild %S: %.1f-%.1f ms\n", timing.name, timing.start * 1000.0, timing.finish * 1000.0);
+            OutputDebugStringW(message);
+        }
+    }
+
+    void release_device()
+    {
+        m_target = nullptr;
+        m_staging = nullptr;
+        m_composed = false;
+        m_composition_target = nullptr;
+        m_composition = nullptr;
+        release_device_resources();
+        start_rebuild();
+    }
+
+    void run()
+    {
+        m_factory = create_factory();
+
+        m_dpi = static_cast<float>(GetDpiForWindow(m_window));
+
+        // The device comes up in the background while the rest of startup continues.
+
+        start_rebuild();
+
+        if (std::future_status::ready != m_rebuild.wait_for(first_pixel_budget))
+        {
+            present_software_frame();
+        }
+
+        check_hresult(CreateDXGIFactory1(__uuidof(m_dxfactory),
+            reinterpret_cast<void**>(m_dxfactory.put())));
+
+        create_device_independent_resources();
+
+        // Each registration is answered at once with the current state, so the policy starts
+        // from the truth rather than its defaults.
+
+        m_refresh = refresh_rate();
+
+        for (auto&& setting : { GUID_SESSION_DISPLAY_STATUS, GUID_ACDC_POWER_SOURCE, GUID_POWER_SAVING_STATUS })
+        {
+            check_bool(RegisterPowerSettingNotification(m_window,
+                &setting,
+                DEVICE_NOTIFY_WINDOW_HANDLE));
+        }
+
+        // A window is cloaked when it is on another virtual desktop, among other things. The
+        // events arrive through this thread's message queue, so nothing needs to poll for them.
+
+        BOOL cloaked = FALSE;
+
+        if (SUCCEEDED(DwmGetWindowAttribute(m_window, DWMWA_CLOAKED, &cloaked, sizeof(cloaked))))
+        {
+            update_visibility(HiddenBy::cloaked, FALSE != cloaked);
+        }
+
+        auto const hook = SetWinEventHook(EVENT_OBJECT_CLOAKED, EVENT_OBJECT_UNCLOAKED,
+            nullptr,
+            cloak_event,
+            GetCurrentProcessId(),
+            GetCurrentThreadId(),
+            WINEVENT_OUTOFCONTEXT);
+
+        MSG message = {};
+
+        while (true)
+        {
+            if (m_visible && m_composed)
+            {
+                wait_composed();
+
+                while (PeekMessageW(&message, nullptr, 0, 0, PM_REMOVE))
+                {
+                    DispatchMessageW(&message);
+                }
+            }
+            else if (m_visible && resting())
+            {
+                wait_tick();
+
+                while (PeekMessageW(&message, nullptr, 0, 0, PM_REMOVE))
+                {
+                    DispatchMessageW(&message);
+                }
+            }
+            else if (m_visible)
+            {
+                render();
+
+                while (PeekMessageW(&message, nullptr, 0, 0, PM_REMOVE))
+                {
+                    DispatchMessageW(&message);
+                }
+            }
+            else
+            {
+                if (BOOL result = GetMessageW(&message, 0, 0, 0))
+                {
+                    if (-1 != result)
+                    {
+                        DispatchMessageW(&message);
+                    }
+                }
+            }
+
+            if (WM_QUIT == message.message)
+            {
+                break;
+            }
+        }
+
+        if (hook)
+        {
+            UnhookWinEvent(hook);
+        }
+    }
+
+    // Animation reads the time of the current frame, so that it follows virtual time too.
+
+    double get_time() const
+    {
+        return m_time.now().elapsed;
+    }
+
+    void schedule_animation()
+    {
+        m_manager = create_instance<IUIAnimationManager>(__uuidof(UIAnimationManager));
         auto library = create_instance<IUIAnimationTransitionLibrary>(__uuidof(UIAnimationTransitionLibrary));
-        check_bool(QueryPerformanceFrequency(&m_frequency));
 
-        com_ptr<IUIAnimationTransition> transition;
+        com_ptr<IUIAnimationTransition> transition;
+
+        check_hresult(library->CreateAccelerateDecelerateTransition(
+            5.0,
+            1.0,
+            0.2,
+            0.8,
+            transition.put()));
+
+        check_hresult(m_manager->CreateAnimationVariable(0.0, m_variable.put()));
+
+        m_intro_began = get_time();
+
+        check_hresult(m_manager->ScheduleTransition(m_variable.get(),
+            transition.get(),
+            m_intro_began));
+    }
+
+    void create_device_independent_resources()
+    {
+        D2D1_STROKE_STYLE_PROPERTIES style = {};
+        style.startCap = D2D1_CAP_STYLE_ROUND;
+        style.endCap = D2D1_CAP_STYLE_TRIANGLE;
+
+        check_hresult(m_factory->CreateStrokeStyle(style,
+            nullptr, 0,
+            m_style.put()));
+
+        schedule_animation();
+    }
+
+    void release_device_resources()
+    {
+        m_brush = nullptr;
+        m_clock = nullptr;
+        m_dials = nullptr;
+        m_shadow = nullptr;
+        m_size = nullptr;
+        m_sizes.clear();
+        m_numerals = nullptr;
+        m_readout = nullptr;
+        m_readout_layer = nullptr;
+        m_glyphs.clear();
+    }
+
+    void create_device_size_resources()
+    {
+        auto sizeF = m_target->GetSize();
+
+        auto sizeU = SizeU(size_bucket(static_cast<UINT>(sizeF.width * m_dpi / 96.0f)),
+            size_bucket(static_cast<UINT>(sizeF.height * m_dpi / 96.0f)));
+
+        auto& resources = m_sizes.get({ m_dpi, sizeU.width, sizeU.height }, [&]
+        {
+            auto props = BitmapProperties1(D2D1_BITMAP_OPTIONS_TARGET,
+                PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED),
+                m_dpi, m_dpi);
+
+            SizeResources created;
+
+            check_hresult(m_target->CreateBitmap(sizeU,
+                nullptr, 0,
+                props,
+                created.clock.put()));
+
+            check_hresult(m_target->CreateBitmap(sizeU,
+                nullptr, 0,
+                props,
+                created.dials.put()));
+
+            return created;
+        });
+
+        if (m_clock != resources.clock)
+        {
+            m_clock = resources.clock;
+            m_dials = resources.dials;
+            m_shadow->SetInput(0, m_clock.get());
+        }
+
+        m_size = &resources;
+        m_scene = record_wall(m_count, sizeF.width, sizeF.height, true, *m_theme);
+        create_text_resources(sizeF);
+        m_tier = detail_tier(wall_radius(m_count, sizeF.width, sizeF.height, m_dpi) * m_policy.policy().lod_bias, m_tier, m_thresholds);
+        m_redrawn = everywhere;
+        m_dials_dirty = resources.drawn.width != sizeF.width || resources.drawn.height != sizeF.height || resources.tier != m_tier ||
+            memcmp(&resources.theme, m_theme, sizeof(FaceTheme));
+
+        m_brush->SetColor(to_color(m_theme->ink));
+        m_brush->SetOpacity(m_theme->opacity);
+        check_hresult(m_shadow->SetValue(D2D1_SHADOW_PROP_BLUR_STANDARD_DEVIATION, m_theme->shadow_deviation));
+
+        // The smallest clocks are drawn aliased and without a shadow, and middling ones let the
+        // shadow effect blur at a lower resolution, as does the power policy when it asks for a
+        // fast shadow.
+
+        m_target->SetAntialiasMode(DetailTier::sprite == m_tier ? D2D1_ANTIALIAS_MODE_ALIASED : D2D1_ANTIALIAS_MODE_PER_PRIMITIVE);
+
+        check_hresult(m_shadow->SetValue(D2D1_SHADOW_PROP_OPTIMIZATION,
+            DetailTier::reduced == m_tier || ShadowQuality::fast == m_policy.policy().shadow ? D2D1_SHADOW_OPTIMIZATION_SPEED : D2D1_SHADOW_OPTIMIZATION_BALANCED));
+    }
+
+    // Text draws from glyph atlases cached by size and DPI. Only a single clock has a readout.
+
+    void show_text(bool const numerals, bool const readout)
+    {
+        m_show_numerals = numerals;
+        m_show_readout = readout && 1 == m_count;
+    }
+
+    GlyphResources& glyphs(float const size)
+    {
+        return m_glyphs.get({ dwrite_font, size, m_dpi }, [&]
+        {
+            if (!m_face)
+            {
+                m_write = create_write_factory();
+                m_face = create_font_face(m_write.get());
+            }
+
+            GlyphResources created{ dwrite_atlas(m_write.get(), m_face.get(), size, m_dpi), nullptr };
+
+            check_hresult(m_target->CreateBitmap(SizeU(created.atlas.width, created.atlas.height),
+                created.atlas.alpha.data(), created.atlas.width,
+                BitmapProperties1(D2D1_BITMAP_OPTIONS_NONE, PixelFormat(DXGI_FORMAT_A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED), m_dpi, m_dpi),
+                created.bitmap.put()));
+
+            return created;
+        });
+    }
+
+    // The numerals join the dials, to be drawn with them only when they change. The readout has a
+    // layer of its own, just big enough to hold it, in which only the digits that change from
+    // one frame to the next are drawn again.
+
+    void create_text_resources(D2D1_SIZE_F const& size)
+    {
+        auto const layout = wall_layout(m_count, size.width, size.height);
+        auto const radius = wall_geometry(layout, 0).radius;
+        m_numerals = nullptr;
+        m_readout = nullptr;
+        m_readout_layer = nullptr;
+
+        if (m_show_numerals)
+        {
+            m_numerals = &glyphs(numeral_size(radius));
+
+            for (uint32_t index = 0; index != m_count; ++index)
+            {
+                record_numerals(m_scene.dials, wall_geometry(layout, index), m_numerals->atlas);
+            }
+        }
+
+        if (m_show_readout)
+        {
+            auto const& text = glyphs(readout_size(radius));
+            auto const geometry = wall_geometry(layout, 0);
+            m_readout = std::make_unique<DigitalReadout>(text.atlas, geometry.x, geometry.y + geometry.radius * 0.5f);
+            m_readout_text = &text;
+
+            auto const bounds = m_readout->bounds();
+            auto const scale = m_dpi / 96.0f;
+            m_readout_origin = Point2F(std::floor(bounds.left * scale) * 96.0f / m_dpi, std::floor(bounds.top * scale) * 96.0f / m_dpi);
+
+            check_hresult(m_target->CreateBitmap(SizeU(static_cast<UINT>(std::ceil((bounds.right - m_readout_origin.x) * scale)), static_cast<UINT>(std::ceil((bounds.bottom - m_readout_origin.y) * scale))),
+                nullptr, 0,
+                BitmapProperties1(D2D1_BITMAP_OPTIONS_TARGET, PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED), m_dpi, m_dpi),
+                m_readout_layer.put()));
+
+            m_readout_cleared = false;
+        }
+    }
+
+    // The settings that can change while the clock runs are published by a ConfigReloader, from
+    // "/config:PATH" or from the command line alone. The window takes up the current version at
+    // the start of each frame, and straight away when told that a new one has been published, and
+    // applies all of it at once. The version taken stays valid until the next is taken up, so the
+    // face may point into its theme library.
+
+    void use_config(std::string const& path, ClockSettings const& defaults)
+    {
+        auto const window = m_window;
+
+        m_reloader = std::make_unique<ConfigReloader>(path, defaults, [window]
+        {
+            PostMessageW(window, wm_config, 0, 0);
+        });
+
+        m_config_reader = std::make_unique<RcuReader<ClockConfig>>(m_reloader->configs());
+        update_config();
+        trace_config();
+    }
+
+    void update_config()
+    {
+        auto const config = m_config_reader->read();
+
+        if (config == m_config)
+        {
+            return;
+        }
+
+        m_config = config;
+        auto const& settings = config->settings;
+        auto const theme = config->themes.find(settings.theme);
+        m_theme = config->face;
+        m_theme_index = theme < 0 ? config->themes.size() - 1 : static_cast<uint32_t>(theme);
+        m_thresholds = settings.thresholds;
+        m_compose = FramePolicy::compose == settings.frames;
+        m_interval = settings.interval;
+        m_motion = settings.motion;
+        m_tick = settings.tick;
+        m_wake = 0;
+
+        if (settings.exported != m_export_name)
+        {
+            m_export_name = settings.exported;
+            m_export = nullptr;
+            m_staging = nullptr;
+
+            if (!m_export_name.empty())
+            {
+                try
+                {
+                    m_export = std::make_unique<FrameRingWriter>(m_export_name,
+                        static_cast<uint32_t>(GetSystemMetrics(SM_CXVIRTUALSCREEN)),
+                        static_cast<uint32_t>(GetSystemMetrics(SM_CYVIRTUALSCREEN)));
+                }
+                catch (std::exception const& e)
+                {
+                    OutputDebugStringA(e.what());
+                }
+            }
+        }
+
+        if (settings.rfb != m_rfb_port)
+        {
+            m_rfb_port = settings.rfb;
+            m_rfb = nullptr;
+            m_staging = nullptr;
+
+            if (m_rfb_port)
+            {
+                try
+                {
+                    m_rfb = std::make_unique<RfbServer>(m_rfb_port);
+                }
+                catch (std::exception const& e)
+                {
+                    OutputDebugStringA(e.what());
+                }
+            }
+        }
+
+        // The scene is recorded again with the new face and detail.
+
+        if (m_target)
+        {
+            m_resize = true;
+        }
+
+        recompose();
+    }
+
+    // Hands left to the compositor are handed over again, or taken back if the clock no longer
+    // composes, after a change to how they move.
+
+    void recompose()
+    {
+        m_composed = false;
+
+        if (m_composition_target && !composing())
+        {
+            check_hresult(m_composition_target->SetRoot(nullptr));
+            check_hresult(m_composition->Commit());
+        }
+    }
+
+    // Reports one reason the window may be hidden. Once the last is lifted, the next frame is
+    // drawn at once from the current time, with the compositor's curves rebuilt if need be, so
+    // that the hands are never seen where they were when the window was hidden.
+
+    void update_visibility(HiddenBy const reason, bool const hidden)
+    {
+        auto const rate = m_composed ? 0.0 : policy_frame_rate(m_policy.policy(), motion(), m_refresh, m_tick);
+        auto const change = m_visibility.update(reason, hidden, steady_now(), rate);
+
+        if (VisibilityChange::none == change)
+        {
+            return;
+        }
+
+        // Cloaking is reported from within GetMessage, which returns only once there is a
+        // message, so one is posted to bring the loop round to render.
+
+        if (VisibilityChange::revealed == change)
+        {
+            m_wake = 0;
+            recompose();
+            PostMessageW(m_window, WM_NULL, 0, 0);
+        }
+
+        m_power_inputs.hidden = !m_visibility.visible();
+        update_power();
+        store_stats();
+        trace_visibility(reason, change);
+    }
+
+    void trace_visibility(HiddenBy const reason, VisibilityChange const change) const
+    {
+        wchar_t message[128];
+        auto const now = steady_now();
+
+        swprintf_s(message, L"visibility: %hs %hs, %llu frames saved over %.0f s hidden\n",
+            VisibilityChange::hidden == change ? "hidden by" : "revealed, no longer",
+            hidden_by_name(reason),
+            static_cast<unsigned long long>(m_visibility.frames_saved(now)),
+            m_visibility.hidden_seconds(now));
+
+        OutputDebugStringW(message);
+    }
+
+    // A window found occluded is registered for occlusion status, which arrives as WM_USER once
+    // it may be visible again. A test present confirms it before anything is drawn.
+
+    void probe_occlusion()
+    {
+        if (m_occlusion && S_OK == m_swapChain->Present(0, DXGI_PRESENT_TEST))
+        {
+            m_dxfactory->UnregisterOcclusionStatus(m_occlusion);
+            m_occlusion = 0;
+            update_visibility(HiddenBy::occlusion, false);
+        }
+    }
+
+    static void __stdcall cloak_event(HWINEVENTHOOK, DWORD const event, HWND const window, LONG const object, LONG, DWORD, DWORD) noexcept
+    {
+        wchar_t name[std::size(window_class)];
+
+        if (OBJID_WINDOW != object || !GetClassNameW(window, name, static_cast<int>(std::size(name))) || wcscmp(name, window_class))
+        {
+            return;
+        }
+
+        if (auto that = reinterpret_cast<Window*>(GetWindowLongPtrW(window, GWLP_USERDATA)))
+        {
+            that->update_visibility(HiddenBy::cloaked, EVENT_OBJECT_CLOAKED == event);
+        }
+    }
+
+    static double steady_now() noexcept
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Feeds the power policy the current inputs. The window renders only while it is neither
+    // hidden nor paused by the policy, and a change of level redraws at once with the new
+    // policy's frame rate, motion, shadow and detail. A costlier level waiting out its dwell
+    // sets a timer to be looked at again once it is due.
+
+    void update_power()
+    {
+        m_power_inputs.saver = m_saver || PowerMode::low == m_power;
+        auto const now = steady_now();
+
+        if (m_policy.update(m_power_inputs, now))
+        {
+            m_wake = 0;
+
+            if (m_target)
+            {
+                m_resize = true;
+            }
+
+            recompose();
+            trace_power();
+        }
+
+        m_visible = m_visibility.visible() && m_policy.policy().render;
+        auto const due = m_policy.due();
+
+        if (due < std::numeric_limits<double>::infinity())
+        {
+            SetTimer(m_window, power_timer, static_cast<UINT>(std::ceil((due - now) * 1000.0)), nullptr);
+        }
+        else
+        {
+            KillTimer(m_window, power_timer);
+        }
+    }
+
+    void trace_power() const
+    {
+        wchar_t message[128];
+        auto const& policy = m_policy.policy();
+
+        swprintf_s(message, L"power: %hs, %.0f fps at most, %hs%hs\n",
+            power_level_name(m_policy.level()),
+            policy.max_fps > 0.0f ? policy.max_fps : m_refresh,
+            HandMotion::tick == motion() ? "ticking" : "sweeping",
+            ShadowQuality::none == policy.shadow ? ", no shadow" : ShadowQuality::fast == policy.shadow ? ", fast shadow" : "");
+
+        OutputDebugStringW(message);
+    }
+
+    // The hand ticks whenever the power policy asks it to, and otherwise as configured.
+
+    HandMotion motion() const noexcept
+    {
+        return HandMotion::tick == m_policy.policy().motion ? HandMotion::tick : m_motion;
+    }
+
+    // The refresh rate of the monitor the window is mostly on, from which the policy's frame
+    // rate becomes a present interval.
+
+    float refresh_rate() const
+    {
+        MONITORINFOEXW info = {};
+        info.cbSize = sizeof(info);
+        DEVMODEW mode = {};
+        mode.dmSize = sizeof(mode);
+
+        if (GetMonitorInfoW(MonitorFromWindow(m_window, MONITOR_DEFAULTTONEAREST), &info) &&
+            EnumDisplaySettingsW(info.szDevice, ENUM_CURRENT_SETTINGS, &mode) &&
+            mode.dmDisplayFrequency > 1)
+        {
+            return static_cast<float>(mode.dmDisplayFrequency);
+        }
+
+        return 60.0f;
+    }
+
+    void trace_config()
+    {
+        if (auto const failures = m_reloader->failures(); failures != m_config_failures)
+        {
+            m_config_failures = failures;
+            OutputDebugStringA(("config: " + m_reloader->error() + "\n").c_str());
+        }
+    }
+
+    // T moves on to the next face in the theme library.
+
+    void next_theme()
+    {
+        auto const& themes = m_config->themes;
+
+        if (!themes.size())
+        {
+            return;
+        }
+
+        m_theme_index = (m_theme_index + 1) % themes.size();
+        m_theme = &themes.face(m_theme_index);
+
+        if (m_target)
+        {
+            m_resize = true;
+            m_composed = false;
+        }
+    }
+
+    // "/control:PATH" opens a control socket (see Control.h). Its commands are applied at the
+    // start of each frame, and straight away when the window is told that some have arrived.
+
+    void open_control(std::string const& path)
+    {
+        auto const window = m_window;
+
+        m_control = std::make_unique<ControlServer>(path, [window]
+        {
+            PostMessageW(window, wm_control, 0, 0);
+        });
+    }
+
+    void serve_control()
+    {
+        if (!m_control)
+        {
+            return;
+        }
+
+        m_commands += m_control->serve([this](ControlCommand const command, ControlReader& arguments, std::vector<uint8_t>& result)
+        {
+            return control(command, arguments, result);
+        });
+    }
+
+    ControlStatus control(ControlCommand const command, ControlReader& arguments, std::vector<uint8_t>& result)
+    {
+        if (ControlCommand::motion == command)
+        {
+            auto const motion = arguments.get8();
+
+            if (!arguments.finished() || motion > static_cast<uint8_t>(HandMotion::tick))
+            {
+                return ControlStatus::bad_request;
+            }
+
+            m_motion = static_cast<HandMotion>(motion);
+            m_wake = 0;
+            recompose();
+        }
+        else if (ControlCommand::detail == command)
+        {
+            DetailThresholds thresholds;
+            thresholds.reduced = arguments.get_float();
+            thresholds.full = arguments.get_float();
+
+            if (!arguments.finished() || !(thresholds.reduced >= 0.0f) || !(thresholds.full >= thresholds.reduced))
+            {
+                return ControlStatus::bad_request;
+            }
+
+            m_thresholds = thresholds;
+
+            if (m_target)
+            {
+                m_resize = true;
+            }
+        }
+        else if (ControlCommand::power == command)
+        {
+            auto const power = arguments.get8();
+
+            if (!arguments.finished() || power > static_cast<uint8_t>(PowerMode::low))
+            {
+                return ControlStatus::bad_request;
+            }
+
+            m_power = static_cast<PowerMode>(power);
+            update_power();
+        }
+        else if (ControlCommand::snapshot == command)
+        {
+            auto const width = arguments.get32();
+            auto const height = arguments.get32();
+
+            if (!arguments.finished() || width > 4096 || height > 4096)
+            {
+                return ControlStatus::bad_request;
+            }
+
+            auto const png = snapshot(width, height);
+
+            if (!png)
+            {
+                return ControlStatus::failed;
+            }
+
+            result.insert(result.end(), png->begin(), png->end());
+        }
+        else if (ControlCommand::ping != command)
+        {
+            return ControlStatus::bad_request;
+        }
+
+        return ControlStatus::ok;
+    }
+
+    // Counts each presented frame and, given a control socket, publishes the stats for its I/O
+    // thread to read at any time. They are also published as the window is hidden and revealed,
+    // since nothing is presented in between.
+
+    void publish_stats(std::chrono::steady_clock::time_point const start)
+    {
+        auto const now = std::chrono::steady_clock::now();
+        auto const milliseconds = [](auto const duration) { return std::chrono::duration<float, std::milli>(duration).count(); };
+
+        if (m_presented++)
+        {
+            auto const interval = milliseconds(now - m_last_present);
+            m_frame_interval = m_frame_interval > 0.0f ? m_frame_interval + (interval - m_frame_interval) / 16.0f : interval;
+        }
+
+        m_last_present = now;
+        m_frame_ms = milliseconds(now - start);
+        store_stats();
+    }
+
+    void store_stats()
+    {
+        if (!m_control || !m_target)
+        {
+            return;
+        }
+
+        auto const size = m_target->GetPixelSize();
 
-        check_hresult(library->CreateAccelerateDecelerateTransition(
-            5.0,
-            1.0,
-            0.2,
-            0.8,
-            transition.put()));
+        m_control->stats().store(
+        {
+            m_presented,
+            m_commands,
+            m_visibility.frames_saved(steady_now()),
+            m_frame_ms,
+            m_frame_interval,
+            size.width,
+            size.height,
+            m_count,
+            static_cast<uint8_t>(m_tier),
+            static_cast<uint8_t>(motion()),
+            static_cast<uint8_t>(m_power),
+            static_cast<uint8_t>(m_policy.level()),
+            m_visibility.hidden(),
+            composing()
+        });
+    }
 
-        check_hresult(m_manager->CreateAnimationVariable(0.0, m_variable.put()));
+    void trace_sizes() const
+    {
+        wchar_t message[128];
 
-        check_hresult(m_manager->ScheduleTransition(m_variable.get(),
-            transition.get(),
-            get_time()));
+        swprintf_s(message, L"dpi %.0f: size resources %llu hits, %llu misses, %llu evicted\n",
+            m_dpi,
+            static_cast<unsigned long long>(m_sizes.hits()),
+            static_cast<unsigned long long>(m_sizes.misses()),
+            static_cast<unsigned long long>(m_sizes.evictions()));
+
+        OutputDebugStringW(message);
     }
 
-    void create_device_independent_resources()
-    {
-        D2D1_STROKE_STYLE_PROPERTIES style = {};
-        style.startCap = D2D1_CAP_STYLE_ROUND;
-        style.endCap = D2D1_CAP_STYLE_TRIANGLE;
+    // Frames take their time from the given source rather than the system clocks, and may
+    // record it for replay.
 
-        check_hresult(m_factory->CreateStrokeStyle(style,
-            nullptr, 0,
-            m_style.put()));
+    void use_time(TimeSource time)
+    {
+        m_time = std::move(time);
+    }
 
-        schedule_animation();
+    bool record_time(FILE* const file)
+    {
+        return m_time.record(file);
     }
 
-    void release_device_resources()
+    // Composing turns the hands with the compositor rather than drawing them every frame. Only
+    // real time drives the compositor's clock, its curves only sweep, and exported frames need
+    // their hands drawn, so any of those keeps rendering.
+
+    bool composing() const noexcept
     {
-        m_brush = nullptr;
-        m_clock = nullptr;
-        m_shadow = nullptr;
+        return m_compose && HandMotion::sweep == motion() && !m_export && !m_rfb && !m_show_readout && TimeKind::real == m_time.kind();
     }
 
-    void create_device_resources()
+    // Each hand becomes a visual of its own, drawn once, above a shadow visual that shares its
+    // rotation but keeps its offset. The rotations are compositor animations fitted to the intro
+    // swing and the steady turn of each hand, so once composed no frames are rendered at all
+    // until the window changes. The curves are rebuilt every hour to follow the system time.
+
+    void compose()
     {
-        constexpr D2D1_COLOR_F color_orange = { 0.92f,  0.38f,  0.208f,  1.0f };
+        if (!m_composition)
+        {
+            com_ptr<IDXGIDevice> device;
+            check_hresult(m_swapChain->GetDevice(__uuidof(device), device.put_void()));
+            check_hresult(DCompositionCreateDevice(device.get(), __uuidof(m_composition), m_composition.put_void()));
+            check_hresult(m_composition->CreateTargetForHwnd(m_window, TRUE, m_composition_target.put()));
+        }
+
+        // The curves start from a fresh sample, taken just before the compositor time that
+        // anchors them.
+
+        m_time.advance();
+        update_targets();
+
+        if (m_start.empty())
+        {
+            m_start = m_angles;
+        }
+
+        LARGE_INTEGER begin;
+        check_bool(QueryPerformanceCounter(&begin));
+        auto const elapsed = get_time() - m_intro_began;
+        auto const scale = m_dpi / 96.0f;
+
+        com_ptr<IDCompositionVisual> root;
+        com_ptr<IDCompositionVisual> shadows;
+        com_ptr<IDCompositionVisual> hands;
+        check_hresult(m_composition->CreateVisual(root.put()));
+        check_hresult(m_composition->CreateVisual(shadows.put()));
+        check_hresult(m_composition->CreateVisual(hands.put()));
+        check_hresult(root->AddVisual(shadows.get(), TRUE, nullptr));
+        check_hresult(root->AddVisual(hands.get(), TRUE, shadows.get()));
+        com_ptr<IDCompositionVisual> last_shadow;
+        com_ptr<IDCompositionVisual> last_hand;
+
+        auto const& ops = m_scene.hands.ops;
+
+        for (size_t index = 0; index + 1 < ops.size(); ++index)
+        {
+            if (DisplayCommand::set_transform != ops[index].command)
+            {
+                continue;
+            }
+
+            auto const slot = ops[index].slot;
+            auto const clock = slot / 4u;
+            auto const& hand = ops[index + 1];
+            auto const& center = m_scene.hands.transforms[clock * 4 + slot_dial];
+            auto const& target = m_angles[clock];
+            auto const& start = m_start[clock];
+
+            auto const turn =
+                slot_second == slot % 4 ? HandTurn{ target.second, start.second, hand_rate_second, 60.0 } :
+                slot_minute == slot % 4 ? HandTurn{ target.minute, start.minute, hand_rate_minute, 3600.0 } :
+                HandTurn{ target.hour, start.hour, hand_rate_hour, 43200.0 };
+
+            // The hand is drawn pointing at twelve in the middle of a square that leaves room
+            // for its shadow to blur.
+
+            auto const reach = std::hypot(hand.x1 - hand.x0, hand.y1 - hand.y0) + hand.stroke + 3.0f * m_theme->shadow_deviation;
+            auto const side = static_cast<UINT>(std::ceil(2.0f * reach * scale));
+            auto const half = side / 2.0f;
+
+            auto const draw_hand = [&](Transform const& place)
+            {
+                DeviceContextTarget const context{ m_target.get(), m_brush.get(), m_style.get() };
+                context.set_transform(translation(reach, reach) * place);
+                context.draw_line(hand.x0, hand.y0, hand.x1, hand.y1, hand.stroke);
+            };
+
+            auto const surface = draw_surface(side, draw_hand);
+
+            auto const shade = draw_surface(side, [&](Transform const& place)
+            {
+                com_ptr<ID2D1Image> content;
+                m_target->GetTarget(content.put());
+                m_target->SetTarget(m_clock.get());
+                m_target->Clear();
+                draw_hand(identity());
+
+                auto const area = RectF(0.0f, 0.0f, 2.0f * reach, 2.0f * reach);
+                m_target->SetTarget(content.get());
+                m_target->SetTransform(reinterpret_cast<D2D1_MATRIX_3X2_F const*>(&place));
+                m_target->DrawImage(m_shadow.get(), nullptr, &area);
+            });
+
+            auto const curve = hand_curve(turn, elapsed);
+            com_ptr<IDCompositionAnimation> animation;
+            check_hresult(m_composition->CreateAnimation(animation.put()));
+            check_hresult(animation->SetAbsoluteBeginTime(begin));
+
+            for (auto&& segment : curve.segments)
+            {
+                check_hresult(animation->AddCubic(segment.begin, segment.constant, segment.linear, segment.quadratic, segment.cubic));
+            }
+
+            check_hresult(animation->AddRepeat(curve.repeat_begin, curve.repeat_duration));
+
+            com_ptr<IDCompositionRotateTransform> turn;
+            check_hresult(m_composition->CreateRotateTransform(turn.put()));
+            check_hresult(turn->SetCenterX(half));
+            check_hresult(turn->SetCenterY(half));
+            check_hresult(turn->SetAngle(animation.get()));
 
-        check_hresult(m_target->CreateSolidColorBrush(color_orange,
-            BrushProperties(0.8f),
-            m_brush.put()));
+            auto const add = [&](IDCompositionVisual* parent, com_ptr<IDCompositionVisual>& last, IDCompositionSurface* content, float const offset)
+            {
+                com_ptr<IDCompositionVisual> visual;
+                check_hresult(m_composition->CreateVisual(visual.put()));
+                check_hresult(visual->SetContent(content));
+                check_hresult(visual->SetTransform(turn.get()));
+                check_hresult(visual->SetOffsetX(center.dx * scale - half + offset));
+                check_hresult(visual->SetOffsetY(center.dy * scale - half + offset));
+                check_hresult(parent->AddVisual(visual.get(), TRUE, last.get()));
+                last = visual;
+            };
+
+            add(shadows.get(), last_shadow, shade.get(), m_theme->shadow_offset * scale);
+            add(hands.get(), last_hand, surface.get(), 0.0f);
+        }
+
+        check_hresult(m_composition_target->SetRoot(root.get()));
+        check_hresult(m_composition->Commit());
+        m_composed = true;
+        m_recompose = GetTickCount64() + 3600 * 1000;
     }
 
-    void create_device_size_resources()
+    // Draws into a new composition surface of side by side pixels. draw is given the transform
+    // to the surface's place in the atlas that backs it.
+
+    template <typename Draw>
+    com_ptr<IDCompositionSurface> draw_surface(UINT const side, Draw&& draw)
     {
-        auto sizeF = m_target->GetSize();
+        com_ptr<IDCompositionSurface> surface;
 
-        auto sizeU = SizeU(static_cast<UINT>(sizeF.width * m_dpi / 96.0f),
-            static_cast<UINT>(sizeF.height * m_dpi / 96.0f));
+        check_hresult(m_composition->CreateSurface(side, side,
+            DXGI_FORMAT_B8G8R8A8_UNORM,
+            DXGI_ALPHA_MODE_PREMULTIPLIED,
+            surface.put()));
 
-        auto props = BitmapProperties1(D2D1_BITMAP_OPTIONS_TARGET,
+        com_ptr<IDXGISurface> pixels;
+        POINT offset;
+        check_hresult(surface->BeginDraw(nullptr, __uuidof(pixels), pixels.put_void(), &offset));
+
+        auto const props = BitmapProperties1(D2D1_BITMAP_OPTIONS_TARGET | D2D1_BITMAP_OPTIONS_CANNOT_DRAW,
             PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED),
             m_dpi, m_dpi);
 
-        m_clock = nullptr;
+        com_ptr<ID2D1Bitmap1> bitmap;
+        check_hresult(m_target->CreateBitmapFromDxgiSurface(pixels.get(), props, bitmap.put()));
 
-        check_hresult(m_target->CreateBitmap(sizeU,
-            nullptr, 0,
-            props,
-            m_clock.put()));
+        auto const place = translation(offset.x * 96.0f / m_dpi, offset.y * 96.0f / m_dpi);
+        m_target->SetTarget(bitmap.get());
+        m_target->BeginDraw();
+        m_target->SetTransform(reinterpret_cast<D2D1_MATRIX_3X2_F const*>(&place));
+        m_target->PushAxisAlignedClip(RectF(0.0f, 0.0f, side * 96.0f / m_dpi, side * 96.0f / m_dpi), D2D1_ANTIALIAS_MODE_ALIASED);
+        m_target->Clear();
+        m_target->PopAxisAlignedClip();
+        draw(place);
+        m_target->EndDraw();
+        m_target->SetTarget(nullptr);
 
-        m_shadow = nullptr;
+        check_hresult(surface->EndDraw());
+        return surface;
+    }
+
+    // Between ticks there is nothing new to draw until the next step is due, unless a message
+    // asks for a frame sooner.
+
+    bool resting() const
+    {
+        return m_wake && !m_resize && m_wake > utc_now();
+    }
+
+    // Sleeps until the next step or a message, on a high resolution timer where the system has
+    // one so that the step is not held up to the next timer interrupt.
+
+    void wait_tick()
+    {
+        if (!m_tick_timer)
+        {
+            m_tick_timer.attach(CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS));
+        }
 
-        struct __declspec(uuid("C67EA361-1863-4e69-89DB-695D3E9A5B6B")) Direct2DShadow;
+        if (!m_tick_timer)
+        {
+            m_tick_timer.attach(CreateWaitableTimerW(nullptr, TRUE, nullptr));
+        }
 
-        check_hresult(m_target->CreateEffect(__uuidof(Direct2DShadow),
-            m_shadow.put()));
+        LARGE_INTEGER due;
+        due.QuadPart = -std::max<int64_t>(0, m_wake - utc_now()) * 10;
+        check_bool(SetWaitableTimer(m_tick_timer.get(), &due, 0, nullptr, nullptr, FALSE));
 
-        m_shadow->SetInput(0, m_clock.get());
+        HANDLE const timer = m_tick_timer.get();
+        MsgWaitForMultipleObjectsEx(1, &timer, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+    }
 
+    static int64_t utc_now() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     }
 
-    void draw_clock()
+    // Nothing on screen changes that the compositor does not animate, so the window sleeps
+    // until a message arrives or the curves are due to be rebuilt.
+
+    void wait_composed()
+    {
+        auto const now = GetTickCount64();
+        auto const timeout = m_recompose > now ? static_cast<DWORD>(m_recompose - now) : 0;
+
+        if (WAIT_TIMEOUT == MsgWaitForMultipleObjects(0, nullptr, FALSE, timeout, QS_ALLINPUT))
+        {
+            m_composed = false;
+        }
+    }
+
+    // Each clock of a wall shows its own time zone, given a time zone database.
+
+    void name_zones(TimeZoneDatabase const& database, std::vector<uint32_t> const& zones)
+    {
+        m_zones = std::make_unique<ZoneClocks>(database, zones);
+    }
+
+    void update_angles()
     {
-        auto size = m_target->GetSize();
-        auto radius = std::max(200.0f, std::min(size.width, size.height)) / 2.0f - 50.0f;
-        auto const offset = SizeF(2.0f, 2.0f);
-        auto translation = Matrix3x2F::Translation(size.width / offset.width, size.height / offset.height);
+        update_targets();
 
-        m_target->SetTransform(translation);
+        double swing = 0.0;
+
+        if (m_variable)
+        {
+            check_hresult(m_variable->GetValue(&swing));
+        }
+
+        m_swinging = 1.0 > swing;
+
+        if (m_swinging)
+        {
+            if (m_start.empty())
+            {
+                m_start = m_angles;
+            }
+
+            for (uint32_t index = 0; index != m_count; ++index)
+            {
+                m_angles[index] = apply_swing(m_angles[index], m_start[index], swing);
+            }
+        }
+    }
+
+    // Where the hands point at the current time, before any intro swing. A single clock shows
+    // local time while a wall offsets every clock from UTC, or gives each clock its own zone.
+
+    void update_targets()
+    {
+        auto const& now = m_time.now();
+
+        if (m_zones)
+        {
+            if (HandMotion::tick == motion())
+            {
+                m_zones->update(utc_seconds(now) - 1, tick_progress(utc_fraction(now), m_tick), m_zone_angles);
+            }
+            else
+            {
+                m_zones->update(utc_seconds(now), utc_fraction(now), m_zone_angles);
+            }
+
+            for (uint32_t index = 0; index != m_count; ++index)
+            {
+                m_angles[index] = m_zone_angles[index];
+            }
+        }
+        else
+        {
+            auto seconds = day_seconds(now, 1 == m_count ? now.offset : 0);
+
+            if (HandMotion::tick == motion())
+            {
+                seconds = tick_seconds(seconds, m_tick);
+            }
 
-        m_target->DrawEllipse(Ellipse(Point2F(), radius, radius),
-            m_brush.get(),
-            radius / 20.f);
+            wall_angles(seconds, m_offsets.data(), m_count, m_angles.data());
+        }
+    }
 
-        SYSTEMTIME time;
-        GetLocalTime(&time);
+    // The dials only change with the size of the window so they are drawn once into their own
+    // bitmap and then copied into the clock layer each frame.
 
-        auto secondAngle = (time.wSecond + time.wMilliseconds / 1000.0f) * 6.0f;
-        auto minuteAngle = time.wMinute * 6.0f + secondAngle / 60.0f;
-        auto hourAngle = time.wHour % 12 * 30.0f + minuteAngle / 12.0f;
+    void draw_dials()
+    {
+        m_dials_dirty = false;
+        m_redrawn = everywhere;
+        m_size->drawn = m_target->GetSize();
+        m_size->tier = m_tier;
+        m_size->theme = *m_theme;
+        m_target->SetTarget(m_dials.get());
+        m_target->Clear();
+        replay(m_scene.dials, DeviceContextTarget{ m_target.get(), m_brush.get(), m_style.get(), m_numerals });
+    }
 
-        double swing;
-        check_hresult(m_variable->GetValue(&swing));
+    void draw_readout()
+    {
+        auto const time = m_time.now();
+        auto const changed = m_readout->update(static_cast<uint32_t>(day_seconds(time, time.offset)));
 
-        if (1.0 > swing)
+        if (!changed && m_readout_cleared)
         {
-            static float secondPrevious = secondAngle;
-            static float minutePrevious = minuteAngle;
-            static float hourPrevious = hourAngle;
+            return;
+        }
 
-            if (secondPrevious > secondAngle) secondAngle += 360.0f;
-            if (minutePrevious > minuteAngle) minuteAngle += 360.0f;
-            if (hourPrevious > hourAngle)   hourAngle += 360.0f;
+        com_ptr<ID2D1Image> previous;
+        m_target->GetTarget(previous.put());
+        m_target->SetTarget(m_readout_layer.get());
+        m_target->SetTransform(Matrix3x2F::Translation(-m_readout_origin.x, -m_readout_origin.y));
 
-            secondAngle *= static_cast<float>(swing);
-            minuteAngle *= static_cast<float>(swing);
-            hourAngle *= static_cast<float>(swing);
+        if (!m_readout_cleared)
+        {
+            m_target->Clear();
+            m_readout_cleared = true;
         }
 
-        m_target->SetTransform(Matrix3x2F::Rotation(secondAngle) * m_orientation * translation);
+        DeviceContextTarget const target{ m_target.get(), m_brush.get(), m_style.get(), m_readout_text };
+        auto const scale = m_dpi / 96.0f;
 
-        m_target->DrawLine(Point2F(),
-            Point2F(0.0f, -(radius * 0.75f)),
-            m_brush.get(),
-            radius / 25.f,
-            m_style.get());
+        for (uint32_t cell = 0; cell != DigitalReadout::cells; ++cell)
+        {
+            if (changed >> cell & 1)
+            {
+                auto const& area = m_readout->cell(cell);
+                auto const& glyph = m_readout->glyph(cell);
+                m_target->PushAxisAlignedClip(RectF(area.left, area.top, area.right, area.bottom), D2D1_ANTIALIAS_MODE_ALIASED);
+                m_target->Clear();
+                target.draw_glyph(glyph.slot, glyph.x0, glyph.y0, glyph.x1, glyph.y1);
+                m_target->PopAxisAlignedClip();
+
+                m_redrawn = unite(m_redrawn, {
+                    static_cast<int32_t>(std::floor(area.left * scale)) - 1,
+                    static_cast<int32_t>(std::floor(area.top * scale)) - 1,
+                    static_cast<int32_t>(std::ceil(area.right * scale)) + 1,
+                    static_cast<int32_t>(std::ceil(area.bottom * scale)) + 1 });
+            }
+        }
 
-        m_target->SetTransform(Matrix3x2F::Rotation(minuteAngle) * m_orientation * translation);
+        m_target->SetTarget(previous.get());
+    }
 
-        m_target->DrawLine(Point2F(),
-            Point2F(0.0f, -(radius * 0.75f)),
-            m_brush.get(),
-            radius / 15.0f,
-            m_style.get());
+    void draw_clock()
+    {
+        m_target->DrawImage(m_dials.get());
 
-        m_target->SetTransform(Matrix3x2F::Rotation(hourAngle) * m_orientation * translation);
+        if (composing())
+        {
+            return;
+        }
 
-        m_target->DrawLine(Point2F(),
-            Point2F(0.0f, -(radius * 0.5f)),
-            m_brush.get(),
-            radius / 10.0f,
-            m_style.get());
+        update_angles();
+        patch_wall(m_scene, m_angles.data(), m_orientation);
+        replay(m_scene.hands, DeviceContextTarget{ m_target.get(), m_brush.get(), m_style.get() });
     }
 
     void draw()
     {
-        m_orientation = Matrix3x2F::Identity();
-        auto offset = SizeF(5.0f, 5.0f);
+        m_orientation = identity();
+        auto const offset = SizeF(m_theme->shadow_offset, m_theme->shadow_offset);
         check_hresult(m_manager->Update(get_time()));
 
         m_target->SetUnitMode(D2D1_UNIT_MODE_PIXELS);
 
-        constexpr D2D1_COLOR_F color_white = { 1.0f,  1.0f,  1.0f,  1.0f };
-        m_target->Clear(color_white);
+        m_target->Clear(to_color(m_theme->background));
 
         m_target->SetUnitMode(D2D1_UNIT_MODE_DIPS);
 
         com_ptr<ID2D1Image> previous;
         m_target->GetTarget(previous.put());
 
+        // The clock bitmap may be larger than the window, so only the visible region is cleared
+        // and composited.
+
+        auto const size = m_target->GetSize();
+        auto const visible = RectF(0.0f, 0.0f, size.width, size.height);
+
+        if (m_dials_dirty)
+        {
+            draw_dials();
+        }
+
         m_target->SetTarget(m_clock.get());
+        m_target->SetTransform(Matrix3x2F::Identity());
+        m_target->PushAxisAlignedClip(visible, D2D1_ANTIALIAS_MODE_ALIASED);
         m_target->Clear();
         draw_clock();
+        m_target->PopAxisAlignedClip();
 
         m_target->SetTarget(previous.get());
-        m_target->SetTransform(Matrix3x2F::Translation(offset));
 
-        m_target->DrawImage(m_shadow.get(),
-            D2D1_INTERPOLATION_MODE_LINEAR,
-            D2D1_COMPOSITE_MODE_SOURCE_OVER);
+        if (DetailTier::sprite != m_tier && ShadowQuality::none != m_policy.policy().shadow)
+        {
+            m_target->SetTransform(Matrix3x2F::Translation(offset));
+
+            m_target->DrawImage(m_shadow.get(),
+                nullptr,
+                &visible,
+                D2D1_INTERPOLATION_MODE_LINEAR,
+                D2D1_COMPOSITE_MODE_SOURCE_OVER);
+        }
 
         m_target->SetTransform(Matrix3x2F::Identity());
 
-        m_target->DrawImage(m_clock.get());
+        m_target->DrawImage(m_clock.get(),
+            nullptr,
+            &visible);
+
+        if (m_readout)
+        {
+            draw_readout();
+            m_target->SetTransform(Matrix3x2F::Identity());
+            m_target->DrawImage(m_readout_layer.get(), m_readout_origin);
+        }
     }
 
     float m_dpi{};
     bool m_visible{};
+    bool m_resize{};
     DWORD m_occlusion{};
-    LARGE_INTEGER m_frequency{};
-    D2D1_MATRIX_3X2_F m_orientation{};
+    Transform m_orientation{};
+    uint32_t m_count{};
+    bool m_dials_dirty{};
+    DetailThresholds m_thresholds;
+    DetailTier m_tier{ DetailTier::full };
+    std::unique_ptr<ConfigReloader> m_reloader;
+    std::unique_ptr<RcuReader<ClockConfig>> m_config_reader;
+    ClockConfig const* m_config{};
+    uint64_t m_config_failures{};
+    FaceTheme const* m_theme{ &default_theme };
+    uint32_t m_theme_index{};
+    uint32_t m_interval{ 1 };
+    HandMotion m_motion{ HandMotion::sweep };
+    TickStyle m_tick;
+    int64_t m_wake{};
+    handle m_tick_timer;
+    bool m_swinging{ true };
+    PowerMode m_power{ PowerMode::normal };
+    PowerInputs m_power_inputs;
+    PowerPolicy m_policy;
+    bool m_saver{};
+    VisibilityTracker m_visibility;
+    float m_refresh{ 60.0f };
+    bool m_show_numerals{};
+    bool m_show_readout{};
+    bool m_readout_cleared{};
+    GlyphResources const* m_numerals{};
+    GlyphResources const* m_readout_text{};
+    std::unique_ptr<DigitalReadout> m_readout;
+    D2D1_POINT_2F m_readout_origin{};
+    WallScene m_scene;
+    std::vector<int32_t> m_offsets;
+    std::vector<HandAngles> m_angles;
+    std::vector<HandAngles> m_start;
+    TimeSource m_time{ TimeSource::real(local_offset) };
+    std::unique_ptr<ZoneClocks> m_zones;
+    double m_intro_began{};
+    bool m_compose{};
+    bool m_composed{};
+    ULONGLONG m_recompose{};
+    com_ptr<IDCompositionDevice> m_composition;
+    com_ptr<IDCompositionTarget> m_composition_target;
+    ClockAngles m_zone_angles;
 
     com_ptr<ID2D1Factory1> m_factory;
     com_ptr<IDXGIFactory2> m_dxfactory;
@@ -541,14 +2222,227 @@ struct Window
     com_ptr<ID2D1StrokeStyle> m_style;
     com_ptr<ID2D1Effect> m_shadow;
     com_ptr<ID2D1Bitmap1> m_clock;
+    com_ptr<ID2D1Bitmap1> m_dials;
+    DpiResourceCache<SizeResources> m_sizes;
+    SizeResources* m_size{};
+    DpiResourceCache<GlyphResources, GlyphKey> m_glyphs{ 4 };
+    com_ptr<IDWriteFactory> m_write;
+    com_ptr<IDWriteFontFace> m_face;
+    com_ptr<ID2D1Bitmap1> m_readout_layer;
     com_ptr<IUIAnimationManager> m_manager;
     com_ptr<IUIAnimationVariable> m_variable;
+    std::shared_ptr<DeviceResources> m_rebuilt;
+    std::future<std::vector<RebuildTiming>> m_rebuild;
+    StartupTimeline m_startup;
+    std::unique_ptr<WorkerPool> m_workers;
+    std::unique_ptr<SnapshotCache> m_snapshots;
+    std::unique_ptr<FrameRingWriter> m_export;
+    std::unique_ptr<RfbServer> m_rfb;
+    std::string m_export_name;
+    uint16_t m_rfb_port{};
+    std::unique_ptr<ControlServer> m_control;
+    uint64_t m_commands{};
+    uint64_t m_presented{};
+    std::chrono::steady_clock::time_point m_last_present;
+    float m_frame_interval{};
+    float m_frame_ms{};
+    com_ptr<ID3D11Texture2D> m_staging;
+    std::vector<uint32_t> m_readback;
+    PixelRect m_exported{};
+
+    // A new size, theme, tier or policy and a redrawn dial change the whole frame, while the
+    // readout adds the cells that changed.
+
+    static constexpr PixelRect everywhere{ 0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max() };
+    PixelRect m_redrawn{ everywhere };
 };
 
-int __stdcall wWinMain(HINSTANCE, HINSTANCE, PWSTR, int)
+// Options are given on the command line as "/name:value".
+
+uint32_t command_option(wchar_t const* const command, wchar_t const* const name, uint32_t const fallback)
+{
+    auto const option = wcsstr(command, name);
+
+    if (!option)
+    {
+        return fallback;
+    }
+
+    return static_cast<uint32_t>(wcstoul(option + wcslen(name), nullptr, 10));
+}
+
+std::string command_text(wchar_t const* const command, wchar_t const* const name)
+{
+    std::string text;
+
+    if (auto option = wcsstr(command, name))
+    {
+        for (option += wcslen(name); *option && *option != L' '; ++option)
+        {
+            text += static_cast<char>(*option);
+        }
+    }
+
+    return text;
+}
+
+int __stdcall wWinMain(HINSTANCE, HINSTANCE, PWSTR command, int)
 {
     init_apartment(apartment_type::single_threaded);
 
-    Window window;
+    // Each monitor's DPI is followed as the window moves between them, with the non-client area
+    // scaled by the system.
+
+    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+
+    // "/tzdb:PATH" maps a time zone database compiled by clock-tzc, so zones can be named.
+
+    TimeZoneDatabase zones;
+
+    if (auto const path = command_text(command, L"/tzdb:"); !path.empty())
+    {
+        zones.open(path);
+    }
+
+    // "/serve:PORT" serves PNG snapshots at http://localhost:PORT/clock.png?tz=+01:00&size=512,
+    // or tz=Europe/London given a time zone database.
+
+    std::unique_ptr<HttpServer> server;
+
+    if (auto const port = command_option(command, L"/serve:", 0); port && port <= 65535)
+    {
+        server = std::make_unique<HttpServer>(static_cast<uint16_t>(port), local_offset(), &zones);
+    }
+
+    // "/zones:Europe/London,Asia/Tokyo" lays out a wall with a clock for each named zone, given a
+    // time zone database. Names it does not hold are skipped.
+
+    std::vector<uint32_t> named;
+
+    if (auto const names = command_text(command, L"/zones:"); zones && !names.empty())
+    {
+        for (size_t first = 0; first <= names.size() && named.size() != 1024;)
+        {
+            auto last = names.find(',', first);
+            last = std::string::npos == last ? names.size() : last;
+
+            if (auto const zone = zones.find(std::string_view(names).substr(first, last - first)); zone >= 0)
+            {
+                named.push_back(static_cast<uint32_t>(zone));
+            }
+
+            first = last + 1;
+        }
+    }
+
+    // "/wall:N" lays out N clocks, one per time zone, in a single window.
+
+    Window window(named.empty() ? std::clamp(command_option(command, L"/wall:", 1), 1u, 1024u) : static_cast<uint32_t>(named.size()));
+
+    if (!named.empty())
+    {
+        window.name_zones(zones, named);
+    }
+
+    // The settings below can also come from "/config:PATH", which is watched and applied again
+    // whenever it, or the theme library it names, changes (see Config.h). The command line gives
+    // the settings the file leaves out.
+
+    ClockSettings settings;
+
+    // "/lod:R,F" sets the radii in pixels from which clocks are drawn in reduced and full detail.
+
+    if (auto const lod = command_text(command, L"/lod:"); !lod.empty())
+    {
+        DetailThresholds thresholds;
+
+        if (2 == sscanf_s(lod.c_str(), "%f,%f", &thresholds.reduced, &thresholds.full) && thresholds.reduced >= 0.0f && thresholds.full >= thresholds.reduced)
+        {
+            settings.thresholds = thresholds;
+        }
+    }
+
+    // "/themes:PATH" opens a library of faces compiled by clock-themec and "/theme:NAME" draws the
+    // clock with one of them. T then moves on to the next.
+
+    settings.themes = command_text(command, L"/themes:");
+    settings.theme = command_text(command, L"/theme:");
+
+    // "/numerals" puts the hours on the dials and "/readout" adds a digital readout below the
+    // hands of a single clock.
+
+    window.show_text(nullptr != wcsstr(command, L"/numerals"), nullptr != wcsstr(command, L"/readout"));
+
+    // "/compose" leaves the hands to the compositor, so that no frames are rendered once the
+    // clock is up, and "/interval:N" presents a frame every N vertical blanks.
+
+    if (wcsstr(command, L"/compose"))
+    {
+        settings.frames = FramePolicy::compose;
+    }
+
+    settings.interval = std::clamp(command_option(command, L"/interval:", 1), 1u, 4u);
+
+    // "/tick" steps the second hand once a second, like a quartz movement, and sleeps between
+    // steps rather than rendering every frame.
+
+    if (wcsstr(command, L"/tick"))
+    {
+        settings.motion = HandMotion::tick;
+    }
+
+    // "/step:FPS" runs on virtual time that moves on by 1/FPS every frame, however long frames
+    // take, and "/replay:PATH" replays the frame times recorded with "/record:PATH".
+
+    if (auto const path = command_text(command, L"/replay:"); !path.empty())
+    {
+        if (auto trace = read_time_trace(path); !trace.empty())
+        {
+            window.use_time(TimeSource::replay(std::move(trace)));
+        }
+    }
+    else if (auto const fps = command_option(command, L"/step:", 0))
+    {
+        auto const real = TimeSource::real(local_offset);
+        window.use_time(TimeSource::stepped(real.now().utc, 1000000, fps, real.now().offset));
+    }
+
+    FILE* record = nullptr;
+
+    if (auto const path = command_text(command, L"/record:"); !path.empty())
+    {
+        record = fopen(path.c_str(), "wb");
+
+        if (record)
+        {
+            window.record_time(record);
+        }
+    }
+
+    // "/export:NAME" publishes frames to a shared-memory frame ring, as read by clock-frames.
+
+    settings.exported = command_text(command, L"/export:");
+
+    // "/rfb:PORT" serves the frames to VNC viewers at localhost:PORT.
+
+    if (auto const port = command_option(command, L"/rfb:", 0); port && port <= 65535)
+    {
+        settings.rfb = static_cast<uint16_t>(port);
+    }
+
+    window.use_config(command_text(command, L"/config:"), settings);
+
+    // "/control:PATH" opens a control socket at PATH for clock-ctl.
+
+    if (auto const path = command_text(command, L"/control:"); !path.empty())
+    {
+        window.open_control(path);
+    }
+
     window.run();
+
+    if (record)
+    {
+        fclose(record);
+    }
 }
@@ -0,0 +1,735 @@
+// clock-render: renders the clock scene on the CPU over a range of virtual time and streams the
+// frames to stdout or a file as Y4M or raw BGRA, ready to pipe into an encoder:
+//
+//   clock-render --start 10:08:00 --duration 60 --fps 30 | ffmpeg -i - clock.mp4
+//
+// Frames are rendered and converted in parallel and written in order through a fixed ring of
+// slots, so memory use does not depend on the length of the clip. Only the standard library is
+// needed, so it also builds elsewhere, for example:
+//
+//   g++ -std=c++17 -O2 -pthread ClockRender.cpp -o clock-render
+//
+// With --export the frames are instead published in real time to a shared-memory frame ring,
+// which stands in for the clock window when trying out a consumer such as clock-frames. --rfb
+// likewise serves them in real time to VNC viewers.
+//
+// With --apng the frames are written as an animated PNG that stores only what changed between
+// frames, for example the intro swing:
+//
+//   clock-render --duration 5 --apng intro.png
+//
+// Time is virtual and moves on by 1/fps per frame, or by --step seconds, so a whole day of clock
+// motion renders in seconds and every run produces the same bytes:
+//
+//   clock-render --duration 86400 --step 60 --raw --output day.bgra
+//
+// --trace replays the frame times recorded by the clock window's /record option instead.
+//
+// Clocks are drawn in the level of detail that their radius in pixels calls for, as in the clock
+// window, unless --detail picks one:
+//
+//   clock-render --wall 100 --detail reduced --raw --output wall.bgra
+//
+// --numerals puts the hours on the dials and --readout adds a digital readout to a single clock,
+// both in the built-in font.
+//
+// --themes and --theme draw a face from a theme library compiled by clock-themec:
+//
+//   clock-render --themes faces.theme --theme harbour --duration 5 --apng harbour.png
+//
+// --tick steps the second hand once a second as the clock window's /tick does, taking the given
+// seconds over each step with the given overshoot, or jumping with 0,0:
+//
+//   clock-render --no-intro --tick 0.15,1.7 --fps 60 --duration 3 --apng tick.png
+
+#include "Apng.h"
+#include "FrameRing.h"
+#include "Raster.h"
+#include "Rfb.h"
+#include "Theme.h"
+#include "Tick.h"
+#include "TimeSource.h"
+#include "Wall.h"
+#include "Yuv.h"
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+struct Options
+{
+    uint32_t width = 640;
+    uint32_t height = 480;
+    uint32_t fps = 30;
+    uint32_t count = 1;
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+    float dpi = 96.0f;
+    double start = 10 * 3600.0 + 8 * 60.0;
+    double duration = 10.0;
+    double step = 0.0;
+    DetailThresholds thresholds;
+    DetailTier tier = DetailTier::full;
+    FaceTheme face = default_theme;
+    TickStyle tick_style;
+    bool tick = false;
+    bool detail = false;
+    bool intro = true;
+    bool raw = false;
+    bool numerals = false;
+    bool readout = false;
+    bool apng = false;
+    char const* output = nullptr;
+    char const* exported = nullptr;
+    char const* trace = nullptr;
+    char const* themes = nullptr;
+    char const* theme = nullptr;
+    uint16_t rfb = 0;
+};
+
+static void usage()
+{
+    fputs("usage: clock-render [options]\n"
+        "  --size WxH        frame size in pixels, even (640x480)\n"
+        "  --fps N           frames per second (30)\n"
+        "  --start HH:MM:SS  local time of the first frame (10:08:00)\n"
+        "  --duration S      seconds of virtual time (10)\n"
+        "  --step S          seconds of virtual time per frame (1/fps)\n"
+        "  --trace PATH      replay frame times recorded by the clock window\n"
+        "  --dpi N           scene DPI (96)\n"
+        "  --wall N          number of clocks (1)\n"
+        "  --detail TIER     sprite, reduced or full (from the clock radius)\n"
+        "  --lod R,F         radii in pixels from which the reduced and full tiers apply (40,120)\n"
+        "  --tick S,O        step the second hand each second over S seconds with overshoot O\n"
+        "  --no-intro        start with the hands already in place\n"
+        "  --numerals        hour numerals on the dials\n"
+        "  --readout         digital readout below the hands of a single clock\n"
+        "  --themes PATH     theme library compiled by clock-themec\n"
+        "  --theme NAME      face to draw from the theme library\n"
+        "  --raw             raw BGRA frames rather than Y4M\n"
+        "  --threads N       render threads (all cores)\n"
+        "  --output PATH     file to write rather than stdout\n"
+        "  --apng PATH       write an animated PNG of the changes between frames\n"
+        "  --export NAME     publish to a shared-memory frame ring in real time\n"
+        "  --rfb PORT        serve to VNC viewers on localhost in real time\n",
+        stderr);
+}
+
+static bool parse_time(char const* text, double& seconds)
+{
+    unsigned hour = 0, minute = 0, second = 0;
+
+    if (sscanf(text, "%u:%u:%u", &hour, &minute, &second) < 2 || hour > 23 || minute > 59 || second > 59)
+    {
+        return false;
+    }
+
+    seconds = hour * 3600.0 + minute * 60.0 + second;
+    return true;
+}
+
+static bool parse_options(int const argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const name = argv[i];
+        auto const value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (!strcmp(name, "--no-intro"))
+        {
+            options.intro = false;
+            continue;
+        }
+
+        if (!strcmp(name, "--raw"))
+        {
+            options.raw = true;
+            continue;
+        }
+
+        if (!strcmp(name, "--numerals"))
+        {
+            options.numerals = true;
+            continue;
+        }
+
+        if (!strcmp(name, "--readout"))
+        {
+            options.readout = true;
+            continue;
+        }
+
+        if (!value)
+        {
+            return false;
+        }
+
+        ++i;
+
+        if (!strcmp(name, "--size"))
+        {
+            if (2 != sscanf(value, "%ux%u", &options.width, &options.height))
+            {
+                return false;
+            }
+        }
+        else if (!strcmp(name, "--fps"))
+        {
+            options.fps = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (!strcmp(name, "--start"))
+        {
+            if (!parse_time(value, options.start))
+            {
+                return false;
+            }
+        }
+        else if (!strcmp(name, "--duration"))
+        {
+            options.duration = strtod(value, nullptr);
+        }
+        else if (!strcmp(name, "--step"))
+        {
+            options.step = strtod(value, nullptr);
+
+            if (options.step < 1e-6)
+            {
+                return false;
+            }
+        }
+        else if (!strcmp(name, "--trace"))
+        {
+            options.trace = value;
+        }
+        else if (!strcmp(name, "--dpi"))
+        {
+            options.dpi = static_cast<float>(strtod(value, nullptr));
+        }
+        else if (!strcmp(name, "--wall"))
+        {
+            options.count = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (!strcmp(name, "--detail"))
+        {
+            if (!strcmp(value, "sprite"))
+            {
+                options.tier = DetailTier::sprite;
+            }
+            else if (!strcmp(value, "reduced"))
+            {
+                options.tier = DetailTier::reduced;
+            }
+            else if (!strcmp(value, "full"))
+            {
+                options.tier = DetailTier::full;
+            }
+            else
+            {
+                return false;
+            }
+
+            options.detail = true;
+        }
+        else if (!strcmp(name, "--lod"))
+        {
+            if (2 != sscanf(value, "%f,%f", &options.thresholds.reduced, &options.thresholds.full) ||
+                options.thresholds.reduced < 0.0f || options.thresholds.full < options.thresholds.reduced)
+            {
+                return false;
+            }
+        }
+        else if (!strcmp(name, "--tick"))
+        {
+            if (2 != sscanf(value, "%f,%f", &options.tick_style.settle, &options.tick_style.overshoot) ||
+                !(options.tick_style.settle >= 0.0f && options.tick_style.settle <= 1.0f) || !(options.tick_style.overshoot >= 0.0f))
+            {
+                return false;
+            }
+
+            options.tick = true;
+        }
+        else if (!strcmp(name, "--themes"))
+        {
+            options.themes = value;
+        }
+        else if (!strcmp(name, "--theme"))
+        {
+            options.theme = value;
+        }
+        else if (!strcmp(name, "--threads"))
+        {
+            options.threads = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (!strcmp(name, "--output"))
+        {
+            options.output = value;
+        }
+        else if (!strcmp(name, "--apng"))
+        {
+            options.output = value;
+            options.apng = true;
+            options.raw = true;
+        }
+        else if (!strcmp(name, "--export"))
+        {
+            options.exported = value;
+            options.raw = true;
+        }
+        else if (!strcmp(name, "--rfb"))
+        {
+            auto const port = strtoul(value, nullptr, 10);
+
+            if (!port || port > 65535)
+            {
+                return false;
+            }
+
+            options.rfb = static_cast<uint16_t>(port);
+            options.raw = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.width && options.height && !(options.width % 2) && !(options.height % 2) &&
+        options.fps && !(options.apng && (options.fps > 0xffff || options.exported || options.rfb)) && options.count && options.count <= 1024 && !(options.readout && options.count != 1) && options.threads && options.dpi > 0.0f && !options.themes == !options.theme;
+}
+
+// Each render thread owns its canvases and a copy of the scene so that frames share nothing but
+// the recorded geometry.
+
+struct Renderer
+{
+    Renderer(Options const& options, WallScene const& scene, std::vector<int32_t> const& offsets, std::vector<HandAngles> const& start, GlyphAtlas const& numerals, GlyphAtlas const& readout) :
+        m_options(options),
+        m_scene(scene),
+        m_offsets(offsets),
+        m_start(start),
+        m_angles(options.count),
+        m_software(options.width, options.height, options.dpi, scene.dials, options.face, options.tier, &numerals)
+    {
+        if (options.readout)
+        {
+            auto const scale = 96.0f / options.dpi;
+            auto const geometry = wall_geometry(wall_layout(1, options.width * scale, options.height * scale), 0);
+            m_readout = std::make_unique<DigitalReadout>(readout, geometry.x, geometry.y + geometry.radius * 0.5f);
+            m_text.resize(options.width, options.height);
+            m_text.set_dpi(options.dpi);
+            m_text.set_atlas(&readout);
+            m_text.set_color(options.face.ink, options.face.opacity);
+        }
+    }
+
+    // A single clock shows local time while a wall offsets every clock from UTC, as the clock
+    // window does.
+
+    void render(TimeSample const& time, std::vector<uint8_t>& bytes, PixelRect& damage)
+    {
+        auto seconds = day_seconds(time, 1 == m_options.count ? time.offset : 0);
+
+        if (m_options.tick)
+        {
+            seconds = tick_seconds(seconds, m_options.tick_style);
+        }
+
+        wall_angles(seconds, m_offsets.data(), m_options.count, m_angles.data());
+
+        if (m_options.intro)
+        {
+            auto const swing = accelerate_decelerate(time.elapsed);
+
+            for (uint32_t clock = 0; clock != m_options.count; ++clock)
+            {
+                m_angles[clock] = apply_swing(m_angles[clock], m_start[clock], swing);
+            }
+        }
+
+        patch_wall(m_scene, m_angles.data());
+        m_software.draw(m_frame, m_scene.hands);
+        damage = damage_bounds(m_scene.hands, m_options.dpi, m_options.face);
+
+        // The readout layer is kept from frame to frame and only the digits that changed since
+        // this renderer last drew are drawn again. Frames go to renderers out of turn, so the
+        // whole readout counts as damage.
+
+        if (m_readout)
+        {
+            draw_readout(m_text, *m_readout, m_readout->update(static_cast<uint32_t>(seconds)));
+            draw_image(m_frame, m_text);
+            damage = unite(damage, cell_pixels(m_readout->bounds(), m_options.dpi));
+        }
+
+        if (m_options.raw)
+        {
+            bytes.resize(size_t{ m_options.width } * m_options.height * 4);
+            memcpy(bytes.data(), m_frame.data(), bytes.size());
+        }
+        else
+        {
+            static char const marker[] = "FRAME\n";
+            bytes.resize(sizeof(marker) - 1 + i420_size(m_options.width, m_options.height));
+            memcpy(bytes.data(), marker, sizeof(marker) - 1);
+            convert_i420(m_frame.data(), m_options.width, m_options.height, bytes.data() + sizeof(marker) - 1);
+        }
+    }
+
+private:
+
+    Options const& m_options;
+    WallScene m_scene;
+    std::vector<int32_t> const& m_offsets;
+    std::vector<HandAngles> const& m_start;
+    std::vector<HandAngles> m_angles;
+    SoftwareScene m_software;
+    Canvas m_frame;
+    Canvas m_text;
+    std::unique_ptr<DigitalReadout> m_readout;
+};
+
+// Frame n may only be rendered into slot n % slots once the writer has released the frame that
+// came before it in that slot.
+
+struct Slot
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    uint64_t frame{};
+    bool ready{};
+    std::vector<uint8_t> bytes;
+    PixelRect damage;
+    TimeSample time;
+};
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    if (!parse_options(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    FILE* output = stdout;
+
+    if (options.output)
+    {
+        output = fopen(options.output, "wb");
+
+        if (!output)
+        {
+            perror(options.output);
+            return 1;
+        }
+    }
+#ifdef _WIN32
+    else
+    {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    // Virtual time starts on the first day of 1970, which only matters to the hands through the
+    // time of day.
+
+    auto time = TimeSource::stepped(static_cast<int64_t>(options.start) * 1000000, 1000000, options.fps);
+    auto frames = static_cast<uint64_t>(options.duration * options.fps);
+
+    if (options.trace)
+    {
+        time = TimeSource::replay(read_time_trace(options.trace));
+        frames = time.frames();
+
+        if (!frames)
+        {
+            fprintf(stderr, "clock-render: %s is not a time trace\n", options.trace);
+            return 1;
+        }
+    }
+    else if (options.step > 0.0)
+    {
+        time = TimeSource::stepped(static_cast<int64_t>(options.start) * 1000000, std::llround(options.step * 1000000.0));
+        frames = static_cast<uint64_t>(options.duration / options.step);
+    }
+
+    // The face is copied out of the library, which need only stay open while it is read.
+
+    if (options.themes)
+    {
+        ThemeLibrary library;
+
+        if (!library.open(options.themes))
+        {
+            fprintf(stderr, "clock-render: %s is not a theme library\n", options.themes);
+            return 1;
+        }
+
+        auto const theme = library.find(options.theme);
+
+        if (theme < 0)
+        {
+            fprintf(stderr, "clock-render: %s has no theme named %s\n", options.themes, options.theme);
+            return 1;
+        }
+
+        options.face = library.face(theme);
+    }
+
+    auto const scale = 96.0f / options.dpi;
+    auto scene = record_wall(options.count, options.width * scale, options.height * scale, true, options.face);
+    auto const layout = wall_layout(options.count, options.width * scale, options.height * scale);
+    auto const radius = wall_geometry(layout, 0).radius;
+    auto const numerals = builtin_atlas(numeral_size(radius), options.dpi);
+    auto const readout = builtin_atlas(readout_size(radius), options.dpi);
+
+    if (options.numerals)
+    {
+        for (uint32_t clock = 0; clock != options.count; ++clock)
+        {
+            record_numerals(scene.dials, wall_geometry(layout, clock), numerals);
+        }
+    }
+
+    if (!options.detail)
+    {
+        options.tier = detail_tier(wall_radius(options.count, options.width * scale, options.height * scale, options.dpi), options.thresholds);
+    }
+
+    auto const offsets = wall_offsets(options.count);
+    std::vector<HandAngles> start(options.count);
+    wall_angles(day_seconds(time.now(), 1 == options.count ? time.now().offset : 0), offsets.data(), options.count, start.data());
+    std::vector<Slot> slots(options.threads * 2);
+
+    for (size_t i = 0; i != slots.size(); ++i)
+    {
+        slots[i].frame = i;
+    }
+
+    if (!options.raw)
+    {
+        fprintf(output, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", options.width, options.height, options.fps);
+    }
+
+    std::unique_ptr<FrameRingWriter> ring;
+    std::unique_ptr<RfbServer> rfb;
+    std::unique_ptr<WorkerPool> pool;
+    std::unique_ptr<ApngWriter> apng;
+    std::vector<uint32_t> shown;
+    PixelRect previous{};
+
+    try
+    {
+        if (options.exported)
+        {
+            ring = std::make_unique<FrameRingWriter>(options.exported, options.width, options.height);
+        }
+
+        if (options.rfb)
+        {
+            rfb = std::make_unique<RfbServer>(options.rfb);
+        }
+    }
+    catch (std::exception const& e)
+    {
+        fprintf(stderr, "clock-render: %s\n", e.what());
+        return 1;
+    }
+
+    // Frames are compressed on their own pool, so that compression overlaps rendering.
+
+    if (options.apng)
+    {
+        pool = std::make_unique<WorkerPool>(options.threads);
+        apng = std::make_unique<ApngWriter>(output, options.width, options.height, static_cast<uint16_t>(options.fps), *pool);
+        shown.resize(size_t{ options.width } * options.height);
+    }
+
+    auto const began = std::chrono::steady_clock::now();
+    std::mutex timing;
+    uint64_t next = 0;
+    std::vector<std::thread> workers;
+
+    for (uint32_t i = 0; i != options.threads; ++i)
+    {
+        workers.emplace_back([&]
+        {
+            Renderer renderer(options, scene, offsets, start, numerals, readout);
+
+            while (true)
+            {
+                // Frames are handed out in order along with their time, so that any source can
+                // drive the renderers.
+
+                uint64_t frame;
+                TimeSample sample;
+
+                {
+                    std::lock_guard<std::mutex> lock(timing);
+                    frame = next++;
+
+                    if (frame >= frames)
+                    {
+                        break;
+                    }
+
+                    sample = time.now();
+                    time.advance();
+                }
+
+                auto& slot = slots[frame % slots.size()];
+
+                {
+                    std::unique_lock<std::mutex> lock(slot.lock);
+                    slot.changed.wait(lock, [&] { return slot.frame == frame; });
+                }
+
+                slot.time = sample;
+                renderer.render(sample, slot.bytes, slot.damage);
+
+                {
+                    std::lock_guard<std::mutex> lock(slot.lock);
+                    slot.ready = true;
+                }
+
+                slot.changed.notify_all();
+            }
+        });
+    }
+
+    bool failed = false;
+
+    for (uint64_t frame = 0; frame != frames; ++frame)
+    {
+        auto& slot = slots[frame % slots.size()];
+
+        {
+            std::unique_lock<std::mutex> lock(slot.lock);
+            slot.changed.wait(lock, [&] { return slot.ready; });
+        }
+
+        if (ring || rfb)
+        {
+            std::this_thread::sleep_until(began + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(slot.time.elapsed)));
+            auto const source = reinterpret_cast<uint32_t const*>(slot.bytes.data());
+            auto const dirty = unite(previous, slot.damage);
+
+            if (ring)
+            {
+                ring->publish(options.width, options.height, dirty, [&](uint32_t* pixels, uint32_t const stride, PixelRect const& region)
+                {
+                    for (auto y = region.top; y < region.bottom; ++y)
+                    {
+                        memcpy(pixels + size_t{ static_cast<uint32_t>(y) } * stride + region.left,
+                            source + size_t{ static_cast<uint32_t>(y) } * options.width + region.left,
+                            size_t{ static_cast<uint32_t>(region.right - region.left) } * 4);
+                    }
+                });
+            }
+
+            if (rfb)
+            {
+                rfb->publish(source, options.width, options.height, options.width, dirty);
+            }
+
+            previous = slot.damage;
+        }
+        else if (apng)
+        {
+            // Only the pixels that differ from the frame before are stored, and nothing at all
+            // for a frame that repeats it.
+
+            auto const source = reinterpret_cast<uint32_t const*>(slot.bytes.data());
+            PixelRect const full{ 0, 0, static_cast<int32_t>(options.width), static_cast<int32_t>(options.height) };
+            auto const dirty = frame ? changed_bounds(shown.data(), source, options.width, intersect(unite(previous, slot.damage), full)) : full;
+
+            if (dirty.empty())
+            {
+                apng->repeat();
+            }
+            else
+            {
+                apng->add(source, options.width, dirty);
+
+                for (auto y = dirty.top; y < dirty.bottom; ++y)
+                {
+                    auto const offset = size_t{ static_cast<uint32_t>(y) } * options.width + dirty.left;
+                    memcpy(shown.data() + offset, source + offset, size_t{ static_cast<uint32_t>(dirty.right - dirty.left) } * 4);
+                }
+            }
+
+            previous = slot.damage;
+        }
+        else
+        {
+            failed = failed || slot.bytes.size() != fwrite(slot.bytes.data(), 1, slot.bytes.size(), output);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(slot.lock);
+            slot.ready = false;
+            slot.frame += slots.size();
+        }
+
+        slot.changed.notify_all();
+    }
+
+    for (auto&& worker : workers)
+    {
+        worker.join();
+    }
+
+    if (apng)
+    {
+        failed = !apng->finish() || failed;
+    }
+
+    failed = fflush(output) != 0 || failed;
+
+    if (options.output)
+    {
+        fclose(output);
+    }
+
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+
+    fprintf(stderr, "clock-render: %llu frames in %.2f s (%.1f fps, %.1fx real time)\n",
+        static_cast<unsigned long long>(frames),
+        elapsed,
+        frames / elapsed,
+        time.now().elapsed / elapsed);
+
+    if (apng)
+    {
+        fprintf(stderr, "clock-render: APNG stores %llu of %llu frames in %.1f KB\n",
+            static_cast<unsigned long long>(apng->frames()),
+            static_cast<unsigned long long>(frames),
+            apng->bytes() / 1e3);
+    }
+
+    if (rfb)
+    {
+        fprintf(stderr, "clock-render: %llu VNC updates, %.1f KB/s sent\n",
+            static_cast<unsigned long long>(rfb->updates_sent()),
+            rfb->bytes_sent() / elapsed / 1e3);
+    }
+
+    if (failed)
+    {
+        fputs("clock-render: write failed\n", stderr);
+        return 1;
+    }
+
+    return 0;
+}
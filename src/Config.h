@@ -0,0 +1,388 @@
+#pragma once
+
+#include "Detail.h"
+#include "Rcu.h"
+#include "Theme.h"
+#include "Tick.h"
+#include "Watcher.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The settings that can change while the clock runs, read from a text file of one setting per
+// line, with # beginning a comment. Settings the file leaves out keep the values given on the
+// command line:
+//
+//   themes faces.theme        # a theme library compiled by clock-themec, relative to this file
+//   theme harbour             # the face to draw from it
+//   lod 40,120                # radii in pixels from which reduced and full detail apply
+//   frames compose            # compose or render
+//   motion tick               # sweep or tick
+//   tick 0.15,1.7             # seconds each tick takes and its overshoot, or 0,0 to jump
+//   interval 1                # vertical blanks per presented frame, 1 to 4
+//   export clock              # frame ring name, or none
+//   rfb 5900                  # VNC port, or 0
+
+enum class FramePolicy : uint8_t
+{
+    render,     // every frame is drawn and presented
+    compose,    // the compositor turns the hands and frames are only drawn when something changes
+};
+
+struct ClockSettings
+{
+    std::string themes;
+    std::string theme;
+    DetailThresholds thresholds;
+    FramePolicy frames = FramePolicy::render;
+    HandMotion motion = HandMotion::sweep;
+    TickStyle tick;
+    uint32_t interval = 1;
+    std::string exported;
+    uint16_t rfb = 0;
+};
+
+inline bool parse_settings(std::istream& text, ClockSettings& settings, std::string& error)
+{
+    std::string line;
+
+    for (uint32_t number = 1; std::getline(text, line); ++number)
+    {
+        std::istringstream words(line);
+        std::string key;
+        std::string value;
+        std::string extra;
+
+        if (!(words >> key) || '#' == key[0])
+        {
+            continue;
+        }
+
+        auto const fail = [&](char const* const message)
+        {
+            error = "line " + std::to_string(number) + ": " + message;
+            return false;
+        };
+
+        if (!(words >> value) || (words >> extra && '#' != extra[0]))
+        {
+            return fail("expected a single value");
+        }
+
+        if ("themes" == key)
+        {
+            settings.themes = value;
+        }
+        else if ("theme" == key)
+        {
+            settings.theme = value;
+        }
+        else if ("lod" == key)
+        {
+            DetailThresholds thresholds;
+
+            if (2 != sscanf(value.c_str(), "%f,%f", &thresholds.reduced, &thresholds.full) || thresholds.reduced < 0.0f || thresholds.full < thresholds.reduced)
+            {
+                return fail("expected the reduced and full radii, such as 40,120");
+            }
+
+            settings.thresholds = thresholds;
+        }
+        else if ("frames" == key)
+        {
+            if ("render" != value && "compose" != value)
+            {
+                return fail("expected render or compose");
+            }
+
+            settings.frames = "compose" == value ? FramePolicy::compose : FramePolicy::render;
+        }
+        else if ("motion" == key)
+        {
+            if ("sweep" != value && "tick" != value)
+            {
+                return fail("expected sweep or tick");
+            }
+
+            settings.motion = "tick" == value ? HandMotion::tick : HandMotion::sweep;
+        }
+        else if ("tick" == key)
+        {
+            TickStyle tick;
+
+            if (2 != sscanf(value.c_str(), "%f,%f", &tick.settle, &tick.overshoot) || !(tick.settle >= 0.0f && tick.settle <= 1.0f) || !(tick.overshoot >= 0.0f && tick.overshoot <= 10.0f))
+            {
+                return fail("expected the seconds each tick takes, up to 1, and its overshoot, such as 0.15,1.7");
+            }
+
+            settings.tick = tick;
+        }
+        else if ("interval" == key)
+        {
+            auto const interval = strtoul(value.c_str(), nullptr, 10);
+
+            if (interval < 1 || interval > 4)
+            {
+                return fail("expected an interval from 1 to 4");
+            }
+
+            settings.interval = static_cast<uint32_t>(interval);
+        }
+        else if ("export" == key)
+        {
+            settings.exported = "none" == value ? std::string() : value;
+        }
+        else if ("rfb" == key)
+        {
+            char* end = nullptr;
+            auto const port = strtoul(value.c_str(), &end, 10);
+
+            if (*end || port > 65535)
+            {
+                return fail("expected a port, or 0");
+            }
+
+            settings.rfb = static_cast<uint16_t>(port);
+        }
+        else
+        {
+            return fail("unknown setting");
+        }
+    }
+
+    return true;
+}
+
+// One version of the configuration, built in full before it is published and never changed
+// after. The face points into the theme library, which stays mapped for as long as the version
+// lives. A library is replaced by renaming a new file over it, as clock-themec does, so that the
+// mapping of an older version is left as it was; Windows does not allow a mapped file to be
+// replaced, so there the configuration should name a new file instead.
+
+struct ClockConfig
+{
+    ClockSettings settings;
+    ThemeLibrary themes;
+    FaceTheme const* face = &default_theme;
+};
+
+inline std::unique_ptr<ClockConfig> build_config(ClockSettings settings, std::string& error)
+{
+    auto config = std::make_unique<ClockConfig>();
+    config->settings = std::move(settings);
+    auto const& themes = config->settings.themes;
+
+    if (!themes.empty())
+    {
+        if (!config->themes.open(themes))
+        {
+            error = themes + " is not a theme library";
+            return nullptr;
+        }
+
+        if (!config->settings.theme.empty())
+        {
+            auto const theme = config->themes.find(config->settings.theme);
+
+            if (theme < 0)
+            {
+                error = themes + " has no theme named " + config->settings.theme;
+                return nullptr;
+            }
+
+            config->face = &config->themes.face(theme);
+        }
+    }
+
+    return config;
+}
+
+inline std::unique_ptr<ClockConfig> load_config(std::string const& path, ClockSettings settings, std::string& error)
+{
+    std::ifstream file(path);
+
+    if (!file)
+    {
+        error = "cannot read " + path;
+        return nullptr;
+    }
+
+    auto const themes = settings.themes;
+
+    if (!parse_settings(file, settings, error))
+    {
+        error = path + ", " + error;
+        return nullptr;
+    }
+
+    if (settings.themes != themes && std::filesystem::path(settings.themes).is_relative())
+    {
+        settings.themes = (std::filesystem::path(path).parent_path() / settings.themes).string();
+    }
+
+    return build_config(std::move(settings), error);
+}
+
+// Publishes the configuration to the render loop. The file is loaded at once, falling back to
+// the command line's settings alone if it cannot be, and is then watched along with the theme
+// library it names. Each change is loaded on the watching thread and, if it loads, published as
+// a new version. A file that fails to load leaves the current version in place and its error is
+// kept. Either way changed is then called from that thread, so the render loop can be woken.
+// Without a file the settings given are published once and never change.
+
+struct ConfigReloader
+{
+    static constexpr int settle_milliseconds = 50;
+    static constexpr int reclaim_milliseconds = 100;
+
+    ConfigReloader(std::string path, ClockSettings defaults, std::function<void()> changed) :
+        m_path(std::move(path)),
+        m_defaults(std::move(defaults)),
+        m_changed(std::move(changed)),
+        m_configs(initial())
+    {
+        if (!m_path.empty())
+        {
+            m_watcher.watch(m_files);
+            m_thread = std::thread([this] { run(); });
+        }
+    }
+
+    ConfigReloader(ConfigReloader const&) = delete;
+    ConfigReloader& operator=(ConfigReloader const&) = delete;
+
+    ~ConfigReloader()
+    {
+        m_watcher.cancel();
+
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    RcuPointer<ClockConfig>& configs() noexcept
+    {
+        return m_configs;
+    }
+
+    uint64_t failures() const noexcept
+    {
+        return m_failures;
+    }
+
+    std::string error() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_error;
+    }
+
+private:
+
+    std::unique_ptr<ClockConfig> initial()
+    {
+        std::string error;
+        auto config = m_path.empty() ? build_config(m_defaults, error) : load_config(m_path, m_defaults, error);
+
+        if (!config)
+        {
+            fail(error);
+            config = build_config(m_defaults, error);
+        }
+
+        if (!config)
+        {
+            fail(error);
+            config = std::make_unique<ClockConfig>();
+        }
+
+        m_files = files(*config);
+        return config;
+    }
+
+    std::vector<std::string> files(ClockConfig const& config) const
+    {
+        std::vector<std::string> paths{ m_path };
+
+        if (!config.settings.themes.empty())
+        {
+            paths.push_back(config.settings.themes);
+        }
+
+        return paths;
+    }
+
+    void fail(std::string const& error)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_error = error;
+        ++m_failures;
+    }
+
+    void run()
+    {
+        size_t retired = 0;
+
+        while (true)
+        {
+            auto result = m_watcher.wait(retired ? reclaim_milliseconds : -1);
+
+            if (WatchResult::timeout == result)
+            {
+                retired = m_configs.reclaim();
+                continue;
+            }
+
+            // A save is often several writes and a rename, so changes are left to settle first.
+
+            while (WatchResult::changed == result)
+            {
+                result = m_watcher.wait(settle_milliseconds);
+            }
+
+            if (WatchResult::cancelled == result)
+            {
+                return;
+            }
+
+            std::string error;
+
+            if (auto config = load_config(m_path, m_defaults, error))
+            {
+                if (auto changed = files(*config); changed != m_files)
+                {
+                    m_files = std::move(changed);
+                    m_watcher.watch(m_files);
+                }
+
+                retired = m_configs.publish(std::move(config));
+            }
+            else
+            {
+                fail(error);
+            }
+
+            m_changed();
+        }
+    }
+
+    std::string m_path;
+    ClockSettings m_defaults;
+    std::function<void()> m_changed;
+    std::vector<std::string> m_files;
+    mutable std::mutex m_lock;
+    std::string m_error;
+    std::atomic<uint64_t> m_failures{};
+    RcuPointer<ClockConfig> m_configs;
+    FileWatcher m_watcher;
+    std::thread m_thread;
+};
@@ -0,0 +1,628 @@
+#pragma once
+
+#include "Socket.h"
+#include "Tick.h"
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A control socket for a running clock, on a local (Unix domain) socket that only its owner can
+// reach. Operators query frame stats and change how the clock runs without restarting it, for
+// example with clock-ctl.
+//
+// Each message, either way, is a 32-bit little-endian length and then that many bytes. The
+// first byte of a request is the command and the first byte of a response is the status; any
+// arguments or results follow, little-endian. A client has one request outstanding at a time and
+// its next request is not read until the response has been sent, so responses arrive in order.
+//
+//   stats                          -> ControlStats
+//   ping                           -> nothing, once the render loop has seen it
+//   motion    u8 HandMotion        -> nothing
+//   detail    f32 reduced, f32 full -> nothing
+//   power     u8 PowerMode         -> nothing
+//   snapshot  u32 width, u32 height -> a PNG of the clock, or of the window with zero sizes
+//
+// Stats are answered on the I/O thread from the snapshot the render loop last published. Every
+// other command is handed to the render loop through a queue and answered once it has been
+// applied.
+
+enum class ControlCommand : uint8_t
+{
+    stats = 1,
+    ping,
+    motion,
+    detail,
+    power,
+    snapshot,
+};
+
+enum class ControlStatus : uint8_t
+{
+    ok,
+    bad_request,
+    busy,           // the render loop has too many commands waiting
+    failed,
+};
+
+enum class PowerMode : uint8_t
+{
+    normal,
+    low,            // the power policy runs as though the system's energy saver were on
+};
+
+struct ControlStats
+{
+    uint64_t frames;        // presented since startup
+    uint64_t commands;      // applied by the render loop
+    uint64_t frames_saved;  // not drawn while hidden, at the rate drawn before
+    float frame_ms;         // drawing and presenting the last frame
+    float interval_ms;      // between presented frames, smoothed
+    uint32_t width;
+    uint32_t height;
+    uint32_t clocks;
+    uint8_t tier;           // DetailTier
+    uint8_t motion;         // HandMotion
+    uint8_t power;          // PowerMode
+    uint8_t policy;         // PowerLevel
+    uint8_t hidden;         // HiddenBy flags
+    uint8_t composing;
+};
+
+constexpr uint32_t control_max_request = 64 * 1024;
+constexpr uint32_t control_max_response = 64 * 1024 * 1024;
+
+inline void control_put8(std::vector<uint8_t>& bytes, uint32_t const value)
+{
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+inline void control_put32(std::vector<uint8_t>& bytes, uint32_t const value)
+{
+    for (uint32_t shift = 0; shift != 32; shift += 8)
+    {
+        bytes.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+inline void control_put64(std::vector<uint8_t>& bytes, uint64_t const value)
+{
+    control_put32(bytes, static_cast<uint32_t>(value));
+    control_put32(bytes, static_cast<uint32_t>(value >> 32));
+}
+
+inline void control_put_float(std::vector<uint8_t>& bytes, float const value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    control_put32(bytes, bits);
+}
+
+// Reads the arguments or results of a message. Reading past the end yields zeros and clears ok,
+// so a message can be read in full and checked once.
+
+struct ControlReader
+{
+    uint8_t const* data;
+    size_t size;
+    size_t used{};
+    bool ok{ true };
+
+    uint8_t get8() noexcept
+    {
+        return static_cast<uint8_t>(get(1));
+    }
+
+    uint32_t get32() noexcept
+    {
+        return static_cast<uint32_t>(get(4));
+    }
+
+    uint64_t get64() noexcept
+    {
+        return get(8);
+    }
+
+    float get_float() noexcept
+    {
+        auto const bits = get32();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    bool finished() const noexcept
+    {
+        return ok && used == size;
+    }
+
+private:
+
+    uint64_t get(size_t const count) noexcept
+    {
+        if (size - used < count)
+        {
+            ok = false;
+            used = size;
+            return 0;
+        }
+
+        uint64_t value = 0;
+
+        for (size_t i = 0; i != count; ++i)
+        {
+            value |= uint64_t{ data[used + i] } << (i * 8);
+        }
+
+        used += count;
+        return value;
+    }
+};
+
+inline void put_stats(std::vector<uint8_t>& bytes, ControlStats const& stats)
+{
+    control_put64(bytes, stats.frames);
+    control_put64(bytes, stats.commands);
+    control_put64(bytes, stats.frames_saved);
+    control_put_float(bytes, stats.frame_ms);
+    control_put_float(bytes, stats.interval_ms);
+    control_put32(bytes, stats.width);
+    control_put32(bytes, stats.height);
+    control_put32(bytes, stats.clocks);
+    control_put8(bytes, stats.tier);
+    control_put8(bytes, stats.motion);
+    control_put8(bytes, stats.power);
+    control_put8(bytes, stats.policy);
+    control_put8(bytes, stats.hidden);
+    control_put8(bytes, stats.composing);
+}
+
+inline ControlStats get_stats(ControlReader& reader) noexcept
+{
+    ControlStats stats;
+    stats.frames = reader.get64();
+    stats.commands = reader.get64();
+    stats.frames_saved = reader.get64();
+    stats.frame_ms = reader.get_float();
+    stats.interval_ms = reader.get_float();
+    stats.width = reader.get32();
+    stats.height = reader.get32();
+    stats.clocks = reader.get32();
+    stats.tier = reader.get8();
+    stats.motion = reader.get8();
+    stats.power = reader.get8();
+    stats.policy = reader.get8();
+    stats.hidden = reader.get8();
+    stats.composing = reader.get8();
+    return stats;
+}
+
+// A value written by one thread and read by any number of others without either waiting for the
+// other. The writer makes the sequence odd while it writes and even again once it is done, and a
+// reader retries whenever the sequence was odd or moved while it read. The value is held as
+// relaxed atomic words so that a read racing a write is merely discarded rather than undefined.
+
+template <typename T>
+struct SeqLock
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    void store(T const& value) noexcept
+    {
+        uint64_t words[word_count] = {};
+        memcpy(words, &value, sizeof(T));
+        auto const sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i != word_count; ++i)
+        {
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    T load() const noexcept
+    {
+        uint64_t words[word_count];
+
+        while (true)
+        {
+            auto const sequence = m_sequence.load(std::memory_order_acquire);
+
+            for (size_t i = 0; i != word_count; ++i)
+            {
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (!(sequence & 1) && sequence == m_sequence.load(std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+
+        T value;
+        memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+
+    static constexpr size_t word_count = (sizeof(T) + 7) / 8;
+
+    std::atomic<uint64_t> m_sequence{};
+    std::atomic<uint64_t> m_words[word_count]{};
+};
+
+// A bounded queue between exactly one producing thread and one consuming thread. Neither side
+// locks: each owns one index and only reads the other's.
+
+template <typename T, size_t Capacity>
+struct SpscQueue
+{
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "the capacity must be a power of two");
+
+    bool push(T&& value)
+    {
+        auto const tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+
+        m_items[tail & (Capacity - 1)] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        auto const head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        value = std::move(m_items[head & (Capacity - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+
+    alignas(64) std::atomic<size_t> m_head{};
+    alignas(64) std::atomic<size_t> m_tail{};
+    T m_items[Capacity];
+};
+
+struct ControlMessage
+{
+    uint64_t client;
+    std::vector<uint8_t> body;
+};
+
+// The I/O side of the control socket. It runs its own thread for the sockets, while the render
+// loop calls serve to apply the commands waiting for it. wake is called from the I/O thread when
+// commands arrive, so that a render loop that is asleep can be woken.
+
+struct ControlServer
+{
+    static constexpr size_t queue_size = 64;
+
+    ControlServer(std::string path, std::function<void()> wake) :
+        m_path(std::move(path)),
+        m_wake_render(std::move(wake))
+    {
+        if (!m_server.open(listen_local(m_path.c_str(), m_file)))
+        {
+            if (invalid_socket != m_server.listener())
+            {
+                remove_local(m_path.c_str(), m_file);
+            }
+
+            throw std::runtime_error("ControlServer: cannot listen on " + m_path);
+        }
+
+        m_thread = std::thread([this] { m_server.run(m_stopping, *this); });
+    }
+
+    // Only the socket this server bound is removed, not one that another clock has since bound
+    // at the same path.
+
+    ~ControlServer()
+    {
+        m_stopping = true;
+        m_server.wake();
+        m_thread.join();
+        remove_local(m_path.c_str(), m_file);
+    }
+
+    ControlServer(ControlServer const&) = delete;
+    ControlServer& operator=(ControlServer const&) = delete;
+
+    // Written by the render loop, typically once per frame.
+
+    SeqLock<ControlStats>& stats() noexcept
+    {
+        return m_stats;
+    }
+
+    // Applies each command waiting for the render loop, calling handle(command, arguments,
+    // result) for each and sending back the status it returns along with whatever it added to
+    // result. Returns the number applied.
+
+    template <typename Handler>
+    size_t serve(Handler&& handle)
+    {
+        ControlMessage message;
+        size_t count = 0;
+
+        while (m_requests.pop(message))
+        {
+            ControlReader arguments{ message.body.data() + 1, message.body.size() - 1 };
+            std::vector<uint8_t> result{ 0 };
+            result[0] = static_cast<uint8_t>(handle(static_cast<ControlCommand>(message.body[0]), arguments, result));
+
+            // Only as many requests as the queue holds are ever outstanding, so there is always
+            // room for the response.
+
+            m_responses.push({ message.client, std::move(result) });
+            ++count;
+        }
+
+        if (count)
+        {
+            m_server.wake();
+        }
+
+        return count;
+    }
+
+private:
+
+    struct Client
+    {
+        Socket socket;
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        size_t sent{};
+        bool waiting{};     // for the render loop to respond
+    };
+
+    template <typename> friend struct SocketServer;
+
+    short events(Client const& client) const noexcept
+    {
+        return static_cast<short>(client.sent != client.output.size() ? POLLOUT : client.waiting ? 0 : POLLIN);
+    }
+
+    void woken()
+    {
+        take_responses();
+    }
+
+    void accepted(uint64_t, Client&) noexcept
+    {
+    }
+
+    void writable(uint64_t const id, Client&)
+    {
+        flush(id);
+        process(id);
+    }
+
+    void received(uint64_t const id, Client& client, char const* data, size_t const size)
+    {
+        client.input.insert(client.input.end(), data, data + size);
+        process(id);
+    }
+
+    // Responses for clients that have since gone are dropped with them.
+
+    void take_responses()
+    {
+        ControlMessage message;
+
+        while (m_responses.pop(message))
+        {
+            --m_outstanding;
+
+            if (auto const client = m_server.find(message.client))
+            {
+                client->waiting = false;
+                respond(message.client, message.body);
+                process(message.client);
+            }
+        }
+    }
+
+    void respond(uint64_t const id, std::vector<uint8_t> const& body)
+    {
+        auto& output = m_server.clients()[id].output;
+        control_put32(output, static_cast<uint32_t>(body.size()));
+        output.insert(output.end(), body.begin(), body.end());
+        flush(id);
+    }
+
+    void flush(uint64_t const id)
+    {
+        auto const client = m_server.find(id);
+
+        if (!client)
+        {
+            return;
+        }
+
+        SendBuffer const buffer{ client->output.data(), client->output.size() };
+
+        if (m_server.send(id, &buffer, 1, client->sent) && client->sent == client->output.size())
+        {
+            client->output.clear();
+            client->sent = 0;
+        }
+    }
+
+    // Takes complete requests from the client's input until one is handed to the render loop,
+    // a response cannot be sent straight away, or more input is needed.
+
+    void process(uint64_t const id)
+    {
+        while (true)
+        {
+            auto const client = m_server.find(id);
+
+            if (!client || client->waiting || !client->output.empty())
+            {
+                return;
+            }
+
+            auto& input = client->input;
+
+            if (input.size() < 4)
+            {
+                return;
+            }
+
+            ControlReader header{ input.data(), 4 };
+            auto const length = header.get32();
+
+            if (!length || length > control_max_request)
+            {
+                m_server.drop(id);
+                return;
+            }
+
+            if (input.size() - 4 < length)
+            {
+                return;
+            }
+
+            std::vector<uint8_t> body(input.begin() + 4, input.begin() + 4 + length);
+            input.erase(input.begin(), input.begin() + 4 + length);
+            auto const command = static_cast<ControlCommand>(body[0]);
+
+            if (ControlCommand::stats == command)
+            {
+                std::vector<uint8_t> result{ static_cast<uint8_t>(ControlStatus::ok) };
+                put_stats(result, m_stats.load());
+                respond(id, result);
+            }
+            else if (command < ControlCommand::ping || command > ControlCommand::snapshot)
+            {
+                respond(id, { static_cast<uint8_t>(ControlStatus::bad_request) });
+            }
+            else if (m_outstanding == queue_size || !m_requests.push({ id, std::move(body) }))
+            {
+                respond(id, { static_cast<uint8_t>(ControlStatus::busy) });
+            }
+            else
+            {
+                ++m_outstanding;
+                client->waiting = true;
+                m_wake_render();
+                return;
+            }
+        }
+    }
+
+    std::string m_path;
+    std::function<void()> m_wake_render;
+    SocketLibrary m_library;
+    LocalSocketFile m_file{};
+    SocketServer<Client> m_server;
+    std::thread m_thread;
+    std::atomic<bool> m_stopping{};
+    size_t m_outstanding{};
+    SeqLock<ControlStats> m_stats;
+    SpscQueue<ControlMessage, queue_size> m_requests;
+    SpscQueue<ControlMessage, queue_size> m_responses;
+};
+
+// The client side, for tools: sends a request and blocks for its response.
+
+struct ControlClient
+{
+    explicit ControlClient(std::string const& path) :
+        m_socket(connect_local(path.c_str()))
+    {
+        if (invalid_socket == m_socket)
+        {
+            throw std::runtime_error("ControlClient: cannot connect to " + path);
+        }
+    }
+
+    ~ControlClient()
+    {
+        close_socket(m_socket);
+    }
+
+    ControlClient(ControlClient const&) = delete;
+    ControlClient& operator=(ControlClient const&) = delete;
+
+    // Sends the command and its arguments and returns the response, status first.
+
+    std::vector<uint8_t> request(ControlCommand const command, std::vector<uint8_t> const& arguments = {})
+    {
+        std::vector<uint8_t> message;
+        control_put32(message, static_cast<uint32_t>(arguments.size() + 1));
+        control_put8(message, static_cast<uint8_t>(command));
+        message.insert(message.end(), arguments.begin(), arguments.end());
+
+        for (size_t sent = 0; sent != message.size();)
+        {
+            SendBuffer const buffer{ message.data() + sent, message.size() - sent };
+            auto const count = send_gather(m_socket, &buffer, 1);
+
+            if (count <= 0)
+            {
+                throw std::runtime_error("ControlClient: connection lost");
+            }
+
+            sent += static_cast<size_t>(count);
+        }
+
+        uint8_t header[4];
+        receive_all(header, sizeof(header));
+        ControlReader reader{ header, sizeof(header) };
+        auto const length = reader.get32();
+
+        if (!length || length > control_max_response)
+        {
+            throw std::runtime_error("ControlClient: bad response");
+        }
+
+        std::vector<uint8_t> response(length);
+        receive_all(response.data(), response.size());
+        return response;
+    }
+
+private:
+
+    void receive_all(uint8_t* data, size_t size)
+    {
+        while (size)
+        {
+            auto const count = receive(m_socket, reinterpret_cast<char*>(data), size);
+
+            if (count <= 0)
+            {
+                throw std::runtime_error("ControlClient: connection lost");
+            }
+
+            data += count;
+            size -= static_cast<size_t>(count);
+        }
+    }
+
+    SocketLibrary m_library;
+    Socket m_socket;
+};
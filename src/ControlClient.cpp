@@ -0,0 +1,203 @@
+// clock-ctl: sends commands to a running clock over its control socket, as opened by "Clock.exe
+// /control:PATH" (see Control.h):
+//
+//   clock-ctl /tmp/clock.sock stats
+//   clock-ctl /tmp/clock.sock tick
+//   clock-ctl /tmp/clock.sock lod 40,120
+//   clock-ctl /tmp/clock.sock snapshot clock.png 512
+//   clock-ctl /tmp/clock.sock bench 10000
+//
+// bench times round trips of ping, which goes through the render loop, and of stats, which the
+// I/O thread answers alone. Only the standard library and the platform's sockets are needed, so
+// it also builds elsewhere, for example:
+//
+//   g++ -std=c++17 -O2 -pthread ControlClient.cpp -o clock-ctl
+
+#include "Control.h"
+#include "Power.h"
+#include "Visibility.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage()
+{
+    fputs("usage: clock-ctl SOCKET COMMAND\n"
+        "  stats                 frame stats\n"
+        "  ping                  a round trip through the render loop\n"
+        "  sweep | tick          how the second hand moves\n"
+        "  lod R,F               radii from which reduced and full detail apply\n"
+        "  power normal | low    run as though the energy saver were off or on\n"
+        "  snapshot PATH [SIZE]  write a PNG of the clock, the window's size by default\n"
+        "  bench [COUNT]         time COUNT round trips (10000)\n",
+        stderr);
+}
+
+static char const* status_text(uint8_t const status)
+{
+    switch (static_cast<ControlStatus>(status))
+    {
+    case ControlStatus::ok: return "ok";
+    case ControlStatus::bad_request: return "bad request";
+    case ControlStatus::busy: return "busy";
+    default: return "failed";
+    }
+}
+
+static void print_stats(std::vector<uint8_t> const& response)
+{
+    ControlReader reader{ response.data() + 1, response.size() - 1 };
+    auto const stats = get_stats(reader);
+    char const* const tiers[] = { "sprite", "reduced", "full" };
+    std::string hidden;
+
+    for (uint32_t reason = 1; reason <= static_cast<uint32_t>(HiddenBy::cloaked); reason <<= 1)
+    {
+        if (stats.hidden & reason)
+        {
+            hidden += (hidden.empty() ? "no, hidden by " : ", ") + std::string(hidden_by_name(static_cast<HiddenBy>(reason)));
+        }
+    }
+
+    printf("frames     %llu\n", static_cast<unsigned long long>(stats.frames));
+    printf("commands   %llu\n", static_cast<unsigned long long>(stats.commands));
+    printf("saved      %llu frames while hidden\n", static_cast<unsigned long long>(stats.frames_saved));
+    printf("frame      %.2f ms\n", stats.frame_ms);
+    printf("interval   %.2f ms\n", stats.interval_ms);
+    printf("size       %ux%u, %u clocks\n", stats.width, stats.height, stats.clocks);
+    printf("detail     %s\n", stats.tier < 3 ? tiers[stats.tier] : "?");
+    printf("motion     %s\n", static_cast<HandMotion>(stats.motion) == HandMotion::tick ? "tick" : "sweep");
+    printf("power      %s\n", static_cast<PowerMode>(stats.power) == PowerMode::low ? "low" : "normal");
+    printf("policy     %s\n", power_level_name(static_cast<PowerLevel>(stats.policy)));
+    printf("visible    %s\n", hidden.empty() ? "yes" : hidden.c_str());
+    printf("composing  %s\n", stats.composing ? "yes" : "no");
+}
+
+// Prints the spread of round trip times for one command.
+
+static bool bench(ControlClient& client, ControlCommand const command, char const* const name, uint32_t const count)
+{
+    std::vector<double> times;
+    times.reserve(count);
+
+    for (uint32_t i = 0; i != count; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        auto const response = client.request(command);
+        times.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+        if (static_cast<uint8_t>(ControlStatus::ok) != response[0])
+        {
+            fprintf(stderr, "clock-ctl: %s: %s\n", name, status_text(response[0]));
+            return false;
+        }
+    }
+
+    std::sort(times.begin(), times.end());
+    auto const at = [&](double const fraction) { return times[std::min(times.size() - 1, static_cast<size_t>(fraction * times.size()))]; };
+
+    printf("%-6s %u round trips: min %.1f us, median %.1f us, p99 %.1f us, max %.1f us\n",
+        name, count, times.front(), at(0.5), at(0.99), times.back());
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    auto const verb = std::string(argv[2]);
+    std::vector<uint8_t> arguments;
+    ControlCommand command;
+
+    if ("stats" == verb || "ping" == verb || "bench" == verb)
+    {
+        command = "ping" == verb ? ControlCommand::ping : ControlCommand::stats;
+    }
+    else if ("sweep" == verb || "tick" == verb)
+    {
+        command = ControlCommand::motion;
+        control_put8(arguments, static_cast<uint8_t>("tick" == verb ? HandMotion::tick : HandMotion::sweep));
+    }
+    else if ("lod" == verb && 4 == argc)
+    {
+        float reduced;
+        float full;
+
+        if (2 != sscanf(argv[3], "%f,%f", &reduced, &full))
+        {
+            usage();
+            return 1;
+        }
+
+        command = ControlCommand::detail;
+        control_put_float(arguments, reduced);
+        control_put_float(arguments, full);
+    }
+    else if ("power" == verb && 4 == argc && (!strcmp(argv[3], "normal") || !strcmp(argv[3], "low")))
+    {
+        command = ControlCommand::power;
+        control_put8(arguments, static_cast<uint8_t>(strcmp(argv[3], "low") ? PowerMode::normal : PowerMode::low));
+    }
+    else if ("snapshot" == verb && (4 == argc || 5 == argc))
+    {
+        auto const size = 5 == argc ? static_cast<uint32_t>(strtoul(argv[4], nullptr, 10)) : 0;
+        command = ControlCommand::snapshot;
+        control_put32(arguments, size);
+        control_put32(arguments, size);
+    }
+    else
+    {
+        usage();
+        return 1;
+    }
+
+    try
+    {
+        ControlClient client(argv[1]);
+
+        if ("bench" == verb)
+        {
+            auto const count = std::max(1u, 4 == argc ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 10000u);
+            return bench(client, ControlCommand::ping, "ping", count) && bench(client, ControlCommand::stats, "stats", count) ? 0 : 1;
+        }
+
+        auto const response = client.request(command, arguments);
+
+        if (static_cast<uint8_t>(ControlStatus::ok) != response[0])
+        {
+            fprintf(stderr, "clock-ctl: %s: %s\n", verb.c_str(), status_text(response[0]));
+            return 1;
+        }
+
+        if (ControlCommand::stats == command)
+        {
+            print_stats(response);
+        }
+        else if (ControlCommand::snapshot == command)
+        {
+            auto const file = fopen(argv[3], "wb");
+
+            if (!file || response.size() - 1 != fwrite(response.data() + 1, 1, response.size() - 1, file) || fclose(file))
+            {
+                perror(argv[3]);
+                return 1;
+            }
+
+            fprintf(stderr, "clock-ctl: %zu bytes\n", response.size() - 1);
+        }
+
+        return 0;
+    }
+    catch (std::exception const& e)
+    {
+        fprintf(stderr, "clock-ctl: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "Scene.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Hand motion as piecewise cubic curves, in the form a compositor animation takes them: each
+// segment starts at an offset in seconds from the start of the animation and holds
+//
+//   value = constant + linear x + quadratic x^2 + cubic x^3, where x = t - begin
+//
+// until the next segment begins. An optional repeat then replays the given span before its
+// begin forever, which is all a hand needs once the intro is over: a sweep up to 360 degrees
+// and then a turn from 0 to 360 repeated every period.
+//
+// Coefficients are single precision, as the compositor keeps them, and fitting measures the
+// error with them rounded.
+
+struct CubicSegment
+{
+    double begin;
+    float constant;
+    float linear;
+    float quadratic;
+    float cubic;
+};
+
+inline double evaluate(CubicSegment const& segment, double const time) noexcept
+{
+    auto const x = time - segment.begin;
+    return segment.constant + x * (segment.linear + x * (segment.quadratic + x * segment.cubic));
+}
+
+// Fits function over [begin, end] with cubic Hermite segments, each matching the function and
+// its slope at both ends, and halves any segment whose error exceeds tolerance. Pieces of the
+// function that are themselves cubic come out as a single segment, so callers should fit
+// separately either side of any point where the function changes form.
+
+template <typename Function>
+void fit_cubics(Function const& function, double const begin, double const end, double const tolerance, std::vector<CubicSegment>& segments, int const depth = 24)
+{
+    auto const span = end - begin;
+
+    if (span <= 0.0)
+    {
+        return;
+    }
+
+    // Slopes are one-sided so that the function is only sampled within the span.
+
+    auto const h = span / 1024.0;
+    auto const first = function(begin);
+    auto const last = function(end);
+    auto const d0 = (-3.0 * first + 4.0 * function(begin + h) - function(begin + 2.0 * h)) / (2.0 * h);
+    auto const d1 = (3.0 * last - 4.0 * function(end - h) + function(end - 2.0 * h)) / (2.0 * h);
+    auto const slope = (last - first) / span;
+
+    CubicSegment const segment
+    {
+        begin,
+        static_cast<float>(first),
+        static_cast<float>(d0),
+        static_cast<float>((3.0 * slope - 2.0 * d0 - d1) / span),
+        static_cast<float>((d0 + d1 - 2.0 * slope) / (span * span))
+    };
+
+    double error = 0.0;
+
+    for (int sample = 0; sample <= 32; ++sample)
+    {
+        auto const time = begin + span * sample / 32.0;
+        error = std::max(error, std::abs(evaluate(segment, time) - function(time)));
+    }
+
+    if (error <= tolerance || !depth)
+    {
+        segments.push_back(segment);
+        return;
+    }
+
+    auto const middle = begin + span / 2.0;
+    fit_cubics(function, begin, middle, tolerance, segments, depth - 1);
+    fit_cubics(function, middle, end, tolerance, segments, depth - 1);
+}
+
+struct HandCurve
+{
+    std::vector<CubicSegment> segments;
+    double repeat_begin;
+    double repeat_duration;
+};
+
+inline double evaluate(HandCurve const& curve, double time) noexcept
+{
+    if (curve.repeat_duration > 0.0 && time >= curve.repeat_begin)
+    {
+        time = curve.repeat_begin - curve.repeat_duration + std::fmod(time - curve.repeat_begin, curve.repeat_duration);
+    }
+
+    auto const next = std::upper_bound(curve.segments.begin(), curve.segments.end(), time, [](double const t, CubicSegment const& segment)
+    {
+        return t < segment.begin;
+    });
+
+    return next == curve.segments.begin() ? 0.0 : evaluate(*(next - 1), time);
+}
+
+// A hand turning at a steady rate, seen part way through the intro swing or after it.
+
+struct HandTurn
+{
+    float angle;        // where the hand points now without the swing, as hand_angles gives it
+    float start;        // the angle sampled as the intro began, as apply_swing takes it
+    double rate;        // degrees per second
+    double period;      // seconds per turn
+};
+
+constexpr double hand_rate_second = 6.0;
+constexpr double hand_rate_minute = 0.1;
+constexpr double hand_rate_hour = 1.0 / 120.0;
+
+// Builds the curve for a hand from now on, elapsed seconds into the intro. The swing multiplies
+// a quadratic by the linear target, so its pieces either side of the changes in acceleration
+// are exactly cubic and fit as one segment each; the tolerance only matters for other profiles.
+
+inline HandCurve hand_curve(HandTurn const& turn, double const elapsed, double const tolerance = 0.01)
+{
+    HandCurve curve{ {}, 0.0, 0.0 };
+    auto const target = turn.angle + (turn.start > turn.angle ? 360.0 : 0.0);
+    auto const remaining = std::max(0.0, intro_duration - elapsed);
+
+    if (remaining > 0.0)
+    {
+        auto const swing = [&](double const time)
+        {
+            return accelerate_decelerate(elapsed + time) * (target + turn.rate * time);
+        };
+
+        double const changes[] =
+        {
+            intro_acceleration * intro_duration - elapsed,
+            intro_duration - intro_deceleration * intro_duration - elapsed,
+        };
+
+        auto begin = 0.0;
+
+        for (auto change : changes)
+        {
+            if (change > begin && change < remaining)
+            {
+                fit_cubics(swing, begin, change, tolerance, curve.segments);
+                begin = change;
+            }
+        }
+
+        fit_cubics(swing, begin, remaining, tolerance, curve.segments);
+    }
+
+    // Then a sweep to the top and whole turns from there.
+
+    auto const angle = std::fmod(target + turn.rate * remaining, 360.0);
+    auto const top = remaining + (360.0 - angle) / turn.rate;
+    curve.segments.push_back({ remaining, static_cast<float>(angle), static_cast<float>(turn.rate), 0.0f, 0.0f });
+    curve.segments.push_back({ top, 0.0f, static_cast<float>(turn.rate), 0.0f, 0.0f });
+    curve.repeat_begin = top + turn.period;
+    curve.repeat_duration = turn.period;
+    return curve;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+// Clocks are drawn in less detail the smaller they are on screen. A clock a few dozen pixels
+// across on a wall cannot show a blurred drop shadow or anti-aliased edges to any effect, yet
+// they cost as much per pixel as they do on a clock filling the window.
+//
+// - sprite: no shadow and aliased edges, with the dials baked once as for every tier.
+// - reduced: the shadow is blurred at half resolution and scaled back up.
+// - full: everything, as before.
+
+enum class DetailTier : uint8_t
+{
+    sprite,
+    reduced,
+    full,
+};
+
+// Radii in pixels from which the reduced and full tiers apply, and the fraction either side of
+// each by which a radius must cross it before the tier changes, so that a live resize around a
+// threshold does not flip back and forth between tiers.
+
+struct DetailThresholds
+{
+    float reduced = 40.0f;
+    float full = 120.0f;
+    float hysteresis = 0.15f;
+};
+
+inline DetailTier detail_tier(float const radius, DetailTier tier, DetailThresholds const& thresholds = {})
+{
+    auto const up = 1.0f + thresholds.hysteresis;
+    auto const down = 1.0f - thresholds.hysteresis;
+
+    if (DetailTier::sprite == tier && radius >= thresholds.reduced * up)
+    {
+        tier = DetailTier::reduced;
+    }
+
+    if (DetailTier::reduced == tier && radius >= thresholds.full * up)
+    {
+        tier = DetailTier::full;
+    }
+
+    if (DetailTier::full == tier && radius < thresholds.full * down)
+    {
+        tier = DetailTier::reduced;
+    }
+
+    if (DetailTier::reduced == tier && radius < thresholds.reduced * down)
+    {
+        tier = DetailTier::sprite;
+    }
+
+    return tier;
+}
+
+// Without a previous tier there is nothing to hold on to, so the thresholds apply as they are.
+
+inline DetailTier detail_tier(float const radius, DetailThresholds const& thresholds = {})
+{
+    return radius < thresholds.reduced ? DetailTier::sprite : radius < thresholds.full ? DetailTier::reduced : DetailTier::full;
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "Scene.h"
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// The clock scene is recorded once per size/DPI change as a flat array of fixed-size ops that
+// reference a table of transforms. Each frame only the hand transform slots are patched before
+// the list is replayed against whichever backend is drawing. Text is recorded as one op per glyph,
+// its slot holding the character and its points the corners of the glyph's box in a GlyphAtlas.
+
+enum class DisplayCommand : uint16_t
+{
+    set_transform,
+    draw_ellipse,
+    draw_line,
+    draw_glyph,
+};
+
+struct DisplayOp
+{
+    DisplayCommand command;
+    uint16_t slot;
+    float stroke;
+    float x0, y0;
+    float x1, y1;
+};
+
+static_assert(std::is_trivially_copyable_v<DisplayOp> && sizeof(DisplayOp) == 24);
+
+struct DisplayList
+{
+    std::vector<Transform> transforms;
+    std::vector<DisplayOp> ops;
+};
+
+// Slots relative to the value returned by record_clock. Hands may be recorded without the dial
+// when the dials are drawn once into a cached layer, and without the second hand for displays
+// that only change once a minute. The second hand's slot is kept either way.
+
+constexpr uint16_t slot_dial = 0;
+constexpr uint16_t slot_second = 1;
+constexpr uint16_t slot_minute = 2;
+constexpr uint16_t slot_hour = 3;
+
+inline uint16_t record_clock(DisplayList& list, ClockGeometry const& geometry, bool const dial = true, bool const second = true, FaceTheme const& theme = default_theme)
+{
+    auto const first = static_cast<uint16_t>(list.transforms.size());
+    auto const radius = geometry.radius;
+    auto const base = translation(geometry.x, geometry.y);
+
+    list.transforms.insert(list.transforms.end(), { base, base, base, base });
+
+    if (dial)
+    {
+        list.ops.push_back({ DisplayCommand::set_transform, static_cast<uint16_t>(first + slot_dial), 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+        list.ops.push_back({ DisplayCommand::draw_ellipse, 0, radius * theme.dial_stroke, 0.0f, 0.0f, radius, radius });
+    }
+
+    if (second)
+    {
+        list.ops.push_back({ DisplayCommand::set_transform, static_cast<uint16_t>(first + slot_second), 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+        list.ops.push_back({ DisplayCommand::draw_line, 0, radius * theme.second_stroke, 0.0f, 0.0f, 0.0f, -(radius * theme.second_length) });
+    }
+
+    list.ops.push_back({ DisplayCommand::set_transform, static_cast<uint16_t>(first + slot_minute), 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    list.ops.push_back({ DisplayCommand::draw_line, 0, radius * theme.minute_stroke, 0.0f, 0.0f, 0.0f, -(radius * theme.minute_length) });
+
+    list.ops.push_back({ DisplayCommand::set_transform, static_cast<uint16_t>(first + slot_hour), 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    list.ops.push_back({ DisplayCommand::draw_line, 0, radius * theme.hour_stroke, 0.0f, 0.0f, 0.0f, -(radius * theme.hour_length) });
+
+    return first;
+}
+
+inline void record_dial(DisplayList& list, ClockGeometry const& geometry, FaceTheme const& theme = default_theme)
+{
+    auto const slot = static_cast<uint16_t>(list.transforms.size());
+    auto const radius = geometry.radius;
+    list.transforms.push_back(translation(geometry.x, geometry.y));
+    list.ops.push_back({ DisplayCommand::set_transform, slot, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    list.ops.push_back({ DisplayCommand::draw_ellipse, 0, radius * theme.dial_stroke, 0.0f, 0.0f, radius, radius });
+}
+
+inline DisplayList record_clock(ClockGeometry const& geometry, FaceTheme const& theme = default_theme)
+{
+    DisplayList list;
+    record_clock(list, geometry, true, true, theme);
+    return list;
+}
+
+inline void patch_hands(DisplayList& list, uint16_t const first, HandAngles const& angles, Transform const& orientation = identity())
+{
+    auto const base = orientation * list.transforms[first + slot_dial];
+    list.transforms[first + slot_second] = rotation(angles.second) * base;
+    list.transforms[first + slot_minute] = rotation(angles.minute) * base;
+    list.transforms[first + slot_hour] = rotation(angles.hour) * base;
+}
+
+// A target provides set_transform, draw_ellipse, draw_line and draw_glyph.
+
+template <typename Target>
+void replay(DisplayList const& list, Target&& target)
+{
+    for (auto&& op : list.ops)
+    {
+        switch (op.command)
+        {
+        case DisplayCommand::set_transform:
+            target.set_transform(list.transforms[op.slot]);
+            break;
+
+        case DisplayCommand::draw_ellipse:
+            target.draw_ellipse(op.x0, op.y0, op.x1, op.y1, op.stroke);
+            break;
+
+        case DisplayCommand::draw_line:
+            target.draw_line(op.x0, op.y0, op.x1, op.y1, op.stroke);
+            break;
+
+        case DisplayCommand::draw_glyph:
+            target.draw_glyph(op.slot, op.x0, op.y0, op.x1, op.y1);
+            break;
+        }
+    }
+}
+
+// Binary blob: header, transforms, ops. Native endianness, as the blob is only meant to move
+// between processes on the same machine or be cached on disk.
+
+struct DisplayListHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t transform_count;
+    uint32_t op_count;
+};
+
+constexpr uint32_t display_list_magic = 0x4c44434b; // "KCDL"
+constexpr uint32_t display_list_version = 2;
+
+inline std::vector<uint8_t> serialize(DisplayList const& list)
+{
+    DisplayListHeader const header
+    {
+        display_list_magic,
+        display_list_version,
+        static_cast<uint32_t>(list.transforms.size()),
+        static_cast<uint32_t>(list.ops.size())
+    };
+
+    auto const transform_bytes = list.transforms.size() * sizeof(Transform);
+    auto const op_bytes = list.ops.size() * sizeof(DisplayOp);
+
+    std::vector<uint8_t> blob(sizeof(header) + transform_bytes + op_bytes);
+    auto out = blob.data();
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    memcpy(out, list.transforms.data(), transform_bytes);
+    out += transform_bytes;
+    memcpy(out, list.ops.data(), op_bytes);
+    return blob;
+}
+
+inline bool deserialize(uint8_t const* data, size_t const size, DisplayList& list)
+{
+    DisplayListHeader header;
+
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != display_list_magic || header.version != display_list_version)
+    {
+        return false;
+    }
+
+    auto const transform_bytes = size_t{ header.transform_count } * sizeof(Transform);
+    auto const op_bytes = size_t{ header.op_count } * sizeof(DisplayOp);
+
+    if (size != sizeof(header) + transform_bytes + op_bytes)
+    {
+        return false;
+    }
+
+    list.transforms.resize(header.transform_count);
+    list.ops.resize(header.op_count);
+    memcpy(list.transforms.data(), data + sizeof(header), transform_bytes);
+    memcpy(list.ops.data(), data + sizeof(header) + transform_bytes, op_bytes);
+
+    for (auto&& op : list.ops)
+    {
+        if (op.command > DisplayCommand::draw_glyph ||
+            (op.command == DisplayCommand::set_transform && op.slot >= header.transform_count))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,220 @@
+// clock-eink: simulates the clock on an e-paper panel. The clock ticks once a minute with no
+// second hand, each frame is quantised to 1-bit or 4-level grey, and the panel refreshes only
+// the tiles that changed, with a full refresh every K partial ones. It runs as fast as it can
+// over a span of virtual time and reports how much of the panel was refreshed per hour:
+//
+//   clock-eink --hours 24 --levels 2 --dither blue --full-every 30 --png panel.png
+//
+// Only the standard library is needed, so it also builds elsewhere, for example:
+//
+//   g++ -std=c++17 -O2 -pthread EInk.cpp -o clock-eink
+
+#include "EInk.h"
+#include "Png.h"
+#include "Raster.h"
+#include "TimeSource.h"
+#include "Wall.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct Options
+{
+    uint32_t width = 800;
+    uint32_t height = 480;
+    uint32_t count = 1;
+    uint32_t levels = 2;
+    uint32_t full_every = 30;
+    Dither dither = Dither::ordered;
+    float dpi = 96.0f;
+    double start = 10 * 3600.0 + 8 * 60.0;
+    double hours = 24.0;
+    char const* png = nullptr;
+};
+
+static void usage()
+{
+    fputs("usage: clock-eink [options]\n"
+        "  --size WxH        panel size in pixels (800x480)\n"
+        "  --levels N        grey levels, 2 or 4 (2)\n"
+        "  --dither KIND     ordered or blue (ordered)\n"
+        "  --full-every K    partial refreshes between full ones, 0 for never (30)\n"
+        "  --start HH:MM     local time of the first frame (10:08)\n"
+        "  --hours H         hours of virtual time, at least a minute (24)\n"
+        "  --dpi N           scene DPI (96)\n"
+        "  --wall N          number of clocks (1)\n"
+        "  --png PATH        write the last frame shown as a PNG\n",
+        stderr);
+}
+
+static bool parse_options(int const argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 == argc)
+        {
+            return false;
+        }
+
+        auto const name = argv[i];
+        auto const value = argv[i + 1];
+
+        if (!strcmp(name, "--size"))
+        {
+            if (2 != sscanf(value, "%ux%u", &options.width, &options.height))
+            {
+                return false;
+            }
+        }
+        else if (!strcmp(name, "--levels"))
+        {
+            options.levels = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (!strcmp(name, "--dither"))
+        {
+            if (!strcmp(value, "ordered"))
+            {
+                options.dither = Dither::ordered;
+            }
+            else if (!strcmp(value, "blue"))
+            {
+                options.dither = Dither::blue_noise;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (!strcmp(name, "--full-every"))
+        {
+            options.full_every = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (!strcmp(name, "--start"))
+        {
+            unsigned hour = 0, minute = 0;
+
+            if (2 != sscanf(value, "%u:%u", &hour, &minute) || hour > 23 || minute > 59)
+            {
+                return false;
+            }
+
+            options.start = hour * 3600.0 + minute * 60.0;
+        }
+        else if (!strcmp(name, "--hours"))
+        {
+            options.hours = strtod(value, nullptr);
+        }
+        else if (!strcmp(name, "--dpi"))
+        {
+            options.dpi = static_cast<float>(strtod(value, nullptr));
+        }
+        else if (!strcmp(name, "--wall"))
+        {
+            options.count = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (!strcmp(name, "--png"))
+        {
+            options.png = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.width && options.height && (2 == options.levels || 4 == options.levels) &&
+        options.hours * 60.0 >= 1.0 && options.count && options.count <= 1024 && options.dpi > 0.0f;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    if (!parse_options(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    auto const scale = 96.0f / options.dpi;
+    auto scene = record_wall(options.count, options.width * scale, options.height * scale, false);
+    auto const offsets = wall_offsets(options.count);
+    std::vector<HandAngles> angles(options.count);
+    SoftwareScene software(options.width, options.height, options.dpi, scene.dials);
+    Canvas frame;
+
+    std::vector<uint8_t> levels(size_t{ options.width } * options.height);
+    EInkPanel panel(options.width, options.height, options.full_every);
+    auto const minutes = static_cast<uint64_t>(options.hours * 60.0);
+    auto time = TimeSource::stepped(static_cast<int64_t>(options.start) * 1000000, 60000000);
+    double render = 0.0, quantise_time = 0.0, diff = 0.0;
+
+    for (uint64_t minute = 0; minute != minutes; ++minute)
+    {
+        auto const began = std::chrono::steady_clock::now();
+        wall_angles(day_seconds(time.now(), 0), offsets.data(), options.count, angles.data());
+        patch_wall(scene, angles.data());
+        software.draw(frame, scene.hands);
+
+        auto const drawn = std::chrono::steady_clock::now();
+        quantise(frame.data(), options.width, options.height, options.levels, options.dither, levels.data());
+
+        auto const quantised = std::chrono::steady_clock::now();
+        panel.present(levels.data());
+
+        auto const presented = std::chrono::steady_clock::now();
+        render += std::chrono::duration<double>(drawn - began).count();
+        quantise_time += std::chrono::duration<double>(quantised - drawn).count();
+        diff += std::chrono::duration<double>(presented - quantised).count();
+        time.advance();
+    }
+
+    auto const panel_area = static_cast<double>(options.width) * options.height;
+    auto const hours = minutes / 60.0;
+    auto const partials = panel.partial_refreshes();
+
+    fprintf(stderr, "clock-eink: %llu minutes, %llu partial refreshes (%.1f rects, %.2f%% of the panel each), %llu full\n",
+        static_cast<unsigned long long>(minutes),
+        static_cast<unsigned long long>(partials),
+        partials ? static_cast<double>(panel.partial_rects()) / partials : 0.0,
+        partials ? panel.partial_area() * 100.0 / panel_area / partials : 0.0,
+        static_cast<unsigned long long>(panel.full_refreshes()));
+
+    fprintf(stderr, "clock-eink: per hour %.2f panels refreshed (%.2f partial, %.2f full)\n",
+        (panel.partial_area() + panel.full_area()) / panel_area / hours,
+        panel.partial_area() / panel_area / hours,
+        panel.full_area() / panel_area / hours);
+
+    fprintf(stderr, "clock-eink: per frame %.2f ms render, %.3f ms quantise, %.3f ms diff\n",
+        render * 1000.0 / minutes,
+        quantise_time * 1000.0 / minutes,
+        diff * 1000.0 / minutes);
+
+    if (options.png && minutes)
+    {
+        // Levels are spread evenly from black to white.
+
+        std::vector<uint32_t> grey(levels.size());
+
+        for (size_t i = 0; i != grey.size(); ++i)
+        {
+            auto const value = panel.shown()[i] * 255u / (options.levels - 1);
+            grey[i] = 0xff000000 | value << 16 | value << 8 | value;
+        }
+
+        auto const bytes = encode_png(grey.data(), options.width, options.height);
+        auto const file = fopen(options.png, "wb");
+
+        if (!file || bytes.size() != fwrite(bytes.data(), 1, bytes.size(), file))
+        {
+            perror(options.png);
+            return 1;
+        }
+
+        fclose(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,452 @@
+#pragma once
+
+#include "Raster.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLOCK_SSE2
+#endif
+
+// Output for e-paper panels, where every refresh is slow and a full refresh flashes the screen.
+// Frames are quantised to 1-bit or 4-level grey with a tiled threshold map: either the 8x8 Bayer
+// matrix or a 64x64 blue-noise map, whose grain is less regular on the dial's long curves. Only
+// the tiles whose quantised pixels changed are refreshed, and a full refresh is scheduled once
+// every few partial ones to clear the ghosting that partial refreshes leave behind.
+
+enum class Dither : uint8_t
+{
+    ordered,
+    blue_noise,
+};
+
+struct ThresholdMap
+{
+    uint32_t size;                  // a power of two
+    std::vector<uint8_t> values;    // size * size thresholds in [0, 255]
+};
+
+inline ThresholdMap const& bayer_map()
+{
+    static ThresholdMap const map = []
+    {
+        ThresholdMap map{ 8, std::vector<uint8_t>(64) };
+
+        for (uint32_t y = 0; y != 8; ++y)
+        {
+            for (uint32_t x = 0; x != 8; ++x)
+            {
+                // Interleaves the bits of x ^ y and y, most significant pair first.
+
+                uint32_t rank = 0;
+
+                for (uint32_t bit = 0; bit != 3; ++bit)
+                {
+                    rank = rank << 2 | ((x ^ y) >> (2 - bit) & 1) << 1 | (y >> (2 - bit) & 1);
+                }
+
+                map.values[y * 8 + x] = static_cast<uint8_t>(rank * 4 + 2);
+            }
+        }
+
+        return map;
+    }();
+
+    return map;
+}
+
+// Builds a blue-noise map with the void-and-cluster method: starting from a relaxed sparse
+// pattern, pixels are ranked by repeatedly removing the tightest cluster and then filling the
+// largest void, with both measured by a Gaussian that wraps around the tile.
+
+inline ThresholdMap const& blue_noise_map()
+{
+    static ThresholdMap const map = []
+    {
+        constexpr uint32_t size = 64;
+        constexpr uint32_t count = size * size;
+        constexpr float sigma = 1.5f;
+
+        std::vector<float> kernel(count);
+
+        for (uint32_t y = 0; y != size; ++y)
+        {
+            for (uint32_t x = 0; x != size; ++x)
+            {
+                auto const dx = static_cast<float>(std::min(x, size - x));
+                auto const dy = static_cast<float>(std::min(y, size - y));
+                kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+        }
+
+        std::vector<uint8_t> pattern(count);
+        std::vector<float> energy(count);
+
+        auto const toggle = [&](uint32_t const index, bool const on)
+        {
+            pattern[index] = on;
+            auto const px = index % size;
+            auto const py = index / size;
+            auto const sign = on ? 1.0f : -1.0f;
+
+            for (uint32_t y = 0; y != size; ++y)
+            {
+                auto const row = ((y - py) & (size - 1)) * size;
+
+                for (uint32_t x = 0; x != size; ++x)
+                {
+                    energy[y * size + x] += sign * kernel[row + ((x - px) & (size - 1))];
+                }
+            }
+        };
+
+        // The tightest cluster is the set pixel with the most energy; the largest void is the
+        // clear pixel with the least.
+
+        auto const find = [&](bool const set)
+        {
+            uint32_t best = 0;
+            auto value = set ? -1.0f : 1e30f;
+
+            for (uint32_t index = 0; index != count; ++index)
+            {
+                if (pattern[index] == set && (set ? energy[index] > value : energy[index] < value))
+                {
+                    best = index;
+                    value = energy[index];
+                }
+            }
+
+            return best;
+        };
+
+        uint32_t seed = 0x2545f491;
+        uint32_t ones = 0;
+
+        while (ones != count / 10)
+        {
+            seed = seed * 1664525 + 1013904223;
+            auto const index = (seed >> 8) % count;
+
+            if (!pattern[index])
+            {
+                toggle(index, true);
+                ++ones;
+            }
+        }
+
+        while (true)
+        {
+            auto const cluster = find(true);
+            toggle(cluster, false);
+            auto const hole = find(false);
+
+            if (hole == cluster)
+            {
+                toggle(cluster, true);
+                break;
+            }
+
+            toggle(hole, true);
+        }
+
+        std::vector<uint32_t> rank(count);
+        auto const initial = pattern;
+        auto const initial_energy = energy;
+
+        for (auto remaining = ones; remaining--;)
+        {
+            auto const cluster = find(true);
+            toggle(cluster, false);
+            rank[cluster] = remaining;
+        }
+
+        pattern = initial;
+        energy = initial_energy;
+
+        for (auto placed = ones; placed != count; ++placed)
+        {
+            auto const hole = find(false);
+            toggle(hole, true);
+            rank[hole] = placed;
+        }
+
+        ThresholdMap map{ size, std::vector<uint8_t>(count) };
+
+        for (uint32_t index = 0; index != count; ++index)
+        {
+            map.values[index] = static_cast<uint8_t>(rank[index] * 256 / count);
+        }
+
+        return map;
+    }();
+
+    return map;
+}
+
+inline ThresholdMap const& threshold_map(Dither const dither)
+{
+    return Dither::ordered == dither ? bayer_map() : blue_noise_map();
+}
+
+// Quantises a row of opaque BGRA pixels to levels 0 (black) to levels - 1 (white). Each pixel's
+// grey, stretched to [0, 256] so that white stays clear of dots and scaled by levels - 1, is
+// offset by its threshold, so that a grey between two levels is rounded up at a proportion of
+// the pixels. Eight pixels are done at a time with SSE2 where available.
+
+inline void quantise_row(uint32_t const* source, uint8_t* output, uint32_t const width, uint32_t const levels, uint8_t const* thresholds, uint32_t const mask) noexcept
+{
+    uint32_t x = 0;
+
+#ifdef CLOCK_SSE2
+    if (mask >= 7)
+    {
+        auto const zero = _mm_setzero_si128();
+        auto const coefficients = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+        auto const scale = _mm_set1_epi16(static_cast<short>(levels - 1));
+
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i greys[2];
+
+            for (int half = 0; half != 2; ++half)
+            {
+                auto const pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + x + half * 4));
+                auto low = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coefficients);
+                auto high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coefficients);
+                low = _mm_add_epi32(low, _mm_srli_epi64(low, 32));
+                high = _mm_add_epi32(high, _mm_srli_epi64(high, 32));
+
+                auto const sums = _mm_unpacklo_epi64(_mm_shuffle_epi32(low, _MM_SHUFFLE(3, 3, 2, 0)),
+                    _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 3, 2, 0)));
+
+                greys[half] = _mm_srli_epi32(sums, 8);
+            }
+
+            // The map is a multiple of eight wide, so the eight thresholds are contiguous.
+
+            auto const threshold = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(thresholds + (x & mask))), zero);
+
+            // Eight greys in 16-bit lanes, scaled and offset, stay below 4 * 256.
+
+            auto grey = _mm_packs_epi32(greys[0], greys[1]);
+            grey = _mm_add_epi16(grey, _mm_srli_epi16(grey, 7));
+            auto const level = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(grey, scale), threshold), 8);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(output + x), _mm_packus_epi16(level, level));
+        }
+    }
+#endif
+
+    for (; x < width; ++x)
+    {
+        auto const pixel = source[x];
+        auto grey = (29 * (pixel & 0xff) + 150 * (pixel >> 8 & 0xff) + 77 * (pixel >> 16 & 0xff)) >> 8;
+        grey += grey >> 7;
+        output[x] = static_cast<uint8_t>((grey * (levels - 1) + thresholds[x & mask]) >> 8);
+    }
+}
+
+inline void quantise(uint32_t const* pixels, uint32_t const width, uint32_t const height, uint32_t const levels, Dither const dither, uint8_t* output) noexcept
+{
+    auto const& map = threshold_map(dither);
+
+    for (uint32_t y = 0; y != height; ++y)
+    {
+        quantise_row(pixels + size_t{ y } * width, output + size_t{ y } * width, width, levels,
+            map.values.data() + (y & (map.size - 1)) * map.size, map.size - 1);
+    }
+}
+
+// Finds the rectangles that cover every changed pixel, at the granularity of tiles, which keeps
+// x aligned to the bytes that 1-bit panel controllers address. Runs of changed tiles on a row of
+// tiles continue a rectangle from the row above when they span the same columns. Rectangles are
+// then merged wherever the merged rectangle wastes no more than slack pixels, since every partial
+// refresh has a fixed cost of its own.
+
+constexpr uint32_t eink_tile = 8;
+
+inline std::vector<PixelRect> changed_rects(uint8_t const* previous, uint8_t const* current, uint32_t const width, uint32_t const height, uint32_t const slack = eink_tile * eink_tile * 16)
+{
+    auto const columns = (width + eink_tile - 1) / eink_tile;
+    std::vector<uint8_t> changed(columns);
+    std::vector<PixelRect> open;
+    std::vector<PixelRect> rects;
+
+    for (uint32_t top = 0; top < height; top += eink_tile)
+    {
+        auto const bottom = std::min(height, top + eink_tile);
+        std::fill(changed.begin(), changed.end(), uint8_t{});
+
+        for (auto y = top; y != bottom; ++y)
+        {
+            auto const offset = size_t{ y } * width;
+
+            for (uint32_t x = 0; x < width; x += eink_tile)
+            {
+                auto const length = std::min(eink_tile, width - x);
+                changed[x / eink_tile] |= 0 != memcmp(previous + offset + x, current + offset + x, length);
+            }
+        }
+
+        std::vector<PixelRect> next;
+
+        for (uint32_t column = 0; column != columns;)
+        {
+            if (!changed[column])
+            {
+                ++column;
+                continue;
+            }
+
+            auto const first = column;
+
+            while (column != columns && changed[column])
+            {
+                ++column;
+            }
+
+            PixelRect run{ static_cast<int32_t>(first * eink_tile), static_cast<int32_t>(top),
+                static_cast<int32_t>(std::min(width, column * eink_tile)), static_cast<int32_t>(bottom) };
+
+            auto const above = std::find_if(open.begin(), open.end(), [&](PixelRect const& rect)
+            {
+                return rect.left == run.left && rect.right == run.right;
+            });
+
+            if (above != open.end())
+            {
+                run.top = above->top;
+                open.erase(above);
+            }
+
+            next.push_back(run);
+        }
+
+        rects.insert(rects.end(), open.begin(), open.end());
+        open.swap(next);
+    }
+
+    rects.insert(rects.end(), open.begin(), open.end());
+
+    for (bool merged = true; merged;)
+    {
+        merged = false;
+
+        for (size_t i = 0; i < rects.size() && !merged; ++i)
+        {
+            for (size_t j = i + 1; j < rects.size(); ++j)
+            {
+                auto const both = unite(rects[i], rects[j]);
+
+                if (both.area() <= rects[i].area() + rects[j].area() + slack)
+                {
+                    rects[i] = both;
+                    rects.erase(rects.begin() + static_cast<ptrdiff_t>(j));
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return rects;
+}
+
+// A simulated panel that takes quantised frames, refreshing only what changed, except that every
+// full_every-th update refreshes the whole panel. Area is counted in pixels.
+
+struct EInkPanel
+{
+    EInkPanel(uint32_t const width, uint32_t const height, uint32_t const full_every) :
+        m_width(width),
+        m_height(height),
+        m_full_every(full_every),
+        m_shown(size_t{ width } * height, 0xff)
+    {
+    }
+
+    // Returns the rectangles refreshed, which are empty if the frame showed nothing new.
+
+    std::vector<PixelRect> present(uint8_t const* frame)
+    {
+        auto rects = changed_rects(m_shown.data(), frame, m_width, m_height);
+
+        if (rects.empty() && m_updates)
+        {
+            return rects;
+        }
+
+        ++m_updates;
+
+        if (1 == m_updates || (m_full_every && ++m_partials > m_full_every))
+        {
+            rects = { PixelRect{ 0, 0, static_cast<int32_t>(m_width), static_cast<int32_t>(m_height) } };
+            m_partials = 0;
+            ++m_full;
+            m_full_area += rects[0].area();
+        }
+        else
+        {
+            ++m_partial;
+
+            for (auto&& rect : rects)
+            {
+                m_partial_area += rect.area();
+            }
+
+            m_partial_rects += rects.size();
+        }
+
+        std::copy(frame, frame + m_shown.size(), m_shown.begin());
+        return rects;
+    }
+
+    uint8_t const* shown() const noexcept
+    {
+        return m_shown.data();
+    }
+
+    uint64_t full_refreshes() const noexcept
+    {
+        return m_full;
+    }
+
+    uint64_t partial_refreshes() const noexcept
+    {
+        return m_partial;
+    }
+
+    uint64_t partial_rects() const noexcept
+    {
+        return m_partial_rects;
+    }
+
+    uint64_t full_area() const noexcept
+    {
+        return m_full_area;
+    }
+
+    uint64_t partial_area() const noexcept
+    {
+        return m_partial_area;
+    }
+
+private:
+
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_full_every;
+    std::vector<uint8_t> m_shown;
+    uint64_t m_updates{};
+    uint32_t m_partials{};
+    uint64_t m_full{};
+    uint64_t m_partial{};
+    uint64_t m_partial_rects{};
+    uint64_t m_full_area{};
+    uint64_t m_partial_area{};
+};
@@ -0,0 +1,170 @@
+// clock-frames: a sample consumer of the shared-memory frame ring published by "Clock.exe
+// /export:NAME" or "clock-render --export NAME". It keeps a private copy of the frame up to date
+// by copying only the dirty rectangle of each frame that directly follows the last one it saw,
+// checks every read for tearing, and reports what it observed:
+//
+//   clock-frames clock --seconds 10 --png latest.png
+//
+// Only the standard library and the platform's shared memory are needed, so it also builds
+// elsewhere, for example:
+//
+//   g++ -std=c++17 -O2 -pthread FrameConsumer.cpp -o clock-frames -lrt
+
+#include "FrameRing.h"
+#include "Png.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static void usage()
+{
+    fputs("usage: clock-frames NAME [options]\n"
+        "  --seconds S       how long to watch (10)\n"
+        "  --png PATH        write the last frame seen as a PNG\n",
+        stderr);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage();
+        return 1;
+    }
+
+    auto const name = argv[1];
+    double seconds = 10.0;
+    char const* png = nullptr;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (i + 1 == argc)
+        {
+            usage();
+            return 1;
+        }
+
+        if (!strcmp(argv[i], "--seconds"))
+        {
+            seconds = strtod(argv[++i], nullptr);
+        }
+        else if (!strcmp(argv[i], "--png"))
+        {
+            png = argv[++i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    FrameRingReader reader;
+    auto const began = std::chrono::steady_clock::now();
+    auto const deadline = began + std::chrono::duration<double>(seconds);
+
+    while (!reader.open(name))
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            fprintf(stderr, "clock-frames: no frame ring named %s\n", name);
+            return 1;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    std::vector<uint32_t> copy;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t last = 0;
+    uint64_t seen = 0, missed = 0, torn = 0, partial = 0;
+    uint64_t copied = 0;
+    double latency = 0.0;
+
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        if (reader.latest_frame() == last)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        FrameView view;
+
+        if (!reader.latest(view))
+        {
+            continue;
+        }
+
+        // Only the dirty rectangle needs copying when nothing was skipped in between.
+
+        auto region = view.dirty;
+        auto const contiguous = view.frame == last + 1 && view.width == width && view.height == height;
+
+        if (!contiguous)
+        {
+            width = view.width;
+            height = view.height;
+            copy.resize(size_t{ width } * height);
+            region = { 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) };
+        }
+
+        for (auto y = region.top; y < region.bottom; ++y)
+        {
+            memcpy(copy.data() + size_t{ static_cast<uint32_t>(y) } * width + region.left,
+                view.pixels + size_t{ static_cast<uint32_t>(y) } * view.stride + region.left,
+                size_t{ static_cast<uint32_t>(region.right - region.left) } * 4);
+        }
+
+        if (!reader.valid(view))
+        {
+            // The producer lapped this read, so the copy is forced back to a full refresh.
+
+            ++torn;
+            last = 0;
+            continue;
+        }
+
+        if (last && view.frame > last + 1)
+        {
+            missed += view.frame - last - 1;
+        }
+
+        last = view.frame;
+        partial += contiguous;
+        ++seen;
+        copied += static_cast<uint64_t>(region.area()) * 4;
+
+        auto const now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        latency += static_cast<double>(now - view.time);
+    }
+
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+
+    fprintf(stderr, "clock-frames: %llu frames (%.1f fps), %llu missed, %llu torn, %llu partial, %.2f MB/s copied, %.0f us mean latency\n",
+        static_cast<unsigned long long>(seen),
+        seen / elapsed,
+        static_cast<unsigned long long>(missed),
+        static_cast<unsigned long long>(torn),
+        static_cast<unsigned long long>(partial),
+        copied / elapsed / 1e6,
+        seen ? latency / seen : 0.0);
+
+    if (png && seen)
+    {
+        auto const bytes = encode_png(copy.data(), width, height);
+        auto const file = fopen(png, "wb");
+
+        if (!file || bytes.size() != fwrite(bytes.data(), 1, bytes.size(), file))
+        {
+            perror(png);
+            return 1;
+        }
+
+        fclose(file);
+    }
+
+    return 0;
+}
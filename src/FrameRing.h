@@ -0,0 +1,246 @@
+#pragma once
+
+#include "Raster.h"
+#include "SharedMemory.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Publishes rendered frames to other processes through a ring of BGRA buffers in shared memory.
+// Each slot is guarded by a sequence lock: the producer makes the sequence odd while it writes
+// and even again once the frame is complete. Consumers read the newest frame in place and check
+// afterwards that the sequence has not moved, which tells them whether the read was torn. With
+// three or more slots the producer is two frames away from overwriting the newest one.
+//
+// The mapping holds a FrameRingHeader, then the FrameSlot array, then the pixels of each slot,
+// every row capacity_width pixels long.
+
+constexpr uint32_t frame_ring_magic = 0x5246434b; // "KCFR"
+constexpr uint32_t frame_ring_version = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence must be usable across processes");
+
+struct alignas(64) FrameSlot
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t frame;         // counting from 1
+    int64_t time;           // microseconds since 1970 when the frame was published
+    uint32_t width;
+    uint32_t height;
+    PixelRect dirty;        // what changed since frame - 1
+};
+
+struct alignas(64) FrameRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity_width;
+    uint32_t capacity_height;
+    uint32_t slots;
+    uint32_t reserved;
+    uint64_t pixels_offset;
+    uint64_t slot_size;
+    std::atomic<uint64_t> latest;   // newest complete frame, zero before the first
+};
+
+inline size_t frame_ring_size(uint32_t const width, uint32_t const height, uint32_t const slots) noexcept
+{
+    auto const pixels = (sizeof(FrameRingHeader) + sizeof(FrameSlot) * slots + 4095) & ~size_t{ 4095 };
+    return pixels + size_t{ width } * height * 4 * slots;
+}
+
+struct FrameRingWriter
+{
+    FrameRingWriter(std::string const& name, uint32_t const width, uint32_t const height, uint32_t const slots = 3) :
+        m_memory(SharedMemory::create(name, frame_ring_size(width, height, slots))),
+        m_history(slots)
+    {
+        if (!m_memory)
+        {
+            throw std::runtime_error("FrameRingWriter: cannot create " + name);
+        }
+
+        m_header = new (m_memory.data()) FrameRingHeader{};
+        m_header->capacity_width = width;
+        m_header->capacity_height = height;
+        m_header->slots = slots;
+        m_header->pixels_offset = frame_ring_size(width, height, slots) - size_t{ width } * height * 4 * slots;
+        m_header->slot_size = size_t{ width } * height * 4;
+        m_slots = reinterpret_cast<FrameSlot*>(m_header + 1);
+
+        for (uint32_t i = 0; i != slots; ++i)
+        {
+            new (m_slots + i) FrameSlot{};
+        }
+
+        // The magic is written last so that a consumer never sees a half initialised header.
+
+        m_header->version = frame_ring_version;
+        std::atomic_thread_fence(std::memory_order_release);
+        m_header->magic = frame_ring_magic;
+    }
+
+    uint32_t capacity_width() const noexcept
+    {
+        return m_header->capacity_width;
+    }
+
+    uint32_t capacity_height() const noexcept
+    {
+        return m_header->capacity_height;
+    }
+
+    // Publishes a frame no larger than the capacity, given what changed since the previous one.
+    // The slot still holds the frame from a full lap ago, so copy(pixels, stride, region) only has
+    // to fill in the region that changed since then. Returns the frame number.
+
+    template <typename Copy>
+    uint64_t publish(uint32_t width, uint32_t height, PixelRect dirty, Copy&& copy)
+    {
+        width = std::min(width, m_header->capacity_width);
+        height = std::min(height, m_header->capacity_height);
+        PixelRect const full{ 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) };
+        dirty = width == m_width && height == m_height ? intersect(dirty, full) : full;
+        m_width = width;
+        m_height = height;
+
+        auto const frame = ++m_frame;
+        auto& slot = m_slots[frame % m_header->slots];
+        m_history[frame % m_history.size()] = dirty;
+        auto stale = slot.width == width && slot.height == height ? PixelRect{} : full;
+
+        for (auto&& rect : m_history)
+        {
+            stale = unite(stale, rect);
+        }
+
+        auto const sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        auto const pixels = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(m_memory.data()) + m_header->pixels_offset + m_header->slot_size * (frame % m_header->slots));
+        copy(pixels, m_header->capacity_width, intersect(stale, full));
+
+        slot.frame = frame;
+        slot.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        slot.width = width;
+        slot.height = height;
+        slot.dirty = dirty;
+
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        m_header->latest.store(frame, std::memory_order_release);
+        return frame;
+    }
+
+private:
+
+    SharedMemory m_memory;
+    FrameRingHeader* m_header{};
+    FrameSlot* m_slots{};
+    std::vector<PixelRect> m_history;
+    uint64_t m_frame{};
+    uint32_t m_width{};
+    uint32_t m_height{};
+};
+
+// A frame read in place from the ring. stride is in pixels.
+
+struct FrameView
+{
+    FrameSlot const* slot;
+    uint64_t sequence;
+    uint64_t frame;
+    int64_t time;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    PixelRect dirty;
+    uint32_t const* pixels;
+};
+
+struct FrameRingReader
+{
+    bool open(std::string const& name)
+    {
+        m_memory = SharedMemory::open(name);
+
+        if (!m_memory || m_memory.size() < sizeof(FrameRingHeader))
+        {
+            return false;
+        }
+
+        m_header = static_cast<FrameRingHeader const*>(m_memory.data());
+
+        if (m_header->magic != frame_ring_magic)
+        {
+            return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return m_header->version == frame_ring_version && m_header->slots &&
+            m_memory.size() >= frame_ring_size(m_header->capacity_width, m_header->capacity_height, m_header->slots);
+    }
+
+    uint64_t latest_frame() const noexcept
+    {
+        return m_header->latest.load(std::memory_order_acquire);
+    }
+
+    // Finds the newest complete frame. The pixels are not copied, so once they have been used
+    // valid() must be checked: if the producer has since started to overwrite the slot, whatever
+    // was read may be torn.
+
+    bool latest(FrameView& view) const noexcept
+    {
+        for (int attempt = 0; attempt != 16; ++attempt)
+        {
+            auto const frame = latest_frame();
+
+            if (!frame)
+            {
+                return false;
+            }
+
+            auto const index = frame % m_header->slots;
+            auto const& slot = reinterpret_cast<FrameSlot const*>(m_header + 1)[index];
+            auto const sequence = slot.sequence.load(std::memory_order_acquire);
+
+            if (sequence & 1)
+            {
+                continue;
+            }
+
+            view.slot = &slot;
+            view.sequence = sequence;
+            view.frame = slot.frame;
+            view.time = slot.time;
+            view.width = slot.width;
+            view.height = slot.height;
+            view.stride = m_header->capacity_width;
+            view.dirty = slot.dirty;
+            view.pixels = reinterpret_cast<uint32_t const*>(static_cast<uint8_t const*>(m_memory.data()) + m_header->pixels_offset + m_header->slot_size * index);
+
+            if (valid(view))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool valid(FrameView const& view) const noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return view.slot->sequence.load(std::memory_order_relaxed) == view.sequence;
+    }
+
+private:
+
+    SharedMemory m_memory;
+    FrameRingHeader const* m_header{};
+};
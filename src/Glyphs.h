@@ -0,0 +1,428 @@
+#pragma once
+
+#include "DisplayList.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Text is drawn from a glyph atlas rather than laid out every frame. Each glyph a font needs is
+// rasterised once, for one size and DPI, into 8-bit coverage packed into a single bitmap, and
+// text becomes one display list op per glyph naming its box in the atlas. Drawing a glyph is then
+// a copy of its coverage through the brush, on the CPU as much as on the GPU.
+//
+// On Windows the glyphs come from DirectWrite. Elsewhere, and for testing, a built-in 5x7 bitmap
+// font covers the digits and the colon that the dial numerals and the digital readout need.
+
+// A glyph's place in the atlas, and where its box sits relative to the pen on the baseline, all
+// in pixels.
+
+struct GlyphBox
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    int16_t left;
+    int16_t top;
+    float advance;
+};
+
+struct GlyphAtlas
+{
+    float size;         // em, in DIPs
+    float dpi;
+    float ascent;       // height of the digits above the baseline, in pixels
+    float digit;        // advance of the widest digit, in pixels
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> alpha;
+    std::array<GlyphBox, 128> glyphs;
+
+    GlyphBox const& glyph(uint16_t const code) const noexcept
+    {
+        return glyphs[code < glyphs.size() ? code : ' '];
+    }
+};
+
+// Atlases are cached under the font, the size and the DPI they were rasterised for.
+
+struct GlyphKey
+{
+    uint32_t font;
+    float size;
+    float dpi;
+
+    bool operator==(GlyphKey const& other) const noexcept
+    {
+        return font == other.font && size == other.size && dpi == other.dpi;
+    }
+};
+
+// Layout matches D2D1_RECT_F.
+
+struct GlyphRect
+{
+    float left;
+    float top;
+    float right;
+    float bottom;
+};
+
+// Rasterises each of the characters with raster(code, coverage, box), which fills width by height
+// bytes of coverage and the box's size, offset and advance, then packs them in rows, tallest
+// first, a pixel apart so that sampling one never picks up its neighbours.
+
+template <typename Raster>
+GlyphAtlas build_atlas(float const size, float const dpi, std::string_view const characters, Raster&& raster)
+{
+    GlyphAtlas atlas{ size, dpi, 0.0f, 0.0f, 0, 0, {}, {} };
+    std::vector<std::vector<uint8_t>> coverage(characters.size());
+    std::vector<size_t> order;
+    uint64_t area = 0;
+    uint32_t widest = 0;
+
+    for (size_t index = 0; index != characters.size(); ++index)
+    {
+        auto const code = static_cast<uint8_t>(characters[index]);
+
+        if (code >= atlas.glyphs.size())
+        {
+            continue;
+        }
+
+        auto& box = atlas.glyphs[code];
+        raster(code, coverage[index], box);
+        order.push_back(index);
+        area += uint64_t{ box.width + 1u } * (box.height + 1u);
+        widest = std::max(widest, box.width + 1u);
+
+        if (code >= '0' && code <= '9')
+        {
+            atlas.ascent = std::max(atlas.ascent, static_cast<float>(-box.top));
+            atlas.digit = std::max(atlas.digit, box.advance);
+        }
+    }
+
+    std::sort(order.begin(), order.end(), [&](size_t const a, size_t const b)
+    {
+        return atlas.glyphs[static_cast<uint8_t>(characters[a])].height > atlas.glyphs[static_cast<uint8_t>(characters[b])].height;
+    });
+
+    atlas.width = 16;
+
+    while (atlas.width < widest || uint64_t{ atlas.width } * atlas.width < area)
+    {
+        atlas.width *= 2;
+    }
+
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t shelf = 0;
+
+    for (auto index : order)
+    {
+        auto& box = atlas.glyphs[static_cast<uint8_t>(characters[index])];
+
+        if (x + box.width + 1 > atlas.width)
+        {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+
+        box.x = static_cast<uint16_t>(x);
+        box.y = static_cast<uint16_t>(y);
+        x += box.width + 1u;
+        shelf = std::max(shelf, box.height + 1u);
+    }
+
+    atlas.height = std::max(1u, y + shelf);
+    atlas.alpha.assign(size_t{ atlas.width } * atlas.height, 0);
+
+    for (auto index : order)
+    {
+        auto const& box = atlas.glyphs[static_cast<uint8_t>(characters[index])];
+
+        for (uint32_t row = 0; row != box.height; ++row)
+        {
+            std::copy_n(coverage[index].data() + size_t{ row } * box.width, box.width,
+                atlas.alpha.data() + size_t{ box.y + row } * atlas.width + box.x);
+        }
+    }
+
+    return atlas;
+}
+
+// Rows of the built-in font, top first, with the leftmost of the five columns in bit 4.
+
+inline uint8_t const* builtin_rows(uint8_t const code) noexcept
+{
+    static uint8_t const digits[10][7]
+    {
+        { 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e },
+        { 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e },
+        { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f },
+        { 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e },
+        { 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 },
+        { 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e },
+        { 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e },
+        { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+        { 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e },
+        { 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c },
+    };
+
+    static uint8_t const colon[7] = { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 };
+
+    if (code >= '0' && code <= '9')
+    {
+        return digits[code - '0'];
+    }
+
+    return ':' == code ? colon : nullptr;
+}
+
+constexpr uint32_t builtin_font = 0;
+
+// Each cell of the built-in font is a tenth of the em square, with the glyphs seven cells tall
+// on the baseline and six cells apart. Coverage is the exact area of each pixel that the lit cells
+// cover, so the glyphs are anti-aliased at any size.
+
+inline GlyphAtlas builtin_atlas(float const size, float const dpi)
+{
+    auto const cell = size * dpi / 96.0f / 10.0f;
+
+    return build_atlas(size, dpi, "0123456789: ", [&](uint8_t const code, std::vector<uint8_t>& coverage, GlyphBox& box)
+    {
+        auto const rows = builtin_rows(code);
+        auto const left = std::floor(cell * 0.5f);
+        auto const top = std::floor(-cell * 7.0f);
+        box.advance = cell * 6.0f;
+
+        if (!rows)
+        {
+            return;
+        }
+
+        box.left = static_cast<int16_t>(left);
+        box.top = static_cast<int16_t>(top);
+        box.width = static_cast<uint16_t>(std::ceil(cell * 5.5f) - left);
+        box.height = static_cast<uint16_t>(-top);
+        std::vector<float> area(size_t{ box.width } * box.height);
+
+        for (int row = 0; row != 7; ++row)
+        {
+            for (int column = 0; column != 5; ++column)
+            {
+                if (!(rows[row] >> (4 - column) & 1))
+                {
+                    continue;
+                }
+
+                auto const x0 = cell * (column + 0.5f) - left;
+                auto const x1 = x0 + cell;
+                auto const y0 = cell * (row - 7.0f) - top;
+                auto const y1 = y0 + cell;
+
+                for (auto y = static_cast<int>(y0); y < std::min(static_cast<int>(std::ceil(y1)), static_cast<int>(box.height)); ++y)
+                {
+                    auto const high = std::min(y1, y + 1.0f) - std::max(y0, static_cast<float>(y));
+
+                    for (auto x = static_cast<int>(x0); x < std::min(static_cast<int>(std::ceil(x1)), static_cast<int>(box.width)); ++x)
+                    {
+                        area[size_t{ static_cast<uint32_t>(y) } * box.width + x] += high * (std::min(x1, x + 1.0f) - std::max(x0, static_cast<float>(x)));
+                    }
+                }
+            }
+        }
+
+        coverage.resize(area.size());
+
+        for (size_t index = 0; index != area.size(); ++index)
+        {
+            coverage[index] = static_cast<uint8_t>(std::min(1.0f, area[index]) * 255.0f + 0.5f);
+        }
+    });
+}
+
+inline GlyphRect glyph_rect(GlyphAtlas const& atlas, uint16_t const code, float const x, float const y)
+{
+    auto const scale = 96.0f / atlas.dpi;
+    auto const& box = atlas.glyph(code);
+    auto const left = x + box.left * scale;
+    auto const top = y + box.top * scale;
+    return { left, top, left + box.width * scale, top + box.height * scale };
+}
+
+// Records text with the pen starting at x on the baseline y, in DIPs. Returns where the pen ends.
+
+inline float record_text(DisplayList& list, GlyphAtlas const& atlas, std::string_view const text, float x, float const y)
+{
+    for (auto character : text)
+    {
+        auto const code = static_cast<uint8_t>(character);
+        auto const& box = atlas.glyph(code);
+
+        if (box.width)
+        {
+            auto const rect = glyph_rect(atlas, code, x, y);
+            list.ops.push_back({ DisplayCommand::draw_glyph, code, 0.0f, rect.left, rect.top, rect.right, rect.bottom });
+        }
+
+        x += box.advance * 96.0f / atlas.dpi;
+    }
+
+    return x;
+}
+
+inline float text_width(GlyphAtlas const& atlas, std::string_view const text)
+{
+    auto width = 0.0f;
+
+    for (auto character : text)
+    {
+        width += atlas.glyph(static_cast<uint8_t>(character)).advance;
+    }
+
+    return width * 96.0f / atlas.dpi;
+}
+
+// Hour numerals sit inside the dial, clear of the ring and beyond the reach of the hands, in an
+// atlas rasterised at numeral_size for the radius.
+
+inline float numeral_size(float const radius)
+{
+    return std::max(6.0f, std::round(radius * 0.16f));
+}
+
+inline void record_numerals(DisplayList& list, ClockGeometry const& geometry, GlyphAtlas const& atlas)
+{
+    auto const slot = static_cast<uint16_t>(list.transforms.size());
+    list.transforms.push_back(translation(geometry.x, geometry.y));
+    list.ops.push_back({ DisplayCommand::set_transform, slot, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    auto const height = atlas.ascent * 96.0f / atlas.dpi;
+
+    for (int hour = 1; hour <= 12; ++hour)
+    {
+        char text[3] = {};
+        auto const length = hour < 10 ? 1 : 2;
+        text[0] = static_cast<char>(hour < 10 ? '0' + hour : '1');
+        text[1] = static_cast<char>(hour < 10 ? 0 : '0' + hour - 10);
+
+        auto const radians = hour * 30.0f * 3.14159265358979f / 180.0f;
+        auto const x = std::sin(radians) * geometry.radius * 0.85f;
+        auto const y = -std::cos(radians) * geometry.radius * 0.85f;
+        std::string_view const numeral(text, length);
+        record_text(list, atlas, numeral, x - text_width(atlas, numeral) / 2.0f, y + height / 2.0f);
+    }
+}
+
+inline float readout_size(float const radius)
+{
+    return std::max(6.0f, std::round(radius * 0.12f));
+}
+
+// A digital HH:MM:SS readout centred on x with its baseline at y, in DIPs. Every digit has a cell
+// as wide as the widest digit, so that one changing never moves the others, and update() only
+// patches the glyphs of the cells that changed and reports which they were, so that only those
+// need drawing again.
+
+struct DigitalReadout
+{
+    static constexpr uint32_t cells = 8;
+
+    DigitalReadout(GlyphAtlas const& atlas, float const x, float const y) :
+        m_atlas(&atlas)
+    {
+        auto const scale = 96.0f / atlas.dpi;
+        auto const colon = atlas.glyph(':').advance;
+        auto left = x - (atlas.digit * 6.0f + colon * 2.0f) * scale / 2.0f;
+        auto top = 0.0f;
+        auto bottom = 0.0f;
+
+        for (auto character : std::string_view("0123456789:"))
+        {
+            auto const& box = atlas.glyph(static_cast<uint8_t>(character));
+            top = std::min(top, static_cast<float>(box.top));
+            bottom = std::max(bottom, static_cast<float>(box.top + box.height));
+        }
+
+        for (uint32_t cell = 0; cell != cells; ++cell)
+        {
+            auto const width = (cell % 3 == 2 ? colon : atlas.digit) * scale;
+            m_cells[cell] = { left, y + top * scale, left + width, y + bottom * scale };
+            left += width;
+        }
+
+        m_baseline = y;
+        m_list.transforms.push_back(identity());
+        m_list.ops.push_back({ DisplayCommand::set_transform, 0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+        m_list.ops.resize(1 + cells, { DisplayCommand::draw_glyph, ' ', 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    }
+
+    // Shows the given seconds since midnight. Returns a mask of the cells that changed.
+
+    uint32_t update(uint32_t const seconds)
+    {
+        auto const hour = seconds / 3600 % 24;
+        auto const minute = seconds / 60 % 60;
+        auto const second = seconds % 60;
+
+        char const text[cells]
+        {
+            static_cast<char>('0' + hour / 10), static_cast<char>('0' + hour % 10), ':',
+            static_cast<char>('0' + minute / 10), static_cast<char>('0' + minute % 10), ':',
+            static_cast<char>('0' + second / 10), static_cast<char>('0' + second % 10),
+        };
+
+        uint32_t changed = 0;
+
+        for (uint32_t cell = 0; cell != cells; ++cell)
+        {
+            auto& op = m_list.ops[1 + cell];
+            auto const code = static_cast<uint16_t>(static_cast<uint8_t>(text[cell]));
+
+            if (op.slot == code && op.x1 > op.x0)
+            {
+                continue;
+            }
+
+            auto const& bounds = m_cells[cell];
+            auto const pen = bounds.left + (bounds.right - bounds.left - m_atlas->glyph(code).advance * 96.0f / m_atlas->dpi) / 2.0f;
+            auto const rect = glyph_rect(*m_atlas, code, pen, m_baseline);
+            op = { DisplayCommand::draw_glyph, code, 0.0f, rect.left, rect.top, rect.right, rect.bottom };
+            changed |= 1u << cell;
+        }
+
+        return changed;
+    }
+
+    DisplayList const& list() const noexcept
+    {
+        return m_list;
+    }
+
+    DisplayOp const& glyph(uint32_t const cell) const noexcept
+    {
+        return m_list.ops[1 + cell];
+    }
+
+    GlyphRect const& cell(uint32_t const index) const noexcept
+    {
+        return m_cells[index];
+    }
+
+    GlyphRect bounds() const noexcept
+    {
+        return { m_cells[0].left, m_cells[0].top, m_cells[cells - 1].right, m_cells[cells - 1].bottom };
+    }
+
+private:
+
+    GlyphAtlas const* m_atlas;
+    DisplayList m_list;
+    GlyphRect m_cells[cells];
+    float m_baseline;
+};
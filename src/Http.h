@@ -0,0 +1,442 @@
+#pragma once
+
+#include "Snapshot.h"
+#include "Socket.h"
+#include "TimeZones.h"
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Parses a time zone given as a UTC offset: "UTC", "Z", "+5", "-08", "+05:30" or "+0530". A
+// leading space is taken as a plus sign that was sent unescaped in a query string.
+
+inline bool parse_utc_offset(std::string const& text, int32_t& offset) noexcept
+{
+    if (text == "UTC" || text == "Z" || text == "0")
+    {
+        offset = 0;
+        return true;
+    }
+
+    if (text.size() < 2 || (text[0] != '+' && text[0] != '-' && text[0] != ' '))
+    {
+        return false;
+    }
+
+    unsigned hours = 0, minutes = 0, digits = 0;
+    size_t i = 1;
+
+    for (; i != text.size() && isdigit(static_cast<unsigned char>(text[i])) && digits != 2; ++i, ++digits)
+    {
+        hours = hours * 10 + (text[i] - '0');
+    }
+
+    if (i != text.size())
+    {
+        if (text[i] == ':')
+        {
+            ++i;
+        }
+
+        if (text.size() - i != 2 || !isdigit(static_cast<unsigned char>(text[i])) || !isdigit(static_cast<unsigned char>(text[i + 1])))
+        {
+            return false;
+        }
+
+        minutes = (text[i] - '0') * 10 + (text[i + 1] - '0');
+    }
+
+    if (!digits || hours > 14 || minutes > 59)
+    {
+        return false;
+    }
+
+    offset = static_cast<int32_t>(hours * 3600 + minutes * 60) * (text[0] == '-' ? -1 : 1);
+    return true;
+}
+
+inline std::string url_decode(std::string const& text)
+{
+    std::string result;
+
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        if (text[i] == '%' && i + 2 < text.size() && isxdigit(static_cast<unsigned char>(text[i + 1])) && isxdigit(static_cast<unsigned char>(text[i + 2])))
+        {
+            result += static_cast<char>(std::stoi(text.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        }
+        else
+        {
+            result += text[i] == '+' ? ' ' : text[i];
+        }
+    }
+
+    return result;
+}
+
+inline int64_t current_unix_seconds() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// A minimal HTTP/1.1 server, bound to loopback only, serving GET /clock.png?tz=...&size=... The
+// time zone is a UTC offset or, given a time zone database, a name such as Europe/London. One
+// I/O thread owns every connection. Renders run on a separate worker pool, and all requests for
+// the same key arriving while it renders wait on that one render. Each response body is a
+// shared immutable buffer from the snapshot cache, sent straight from there.
+
+struct HttpServer
+{
+    static constexpr size_t max_request = 8192;
+    static constexpr uint32_t min_size = 16;
+    static constexpr uint32_t max_size = 4096;
+
+    HttpServer(uint16_t const port, int32_t const default_offset, TimeZoneDatabase const* zones = nullptr, unsigned const threads = std::max(1u, std::thread::hardware_concurrency())) :
+        m_default_offset(default_offset),
+        m_zones(zones && *zones ? std::make_unique<TimeZoneCache>(*zones) : nullptr),
+        m_pool(std::make_unique<WorkerPool>(threads)),
+        m_cache(m_pool.get(), 64)
+    {
+        if (!m_server.open(listen_loopback(port)))
+        {
+            throw std::runtime_error("HttpServer: cannot listen on loopback");
+        }
+
+        m_port = socket_port(m_server.listener());
+        m_thread = std::thread([this] { m_server.run(m_stopping, *this); });
+    }
+
+    ~HttpServer()
+    {
+        m_stopping = true;
+        m_server.wake();
+        m_thread.join();
+        m_pool.reset();
+    }
+
+    HttpServer(HttpServer const&) = delete;
+    HttpServer& operator=(HttpServer const&) = delete;
+
+    uint16_t port() const noexcept
+    {
+        return m_port;
+    }
+
+    uint64_t renders() const noexcept
+    {
+        return m_cache.misses();
+    }
+
+private:
+
+    struct Connection
+    {
+        Socket socket;
+        std::string input;
+        std::string head;
+        SnapshotBytes body;
+        size_t sent{};
+        bool waiting{};
+        bool responding{};
+        bool closing{};
+    };
+
+    struct Completion
+    {
+        SnapshotKey key;
+        SnapshotBytes bytes;
+    };
+
+    template <typename> friend struct SocketServer;
+
+    short events(Connection const& connection) const noexcept
+    {
+        return static_cast<short>(connection.responding ? POLLOUT : connection.waiting ? 0 : POLLIN);
+    }
+
+    void woken()
+    {
+        complete();
+    }
+
+    void accepted(uint64_t, Connection& connection) noexcept
+    {
+        int const on = 1;
+        setsockopt(connection.socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const*>(&on), sizeof(on));
+    }
+
+    void writable(uint64_t const id, Connection& connection)
+    {
+        flush(id, connection);
+    }
+
+    void received(uint64_t const id, Connection& connection, char const* data, size_t const size)
+    {
+        connection.input.append(data, size);
+        process(id, connection);
+    }
+
+    // Handles the next complete request buffered on the connection, if any. Requests on one
+    // connection are answered in order, so a pipelined request waits until the previous response
+    // has been sent.
+
+    void process(uint64_t const id, Connection& connection)
+    {
+        if (connection.waiting || connection.responding)
+        {
+            return;
+        }
+
+        auto const end = connection.input.find("\r\n\r\n");
+
+        if (end == std::string::npos)
+        {
+            if (connection.input.size() > max_request)
+            {
+                respond(id, connection, "431 Request Header Fields Too Large", true);
+            }
+
+            return;
+        }
+
+        auto const request = connection.input.substr(0, end + 2);
+        connection.input.erase(0, end + 4);
+
+        auto const line = request.substr(0, request.find("\r\n"));
+        auto const method_end = line.find(' ');
+        auto const target_end = line.find(' ', method_end + 1);
+
+        if (method_end == std::string::npos || target_end == std::string::npos)
+        {
+            respond(id, connection, "400 Bad Request", true);
+            return;
+        }
+
+        auto lower = request;
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](char const c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+
+        connection.closing = line.compare(target_end + 1, std::string::npos, "HTTP/1.1") != 0 ||
+            lower.find("\r\nconnection: close") != std::string::npos;
+
+        if (line.compare(0, method_end, "GET"))
+        {
+            respond(id, connection, "405 Method Not Allowed", connection.closing);
+            return;
+        }
+
+        SnapshotKey key;
+
+        if (!parse_target(line.substr(method_end + 1, target_end - method_end - 1), key))
+        {
+            respond(id, connection, "404 Not Found", connection.closing);
+            return;
+        }
+
+        if (auto bytes = m_cache.find(key))
+        {
+            respond(id, connection, std::move(bytes));
+            return;
+        }
+
+        connection.waiting = true;
+
+        for (auto&& pending : m_pending)
+        {
+            if (pending.first == key)
+            {
+                pending.second.push_back(id);
+                return;
+            }
+        }
+
+        m_pending.emplace_back(key, std::vector<uint64_t>{ id });
+
+        m_pool->submit([this, key]
+        {
+            SnapshotBytes bytes;
+
+            try
+            {
+                bytes = m_cache.snapshot(key);
+            }
+            catch (...)
+            {
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_completions.push_back({ key, std::move(bytes) });
+            }
+
+            m_server.wake();
+        });
+    }
+
+    bool parse_target(std::string const& target, SnapshotKey& key)
+    {
+        auto const query = target.find('?');
+
+        if (target.compare(0, query, "/clock.png"))
+        {
+            return false;
+        }
+
+        key = { 256, 256, 1, 96.0f, m_default_offset, current_unix_seconds() };
+
+        for (size_t begin = query; begin < target.size();)
+        {
+            auto const end = std::min(target.find('&', begin + 1), target.size());
+            auto const pair = target.substr(begin + 1, end - begin - 1);
+            auto const equals = pair.find('=');
+            auto const name = pair.substr(0, equals);
+            auto const value = equals == std::string::npos ? std::string() : url_decode(pair.substr(equals + 1));
+            begin = end;
+
+            if (name == "tz")
+            {
+                if (!parse_utc_offset(value, key.offset))
+                {
+                    auto const zone = m_zones ? m_zones->database().find(value) : -1;
+
+                    if (zone < 0)
+                    {
+                        return false;
+                    }
+
+                    key.offset = m_zones->offset(static_cast<uint32_t>(zone), key.second);
+                }
+            }
+            else if (name == "size")
+            {
+                unsigned width = 0, height = 0;
+                auto const fields = sscanf(value.c_str(), "%ux%u", &width, &height);
+
+                if (fields < 1)
+                {
+                    return false;
+                }
+
+                key.width = width;
+                key.height = fields == 2 ? height : width;
+
+                if (key.width < min_size || key.width > max_size || key.height < min_size || key.height > max_size)
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void complete()
+    {
+        std::vector<Completion> completions;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            completions.swap(m_completions);
+        }
+
+        for (auto&& completion : completions)
+        {
+            auto const found = std::find_if(m_pending.begin(), m_pending.end(), [&](auto const& pending) { return pending.first == completion.key; });
+            auto const waiters = std::move(found->second);
+            m_pending.erase(found);
+
+            for (auto const id : waiters)
+            {
+                auto const connection = m_server.find(id);
+
+                if (!connection)
+                {
+                    continue;
+                }
+
+                connection->waiting = false;
+
+                if (completion.bytes)
+                {
+                    respond(id, *connection, completion.bytes);
+                }
+                else
+                {
+                    respond(id, *connection, "500 Internal Server Error", true);
+                }
+            }
+        }
+    }
+
+    void respond(uint64_t const id, Connection& connection, SnapshotBytes bytes)
+    {
+        char head[256];
+
+        snprintf(head, sizeof(head),
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: image/png\r\n"
+            "Content-Length: %zu\r\n"
+            "Cache-Control: max-age=1\r\n"
+            "%s"
+            "\r\n",
+            bytes->size(),
+            connection.closing ? "Connection: close\r\n" : "");
+
+        connection.head = head;
+        connection.body = std::move(bytes);
+        start(id, connection);
+    }
+
+    void respond(uint64_t const id, Connection& connection, char const* status, bool const closing)
+    {
+        connection.closing = connection.closing || closing;
+        connection.head = std::string("HTTP/1.1 ") + status + "\r\nContent-Length: 0\r\n" + (connection.closing ? "Connection: close\r\n" : "") + "\r\n";
+        connection.body = nullptr;
+        start(id, connection);
+    }
+
+    void start(uint64_t const id, Connection& connection)
+    {
+        connection.sent = 0;
+        connection.responding = true;
+        flush(id, connection);
+    }
+
+    void flush(uint64_t const id, Connection& connection)
+    {
+        auto const body_size = connection.body ? connection.body->size() : 0;
+        SendBuffer const buffers[2] = { { connection.head.data(), connection.head.size() }, { body_size ? connection.body->data() : nullptr, body_size } };
+
+        if (!m_server.send(id, buffers, body_size ? 2 : 1, connection.sent) || connection.sent != connection.head.size() + body_size)
+        {
+            return;
+        }
+
+        connection.responding = false;
+        connection.body = nullptr;
+
+        if (connection.closing)
+        {
+            m_server.drop(id);
+            return;
+        }
+
+        process(id, connection);
+    }
+
+    SocketLibrary m_library;
+    int32_t m_default_offset;
+    std::unique_ptr<TimeZoneCache> m_zones;
+    uint16_t m_port{};
+    SocketServer<Connection> m_server;
+    std::atomic<bool> m_stopping{};
+    std::unique_ptr<WorkerPool> m_pool;
+    SnapshotCache m_cache;
+    std::vector<std::pair<SnapshotKey, std::vector<uint64_t>>> m_pending;
+    std::mutex m_lock;
+    std::vector<Completion> m_completions;
+    std::thread m_thread;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// The precompiled files, such as the time zone database and the theme library, are mapped
+// read-only and used in place. Each has a header giving the offsets of its tables, each table
+// 8-byte aligned, and a table of entries sorted by name, whose names are kept together in a table
+// of their own.
+
+// Whether count elements of the given size at offset lie within a mapping of size bytes.
+
+inline bool table_fits(uint64_t const size, uint64_t const offset, uint64_t const count, uint64_t const element) noexcept
+{
+    return offset % 8 == 0 && offset <= size && count <= (size - offset) / element;
+}
+
+// Returns the index of the entry with the given name, or -1, by binary search over count entries
+// whose names name_of(index) gives in sorted order.
+
+template <typename NameOf>
+int32_t find_by_name(uint32_t const count, std::string_view const name, NameOf const& name_of) noexcept
+{
+    uint32_t low = 0;
+    uint32_t high = count;
+
+    while (low < high)
+    {
+        auto const middle = low + (high - low) / 2;
+        auto const compared = name_of(middle).compare(name);
+
+        if (!compared)
+        {
+            return static_cast<int32_t>(middle);
+        }
+
+        if (compared < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,561 @@
+#pragma once
+
+#include "Workers.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// A self-contained PNG encoder for opaque BGRA frames. The filtered image is cut into blocks that
+// are compressed independently on a worker pool, each primed with the 32KB that precedes it so
+// that matches still reach across block boundaries. Every block but the last ends on a byte
+// boundary with an empty stored block, so the pieces simply concatenate into one zlib stream.
+// Blocks use the fixed Huffman codes, which suit the flat colour of the clock well.
+
+constexpr size_t png_block_size = 128 * 1024;
+constexpr uint32_t deflate_window = 32 * 1024;
+
+inline uint32_t crc32(uint32_t crc, uint8_t const* data, size_t const size) noexcept
+{
+    struct Table
+    {
+        uint32_t values[256];
+
+        Table() noexcept
+        {
+            for (uint32_t i = 0; i != 256; ++i)
+            {
+                auto value = i;
+
+                for (int bit = 0; bit != 8; ++bit)
+                {
+                    value = value & 1 ? 0xedb88320 ^ value >> 1 : value >> 1;
+                }
+
+                values[i] = value;
+            }
+        }
+    };
+
+    static Table const table;
+    crc = ~crc;
+
+    for (size_t i = 0; i != size; ++i)
+    {
+        crc = table.values[(crc ^ data[i]) & 0xff] ^ crc >> 8;
+    }
+
+    return ~crc;
+}
+
+inline uint32_t adler32(uint32_t const adler, uint8_t const* data, size_t size) noexcept
+{
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+
+    while (size)
+    {
+        // 5552 is the most bytes that can be summed before b may overflow 32 bits.
+
+        auto const run = size < 5552 ? size : 5552;
+        size -= run;
+
+        for (size_t i = 0; i != run; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+
+        data += run;
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return b << 16 | a;
+}
+
+// Combines the checksums of two adjacent runs given the length of the second, so that blocks can
+// be summed in parallel.
+
+inline uint32_t adler32_combine(uint32_t const first, uint32_t const second, size_t const length) noexcept
+{
+    uint64_t const base = 65521;
+    auto const remainder = length % base;
+    auto a = uint64_t{ first & 0xffff };
+    auto b = (remainder * a + (first >> 16) + (second >> 16) + base - remainder) % base;
+    a = (a + (second & 0xffff) + base - 1) % base;
+    return static_cast<uint32_t>(b << 16 | a);
+}
+
+struct BitWriter
+{
+    std::vector<uint8_t>& bytes;
+    uint64_t bits{};
+    uint32_t count{};
+
+    void write(uint32_t const value, uint32_t const length)
+    {
+        bits |= uint64_t{ value } << count;
+        count += length;
+
+        while (count >= 8)
+        {
+            bytes.push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void align()
+    {
+        if (count)
+        {
+            write(0, 8 - count);
+        }
+    }
+};
+
+struct FixedHuffman
+{
+    // Huffman codes are sent most significant bit first, so they are stored here reversed.
+
+    uint16_t codes[288];
+    uint8_t lengths[288];
+    uint16_t distance_codes[30];
+    uint8_t length_symbol[259];
+    uint8_t distance_symbol[512];
+
+    static constexpr uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static constexpr uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static constexpr uint16_t distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static constexpr uint8_t distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    static uint16_t reverse(uint32_t code, uint32_t const length) noexcept
+    {
+        uint32_t result = 0;
+
+        for (uint32_t i = 0; i != length; ++i)
+        {
+            result = result << 1 | (code & 1);
+            code >>= 1;
+        }
+
+        return static_cast<uint16_t>(result);
+    }
+
+    FixedHuffman() noexcept
+    {
+        for (uint32_t symbol = 0; symbol != 288; ++symbol)
+        {
+            if (symbol < 144) { lengths[symbol] = 8; codes[symbol] = reverse(0x30 + symbol, 8); }
+            else if (symbol < 256) { lengths[symbol] = 9; codes[symbol] = reverse(0x190 + symbol - 144, 9); }
+            else if (symbol < 280) { lengths[symbol] = 7; codes[symbol] = reverse(symbol - 256, 7); }
+            else { lengths[symbol] = 8; codes[symbol] = reverse(0xc0 + symbol - 280, 8); }
+        }
+
+        for (uint32_t code = 0; code != 30; ++code)
+        {
+            distance_codes[code] = reverse(code, 5);
+        }
+
+        for (uint32_t code = 0; code != 29; ++code)
+        {
+            auto const last = code == 28 ? 258u : length_base[code] + (1u << length_extra[code]) - 1;
+
+            for (uint32_t length = length_base[code]; length <= last; ++length)
+            {
+                length_symbol[length] = static_cast<uint8_t>(code);
+            }
+        }
+
+        // Distances up to 256 are looked up directly, longer ones by their distance - 1 >> 7.
+
+        for (uint32_t code = 0; code != 30; ++code)
+        {
+            auto const first = distance_base[code];
+            auto const last = first + (1u << distance_extra[code]) - 1;
+
+            for (uint32_t distance = first; distance <= last; ++distance)
+            {
+                if (distance <= 256)
+                {
+                    distance_symbol[distance - 1] = static_cast<uint8_t>(code);
+                }
+                else
+                {
+                    distance_symbol[256 + ((distance - 1) >> 7)] = static_cast<uint8_t>(code);
+                }
+            }
+        }
+    }
+
+    void literal(BitWriter& writer, uint32_t const symbol) const
+    {
+        writer.write(codes[symbol], lengths[symbol]);
+    }
+
+    void match(BitWriter& writer, uint32_t const length, uint32_t const distance) const
+    {
+        auto const code = length_symbol[length];
+        literal(writer, 257 + code);
+        writer.write(length - length_base[code], length_extra[code]);
+
+        auto const symbol = distance <= 256 ? distance_symbol[distance - 1] : distance_symbol[256 + ((distance - 1) >> 7)];
+        writer.write(distance_codes[symbol], 5);
+        writer.write(distance - distance_base[symbol], distance_extra[symbol]);
+    }
+};
+
+// Compresses data[begin, end) as one fixed Huffman block. Matches may refer back into the 32KB
+// before begin, which the decoder will already have produced from the previous block.
+
+inline void deflate_block(uint8_t const* data, size_t const begin, size_t const end, bool const last, std::vector<uint8_t>& bytes)
+{
+    static FixedHuffman const huffman;
+    constexpr uint32_t hash_bits = 15;
+    constexpr uint32_t max_chain = 16;
+    constexpr uint32_t min_match = 3;
+    constexpr uint32_t max_match = 258;
+
+    auto const base = begin > deflate_window ? begin - deflate_window : 0;
+    auto const source = data + base;
+    auto const first = static_cast<uint32_t>(begin - base);
+    auto const size = static_cast<uint32_t>(end - base);
+
+    std::vector<int32_t> head(size_t{ 1 } << hash_bits, -1);
+    std::vector<int32_t> previous(deflate_window, -1);
+
+    auto const hash = [&](uint32_t const position)
+    {
+        auto const value = uint32_t{ source[position] } | uint32_t{ source[position + 1] } << 8 | uint32_t{ source[position + 2] } << 16;
+        return value * 2654435761u >> (32 - hash_bits);
+    };
+
+    auto const insert = [&](uint32_t const position)
+    {
+        if (position + min_match <= size)
+        {
+            auto& slot = head[hash(position)];
+            previous[position % deflate_window] = slot;
+            slot = static_cast<int32_t>(position);
+        }
+    };
+
+    for (uint32_t position = 0; position != first; ++position)
+    {
+        insert(position);
+    }
+
+    BitWriter writer{ bytes };
+    writer.write(last ? 1 : 0, 1);
+    writer.write(1, 2);
+
+    for (auto position = first; position < size;)
+    {
+        uint32_t best_length = 0;
+        uint32_t best_distance = 0;
+
+        if (position + min_match <= size)
+        {
+            auto const limit = std::min(max_match, size - position);
+            auto candidate = head[hash(position)];
+
+            for (uint32_t chain = 0; candidate >= 0 && chain != max_chain; ++chain)
+            {
+                auto const distance = position - static_cast<uint32_t>(candidate);
+
+                if (distance > deflate_window)
+                {
+                    break;
+                }
+
+                if (source[candidate + best_length] == source[position + best_length])
+                {
+                    uint32_t length = 0;
+
+                    while (length != limit && source[candidate + length] == source[position + length])
+                    {
+                        ++length;
+                    }
+
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        best_distance = distance;
+
+                        if (length == limit)
+                        {
+                            break;
+                        }
+                    }
+                }
+
+                candidate = previous[candidate % deflate_window];
+            }
+        }
+
+        if (best_length >= min_match)
+        {
+            huffman.match(writer, best_length, best_distance);
+
+            for (uint32_t i = 0; i != best_length; ++i)
+            {
+                insert(position + i);
+            }
+
+            position += best_length;
+        }
+        else
+        {
+            huffman.literal(writer, source[position]);
+            insert(position);
+            ++position;
+        }
+    }
+
+    huffman.literal(writer, 256);
+
+    if (!last)
+    {
+        // An empty stored block leaves the stream byte aligned for the next block.
+
+        writer.write(0, 3);
+        writer.align();
+        writer.write(0x0000, 16);
+        writer.write(0xffff, 16);
+    }
+
+    writer.align();
+}
+
+// PNG filter type 4, chosen per row along with the others by the usual minimum sum heuristic.
+
+inline uint8_t paeth(int const a, int const b, int const c) noexcept
+{
+    auto const p = a + b - c;
+    auto const pa = abs(p - a);
+    auto const pb = abs(p - b);
+    auto const pc = abs(p - c);
+    return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+template <uint8_t Type>
+inline uint8_t filter_byte(int const value, int const left, int const up, int const corner) noexcept
+{
+    switch (Type)
+    {
+    case 1: return static_cast<uint8_t>(value - left);
+    case 2: return static_cast<uint8_t>(value - up);
+    case 3: return static_cast<uint8_t>(value - (left + up) / 2);
+    case 4: return static_cast<uint8_t>(value - paeth(left, up, corner));
+    default: return static_cast<uint8_t>(value);
+    }
+}
+
+// Calls action(index, filtered) for each byte of the row; the first pixel has no left neighbour.
+
+template <uint8_t Type, typename Action>
+inline void filter_each(uint8_t const* row, uint8_t const* above, uint32_t const stride, Action&& action) noexcept
+{
+    for (uint32_t i = 0; i != 3; ++i)
+    {
+        action(i, filter_byte<Type>(row[i], 0, above[i], 0));
+    }
+
+    for (uint32_t i = 3; i != stride; ++i)
+    {
+        action(i, filter_byte<Type>(row[i], row[i - 3], above[i], above[i - 3]));
+    }
+}
+
+template <uint8_t Type>
+inline uint32_t filter_cost(uint8_t const* row, uint8_t const* above, uint32_t const stride) noexcept
+{
+    uint32_t cost = 0;
+
+    filter_each<Type>(row, above, stride, [&](uint32_t, uint8_t const value)
+    {
+        cost += static_cast<uint32_t>(abs(static_cast<int8_t>(value)));
+    });
+
+    return cost;
+}
+
+template <uint8_t Type>
+inline void filter_apply(uint8_t const* row, uint8_t const* above, uint32_t const stride, uint8_t* output) noexcept
+{
+    output[0] = Type;
+
+    filter_each<Type>(row, above, stride, [&](uint32_t const i, uint8_t const value)
+    {
+        output[i + 1] = value;
+    });
+}
+
+// The first row has nothing above it, so it is filtered against a row of zeros.
+
+inline void filter_row(uint8_t const* row, uint8_t const* above, uint32_t const stride, uint8_t* output) noexcept
+{
+    uint32_t const costs[5] =
+    {
+        filter_cost<0>(row, above, stride),
+        filter_cost<1>(row, above, stride),
+        filter_cost<2>(row, above, stride),
+        filter_cost<3>(row, above, stride),
+        filter_cost<4>(row, above, stride),
+    };
+
+    auto const best = std::min_element(costs, costs + 5) - costs;
+
+    switch (best)
+    {
+    case 0: filter_apply<0>(row, above, stride, output); break;
+    case 1: filter_apply<1>(row, above, stride, output); break;
+    case 2: filter_apply<2>(row, above, stride, output); break;
+    case 3: filter_apply<3>(row, above, stride, output); break;
+    default: filter_apply<4>(row, above, stride, output); break;
+    }
+}
+
+inline void png_chunk(std::vector<uint8_t>& png, char const (&type)[5], uint8_t const* data, size_t const size)
+{
+    auto const put32 = [&](uint32_t const value)
+    {
+        png.push_back(static_cast<uint8_t>(value >> 24));
+        png.push_back(static_cast<uint8_t>(value >> 16));
+        png.push_back(static_cast<uint8_t>(value >> 8));
+        png.push_back(static_cast<uint8_t>(value));
+    };
+
+    put32(static_cast<uint32_t>(size));
+    auto const start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data, data + size);
+    put32(crc32(0, png.data() + start, png.size() - start));
+}
+
+// Filters and compresses opaque BGRA pixels into the zlib stream carried by IDAT (or fdAT)
+// chunks of an 8-bit RGB image. stride is in pixels, so this can also encode part of a larger
+// frame. Without a pool everything runs on the caller. Width and height must not be zero.
+
+inline std::vector<uint8_t> png_image_data(uint32_t const* pixels, uint32_t const pixel_stride, uint32_t const width, uint32_t const height, WorkerPool* pool = nullptr)
+{
+    auto const stride = width * 3;
+    auto const row_size = size_t{ stride } + 1;
+    auto const rows_per_block = static_cast<uint32_t>(std::max<size_t>(1, png_block_size / row_size));
+    auto const blocks = (height + rows_per_block - 1) / rows_per_block;
+
+    auto const run = [&](size_t const count, auto&& action)
+    {
+        if (pool)
+        {
+            pool->parallel_for(count, action);
+        }
+        else
+        {
+            for (size_t i = 0; i != count; ++i)
+            {
+                action(i);
+            }
+        }
+    };
+
+    // Filtering reads the row above in RGB, so each block converts the row before its first.
+
+    std::vector<uint8_t> filtered(row_size * height);
+    std::vector<uint32_t> checksums(blocks);
+
+    run(blocks, [&](size_t const block)
+    {
+        auto const top = static_cast<uint32_t>(block * rows_per_block);
+        auto const bottom = std::min(height, top + rows_per_block);
+        std::vector<uint8_t> rgb(size_t{ stride } * 2);
+
+        auto const convert = [&](uint32_t const y, uint8_t* output)
+        {
+            auto const source = pixels + size_t{ y } * pixel_stride;
+
+            for (uint32_t x = 0; x != width; ++x)
+            {
+                output[x * 3 + 0] = static_cast<uint8_t>(source[x] >> 16);
+                output[x * 3 + 1] = static_cast<uint8_t>(source[x] >> 8);
+                output[x * 3 + 2] = static_cast<uint8_t>(source[x]);
+            }
+        };
+
+        auto above = rgb.data();
+        auto current = rgb.data() + stride;
+
+        if (top)
+        {
+            convert(top - 1, above);
+        }
+
+        for (auto y = top; y != bottom; ++y)
+        {
+            convert(y, current);
+            filter_row(current, above, stride, filtered.data() + row_size * y);
+            std::swap(above, current);
+        }
+
+        checksums[block] = adler32(1, filtered.data() + row_size * top, row_size * (bottom - top));
+    });
+
+    std::vector<std::vector<uint8_t>> compressed(blocks);
+
+    run(blocks, [&](size_t const block)
+    {
+        auto const begin = row_size * block * rows_per_block;
+        auto const end = std::min(filtered.size(), begin + row_size * rows_per_block);
+        compressed[block].reserve((end - begin) / 4);
+        deflate_block(filtered.data(), begin, end, block + 1 == blocks, compressed[block]);
+    });
+
+    std::vector<uint8_t> stream = { 0x78, 0x5e };
+    uint32_t adler = 1;
+
+    for (uint32_t block = 0; block != blocks; ++block)
+    {
+        stream.insert(stream.end(), compressed[block].begin(), compressed[block].end());
+        auto const length = std::min(filtered.size() - row_size * block * rows_per_block, row_size * rows_per_block);
+        adler = adler32_combine(adler, checksums[block], length);
+    }
+
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        stream.push_back(static_cast<uint8_t>(adler >> shift));
+    }
+
+    return stream;
+}
+
+// Starts a PNG with its signature and the IHDR of an 8-bit RGB image.
+
+inline std::vector<uint8_t> png_start(uint32_t const width, uint32_t const height)
+{
+    uint8_t const header[13] =
+    {
+        static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16), static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+        static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16), static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+        8, 2, 0, 0, 0
+    };
+
+    static uint8_t const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<uint8_t> png(signature, signature + sizeof(signature));
+    png_chunk(png, "IHDR", header, sizeof(header));
+    return png;
+}
+
+// Encodes opaque BGRA pixels as an 8-bit RGB PNG. Without a pool everything runs on the caller.
+// Width and height must not be zero.
+
+inline std::vector<uint8_t> encode_png(uint32_t const* pixels, uint32_t const width, uint32_t const height, WorkerPool* pool = nullptr)
+{
+    auto const stream = png_image_data(pixels, width, width, height, pool);
+    auto png = png_start(width, height);
+    png.reserve(png.size() + stream.size() + 24);
+    png_chunk(png, "IDAT", stream.data(), stream.size());
+    png_chunk(png, "IEND", nullptr, 0);
+    return png;
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "Tick.h"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// How hard the clock works follows what the system can afford and what anyone can see. The
+// power source, the display's state, whether the window can be seen at all and whether it is in
+// the foreground together pick a power level, and each level has a rendering policy: how many frames
+// a second it may present, whether the second hand must tick, how good a shadow it draws and how
+// far it biases the choice of detail tiers. The state machine is pure so that every combination
+// of inputs can be checked away from Windows, and it takes the time rather than reading a clock.
+//
+// A level that saves more power applies at once. A level that spends more must have been asked
+// for continuously for the dwell before it applies, so that a laptop whose charger is jiggled or
+// a window that is alt-tabbed through does not flip the clock between policies. Nothing is drawn
+// while paused, so leaving it is the one exception and goes straight to the level asked for.
+
+enum class PowerSource : uint8_t
+{
+    ac,
+    battery,
+};
+
+// In the order that Windows reports them.
+
+enum class DisplayState : uint8_t
+{
+    off,
+    on,
+    dimmed,
+};
+
+enum class PowerLevel : uint8_t
+{
+    full,
+    balanced,
+    saving,
+    paused,
+};
+
+// As for detail tiers, shadows are either drawn as the tier allows, blurred at half resolution
+// whatever the tier, or not drawn at all.
+
+enum class ShadowQuality : uint8_t
+{
+    full,
+    fast,
+    none,
+};
+
+struct PowerInputs
+{
+    PowerSource source = PowerSource::ac;
+    DisplayState display = DisplayState::on;
+    bool saver = false;         // the system's battery or energy saver is on, or low power was asked for
+    bool hidden = false;        // nothing of the window can be seen (see Visibility.h)
+    bool foreground = true;
+};
+
+struct RenderPolicy
+{
+    bool render;
+    float max_fps;              // zero for every vertical blank
+    HandMotion motion;          // tick forces the hand to tick, sweep leaves it as configured
+    ShadowQuality shadow;
+    float lod_bias;             // scales the radius that picks a detail tier, so less than one drops detail sooner
+};
+
+struct PowerPolicySettings
+{
+    RenderPolicy levels[4] =
+    {
+        { true, 0.0f, HandMotion::sweep, ShadowQuality::full, 1.0f },
+        { true, 30.0f, HandMotion::sweep, ShadowQuality::fast, 0.75f },
+        { true, 15.0f, HandMotion::tick, ShadowQuality::none, 0.5f },
+        { false, 0.0f, HandMotion::tick, ShadowQuality::none, 0.5f },
+    };
+
+    double dwell = 5.0;         // seconds a more expensive level must be asked for before it applies
+};
+
+inline char const* power_level_name(PowerLevel const level) noexcept
+{
+    char const* const names[] = { "full", "balanced", "saving", "paused" };
+    return static_cast<uint8_t>(level) < 4 ? names[static_cast<uint8_t>(level)] : "?";
+}
+
+// The level the inputs ask for, before any hysteresis. A display that is off or a window that is
+// hidden shows nothing. A saver or a dimmed display asks for the least, as does running on
+// battery in the background; either battery or the background alone gives up a little.
+
+inline PowerLevel power_level(PowerInputs const& inputs) noexcept
+{
+    if (DisplayState::off == inputs.display || inputs.hidden)
+    {
+        return PowerLevel::paused;
+    }
+
+    if (inputs.saver || DisplayState::dimmed == inputs.display)
+    {
+        return PowerLevel::saving;
+    }
+
+    if (PowerSource::battery == inputs.source)
+    {
+        return inputs.foreground ? PowerLevel::balanced : PowerLevel::saving;
+    }
+
+    return inputs.foreground ? PowerLevel::full : PowerLevel::balanced;
+}
+
+// Vertical blanks per presented frame, as Present takes them, for a display refreshing at the
+// given rate to present no more than max_fps frames a second. Present allows at most four.
+
+inline uint32_t present_interval(float const max_fps, float const refresh_hz) noexcept
+{
+    if (!(max_fps > 0.0f) || !(refresh_hz > max_fps))
+    {
+        return 1;
+    }
+
+    auto const interval = std::ceil(refresh_hz / max_fps - 0.001f);
+    return interval < 4.0f ? static_cast<uint32_t>(interval) : 4;
+}
+
+// Frames a second drawn under a policy, given how the hand moves once the policy is applied. A
+// ticking hand is drawn through its step and once more at rest, then sleeps out the second.
+
+inline double policy_frame_rate(RenderPolicy const& policy, HandMotion const motion, float const refresh_hz, TickStyle const& tick) noexcept
+{
+    if (!policy.render)
+    {
+        return 0.0;
+    }
+
+    auto const fps = static_cast<double>(refresh_hz) / present_interval(policy.max_fps, refresh_hz);
+
+    if (HandMotion::tick == motion)
+    {
+        return std::fmin(fps, std::ceil(tick.settle * fps - 0.001) + 1.0);
+    }
+
+    return fps;
+}
+
+struct PowerPolicy
+{
+    explicit PowerPolicy(PowerPolicySettings const& settings = {}) noexcept :
+        m_settings(settings)
+    {
+    }
+
+    // Takes the inputs as they are at the given time, in seconds from any fixed point, and
+    // returns whether the level changed. A pending upgrade applies only when update is called
+    // again at or after the time it is due, so callers should call back by then.
+
+    bool update(PowerInputs const& inputs, double const seconds) noexcept
+    {
+        auto const wanted = power_level(inputs);
+
+        if (wanted >= m_level || PowerLevel::paused == m_level)
+        {
+            m_wanted = wanted;
+            return change(wanted);
+        }
+
+        if (wanted != m_wanted)
+        {
+            m_wanted = wanted;
+            m_since = seconds;
+        }
+
+        return seconds >= m_since + m_settings.dwell && change(wanted);
+    }
+
+    PowerLevel level() const noexcept
+    {
+        return m_level;
+    }
+
+    RenderPolicy const& policy() const noexcept
+    {
+        return m_settings.levels[static_cast<uint8_t>(m_level)];
+    }
+
+    // When a pending upgrade is due, or infinity if there is none.
+
+    double due() const noexcept
+    {
+        return m_wanted < m_level ? m_since + m_settings.dwell : std::numeric_limits<double>::infinity();
+    }
+
+    uint64_t changes() const noexcept
+    {
+        return m_changes;
+    }
+
+private:
+
+    bool change(PowerLevel const level) noexcept
+    {
+        if (level == m_level)
+        {
+            return false;
+        }
+
+        m_level = level;
+        ++m_changes;
+        return true;
+    }
+
+    PowerPolicySettings m_settings;
+    PowerLevel m_level{ PowerLevel::full };
+    PowerLevel m_wanted{ PowerLevel::full };
+    double m_since{};
+    uint64_t m_changes{};
+};
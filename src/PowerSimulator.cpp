@@ -0,0 +1,351 @@
+// clock-power: estimates the frames and pixel work an hour of each power policy costs (see
+// Power.h), and what a day of changing power and window states costs through the policy engine:
+//
+//   clock-power
+//   clock-power --refresh 144 --size 2560x1440 --clocks 12
+//   clock-power --scenario day.txt
+//
+// A scenario gives the state from each minute on, one per line, with # beginning a comment.
+// Anything a line leaves out is as on the desk: on AC, the display on, no saver, the window in
+// view and in the foreground. The last line is the minute the scenario ends:
+//
+//   0      ac                  # at the desk
+//   95     battery background  # in a meeting, the clock behind the slides
+//   100    battery             # a glance at it
+//   100.05 battery background  # three seconds later
+//   140    battery dimmed
+//   480    end
+//
+// Pixel work counts the pixels written each frame: the clock layer is cleared and drawn and
+// then blended into the window, and its shadow is blurred over the whole window, over a quarter
+// of it at half resolution, or not at all. It is a model of fill cost rather than a measurement,
+// but it moves as the GPU's work does. Only the standard library is needed, so it also builds
+// elsewhere, for example:
+//
+//   g++ -std=c++17 -O2 PowerSimulator.cpp -o clock-power
+
+#include "Detail.h"
+#include "Power.h"
+#include "Wall.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Display
+{
+    float refresh = 60.0f;
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    uint32_t clocks = 1;
+    HandMotion motion = HandMotion::sweep;
+    TickStyle tick;
+};
+
+struct Cost
+{
+    double frames;      // per second
+    double pixels;      // per frame
+};
+
+static Cost level_cost(RenderPolicy const& policy, Display const& display)
+{
+    if (!policy.render)
+    {
+        return { 0.0, 0.0 };
+    }
+
+    auto const motion = HandMotion::tick == policy.motion ? HandMotion::tick : display.motion;
+    auto const frames = policy_frame_rate(policy, motion, display.refresh, display.tick);
+    auto const area = static_cast<double>(display.width) * display.height;
+    auto const radius = wall_radius(display.clocks, static_cast<float>(display.width), static_cast<float>(display.height), 96.0f);
+    auto const tier = detail_tier(radius * policy.lod_bias);
+    auto shadow = area;
+
+    if (DetailTier::sprite == tier || ShadowQuality::none == policy.shadow)
+    {
+        shadow = 0.0;
+    }
+    else if (DetailTier::reduced == tier || ShadowQuality::fast == policy.shadow)
+    {
+        shadow = area / 4.0;
+    }
+
+    return { frames, 2.0 * area + shadow };
+}
+
+struct Step
+{
+    double minute;
+    PowerInputs inputs;
+    bool end;
+};
+
+static char const default_scenario[] =
+    "0      ac                  # at the desk\n"
+    "50     ac background       # another window in front, the clock still in view\n"
+    "50.02  ac\n"
+    "50.05  ac background       # alt-tabbing through it\n"
+    "50.07  ac\n"
+    "50.1   ac background\n"
+    "90     ac hidden           # covered entirely\n"
+    "120    battery             # off to a meeting\n"
+    "125    battery background\n"
+    "175    battery saver\n"
+    "180    ac                  # back at the desk\n"
+    "240    ac dimmed           # lunch\n"
+    "245    ac off\n"
+    "300    ac\n"
+    "420    ac background\n"
+    "480    end\n";
+
+static bool parse_scenario(std::istream& text, char const* const name, std::vector<Step>& steps)
+{
+    std::string line;
+
+    for (uint32_t number = 1; std::getline(text, line); ++number)
+    {
+        std::istringstream words(line);
+        std::string word;
+        Step step{};
+
+        if (!(words >> word) || '#' == word[0])
+        {
+            continue;
+        }
+
+        auto const error = [&](char const* const message)
+        {
+            fprintf(stderr, "%s(%u): %s\n", name, number, message);
+            return false;
+        };
+
+        char* end = nullptr;
+        step.minute = strtod(word.c_str(), &end);
+
+        if (*end || !(step.minute >= 0.0) || (!steps.empty() && step.minute <= steps.back().minute))
+        {
+            return error("expected a minute later than the line before");
+        }
+
+        if (!steps.empty() && steps.back().end)
+        {
+            return error("end must be the last line");
+        }
+
+        while (words >> word && '#' != word[0])
+        {
+            if ("ac" == word || "battery" == word)
+            {
+                step.inputs.source = "ac" == word ? PowerSource::ac : PowerSource::battery;
+            }
+            else if ("on" == word || "dimmed" == word || "off" == word)
+            {
+                step.inputs.display = "on" == word ? DisplayState::on : "off" == word ? DisplayState::off : DisplayState::dimmed;
+            }
+            else if ("saver" == word)
+            {
+                step.inputs.saver = true;
+            }
+            else if ("hidden" == word)
+            {
+                step.inputs.hidden = true;
+            }
+            else if ("background" == word)
+            {
+                step.inputs.foreground = false;
+            }
+            else if ("end" == word)
+            {
+                step.end = true;
+            }
+            else
+            {
+                return error("expected ac, battery, on, dimmed, off, saver, hidden, background or end");
+            }
+        }
+
+        steps.push_back(step);
+    }
+
+    if (steps.size() < 2 || !steps.back().end)
+    {
+        fprintf(stderr, "%s: expected at least one state and then a last line ending it\n", name);
+        return false;
+    }
+
+    return true;
+}
+
+// Runs the policy engine through the scenario, charging each stretch of time to the level that
+// was in force. Upgrades held back by the dwell apply partway through a stretch.
+
+static void simulate(std::vector<Step> const& steps, Display const& display, PowerPolicySettings const& settings)
+{
+    PowerPolicy policy(settings);
+    double seconds[4] = {};
+    double frames = 0.0;
+    double pixels = 0.0;
+
+    auto const charge = [&](double const from, double const to)
+    {
+        auto const cost = level_cost(policy.policy(), display);
+        seconds[static_cast<uint8_t>(policy.level())] += to - from;
+        frames += cost.frames * (to - from);
+        pixels += cost.frames * cost.pixels * (to - from);
+    };
+
+    for (size_t i = 0; i + 1 != steps.size(); ++i)
+    {
+        auto now = steps[i].minute * 60.0;
+        auto const until = steps[i + 1].minute * 60.0;
+        policy.update(steps[i].inputs, now);
+
+        while (policy.due() < until)
+        {
+            charge(now, policy.due());
+            now = policy.due();
+            policy.update(steps[i].inputs, now);
+        }
+
+        charge(now, until);
+    }
+
+    auto const total = steps.back().minute * 60.0 - steps.front().minute * 60.0;
+    auto const always = level_cost(settings.levels[0], display);
+
+    printf("\nscenario: %.2f hours, %llu level changes\n", total / 3600.0, static_cast<unsigned long long>(policy.changes()));
+
+    for (uint8_t level = 0; level != 4; ++level)
+    {
+        printf("  %-9s %7.2f hours\n", power_level_name(static_cast<PowerLevel>(level)), seconds[level] / 3600.0);
+    }
+
+    printf("  frames    %12.0f, %5.1f%% of always full\n", frames, 100.0 * frames / (always.frames * total));
+    printf("  Mpixels   %12.0f, %5.1f%% of always full\n", pixels / 1e6, 100.0 * pixels / (always.frames * always.pixels * total));
+}
+
+static void usage()
+{
+    fputs("usage: clock-power [OPTIONS]\n"
+        "  --refresh HZ          display refresh rate (60)\n"
+        "  --size WxH            window size in pixels (1920x1080)\n"
+        "  --clocks N            clocks on the wall (1)\n"
+        "  --motion sweep|tick   how the second hand moves where the policy allows (sweep)\n"
+        "  --tick S,O            seconds each tick takes and its overshoot (0.15,1.7)\n"
+        "  --dwell SECONDS       how long a costlier level must be asked for (5)\n"
+        "  --scenario PATH       states to run through the policy engine, a working day by default\n",
+        stderr);
+}
+
+int main(int argc, char** argv)
+{
+    Display display;
+    PowerPolicySettings settings;
+    char const* scenario = nullptr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const option = std::string(argv[i]);
+
+        if (i + 1 == argc)
+        {
+            usage();
+            return 1;
+        }
+
+        auto const value = argv[++i];
+        auto valid = true;
+
+        if ("--refresh" == option)
+        {
+            display.refresh = strtof(value, nullptr);
+            valid = display.refresh >= 1.0f && display.refresh <= 1000.0f;
+        }
+        else if ("--size" == option)
+        {
+            valid = 2 == sscanf(value, "%ux%u", &display.width, &display.height) && display.width && display.height;
+        }
+        else if ("--clocks" == option)
+        {
+            display.clocks = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+            valid = display.clocks >= 1 && display.clocks <= 1000;
+        }
+        else if ("--motion" == option)
+        {
+            display.motion = strcmp(value, "tick") ? HandMotion::sweep : HandMotion::tick;
+            valid = !strcmp(value, "tick") || !strcmp(value, "sweep");
+        }
+        else if ("--tick" == option)
+        {
+            valid = 2 == sscanf(value, "%f,%f", &display.tick.settle, &display.tick.overshoot) && display.tick.settle >= 0.0f && display.tick.settle <= 1.0f;
+        }
+        else if ("--dwell" == option)
+        {
+            settings.dwell = strtod(value, nullptr);
+            valid = settings.dwell >= 0.0;
+        }
+        else if ("--scenario" == option)
+        {
+            scenario = value;
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<Step> steps;
+
+    if (scenario)
+    {
+        std::ifstream file(scenario);
+
+        if (!file)
+        {
+            perror(scenario);
+            return 1;
+        }
+
+        if (!parse_scenario(file, scenario, steps))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        std::istringstream text(default_scenario);
+        parse_scenario(text, "default", steps);
+    }
+
+    printf("%ux%u at %.0f Hz, %u clock%s\n", display.width, display.height, display.refresh, display.clocks, 1 == display.clocks ? "" : "s");
+    printf("%-9s %6s %6s %6s %5s %12s %12s\n", "level", "fps", "motion", "shadow", "lod", "frames/hour", "Mpixels/hour");
+
+    for (uint8_t level = 0; level != 4; ++level)
+    {
+        auto const& policy = settings.levels[level];
+        auto const cost = level_cost(policy, display);
+        char const* const shadows[] = { "full", "fast", "none" };
+
+        printf("%-9s %6.1f %6s %6s %5.2f %12.0f %12.0f\n",
+            power_level_name(static_cast<PowerLevel>(level)),
+            policy.render ? display.refresh / present_interval(policy.max_fps, display.refresh) : 0.0f,
+            HandMotion::tick == policy.motion || HandMotion::tick == display.motion ? "tick" : "sweep",
+            shadows[static_cast<uint8_t>(policy.shadow)],
+            policy.lod_bias,
+            cost.frames * 3600.0,
+            cost.frames * cost.pixels * 3600.0 / 1e6);
+    }
+
+    simulate(steps, display, settings);
+    return 0;
+}
@@ -0,0 +1,904 @@
+#pragma once
+
+#include "Detail.h"
+#include "DisplayList.h"
+#include "Glyphs.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A small software rasteriser for the clock scene. Pixels are premultiplied BGRA, as with
+// DXGI_FORMAT_B8G8R8A8_UNORM and D2D1_ALPHA_MODE_PREMULTIPLIED, and coordinates are DIPs scaled
+// by the canvas DPI. Coverage comes from the signed distance to each shape so the edges are
+// anti-aliased much like Direct2D's per-primitive anti-aliasing, or aliased for the smallest
+// clocks. Shapes are filled a row span at a time and the canvas tracks the bounds of what has been
+// drawn, so the shadow and composition only touch the part of the frame the clock occupies.
+
+// Pixel rectangle with exclusive right and bottom edges.
+
+struct PixelRect
+{
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+
+    bool empty() const noexcept
+    {
+        return left >= right || top >= bottom;
+    }
+
+    int64_t area() const noexcept
+    {
+        return empty() ? 0 : int64_t{ right - left } * (bottom - top);
+    }
+};
+
+inline PixelRect unite(PixelRect const& a, PixelRect const& b) noexcept
+{
+    if (a.empty()) return b;
+    if (b.empty()) return a;
+    return { std::min(a.left, b.left), std::min(a.top, b.top), std::max(a.right, b.right), std::max(a.bottom, b.bottom) };
+}
+
+inline PixelRect intersect(PixelRect const& a, PixelRect const& b) noexcept
+{
+    return { std::max(a.left, b.left), std::max(a.top, b.top), std::min(a.right, b.right), std::min(a.bottom, b.bottom) };
+}
+
+inline PixelRect inflate(PixelRect const& rect, int32_t const amount) noexcept
+{
+    return { rect.left - amount, rect.top - amount, rect.right + amount, rect.bottom + amount };
+}
+
+struct Canvas
+{
+    Canvas() = default;
+
+    Canvas(uint32_t const width, uint32_t const height, float const dpi = 96.0f)
+    {
+        resize(width, height);
+        set_dpi(dpi);
+    }
+
+    void resize(uint32_t const width, uint32_t const height)
+    {
+        m_width = width;
+        m_height = height;
+        m_pixels.assign(size_t{ width } * height, 0);
+        m_bounds = {};
+    }
+
+    uint32_t width() const noexcept { return m_width; }
+    uint32_t height() const noexcept { return m_height; }
+    float dpi() const noexcept { return m_dpi; }
+    uint32_t* data() noexcept { return m_pixels.data(); }
+    uint32_t const* data() const noexcept { return m_pixels.data(); }
+
+    // The area that may hold anything other than transparent pixels. Clearing to transparent
+    // only needs to touch this area.
+
+    PixelRect bounds() const noexcept { return m_bounds; }
+
+    PixelRect extent() const noexcept
+    {
+        return { 0, 0, static_cast<int32_t>(m_width), static_cast<int32_t>(m_height) };
+    }
+
+    void set_dpi(float const dpi)
+    {
+        m_dpi = dpi;
+        set_transform(identity());
+    }
+
+    // Aliased shapes cover the pixels whose centres they contain, as D2D1_ANTIALIAS_MODE_ALIASED.
+
+    void set_antialias(bool const antialias)
+    {
+        m_antialias = antialias;
+    }
+
+    void set_color(Color const& color, float const opacity)
+    {
+        auto const a = color.a * opacity;
+        m_color[0] = color.b * a;
+        m_color[1] = color.g * a;
+        m_color[2] = color.r * a;
+        m_color[3] = a;
+    }
+
+    void clear(Color const& color = {})
+    {
+        if (color.a > 0.0f)
+        {
+            std::fill(m_pixels.begin(), m_pixels.end(), pack(color.b * color.a, color.g * color.a, color.r * color.a, color.a));
+            m_bounds = extent();
+            return;
+        }
+
+        for (auto y = m_bounds.top; y < m_bounds.bottom; ++y)
+        {
+            auto row = m_pixels.data() + size_t{ static_cast<uint32_t>(y) } * m_width;
+            std::fill(row + m_bounds.left, row + m_bounds.right, 0u);
+        }
+
+        m_bounds = {};
+    }
+
+    // Clears part of the canvas to transparent, leaving the bounds as they are.
+
+    void clear(PixelRect const& rect)
+    {
+        auto const area = intersect(rect, extent());
+
+        for (auto y = area.top; y < area.bottom; ++y)
+        {
+            auto row = m_pixels.data() + size_t{ static_cast<uint32_t>(y) } * m_width;
+            std::fill(row + area.left, row + area.right, 0u);
+        }
+    }
+
+    // Glyphs are drawn from an atlas rasterised at the canvas DPI, so each is a copy of its
+    // coverage at the nearest whole pixel. Only translation applies to them.
+
+    void set_atlas(GlyphAtlas const* atlas)
+    {
+        m_atlas = atlas;
+    }
+
+    void set_transform(Transform const& transform)
+    {
+        auto const scale = m_dpi / 96.0f;
+        m_transform = transform * Transform{ scale, 0.0f, 0.0f, scale, 0.0f, 0.0f };
+        m_scale = std::sqrt(std::abs(m_transform.m11 * m_transform.m22 - m_transform.m12 * m_transform.m21));
+    }
+
+    void draw_ellipse(float const x, float const y, float const rx, float const ry, float const stroke)
+    {
+        auto const center = map(x, y);
+        auto const radius = (rx + ry) / 2.0f * m_scale;
+        auto const half = stroke * m_scale / 2.0f;
+        auto const outer = radius + half + 1.0f;
+        auto const inner = radius - half - 1.0f;
+
+        auto const distance = [&](float px, float py)
+        {
+            px -= center.x;
+            py -= center.y;
+            return std::abs(std::sqrt(px * px + py * py) - radius) - half;
+        };
+
+        auto const top = static_cast<int>(std::floor(center.y - outer));
+        auto const bottom = static_cast<int>(std::ceil(center.y + outer));
+
+        for (int row = std::max(0, top); row < std::min(static_cast<int>(m_height), bottom); ++row)
+        {
+            auto const dy = row + 0.5f - center.y;
+
+            if (std::abs(dy) >= outer)
+            {
+                continue;
+            }
+
+            auto const reach = std::sqrt(outer * outer - dy * dy);
+
+            if (inner > 0.0f && std::abs(dy) < inner)
+            {
+                auto const hole = std::sqrt(inner * inner - dy * dy);
+                fill_row(row, center.x - reach, center.x - hole, distance);
+                fill_row(row, center.x + hole, center.x + reach, distance);
+            }
+            else
+            {
+                fill_row(row, center.x - reach, center.x + reach, distance);
+            }
+        }
+    }
+
+    // Round start cap and triangle end cap, matching the hand stroke style.
+
+    void draw_line(float const x0, float const y0, float const x1, float const y1, float const stroke)
+    {
+        auto const start = map(x0, y0);
+        auto const end = map(x1, y1);
+        auto const half = stroke * m_scale / 2.0f;
+        auto const dx = end.x - start.x;
+        auto const dy = end.y - start.y;
+        auto const length = std::sqrt(dx * dx + dy * dy);
+
+        if (length == 0.0f)
+        {
+            return;
+        }
+
+        auto const ux = dx / length;
+        auto const uy = dy / length;
+
+        auto const distance = [&](float px, float py)
+        {
+            px -= start.x;
+            py -= start.y;
+            auto const u = px * ux + py * uy;
+            auto const v = std::abs(py * ux - px * uy);
+
+            if (u < 0.0f)
+            {
+                return std::sqrt(u * u + v * v) - half;
+            }
+
+            if (u <= length)
+            {
+                return v - half;
+            }
+
+            return (v + u - length - half) * 0.70710678f;
+        };
+
+        // The stroke lies within a rectangle around the segment, grown by a pixel for the
+        // anti-aliased fringe.
+
+        auto const reach = half + 1.0f;
+        auto const ax = ux * reach;
+        auto const ay = uy * reach;
+
+        Point const corners[]
+        {
+            { start.x - ax - ay, start.y - ay + ax },
+            { end.x + ax - ay, end.y + ay + ax },
+            { end.x + ax + ay, end.y + ay - ax },
+            { start.x - ax + ay, start.y - ay - ax },
+        };
+
+        fill_polygon(corners, distance);
+    }
+
+    void draw_glyph(uint16_t const code, float const x0, float const y0, float, float)
+    {
+        if (!m_atlas)
+        {
+            return;
+        }
+
+        auto const& box = m_atlas->glyph(code);
+        auto const origin = map(x0, y0);
+        auto const left = static_cast<int32_t>(std::floor(origin.x + 0.5f));
+        auto const top = static_cast<int32_t>(std::floor(origin.y + 0.5f));
+        auto const area = intersect({ left, top, left + box.width, top + box.height }, extent());
+
+        if (area.empty())
+        {
+            return;
+        }
+
+        for (auto y = area.top; y < area.bottom; ++y)
+        {
+            auto pixels = m_pixels.data() + size_t{ static_cast<uint32_t>(y) } * m_width;
+            auto coverage = m_atlas->alpha.data() + size_t{ box.y + static_cast<uint32_t>(y - top) } * m_atlas->width + box.x - left;
+
+            for (auto x = area.left; x < area.right; ++x)
+            {
+                if (coverage[x])
+                {
+                    blend(pixels[x], coverage[x] / 255.0f);
+                }
+            }
+        }
+
+        m_bounds = unite(m_bounds, area);
+    }
+
+private:
+
+    struct Point
+    {
+        float x;
+        float y;
+    };
+
+    Point map(float const x, float const y) const noexcept
+    {
+        return
+        {
+            x * m_transform.m11 + y * m_transform.m21 + m_transform.dx,
+            x * m_transform.m12 + y * m_transform.m22 + m_transform.dy
+        };
+    }
+
+    static uint32_t pack(float const b, float const g, float const r, float const a) noexcept
+    {
+        return static_cast<uint32_t>(b * 255.0f + 0.5f) |
+            static_cast<uint32_t>(g * 255.0f + 0.5f) << 8 |
+            static_cast<uint32_t>(r * 255.0f + 0.5f) << 16 |
+            static_cast<uint32_t>(a * 255.0f + 0.5f) << 24;
+    }
+
+    template <typename Distance>
+    void fill_polygon(Point const (&corners)[4], Distance const& distance)
+    {
+        auto top = corners[0].y;
+        auto bottom = corners[0].y;
+
+        for (auto&& corner : corners)
+        {
+            top = std::min(top, corner.y);
+            bottom = std::max(bottom, corner.y);
+        }
+
+        auto const first = std::max(0, static_cast<int>(std::floor(top)));
+        auto const last = std::min(static_cast<int>(m_height), static_cast<int>(std::ceil(bottom)));
+
+        for (int row = first; row < last; ++row)
+        {
+            auto const y = row + 0.5f;
+            auto left = static_cast<float>(m_width);
+            auto right = 0.0f;
+
+            for (size_t i = 0; i != 4; ++i)
+            {
+                auto const& a = corners[i];
+                auto const& b = corners[(i + 1) % 4];
+
+                if ((a.y <= y) != (b.y <= y))
+                {
+                    auto const x = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+                    left = std::min(left, x);
+                    right = std::max(right, x);
+                }
+            }
+
+            fill_row(row, left, right, distance);
+        }
+    }
+
+    template <typename Distance>
+    void fill_row(int const row, float const left, float const right, Distance const& distance)
+    {
+        auto const first = std::max(0, static_cast<int>(std::floor(left)));
+        auto const last = std::min(static_cast<int>(m_width), static_cast<int>(std::ceil(right)));
+
+        if (first >= last)
+        {
+            return;
+        }
+
+        auto pixels = m_pixels.data() + size_t{ static_cast<uint32_t>(row) } * m_width;
+        auto const y = row + 0.5f;
+
+        for (int x = first; x < last; ++x)
+        {
+            auto const inside = distance(x + 0.5f, y);
+            auto const coverage = m_antialias ? std::clamp(0.5f - inside, 0.0f, 1.0f) : inside <= 0.0f ? 1.0f : 0.0f;
+
+            if (coverage > 0.0f)
+            {
+                blend(pixels[x], coverage);
+            }
+        }
+
+        m_bounds = unite(m_bounds, { first, row, last, row + 1 });
+    }
+
+    void blend(uint32_t& pixel, float const coverage) const noexcept
+    {
+        auto const inverse = 1.0f - m_color[3] * coverage;
+        uint32_t result = 0;
+
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            auto const shift = channel * 8;
+            auto const dest = static_cast<float>(pixel >> shift & 0xff);
+            auto const value = m_color[channel] * coverage * 255.0f + dest * inverse;
+            result |= static_cast<uint32_t>(std::min(255.0f, value + 0.5f)) << shift;
+        }
+
+        pixel = result;
+    }
+
+    uint32_t m_width{};
+    uint32_t m_height{};
+    float m_dpi{ 96.0f };
+    float m_scale{ 1.0f };
+    float m_color[4]{};
+    bool m_antialias{ true };
+    GlyphAtlas const* m_atlas{};
+    Transform m_transform{ identity() };
+    PixelRect m_bounds{};
+    std::vector<uint32_t> m_pixels;
+};
+
+// Three box passes approximate a Gaussian with the given standard deviation in pixels. Rows are
+// blurred in place and columns are blurred with a running sum per column so that every pass
+// walks memory in order.
+
+inline void blur(std::vector<float>& values, uint32_t const width, uint32_t const height, float const deviation)
+{
+    auto const box = static_cast<int>(std::sqrt(4.0f * deviation * deviation + 1.0f));
+    auto const radius = std::max(1, box / 2);
+    auto const scale = 1.0f / (2 * radius + 1);
+    std::vector<float> line(width);
+    std::vector<float> sums(width);
+    std::vector<float> columns(values.size());
+
+    for (int iteration = 0; iteration < 3; ++iteration)
+    {
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            auto row = values.data() + size_t{ y } * width;
+            std::copy(row, row + width, line.begin());
+            float sum = 0.0f;
+
+            for (int i = 0; i < radius && i < static_cast<int>(width); ++i)
+            {
+                sum += line[i];
+            }
+
+            for (int i = 0; i < static_cast<int>(width); ++i)
+            {
+                if (i + radius < static_cast<int>(width)) sum += line[i + radius];
+                row[i] = sum * scale;
+                if (i - radius >= 0) sum -= line[i - radius];
+            }
+        }
+
+        std::fill(sums.begin(), sums.end(), 0.0f);
+
+        auto const add = [&](int const y, float const sign)
+        {
+            auto row = values.data() + size_t{ static_cast<uint32_t>(y) } * width;
+
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                sums[x] += sign * row[x];
+            }
+        };
+
+        for (int y = 0; y < radius && y < static_cast<int>(height); ++y)
+        {
+            add(y, 1.0f);
+        }
+
+        for (int y = 0; y < static_cast<int>(height); ++y)
+        {
+            if (y + radius < static_cast<int>(height)) add(y + radius, 1.0f);
+            auto out = columns.data() + size_t{ static_cast<uint32_t>(y) } * width;
+
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                out[x] = sums[x] * scale;
+            }
+
+            if (y - radius >= 0) add(y - radius, -1.0f);
+        }
+
+        values.swap(columns);
+    }
+}
+
+// The shadow is a black copy of the layer's alpha, blurred like the Direct2D shadow effect. Only
+// the drawn bounds of the layer, grown by the reach of the blur, are processed. With a downsample
+// factor the alpha is averaged over blocks of that many pixels square, blurred at that resolution,
+// and scaled back up bilinearly, which costs a fraction of the blur for a shadow that is soft
+// anyway.
+
+struct ShadowMask
+{
+    PixelRect region;
+    std::vector<float> alpha; // 0 to 255, row by row across the region.
+
+    float at(int32_t const x, int32_t const y) const noexcept
+    {
+        return alpha[size_t{ static_cast<uint32_t>(y - region.top) } * (region.right - region.left) + (x - region.left)];
+    }
+};
+
+inline ShadowMask shadow_mask(Canvas const& layer, float const deviation, uint32_t const downsample = 1)
+{
+    auto const pixels = deviation * layer.dpi() / 96.0f;
+    auto const spread = static_cast<int32_t>(std::ceil(pixels * 3.0f)) + 1;
+    ShadowMask mask{ intersect(inflate(layer.bounds(), spread), layer.extent()), {} };
+
+    if (mask.region.empty())
+    {
+        mask.region = {};
+        return mask;
+    }
+
+    auto const width = static_cast<uint32_t>(mask.region.right - mask.region.left);
+    auto const height = static_cast<uint32_t>(mask.region.bottom - mask.region.top);
+    mask.alpha.resize(size_t{ width } * height);
+
+    if (downsample <= 1)
+    {
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            auto source = layer.data() + size_t{ mask.region.top + y } * layer.width() + mask.region.left;
+
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                mask.alpha[size_t{ y } * width + x] = static_cast<float>(source[x] >> 24);
+            }
+        }
+
+        blur(mask.alpha, width, height, pixels);
+        return mask;
+    }
+
+    auto const small_width = (width + downsample - 1) / downsample;
+    auto const small_height = (height + downsample - 1) / downsample;
+    std::vector<float> small(size_t{ small_width } * small_height);
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        auto source = layer.data() + size_t{ mask.region.top + y } * layer.width() + mask.region.left;
+        auto row = small.data() + size_t{ y / downsample } * small_width;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            row[x / downsample] += static_cast<float>(source[x] >> 24);
+        }
+    }
+
+    // Blocks cut short by the edge of the region hold nothing but the blur's own reach, so
+    // dividing them by the full block size does no harm.
+
+    auto const block = 1.0f / static_cast<float>(downsample * downsample);
+
+    for (auto& value : small)
+    {
+        value *= block;
+    }
+
+    blur(small, small_width, small_height, pixels / downsample);
+
+    struct Sample
+    {
+        uint32_t first;
+        uint32_t second;
+        float weight;
+    };
+
+    auto const samples = [&](uint32_t const count, uint32_t const limit)
+    {
+        std::vector<Sample> result(count);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            auto const position = std::max(0.0f, (i + 0.5f) / downsample - 0.5f);
+            auto const first = std::min(static_cast<uint32_t>(position), limit - 1);
+            result[i] = { first, std::min(first + 1, limit - 1), position - first };
+        }
+
+        return result;
+    };
+
+    auto const columns = samples(width, small_width);
+    auto const rows = samples(height, small_height);
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        auto const upper = small.data() + size_t{ rows[y].first } * small_width;
+        auto const lower = small.data() + size_t{ rows[y].second } * small_width;
+        auto out = mask.alpha.data() + size_t{ y } * width;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            auto const& column = columns[x];
+            auto const top = upper[column.first] + (upper[column.second] - upper[column.first]) * column.weight;
+            auto const bottom = lower[column.first] + (lower[column.second] - lower[column.first]) * column.weight;
+            out[x] = top + (bottom - top) * rows[y].weight;
+        }
+    }
+
+    return mask;
+}
+
+// Calls action(pixel, alpha) for every target pixel under the shadow once it is moved by shift.
+
+template <typename Action>
+void for_each_shadow_pixel(Canvas& target, ShadowMask const& mask, int32_t const shift, Action&& action)
+{
+    PixelRect const moved{ mask.region.left + shift, mask.region.top + shift, mask.region.right + shift, mask.region.bottom + shift };
+    auto const visible = intersect(moved, target.extent());
+
+    for (auto y = visible.top; y < visible.bottom; ++y)
+    {
+        auto row = target.data() + size_t{ static_cast<uint32_t>(y) } * target.width();
+
+        for (auto x = visible.left; x < visible.right; ++x)
+        {
+            auto const alpha = mask.at(x - shift, y - shift);
+
+            if (alpha >= 0.5f)
+            {
+                action(row[x], alpha);
+            }
+        }
+    }
+}
+
+inline int32_t shadow_shift(Canvas const& layer, float const offset)
+{
+    return static_cast<int32_t>(std::lround(offset * layer.dpi() / 96.0f));
+}
+
+// Equivalent of the Direct2D shadow effect drawn at an offset and composited source-over.
+
+inline void draw_shadow(Canvas& target, Canvas const& layer, float const deviation, float const offset, uint32_t const downsample = 1)
+{
+    for_each_shadow_pixel(target, shadow_mask(layer, deviation, downsample), shadow_shift(layer, offset), [](uint32_t& pixel, float const alpha)
+    {
+        auto const inverse = (255.0f - alpha) / 255.0f;
+        uint32_t result = static_cast<uint32_t>(std::min(255.0f, alpha + (pixel >> 24) * inverse + 0.5f)) << 24;
+
+        for (int channel = 0; channel < 24; channel += 8)
+        {
+            result |= static_cast<uint32_t>((pixel >> channel & 0xff) * inverse + 0.5f) << channel;
+        }
+
+        pixel = result;
+    });
+}
+
+inline void draw_image(Canvas& target, Canvas const& layer)
+{
+    auto const region = intersect(layer.bounds(), target.extent());
+
+    for (auto y = region.top; y < region.bottom; ++y)
+    {
+        auto row = target.data() + size_t{ static_cast<uint32_t>(y) } * target.width();
+        auto source = layer.data() + size_t{ static_cast<uint32_t>(y) } * layer.width();
+
+        for (auto x = region.left; x < region.right; ++x)
+        {
+            auto const inverse = 255 - (source[x] >> 24);
+
+            if (inverse == 255)
+            {
+                continue;
+            }
+
+            uint32_t result = 0;
+
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                auto const value = (source[x] >> shift & 0xff) + ((row[x] >> shift & 0xff) * inverse + 127) / 255;
+                result |= std::min(255u, value) << shift;
+            }
+
+            row[x] = result;
+        }
+    }
+}
+
+// A replay target that only accumulates the pixel bounds of what a list draws, so the damage done
+// by moving the hands is known without rasterising them.
+
+struct BoundsTarget
+{
+    float scale;
+    Transform transform = identity();
+    float left = HUGE_VALF, top = HUGE_VALF, right = -HUGE_VALF, bottom = -HUGE_VALF;
+
+    void set_transform(Transform const& value)
+    {
+        transform = value * Transform{ scale, 0.0f, 0.0f, scale, 0.0f, 0.0f };
+    }
+
+    void add(float const x, float const y, float const reach)
+    {
+        auto const px = x * transform.m11 + y * transform.m21 + transform.dx;
+        auto const py = x * transform.m12 + y * transform.m22 + transform.dy;
+        auto const extent = reach * std::sqrt(std::abs(transform.m11 * transform.m22 - transform.m12 * transform.m21));
+        left = std::min(left, px - extent);
+        top = std::min(top, py - extent);
+        right = std::max(right, px + extent);
+        bottom = std::max(bottom, py + extent);
+    }
+
+    void draw_ellipse(float const x, float const y, float const rx, float const ry, float const stroke)
+    {
+        add(x, y, std::max(rx, ry) + stroke / 2.0f);
+    }
+
+    void draw_line(float const x0, float const y0, float const x1, float const y1, float const stroke)
+    {
+        add(x0, y0, stroke / 2.0f);
+        add(x1, y1, stroke / 2.0f);
+    }
+
+    void draw_glyph(uint16_t, float const x0, float const y0, float const x1, float const y1)
+    {
+        add(x0, y0, 0.0f);
+        add(x1, y1, 0.0f);
+    }
+};
+
+// The pixels a list and its drop shadow may touch when drawn at the given DPI.
+
+inline PixelRect damage_bounds(DisplayList const& list, float const dpi, FaceTheme const& theme = default_theme)
+{
+    BoundsTarget target{ dpi / 96.0f };
+    target.set_transform(identity());
+    replay(list, target);
+
+    if (target.left > target.right)
+    {
+        return {};
+    }
+
+    PixelRect const drawn
+    {
+        static_cast<int32_t>(std::floor(target.left)) - 1,
+        static_cast<int32_t>(std::floor(target.top)) - 1,
+        static_cast<int32_t>(std::ceil(target.right)) + 1,
+        static_cast<int32_t>(std::ceil(target.bottom)) + 1
+    };
+
+    auto const shadow = inflate(drawn, static_cast<int32_t>(std::ceil(theme.shadow_deviation * target.scale * 3.0f)) + 1);
+    auto const shift = static_cast<int32_t>(std::lround(theme.shadow_offset * target.scale));
+    return unite(drawn, { shadow.left + shift, shadow.top + shift, shadow.right + shift, shadow.bottom + shift });
+}
+
+// Cells meet at whole pixels, rounded as glyphs are placed, so that clearing one never touches
+// its neighbours.
+
+inline PixelRect cell_pixels(GlyphRect const& rect, float const dpi)
+{
+    auto const scale = dpi / 96.0f;
+
+    return
+    {
+        static_cast<int32_t>(std::floor(rect.left * scale + 0.5f)),
+        static_cast<int32_t>(std::floor(rect.top * scale)),
+        static_cast<int32_t>(std::floor(rect.right * scale + 0.5f)),
+        static_cast<int32_t>(std::ceil(rect.bottom * scale))
+    };
+}
+
+// Redraws the cells of a readout that changed into a layer of its own, which keeps the rest, and
+// returns the pixels touched. The layer's atlas and color should already be set.
+
+inline PixelRect draw_readout(Canvas& layer, DigitalReadout const& readout, uint32_t const changed)
+{
+    PixelRect damage{};
+    layer.set_transform(identity());
+
+    for (uint32_t cell = 0; cell != DigitalReadout::cells; ++cell)
+    {
+        if (changed >> cell & 1)
+        {
+            auto const area = cell_pixels(readout.cell(cell), layer.dpi());
+            layer.clear(area);
+            auto const& op = readout.glyph(cell);
+            layer.draw_glyph(op.slot, op.x0, op.y0, op.x1, op.y1);
+            damage = unite(damage, area);
+        }
+    }
+
+    return damage;
+}
+
+// Same composition as Window::draw: the background, drop shadow, then the clock layer holding
+// each of the lists in turn.
+
+template <typename... Lists>
+void draw_scene(Canvas& frame, Canvas& layer, FaceTheme const& theme, Lists const&... lists)
+{
+    frame.clear(theme.background);
+    layer.clear();
+    layer.set_color(theme.ink, theme.opacity);
+    (replay(lists, layer), ...);
+    layer.set_transform(identity());
+    draw_shadow(frame, layer, theme.shadow_deviation, theme.shadow_offset);
+    draw_image(frame, layer);
+}
+
+// Renders a sequence of frames whose dials stay put. The white background with the dial shadow
+// and the dial layer are drawn once; each frame only rasterises, blurs and composites the hands.
+// The hands never overlap the dials and blurring is linear, so on an opaque background the hand
+// shadow's share of it can simply be subtracted and the result matches draw_scene at the full
+// tier. A translucent background is composed in full each frame, as draw_scene does. Lower tiers
+// blur the shadows at half resolution, or drop them and draw aliased.
+
+struct SoftwareScene
+{
+    SoftwareScene(uint32_t const width, uint32_t const height, float const dpi, DisplayList const& dials, FaceTheme const& theme = default_theme, DetailTier const tier = DetailTier::full, GlyphAtlas const* glyphs = nullptr) :
+        m_background(width, height, dpi),
+        m_dials(width, height, dpi),
+        m_hands(width, height, dpi),
+        m_theme(theme),
+        m_tier(tier)
+    {
+        auto const antialias = DetailTier::sprite != tier;
+        m_dials.set_antialias(antialias);
+        m_dials.set_atlas(glyphs);
+        m_hands.set_antialias(antialias);
+        m_background.clear(theme.background);
+        m_dials.set_color(theme.ink, theme.opacity);
+        replay(dials, m_dials);
+        m_dials.set_transform(identity());
+
+        // Without shadows the dials are baked into the background, leaving only the hands to
+        // composite.
+
+        if (DetailTier::sprite == tier)
+        {
+            draw_image(m_background, m_dials);
+        }
+        else if (!translucent())
+        {
+            draw_shadow(m_background, m_dials, theme.shadow_deviation, theme.shadow_offset, downsample());
+        }
+
+        m_hands.set_color(theme.ink, theme.opacity);
+    }
+
+    DetailTier tier() const noexcept
+    {
+        return m_tier;
+    }
+
+    void draw(Canvas& frame, DisplayList const& hands)
+    {
+        frame = m_background;
+
+        if (DetailTier::sprite != m_tier && translucent())
+        {
+            m_layer = m_dials;
+            replay(hands, m_layer);
+            m_layer.set_transform(identity());
+            draw_shadow(frame, m_layer, m_theme.shadow_deviation, m_theme.shadow_offset, downsample());
+            draw_image(frame, m_layer);
+            return;
+        }
+
+        m_hands.clear();
+        replay(hands, m_hands);
+        m_hands.set_transform(identity());
+
+        if (DetailTier::sprite == m_tier)
+        {
+            draw_image(frame, m_hands);
+            return;
+        }
+
+        float const background[3] = { m_theme.background.b, m_theme.background.g, m_theme.background.r };
+
+        for_each_shadow_pixel(frame, shadow_mask(m_hands, m_theme.shadow_deviation, downsample()), shadow_shift(m_hands, m_theme.shadow_offset), [&](uint32_t& pixel, float const alpha)
+        {
+            uint32_t result = pixel & 0xff000000;
+
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                auto const amount = static_cast<uint32_t>(alpha * background[channel] + 0.5f);
+                auto const value = pixel >> channel * 8 & 0xff;
+                result |= (value > amount ? value - amount : 0) << channel * 8;
+            }
+
+            pixel = result;
+        });
+
+        draw_image(frame, m_dials);
+        draw_image(frame, m_hands);
+    }
+
+private:
+
+    uint32_t downsample() const noexcept
+    {
+        return DetailTier::reduced == m_tier ? 2 : 1;
+    }
+
+    bool translucent() const noexcept
+    {
+        return m_theme.background.a < 1.0f;
+    }
+
+    Canvas m_background;
+    Canvas m_dials;
+    Canvas m_hands;
+    Canvas m_layer;     // the dials and hands together, on a translucent background
+    FaceTheme m_theme;
+    DetailTier m_tier;
+};
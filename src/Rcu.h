@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// Read-copy-update for state that is read on every frame and replaced now and then, such as the
+// configuration. Readers never lock or wait: they load the pointer to the current version and use
+// it in place. A writer builds a whole new version off to the side and publishes it with a single
+// atomic swap, so a reader sees either the old version or the new one, never a mixture.
+//
+// The version replaced is retired rather than freed, since readers may still be using it. Each
+// reader has a slot recording the epoch it last passed a quiescent point, a point at which it
+// holds no reference from before; for a render loop that is the start of each frame. A retired
+// version is freed once every reader has passed a quiescent point since it was replaced. Readers
+// that go offline, for example to sleep, drop out of the reckoning until they read again.
+
+struct alignas(64) RcuSlot
+{
+    std::atomic<uint64_t> epoch{};      // zero while offline
+    std::atomic<bool> claimed{};
+};
+
+template <typename T>
+struct RcuPointer
+{
+    static constexpr size_t max_readers = 16;
+
+    explicit RcuPointer(std::unique_ptr<T> initial) :
+        m_current(initial.release())
+    {
+    }
+
+    RcuPointer(RcuPointer const&) = delete;
+    RcuPointer& operator=(RcuPointer const&) = delete;
+
+    // Readers must all be gone by now.
+
+    ~RcuPointer()
+    {
+        delete m_current.load();
+
+        for (auto&& retired : m_retired)
+        {
+            delete retired.value;
+        }
+    }
+
+    // Makes value the current version and returns the number of retired versions still waiting
+    // for readers. Writers are serialised with each other but never with readers.
+
+    size_t publish(std::unique_ptr<T> value)
+    {
+        std::lock_guard<std::mutex> lock(m_writer);
+        auto const previous = m_current.exchange(value.release());
+        m_retired.push_back({ previous, m_epoch.fetch_add(1) + 1 });
+        ++m_published;
+        return reclaim_locked();
+    }
+
+    // Frees the retired versions that no reader can still hold, returning the number still
+    // waiting. Writers call this after publishing and from time to time while any remain.
+
+    size_t reclaim()
+    {
+        std::lock_guard<std::mutex> lock(m_writer);
+        return reclaim_locked();
+    }
+
+    uint64_t published() const noexcept
+    {
+        return m_published;
+    }
+
+    uint64_t reclaimed() const noexcept
+    {
+        return m_reclaimed;
+    }
+
+private:
+
+    template <typename> friend struct RcuReader;
+
+    struct Retired
+    {
+        T* value;
+        uint64_t epoch;     // readers at or past this epoch cannot hold it
+    };
+
+    size_t reclaim_locked()
+    {
+        auto oldest = UINT64_MAX;
+
+        for (auto&& slot : m_slots)
+        {
+            if (auto const epoch = slot.epoch.load(); epoch)
+            {
+                oldest = std::min(oldest, epoch);
+            }
+        }
+
+        auto const kept = std::partition(m_retired.begin(), m_retired.end(), [&](Retired const& retired)
+        {
+            return retired.epoch > oldest;
+        });
+
+        for (auto it = kept; it != m_retired.end(); ++it)
+        {
+            delete it->value;
+            ++m_reclaimed;
+        }
+
+        m_retired.erase(kept, m_retired.end());
+        return m_retired.size();
+    }
+
+    std::atomic<T*> m_current;
+    std::atomic<uint64_t> m_epoch{ 1 };
+    RcuSlot m_slots[max_readers];
+    std::mutex m_writer;
+    std::vector<Retired> m_retired;
+    std::atomic<uint64_t> m_published{};
+    std::atomic<uint64_t> m_reclaimed{};
+};
+
+// A thread's handle on an RcuPointer. It starts offline.
+
+template <typename T>
+struct RcuReader
+{
+    explicit RcuReader(RcuPointer<T>& pointer) :
+        m_pointer(pointer)
+    {
+        for (auto&& slot : pointer.m_slots)
+        {
+            if (!slot.claimed.exchange(true))
+            {
+                m_slot = &slot;
+                return;
+            }
+        }
+
+        throw std::runtime_error("RcuReader: too many readers");
+    }
+
+    RcuReader(RcuReader const&) = delete;
+    RcuReader& operator=(RcuReader const&) = delete;
+
+    ~RcuReader()
+    {
+        offline();
+        m_slot->claimed.store(false);
+    }
+
+    // A quiescent point: anything read before is given up and the current version returned,
+    // which stays valid until the next call to read or offline. The epoch is announced before
+    // the pointer is loaded, so whatever version is loaded can only be retired at a later epoch
+    // than the one announced.
+
+    T const* read() noexcept
+    {
+        m_slot->epoch.store(m_pointer.m_epoch.load());
+        return m_pointer.m_current.load();
+    }
+
+    void offline() noexcept
+    {
+        m_slot->epoch.store(0);
+    }
+
+private:
+
+    RcuPointer<T>& m_pointer;
+    RcuSlot* m_slot{};
+};
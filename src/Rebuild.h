@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+// Device-dependent resources are described as a list of build steps with their dependencies so
+// that they can be recreated in bulk after device loss. Steps whose dependencies are complete run
+// concurrently. A backend is simply the set of steps it supplies, so a fake backend can inject
+// delays or failures to exercise loss and recovery without a GPU.
+
+struct RebuildStep
+{
+    char const* name;
+    uint32_t after; // Bit mask of the indices of steps, at most 32, that must complete first.
+    std::function<void()> build;
+};
+
+struct RebuildTiming
+{
+    char const* name;
+    double start;  // Seconds since the rebuild began.
+    double finish;
+};
+
+inline std::vector<RebuildTiming> rebuild(std::vector<RebuildStep> const& steps)
+{
+    if (steps.size() > 32)
+    {
+        throw std::logic_error("Rebuild supports at most 32 steps");
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto const begin = clock::now();
+
+    auto const seconds = [&]
+    {
+        return std::chrono::duration<double>(clock::now() - begin).count();
+    };
+
+    std::vector<RebuildTiming> timings(steps.size());
+    uint32_t done = 0;
+    uint32_t const all = steps.size() == 32 ? ~0u : (1u << steps.size()) - 1;
+
+    while (done != all)
+    {
+        std::vector<std::pair<size_t, std::future<void>>> wave;
+
+        for (size_t i = 0; i != steps.size(); ++i)
+        {
+            auto const bit = 1u << i;
+
+            if (!(done & bit) && (steps[i].after & done) == steps[i].after)
+            {
+                wave.emplace_back(i, std::async(std::launch::async, [&, i]
+                {
+                    timings[i].name = steps[i].name;
+                    timings[i].start = seconds();
+                    steps[i].build();
+                    timings[i].finish = seconds();
+                }));
+            }
+        }
+
+        if (wave.empty())
+        {
+            throw std::logic_error("Rebuild steps have unsatisfiable dependencies");
+        }
+
+        for (auto&& [i, step] : wave)
+        {
+            step.wait();
+        }
+
+        for (auto&& [i, step] : wave)
+        {
+            step.get();
+            done |= 1u << i;
+        }
+    }
+
+    return timings;
+}
+
+inline std::future<std::vector<RebuildTiming>> rebuild_async(std::vector<RebuildStep> steps)
+{
+    return std::async(std::launch::async, [steps = std::move(steps)]
+    {
+        return rebuild(steps);
+    });
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <utility>
+
+// Offscreen bitmaps are allocated in power-of-two buckets, with the visible region selected by a
+// clip, so a live resize only reallocates when a dimension crosses a bucket boundary.
+
+inline uint32_t size_bucket(uint32_t const size, uint32_t const minimum = 256)
+{
+    auto bucket = minimum;
+
+    while (bucket < size)
+    {
+        bucket *= 2;
+    }
+
+    return bucket;
+}
+
+// Device-size resources, such as the offscreen bitmaps behind the clock, are kept for the last
+// few DPIs and size buckets the window has used, most recent first. A window moved back to a
+// monitor it has already been on then finds everything it drew with there, rather than stalling
+// to rebuild it. Other resources that depend on the DPI, such as glyph atlases, may be cached
+// under keys of their own.
+
+struct DpiKey
+{
+    float dpi;
+    uint32_t width;     // size buckets, in pixels
+    uint32_t height;
+
+    bool operator==(DpiKey const& other) const noexcept
+    {
+        return dpi == other.dpi && width == other.width && height == other.height;
+    }
+};
+
+template <typename Resources, typename Key = DpiKey>
+struct DpiResourceCache
+{
+    explicit DpiResourceCache(size_t const capacity = 3) :
+        m_capacity(capacity)
+    {
+    }
+
+    // Returns the resources for key, calling create to build them on a miss. The least recently
+    // used set is released once there are more than capacity. References stay valid until their
+    // set is released.
+
+    template <typename Create>
+    Resources& get(Key const& key, Create&& create)
+    {
+        for (auto entry = m_entries.begin(); entry != m_entries.end(); ++entry)
+        {
+            if (entry->first == key)
+            {
+                m_entries.splice(m_entries.begin(), m_entries, entry);
+                ++m_hits;
+                return entry->second;
+            }
+        }
+
+        ++m_misses;
+        m_entries.emplace_front(key, create());
+
+        if (m_entries.size() > m_capacity)
+        {
+            m_entries.pop_back();
+            ++m_evictions;
+        }
+
+        return m_entries.front().second;
+    }
+
+    // Releases everything, as when the device is lost.
+
+    void clear() noexcept
+    {
+        m_entries.clear();
+    }
+
+    size_t size() const noexcept
+    {
+        return m_entries.size();
+    }
+
+    uint64_t hits() const noexcept
+    {
+        return m_hits;
+    }
+
+    uint64_t misses() const noexcept
+    {
+        return m_misses;
+    }
+
+    uint64_t evictions() const noexcept
+    {
+        return m_evictions;
+    }
+
+private:
+
+    size_t m_capacity;
+    std::list<std::pair<Key, Resources>> m_entries;
+    uint64_t m_hits{};
+    uint64_t m_misses{};
+    uint64_t m_evictions{};
+};
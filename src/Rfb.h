@@ -0,0 +1,714 @@
+#pragma once
+
+#include "Png.h"
+#include "Raster.h"
+#include "Socket.h"
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// An RFB 3.8 (VNC) server, bound to loopback, serving whatever frames are published to it. Only
+// the damage reported with each frame is sent, so a sweeping second hand costs a small band of
+// the frame rather than a full-frame diff. Damage is cut into bands sent as separate rectangles
+// and, for clients that accept zlib encoding, the bands are deflated in parallel as blocks of
+// the connection's single zlib stream, each primed with the bytes that precede it.
+//
+// Each client has at most one update being encoded or sent. Damage arriving meanwhile is merged
+// and sent from the newest frame once the client asks again, so a slow client skips frames
+// rather than falling behind.
+
+struct RfbPixelFormat
+{
+    uint8_t bits_per_pixel;
+    uint8_t depth;
+    uint8_t big_endian;
+    uint8_t true_colour;
+    uint16_t red_max;
+    uint16_t green_max;
+    uint16_t blue_max;
+    uint8_t red_shift;
+    uint8_t green_shift;
+    uint8_t blue_shift;
+};
+
+constexpr RfbPixelFormat rfb_bgrx = { 32, 24, 0, 1, 255, 255, 255, 16, 8, 0 };
+
+constexpr int32_t rfb_encoding_raw = 0;
+constexpr int32_t rfb_encoding_zlib = 6;
+constexpr int32_t rfb_encoding_desktop_size = -223;
+
+struct RfbFrame
+{
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint32_t> pixels;
+};
+
+// Converts a row of opaque BGRA pixels to the client's pixel format.
+
+inline uint8_t* convert_pixels(RfbPixelFormat const& format, uint32_t const* source, uint32_t const count, uint8_t* output) noexcept
+{
+    auto const bytes = format.bits_per_pixel / 8u;
+
+    if (4 == bytes && !format.big_endian && 255 == format.red_max && 255 == format.green_max && 255 == format.blue_max &&
+        16 == format.red_shift && 8 == format.green_shift && 0 == format.blue_shift)
+    {
+        memcpy(output, source, size_t{ count } * 4);
+        return output + size_t{ count } * 4;
+    }
+
+    for (uint32_t i = 0; i != count; ++i)
+    {
+        auto const pixel = source[i];
+        auto const scale = [](uint32_t const value, uint32_t const max) { return (value * max + 127) / 255; };
+
+        auto const value = scale(pixel >> 16 & 0xff, format.red_max) << format.red_shift |
+            scale(pixel >> 8 & 0xff, format.green_max) << format.green_shift |
+            scale(pixel & 0xff, format.blue_max) << format.blue_shift;
+
+        for (uint32_t b = 0; b != bytes; ++b)
+        {
+            *output++ = static_cast<uint8_t>(value >> (format.big_endian ? (bytes - 1 - b) * 8 : b * 8));
+        }
+    }
+
+    return output;
+}
+
+inline void rfb_put16(std::vector<uint8_t>& bytes, uint32_t const value)
+{
+    bytes.push_back(static_cast<uint8_t>(value >> 8));
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+inline void rfb_put32(std::vector<uint8_t>& bytes, uint32_t const value)
+{
+    rfb_put16(bytes, value >> 16);
+    rfb_put16(bytes, value);
+}
+
+inline uint32_t rfb_get16(uint8_t const* data) noexcept
+{
+    return uint32_t{ data[0] } << 8 | data[1];
+}
+
+inline uint32_t rfb_get32(uint8_t const* data) noexcept
+{
+    return rfb_get16(data) << 16 | rfb_get16(data + 2);
+}
+
+struct RfbServer
+{
+    static constexpr uint32_t band_bytes = 64 * 1024;
+    static constexpr uint32_t max_cut_text = 64 * 1024;
+
+    RfbServer(uint16_t const port, unsigned const threads = std::max(1u, std::thread::hardware_concurrency())) :
+        m_pool(std::make_unique<WorkerPool>(threads))
+    {
+        if (!m_server.open(listen_loopback(port)))
+        {
+            throw std::runtime_error("RfbServer: cannot listen on loopback");
+        }
+
+        m_port = socket_port(m_server.listener());
+        m_thread = std::thread([this] { m_server.run(m_stopping, *this); });
+    }
+
+    ~RfbServer()
+    {
+        m_stopping = true;
+        m_server.wake();
+        m_thread.join();
+        m_pool.reset();
+    }
+
+    RfbServer(RfbServer const&) = delete;
+    RfbServer& operator=(RfbServer const&) = delete;
+
+    uint16_t port() const noexcept
+    {
+        return m_port;
+    }
+
+    uint64_t bytes_sent() const noexcept
+    {
+        return m_bytes_sent;
+    }
+
+    uint64_t updates_sent() const noexcept
+    {
+        return m_updates_sent;
+    }
+
+    // Publishes a frame along with the region that changed since the previous one. The frame is
+    // updated in place unless an encoder still holds it.
+
+    void publish(uint32_t const* pixels, uint32_t const width, uint32_t const height, uint32_t const stride, PixelRect dirty)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            PixelRect const full{ 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) };
+
+            if (!m_frame || m_frame->width != width || m_frame->height != height)
+            {
+                m_frame = std::make_shared<RfbFrame>(RfbFrame{ width, height, std::vector<uint32_t>(size_t{ width } * height) });
+                dirty = full;
+            }
+            else if (m_frame.use_count() > 1)
+            {
+                m_frame = std::make_shared<RfbFrame>(*m_frame);
+            }
+
+            dirty = intersect(dirty, full);
+
+            for (auto y = dirty.top; y < dirty.bottom; ++y)
+            {
+                memcpy(m_frame->pixels.data() + size_t{ static_cast<uint32_t>(y) } * width + dirty.left,
+                    pixels + size_t{ static_cast<uint32_t>(y) } * stride + dirty.left,
+                    size_t{ static_cast<uint32_t>(dirty.right - dirty.left) } * 4);
+            }
+
+            m_damage = unite(m_damage, dirty);
+        }
+
+        m_server.wake();
+    }
+
+private:
+
+    enum class Phase { version, security, init, normal };
+
+    struct Client
+    {
+        Socket socket;
+        Phase phase{ Phase::version };
+        int32_t minor{};    // the protocol version the client asked for, 3.minor
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        size_t sent{};
+        RfbPixelFormat format{ rfb_bgrx };
+        bool zlib{};
+        bool desktop_size{};
+        bool requested{};
+        bool encoding{};
+        PixelRect damage{};
+        uint32_t width{};
+        uint32_t height{};
+        std::vector<uint8_t> history;
+        bool streaming{};
+    };
+
+    struct Update
+    {
+        uint64_t id;
+        std::vector<uint8_t> message;
+        std::vector<uint8_t> history;
+        bool zlib;  // as the client's encodings were when the update was started
+    };
+
+    template <typename> friend struct SocketServer;
+
+    short events(Client const& client) const noexcept
+    {
+        return static_cast<short>(client.sent != client.output.size() ? POLLIN | POLLOUT : POLLIN);
+    }
+
+    void woken()
+    {
+        take_damage();
+        take_updates();
+    }
+
+    void accepted(uint64_t const id, Client& client)
+    {
+        int const on = 1;
+        setsockopt(client.socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const*>(&on), sizeof(on));
+        write(id, "RFB 003.008\n", 12);
+    }
+
+    void writable(uint64_t const id, Client&)
+    {
+        flush(id);
+    }
+
+    void received(uint64_t const id, Client& client, char const* data, size_t const size)
+    {
+        client.input.insert(client.input.end(), data, data + size);
+
+        while (m_server.find(id) && process(id))
+        {
+        }
+    }
+
+    void write(uint64_t const id, void const* data, size_t const size)
+    {
+        auto& client = m_server.clients()[id];
+        auto const bytes = static_cast<uint8_t const*>(data);
+        client.output.insert(client.output.end(), bytes, bytes + size);
+        flush(id);
+    }
+
+    void flush(uint64_t const id)
+    {
+        auto const client = m_server.find(id);
+
+        if (!client)
+        {
+            return;
+        }
+
+        auto const before = client->sent;
+        SendBuffer const buffer{ client->output.data(), client->output.size() };
+
+        if (!m_server.send(id, &buffer, 1, client->sent))
+        {
+            return;
+        }
+
+        m_bytes_sent += client->sent - before;
+
+        if (client->sent == client->output.size())
+        {
+            client->output.clear();
+            client->sent = 0;
+            start_update(id);
+        }
+    }
+
+    // Consumes one complete message from the client's input, returning false once more input is
+    // needed or the client has been dropped.
+
+    bool process(uint64_t const id)
+    {
+        auto& client = m_server.clients()[id];
+        auto const& input = client.input;
+        size_t used = 0;
+
+        if (Phase::version == client.phase)
+        {
+            if (input.size() < 12)
+            {
+                return false;
+            }
+
+            if (memcmp(input.data(), "RFB 003.", 8))
+            {
+                m_server.drop(id);
+                return false;
+            }
+
+            // Version 3.3 has the server choose the security type; later ones let the client.
+
+            client.minor = atoi(std::string(input.begin() + 8, input.begin() + 11).c_str());
+            used = 12;
+
+            if (client.minor < 7)
+            {
+                uint8_t const none[4] = { 0, 0, 0, 1 };
+                client.phase = Phase::init;
+                write(id, none, sizeof(none));
+            }
+            else
+            {
+                uint8_t const types[2] = { 1, 1 };
+                client.phase = Phase::security;
+                write(id, types, sizeof(types));
+            }
+        }
+        else if (Phase::security == client.phase)
+        {
+            if (input.empty())
+            {
+                return false;
+            }
+
+            if (1 != input[0])
+            {
+                m_server.drop(id);
+                return false;
+            }
+
+            // Only 3.8 reports the result of security type None; 3.7 goes straight on to init.
+
+            uint8_t const ok[4] = {};
+            used = 1;
+            client.phase = Phase::init;
+
+            if (client.minor >= 8)
+            {
+                write(id, ok, sizeof(ok));
+            }
+        }
+        else if (Phase::init == client.phase)
+        {
+            if (input.empty())
+            {
+                return false;
+            }
+
+            used = 1;
+            client.phase = Phase::normal;
+            server_init(id);
+        }
+        else
+        {
+            if (input.empty())
+            {
+                return false;
+            }
+
+            static size_t const sizes[] = { 20, 0, 4, 10, 8, 6, 8 };
+
+            if (input[0] >= sizeof(sizes) / sizeof(*sizes) || 1 == input[0])
+            {
+                m_server.drop(id);
+                return false;
+            }
+
+            used = sizes[input[0]];
+
+            if (2 == input[0] && input.size() >= 4)
+            {
+                used += 4 * size_t{ rfb_get16(&input[2]) };
+            }
+            else if (6 == input[0] && input.size() >= 8)
+            {
+                // Cut text is ignored, but it is still buffered whole, so there is a limit to it.
+
+                if (rfb_get32(&input[4]) > max_cut_text)
+                {
+                    m_server.drop(id);
+                    return false;
+                }
+
+                used += rfb_get32(&input[4]);
+            }
+
+            if (input.size() < used)
+            {
+                return false;
+            }
+
+            message(id, client);
+        }
+
+        if (auto const remaining = m_server.find(id))
+        {
+            remaining->input.erase(remaining->input.begin(), remaining->input.begin() + static_cast<ptrdiff_t>(used));
+            return true;
+        }
+
+        return false;
+    }
+
+    void server_init(uint64_t const id)
+    {
+        std::shared_ptr<RfbFrame const> frame;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            frame = m_frame;
+        }
+
+        auto& client = m_server.clients()[id];
+        client.width = frame ? frame->width : 1;
+        client.height = frame ? frame->height : 1;
+
+        static char const name[] = "Clock";
+        std::vector<uint8_t> init;
+        rfb_put16(init, client.width);
+        rfb_put16(init, client.height);
+        init.insert(init.end(), { rfb_bgrx.bits_per_pixel, rfb_bgrx.depth, rfb_bgrx.big_endian, rfb_bgrx.true_colour });
+        rfb_put16(init, rfb_bgrx.red_max);
+        rfb_put16(init, rfb_bgrx.green_max);
+        rfb_put16(init, rfb_bgrx.blue_max);
+        init.insert(init.end(), { rfb_bgrx.red_shift, rfb_bgrx.green_shift, rfb_bgrx.blue_shift, 0, 0, 0 });
+        rfb_put32(init, sizeof(name) - 1);
+        init.insert(init.end(), name, name + sizeof(name) - 1);
+        write(id, init.data(), init.size());
+    }
+
+    void message(uint64_t const id, Client& client)
+    {
+        auto const data = client.input.data();
+
+        if (0 == data[0])
+        {
+            RfbPixelFormat const format =
+            {
+                data[4], data[5], data[6], data[7],
+                static_cast<uint16_t>(rfb_get16(data + 8)), static_cast<uint16_t>(rfb_get16(data + 10)), static_cast<uint16_t>(rfb_get16(data + 12)),
+                data[14], data[15], data[16]
+            };
+
+            if (!format.true_colour || (8 != format.bits_per_pixel && 16 != format.bits_per_pixel && 32 != format.bits_per_pixel))
+            {
+                m_server.drop(id);
+                return;
+            }
+
+            client.format = format;
+        }
+        else if (2 == data[0])
+        {
+            client.zlib = false;
+            client.desktop_size = false;
+
+            for (uint32_t i = 0; i != rfb_get16(data + 2); ++i)
+            {
+                auto const encoding = static_cast<int32_t>(rfb_get32(data + 4 + 4 * i));
+                client.zlib = client.zlib || rfb_encoding_zlib == encoding;
+                client.desktop_size = client.desktop_size || rfb_encoding_desktop_size == encoding;
+            }
+        }
+        else if (3 == data[0])
+        {
+            client.requested = true;
+
+            if (!data[1])
+            {
+                PixelRect const area{ static_cast<int32_t>(rfb_get16(data + 2)), static_cast<int32_t>(rfb_get16(data + 4)),
+                    static_cast<int32_t>(rfb_get16(data + 2) + rfb_get16(data + 6)), static_cast<int32_t>(rfb_get16(data + 4) + rfb_get16(data + 8)) };
+
+                client.damage = unite(client.damage, area);
+            }
+
+            start_update(id);
+        }
+    }
+
+    void take_damage()
+    {
+        PixelRect damage;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            damage = m_damage;
+            m_damage = {};
+        }
+
+        std::vector<uint64_t> ids;
+
+        for (auto&& client : m_server.clients())
+        {
+            client.second.damage = unite(client.second.damage, damage);
+            ids.push_back(client.first);
+        }
+
+        for (auto const id : ids)
+        {
+            start_update(id);
+        }
+    }
+
+    void take_updates()
+    {
+        std::vector<Update> updates;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            updates.swap(m_updates);
+        }
+
+        for (auto&& update : updates)
+        {
+            auto const client = m_server.find(update.id);
+
+            if (!client)
+            {
+                continue;
+            }
+
+            client->encoding = false;
+            client->history = std::move(update.history);
+            client->streaming = client->streaming || update.zlib;
+            ++m_updates_sent;
+            write(update.id, update.message.data(), update.message.size());
+        }
+    }
+
+    // Starts encoding an update once the client has asked for one, has nothing else in flight,
+    // and there is damage to send.
+
+    void start_update(uint64_t const id)
+    {
+        auto const found = m_server.find(id);
+
+        if (!found)
+        {
+            return;
+        }
+
+        auto& client = *found;
+
+        if (Phase::normal != client.phase || !client.requested || client.encoding || client.sent != client.output.size())
+        {
+            return;
+        }
+
+        std::shared_ptr<RfbFrame const> frame;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            frame = m_frame;
+        }
+
+        if (!frame)
+        {
+            return;
+        }
+
+        PixelRect const full{ 0, 0, static_cast<int32_t>(frame->width), static_cast<int32_t>(frame->height) };
+        auto const resized = client.width != frame->width || client.height != frame->height;
+
+        if (resized)
+        {
+            if (!client.desktop_size)
+            {
+                m_server.drop(id);
+                return;
+            }
+
+            client.width = frame->width;
+            client.height = frame->height;
+            client.damage = full;
+        }
+
+        auto const rect = intersect(client.damage, full);
+
+        if (rect.empty())
+        {
+            return;
+        }
+
+        client.damage = {};
+        client.requested = false;
+        client.encoding = true;
+
+        m_pool->submit([this, id, frame, rect, resized, format = client.format, zlib = client.zlib, streaming = client.streaming, history = client.history]() mutable
+        {
+            auto message = encode(*frame, rect, resized, format, zlib, streaming, history);
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_updates.push_back({ id, std::move(message), std::move(history), zlib });
+            }
+
+            m_server.wake();
+        });
+    }
+
+    // Builds a FramebufferUpdate for the rect, cut into bands, led by the new desktop size if the
+    // frame has been resized. Clients that cannot be told about a resize never get this far.
+
+    std::vector<uint8_t> encode(RfbFrame const& frame, PixelRect const& rect, bool const resized, RfbPixelFormat const& format, bool const zlib, bool const streaming, std::vector<uint8_t>& history)
+    {
+        auto const width = static_cast<uint32_t>(rect.right - rect.left);
+        auto const row_bytes = size_t{ width } * (format.bits_per_pixel / 8u);
+        auto const band_rows = static_cast<int32_t>(std::max<size_t>(1, band_bytes / row_bytes));
+        auto const bands = static_cast<uint32_t>((rect.bottom - rect.top + band_rows - 1) / band_rows);
+
+        // The raw bytes of every band follow the history, so each band's compressor can see the
+        // 32KB that the client's inflater will have seen before it.
+
+        auto const base = history.size();
+        std::vector<uint8_t> raw(base + row_bytes * static_cast<uint32_t>(rect.bottom - rect.top));
+        std::copy(history.begin(), history.end(), raw.begin());
+
+        std::vector<std::vector<uint8_t>> compressed(bands);
+
+        auto const band_range = [&](uint32_t const band)
+        {
+            auto const top = rect.top + static_cast<int32_t>(band) * band_rows;
+            auto const bottom = std::min(rect.bottom, top + band_rows);
+            return std::make_pair(top, bottom);
+        };
+
+        auto const offset = [&](int32_t const row)
+        {
+            return base + row_bytes * static_cast<uint32_t>(row - rect.top);
+        };
+
+        m_pool->parallel_for(bands, [&](size_t const band)
+        {
+            auto const [top, bottom] = band_range(static_cast<uint32_t>(band));
+
+            for (auto y = top; y < bottom; ++y)
+            {
+                convert_pixels(format, frame.pixels.data() + size_t{ static_cast<uint32_t>(y) } * frame.width + rect.left, width, raw.data() + offset(y));
+            }
+        });
+
+        if (zlib)
+        {
+            m_pool->parallel_for(bands, [&](size_t const band)
+            {
+                auto const [top, bottom] = band_range(static_cast<uint32_t>(band));
+                deflate_block(raw.data(), offset(top), offset(bottom), false, compressed[band]);
+            });
+        }
+
+        std::vector<uint8_t> message = { 0, 0 };
+        rfb_put16(message, bands + resized);
+
+        if (resized)
+        {
+            rfb_put16(message, 0);
+            rfb_put16(message, 0);
+            rfb_put16(message, frame.width);
+            rfb_put16(message, frame.height);
+            rfb_put32(message, static_cast<uint32_t>(rfb_encoding_desktop_size));
+        }
+
+        for (uint32_t band = 0; band != bands; ++band)
+        {
+            auto const [top, bottom] = band_range(band);
+            rfb_put16(message, static_cast<uint32_t>(rect.left));
+            rfb_put16(message, static_cast<uint32_t>(top));
+            rfb_put16(message, width);
+            rfb_put16(message, static_cast<uint32_t>(bottom - top));
+
+            if (zlib)
+            {
+                auto const header = !streaming && !band;
+                rfb_put32(message, static_cast<uint32_t>(rfb_encoding_zlib));
+                rfb_put32(message, static_cast<uint32_t>(compressed[band].size() + (header ? 2 : 0)));
+
+                if (header)
+                {
+                    message.insert(message.end(), { 0x78, 0x5e });
+                }
+
+                message.insert(message.end(), compressed[band].begin(), compressed[band].end());
+            }
+            else
+            {
+                rfb_put32(message, static_cast<uint32_t>(rfb_encoding_raw));
+                message.insert(message.end(), raw.begin() + static_cast<ptrdiff_t>(offset(top)), raw.begin() + static_cast<ptrdiff_t>(offset(bottom)));
+            }
+        }
+
+        if (zlib)
+        {
+            auto const keep = std::min<size_t>(raw.size(), deflate_window);
+            history.assign(raw.end() - static_cast<ptrdiff_t>(keep), raw.end());
+        }
+
+        return message;
+    }
+
+    SocketLibrary m_library;
+    uint16_t m_port{};
+    SocketServer<Client> m_server;
+    std::atomic<bool> m_stopping{};
+    std::atomic<uint64_t> m_bytes_sent{};
+    std::atomic<uint64_t> m_updates_sent{};
+    std::unique_ptr<WorkerPool> m_pool;
+    std::mutex m_lock;
+    std::shared_ptr<RfbFrame> m_frame;
+    PixelRect m_damage{};
+    std::vector<Update> m_updates;
+    std::thread m_thread;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Layout matches D2D1_MATRIX_3X2_F so transforms can be handed to Direct2D as is.
+
+struct Transform
+{
+    float m11, m12;
+    float m21, m22;
+    float dx, dy;
+};
+
+inline Transform identity()
+{
+    return { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+}
+
+inline Transform translation(float const x, float const y)
+{
+    return { 1.0f, 0.0f, 0.0f, 1.0f, x, y };
+}
+
+inline Transform rotation(float const degrees)
+{
+    auto const radians = degrees * 3.14159265358979f / 180.0f;
+    auto const c = std::cos(radians);
+    auto const s = std::sin(radians);
+    return { c, s, -s, c, 0.0f, 0.0f };
+}
+
+inline Transform operator*(Transform const& a, Transform const& b)
+{
+    return
+    {
+        a.m11 * b.m11 + a.m12 * b.m21,
+        a.m11 * b.m12 + a.m12 * b.m22,
+        a.m21 * b.m11 + a.m22 * b.m21,
+        a.m21 * b.m12 + a.m22 * b.m22,
+        a.dx * b.m11 + a.dy * b.m21 + b.dx,
+        a.dx * b.m12 + a.dy * b.m22 + b.dy
+    };
+}
+
+// Layout matches D2D1_COLOR_F.
+
+struct Color
+{
+    float r, g, b, a;
+};
+
+constexpr Color color_orange = { 0.92f, 0.38f, 0.208f, 1.0f };
+constexpr Color color_white = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+constexpr float hand_opacity = 0.8f;
+constexpr float shadow_deviation = 3.0f;
+constexpr float shadow_offset = 5.0f;
+
+// How a clock face looks. Strokes and lengths are fractions of the radius and the shadow is in
+// DIPs. The layout is fixed, as theme files hold these records as they are (see Theme.h), so
+// fields are only ever added in place of the reserved ones.
+
+struct FaceTheme
+{
+    Color ink;                  // the ring, the hands and any text
+    Color background;
+    float opacity;
+    float dial_stroke;
+    float second_stroke;
+    float minute_stroke;
+    float hour_stroke;
+    float second_length;
+    float minute_length;
+    float hour_length;
+    float shadow_deviation;
+    float shadow_offset;
+    uint32_t reserved[2];
+};
+
+static_assert(std::is_trivially_copyable_v<FaceTheme> && sizeof(FaceTheme) == 80);
+
+constexpr FaceTheme default_theme =
+{
+    color_orange,
+    color_white,
+    hand_opacity,
+    1.0f / 20.0f,
+    1.0f / 25.0f,
+    1.0f / 15.0f,
+    1.0f / 10.0f,
+    0.75f,
+    0.75f,
+    0.5f,
+    shadow_deviation,
+    shadow_offset,
+    {}
+};
+
+struct ClockGeometry
+{
+    float x;
+    float y;
+    float radius;
+};
+
+inline ClockGeometry clock_geometry(float const width, float const height)
+{
+    auto const radius = std::max(200.0f, std::min(width, height)) / 2.0f - 50.0f;
+    return { width / 2.0f, height / 2.0f, radius };
+}
+
+struct HandAngles
+{
+    float second;
+    float minute;
+    float hour;
+};
+
+inline HandAngles hand_angles(unsigned const hour, unsigned const minute, unsigned const second, unsigned const milliseconds)
+{
+    HandAngles angles;
+    angles.second = (second + milliseconds / 1000.0f) * 6.0f;
+    angles.minute = minute * 6.0f + angles.second / 60.0f;
+    angles.hour = hour % 12 * 30.0f + angles.minute / 12.0f;
+    return angles;
+}
+
+// Seconds since midnight, as used when many clocks share one instant at different offsets.
+
+inline HandAngles hand_angles(double const seconds)
+{
+    auto day = std::fmod(seconds, 86400.0);
+
+    if (day < 0.0)
+    {
+        day += 86400.0;
+    }
+
+    HandAngles angles;
+    angles.second = static_cast<float>(std::fmod(day, 60.0) * 6.0);
+    angles.minute = static_cast<float>(std::fmod(day, 3600.0) / 10.0);
+    angles.hour = static_cast<float>(std::fmod(day, 43200.0) / 120.0);
+    return angles;
+}
+
+// The same from whole seconds since local midnight, in [0, 86400), and a fraction of a second.
+// Single precision throughout, so that batches of clocks can be done four at a time with exactly
+// the same results.
+
+inline HandAngles hand_angles(uint32_t const day, float const fraction)
+{
+    HandAngles angles;
+    angles.second = (static_cast<float>(day % 60) + fraction) * 6.0f;
+    angles.minute = (static_cast<float>(day % 3600) + fraction) / 10.0f;
+    angles.hour = (static_cast<float>(day % 43200) + fraction) / 120.0f;
+    return angles;
+}
+
+// Matches the UIAnimation accelerate/decelerate transition that drives the intro: velocity rises
+// linearly for the first part of the duration, holds, then falls linearly to zero at the end.
+
+constexpr double intro_duration = 5.0;
+constexpr double intro_acceleration = 0.2;
+constexpr double intro_deceleration = 0.8;
+
+inline double accelerate_decelerate(double const time,
+    double const duration = intro_duration,
+    double const acceleration = intro_acceleration,
+    double const deceleration = intro_deceleration)
+{
+    if (time <= 0.0)
+    {
+        return 0.0;
+    }
+
+    if (time >= duration)
+    {
+        return 1.0;
+    }
+
+    auto const rise = acceleration * duration;
+    auto const fall = deceleration * duration;
+    auto const velocity = 1.0 / (duration - rise / 2.0 - fall / 2.0);
+
+    if (time < rise)
+    {
+        return velocity * time * time / (2.0 * rise);
+    }
+
+    if (time <= duration - fall)
+    {
+        return velocity * (rise / 2.0 + time - rise);
+    }
+
+    auto const remaining = duration - time;
+    return 1.0 - velocity * remaining * remaining / (2.0 * fall);
+}
+
+// Sweeps the hands up from twelve o'clock during the intro animation. The start angles are those
+// sampled on the first frame so that a hand passing twelve mid-swing keeps moving forward.
+
+inline HandAngles apply_swing(HandAngles angles, HandAngles const& start, double const swing)
+{
+    if (start.second > angles.second) angles.second += 360.0f;
+    if (start.minute > angles.minute) angles.minute += 360.0f;
+    if (start.hour > angles.hour)     angles.hour += 360.0f;
+
+    angles.second *= static_cast<float>(swing);
+    angles.minute *= static_cast<float>(swing);
+    angles.hour *= static_cast<float>(swing);
+    return angles;
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A named region of memory shared between processes: a pagefile-backed file mapping on Windows
+// and a POSIX shared memory object elsewhere. The creator removes the name when it is done with
+// it; anyone who still has the region mapped keeps it until they close it. An ordinary file can
+// also be mapped for reading, which the operating system then shares between its readers.
+
+struct SharedMemory
+{
+    SharedMemory() noexcept = default;
+
+    SharedMemory(SharedMemory&& other) noexcept
+    {
+        swap(other);
+    }
+
+    SharedMemory& operator=(SharedMemory&& other) noexcept
+    {
+        SharedMemory(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~SharedMemory()
+    {
+        close();
+    }
+
+    static SharedMemory create(std::string const& name, size_t const size)
+    {
+        SharedMemory memory;
+        memory.m_size = size;
+        memory.m_owner = true;
+
+#ifdef _WIN32
+        memory.m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(uint64_t{ size } >> 32), static_cast<DWORD>(size), native_name(name).c_str());
+
+        if (memory.m_mapping)
+        {
+            memory.m_data = MapViewOfFile(memory.m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        }
+#else
+        memory.m_name = native_name(name);
+        shm_unlink(memory.m_name.c_str());
+        auto const file = shm_open(memory.m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+        if (file >= 0)
+        {
+            if (0 == ftruncate(file, static_cast<off_t>(size)))
+            {
+                auto const data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+                memory.m_data = data == MAP_FAILED ? nullptr : data;
+            }
+
+            ::close(file);
+        }
+#endif
+
+        if (!memory.m_data)
+        {
+            memory.close();
+        }
+
+        return memory;
+    }
+
+    // Maps an existing region for reading only.
+
+    static SharedMemory open(std::string const& name)
+    {
+        SharedMemory memory;
+
+#ifdef _WIN32
+        memory.m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, native_name(name).c_str());
+
+        if (memory.m_mapping)
+        {
+            memory.m_data = MapViewOfFile(memory.m_mapping, FILE_MAP_READ, 0, 0, 0);
+            MEMORY_BASIC_INFORMATION info = {};
+
+            if (memory.m_data && VirtualQuery(memory.m_data, &info, sizeof(info)))
+            {
+                memory.m_size = info.RegionSize;
+            }
+        }
+#else
+        auto const file = shm_open(native_name(name).c_str(), O_RDONLY, 0);
+
+        if (file >= 0)
+        {
+            struct stat status = {};
+
+            if (0 == fstat(file, &status) && status.st_size > 0)
+            {
+                memory.m_size = static_cast<size_t>(status.st_size);
+                auto const data = mmap(nullptr, memory.m_size, PROT_READ, MAP_SHARED, file, 0);
+                memory.m_data = data == MAP_FAILED ? nullptr : data;
+            }
+
+            ::close(file);
+        }
+#endif
+
+        if (!memory.m_data)
+        {
+            memory.close();
+        }
+
+        return memory;
+    }
+
+    // Maps a whole file for reading only. Empty files cannot be mapped.
+
+    static SharedMemory map_file(std::string const& path)
+    {
+        SharedMemory memory;
+
+#ifdef _WIN32
+        auto const file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (INVALID_HANDLE_VALUE != file)
+        {
+            LARGE_INTEGER size = {};
+
+            if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            {
+                memory.m_size = static_cast<size_t>(size.QuadPart);
+                memory.m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            }
+
+            if (memory.m_mapping)
+            {
+                memory.m_data = MapViewOfFile(memory.m_mapping, FILE_MAP_READ, 0, 0, 0);
+            }
+
+            CloseHandle(file);
+        }
+#else
+        auto const file = ::open(path.c_str(), O_RDONLY);
+
+        if (file >= 0)
+        {
+            struct stat status = {};
+
+            if (0 == fstat(file, &status) && status.st_size > 0)
+            {
+                memory.m_size = static_cast<size_t>(status.st_size);
+                auto const data = mmap(nullptr, memory.m_size, PROT_READ, MAP_SHARED, file, 0);
+                memory.m_data = data == MAP_FAILED ? nullptr : data;
+            }
+
+            ::close(file);
+        }
+#endif
+
+        if (!memory.m_data)
+        {
+            memory.close();
+        }
+
+        return memory;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return nullptr != m_data;
+    }
+
+    void* data() const noexcept
+    {
+        return m_data;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    void close() noexcept
+    {
+#ifdef _WIN32
+        if (m_data)
+        {
+            UnmapViewOfFile(m_data);
+        }
+
+        if (m_mapping)
+        {
+            CloseHandle(m_mapping);
+        }
+
+        m_mapping = nullptr;
+#else
+        if (m_data)
+        {
+            munmap(m_data, m_size);
+        }
+
+        if (m_owner && !m_name.empty())
+        {
+            shm_unlink(m_name.c_str());
+        }
+
+        m_name.clear();
+#endif
+
+        m_data = nullptr;
+        m_size = 0;
+        m_owner = false;
+    }
+
+private:
+
+    // POSIX names begin with a slash; Windows names are kept to the session.
+
+    static std::string native_name(std::string const& name)
+    {
+#ifdef _WIN32
+        return "Local\\" + name;
+#else
+        return "/" + name;
+#endif
+    }
+
+    void swap(SharedMemory& other) noexcept
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_owner, other.m_owner);
+#ifdef _WIN32
+        std::swap(m_mapping, other.m_mapping);
+#else
+        std::swap(m_name, other.m_name);
+#endif
+    }
+
+    void* m_data{};
+    size_t m_size{};
+    bool m_owner{};
+#ifdef _WIN32
+    HANDLE m_mapping{};
+#else
+    std::string m_name;
+#endif
+};
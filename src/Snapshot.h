@@ -0,0 +1,169 @@
+#pragma once
+
+#include "Png.h"
+#include "Raster.h"
+#include "Wall.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+
+// PNG snapshots of the clock scene, rendered offscreen by the software rasteriser. Snapshots are
+// quantised to whole seconds, so one key always produces the same pixels and encoded bytes can be
+// handed out again from a small cache for as long as the second lasts.
+//
+// A snapshot holds what Window::draw presents: the dials with their numerals, the hands and the
+// readout. Text comes from the built-in font rather than DirectWrite's, so it is placed and sized
+// as on screen but its glyphs differ.
+
+struct SnapshotKey
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t count;     // clocks on the wall
+    float dpi;
+    int32_t offset;     // seconds east of UTC
+    int64_t second;     // UTC seconds since 1970
+
+    // The face is held by value, as a reloaded theme may be given the address of the one it
+    // replaced.
+
+    FaceTheme theme = default_theme;
+    bool numerals = false;
+    bool readout = false;   // only shown on a single clock
+
+    bool operator==(SnapshotKey const& other) const noexcept
+    {
+        return width == other.width && height == other.height && count == other.count &&
+            dpi == other.dpi && offset == other.offset && second == other.second &&
+            !memcmp(&theme, &other.theme, sizeof(FaceTheme)) && numerals == other.numerals && readout == other.readout;
+    }
+};
+
+using SnapshotBytes = std::shared_ptr<std::vector<uint8_t> const>;
+
+inline Canvas snapshot_frame(SnapshotKey const& key)
+{
+    auto const scale = 96.0f / key.dpi;
+    auto const width = key.width * scale;
+    auto const height = key.height * scale;
+    auto scene = record_wall(key.count, width, height, true, key.theme);
+    auto const offsets = wall_offsets(key.count);
+    std::vector<HandAngles> angles(key.count);
+
+    auto const second = (key.second + key.offset) % 86400;
+    auto const day = static_cast<uint32_t>(second < 0 ? second + 86400 : second);
+    wall_angles(static_cast<double>(day), offsets.data(), key.count, angles.data());
+    patch_wall(scene, angles.data());
+
+    // Text is laid out as Window::create_text_resources does.
+
+    auto const layout = wall_layout(key.count, width, height);
+    auto const radius = wall_geometry(layout, 0).radius;
+    GlyphAtlas numerals{};
+
+    if (key.numerals)
+    {
+        numerals = builtin_atlas(numeral_size(radius), key.dpi);
+
+        for (uint32_t index = 0; index != key.count; ++index)
+        {
+            record_numerals(scene.dials, wall_geometry(layout, index), numerals);
+        }
+    }
+
+    Canvas frame(key.width, key.height, key.dpi);
+    Canvas layer(key.width, key.height, key.dpi);
+    layer.set_atlas(&numerals);
+    draw_scene(frame, layer, key.theme, scene.dials, scene.hands);
+
+    // The readout goes over the clock without a shadow.
+
+    if (key.readout && 1 == key.count)
+    {
+        auto const text = builtin_atlas(readout_size(radius), key.dpi);
+        auto const geometry = wall_geometry(layout, 0);
+        DigitalReadout readout(text, geometry.x, geometry.y + geometry.radius * 0.5f);
+        layer.clear();
+        layer.set_atlas(&text);
+        layer.set_color(key.theme.ink, key.theme.opacity);
+        draw_readout(layer, readout, readout.update(day));
+        draw_image(frame, layer);
+    }
+
+    return frame;
+}
+
+inline std::vector<uint8_t> render_snapshot(SnapshotKey const& key, WorkerPool* pool = nullptr)
+{
+    auto const frame = snapshot_frame(key);
+    return encode_png(frame.data(), key.width, key.height, pool);
+}
+
+// A least recently used cache of encoded snapshots. It is safe to call from any thread, though
+// two threads missing on the same key will both render it.
+
+struct SnapshotCache
+{
+    explicit SnapshotCache(WorkerPool* pool = nullptr, size_t const capacity = 16) :
+        m_pool(pool),
+        m_capacity(capacity)
+    {
+    }
+
+    SnapshotBytes find(SnapshotKey const& key)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        for (auto entry = m_entries.begin(); entry != m_entries.end(); ++entry)
+        {
+            if (entry->first == key)
+            {
+                m_entries.splice(m_entries.begin(), m_entries, entry);
+                ++m_hits;
+                return entry->second;
+            }
+        }
+
+        return nullptr;
+    }
+
+    SnapshotBytes snapshot(SnapshotKey const& key)
+    {
+        if (auto bytes = find(key))
+        {
+            return bytes;
+        }
+
+        SnapshotBytes bytes = std::make_shared<std::vector<uint8_t> const>(render_snapshot(key, m_pool));
+        std::lock_guard<std::mutex> lock(m_lock);
+        ++m_misses;
+        m_entries.emplace_front(key, bytes);
+
+        if (m_entries.size() > m_capacity)
+        {
+            m_entries.pop_back();
+        }
+
+        return bytes;
+    }
+
+    uint64_t hits() const noexcept
+    {
+        return m_hits;
+    }
+
+    uint64_t misses() const noexcept
+    {
+        return m_misses;
+    }
+
+private:
+
+    WorkerPool* m_pool;
+    size_t m_capacity;
+    std::mutex m_lock;
+    std::list<std::pair<SnapshotKey, SnapshotBytes>> m_entries;
+    std::atomic<uint64_t> m_hits{};
+    std::atomic<uint64_t> m_misses{};
+};
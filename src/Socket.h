@@ -0,0 +1,647 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32")
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// The little socket layer needed by the embedded servers, over Winsock or POSIX sockets.
+
+#ifdef _WIN32
+using Socket = SOCKET;
+constexpr Socket invalid_socket = INVALID_SOCKET;
+using PollEntry = WSAPOLLFD;
+
+inline void close_socket(Socket const socket) noexcept
+{
+    closesocket(socket);
+}
+
+inline bool set_nonblocking(Socket const socket) noexcept
+{
+    u_long on = 1;
+    return 0 == ioctlsocket(socket, FIONBIO, &on);
+}
+
+inline bool would_block() noexcept
+{
+    return WSAEWOULDBLOCK == WSAGetLastError();
+}
+
+inline int poll_sockets(PollEntry* entries, size_t const count, int const timeout) noexcept
+{
+    return WSAPoll(entries, static_cast<ULONG>(count), timeout);
+}
+#else
+using Socket = int;
+constexpr Socket invalid_socket = -1;
+using PollEntry = pollfd;
+
+inline void close_socket(Socket const socket) noexcept
+{
+    close(socket);
+}
+
+inline bool set_nonblocking(Socket const socket) noexcept
+{
+    return 0 == fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+}
+
+inline bool would_block() noexcept
+{
+    return EAGAIN == errno || EWOULDBLOCK == errno;
+}
+
+inline int poll_sockets(PollEntry* entries, size_t const count, int const timeout) noexcept
+{
+    return poll(entries, count, timeout);
+}
+#endif
+
+// Winsock is reference counted, so each server holds one of these for as long as it needs it.
+
+struct SocketLibrary
+{
+    SocketLibrary() noexcept
+    {
+#ifdef _WIN32
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+    }
+
+    ~SocketLibrary()
+    {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    SocketLibrary(SocketLibrary const&) = delete;
+    SocketLibrary& operator=(SocketLibrary const&) = delete;
+};
+
+struct SendBuffer
+{
+    void const* data;
+    size_t size;
+};
+
+// Sends the buffers with a single gathering call, so that a response header and a shared body
+// go out together without first being copied into one buffer. Returns the bytes sent or -1.
+
+inline int64_t send_gather(Socket const socket, SendBuffer const* buffers, size_t const count) noexcept
+{
+#ifdef _WIN32
+    WSABUF parts[4];
+    DWORD sent = 0;
+
+    for (size_t i = 0; i != count; ++i)
+    {
+        parts[i].buf = static_cast<char*>(const_cast<void*>(buffers[i].data));
+        parts[i].len = static_cast<ULONG>(buffers[i].size);
+    }
+
+    if (WSASend(socket, parts, static_cast<DWORD>(count), &sent, 0, nullptr, nullptr))
+    {
+        return -1;
+    }
+
+    return sent;
+#else
+    iovec parts[4];
+
+    for (size_t i = 0; i != count; ++i)
+    {
+        parts[i].iov_base = const_cast<void*>(buffers[i].data);
+        parts[i].iov_len = buffers[i].size;
+    }
+
+    msghdr message = {};
+    message.msg_iov = parts;
+    message.msg_iovlen = count;
+    return sendmsg(socket, &message, MSG_NOSIGNAL);
+#endif
+}
+
+inline int64_t receive(Socket const socket, char* buffer, size_t const size) noexcept
+{
+    return recv(socket, buffer, static_cast<int>(size), 0);
+}
+
+// Opens a non-blocking listening socket on 127.0.0.1. Port zero picks any free port.
+
+inline Socket listen_loopback(uint16_t const port) noexcept
+{
+    auto const listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (invalid_socket == listener)
+    {
+        return invalid_socket;
+    }
+
+    int const on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char const*>(&on), sizeof(on));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ||
+        listen(listener, SOMAXCONN) ||
+        !set_nonblocking(listener))
+    {
+        close_socket(listener);
+        return invalid_socket;
+    }
+
+    return listener;
+}
+
+inline uint16_t socket_port(Socket const socket) noexcept
+{
+    sockaddr_in address = {};
+    socklen_t size = sizeof(address);
+    getsockname(socket, reinterpret_cast<sockaddr*>(&address), &size);
+    return ntohs(address.sin_port);
+}
+
+// Connects a blocking socket to a port on 127.0.0.1, as clients of the servers do.
+
+inline Socket connect_loopback(uint16_t const port) noexcept
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    auto const connection = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (invalid_socket != connection && connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)))
+    {
+        close_socket(connection);
+        return invalid_socket;
+    }
+
+    return connection;
+}
+
+// The file a local socket is bound to, so that it can be told apart from one bound at the same
+// path later. The inode of a file removed is soon reused, so its change time is kept as well.
+
+struct LocalSocketFile
+{
+    uint64_t device;
+    uint64_t inode;
+    int64_t changed;    // in nanoseconds
+
+    bool operator==(LocalSocketFile const& other) const noexcept
+    {
+        return device == other.device && inode == other.inode && changed == other.changed;
+    }
+};
+
+// Whether path names a socket file, without following a link, and if so which.
+
+inline bool local_socket_file(char const* const path, LocalSocketFile& file) noexcept
+{
+#ifdef _WIN32
+    auto const attributes = GetFileAttributesA(path);
+    file = {};
+    return INVALID_FILE_ATTRIBUTES != attributes && (attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+#else
+    struct stat status;
+
+    if (lstat(path, &status) || !S_ISSOCK(status.st_mode))
+    {
+        return false;
+    }
+
+    file = { static_cast<uint64_t>(status.st_dev), static_cast<uint64_t>(status.st_ino), status.st_ctim.tv_sec * int64_t{ 1000000000 } + status.st_ctim.tv_nsec };
+    return true;
+#endif
+}
+
+// Opens a non-blocking listening socket at a local (Unix domain) path. A socket left there by an
+// earlier process is replaced, but anything else at the path is left alone and the listen fails.
+// Windows 10 has these too. On Linux only the owner may connect.
+
+inline Socket listen_local(char const* const path, LocalSocketFile& file) noexcept
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        return invalid_socket;
+    }
+
+    strcpy(address.sun_path, path);
+
+#ifdef _WIN32
+    auto const attributes = GetFileAttributesA(path);
+
+    if (INVALID_FILE_ATTRIBUTES != attributes)
+    {
+        if (!(attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+        {
+            return invalid_socket;
+        }
+
+        remove(path);
+    }
+#else
+    struct stat status;
+
+    if (!lstat(path, &status))
+    {
+        if (!S_ISSOCK(status.st_mode))
+        {
+            return invalid_socket;
+        }
+
+        unlink(path);
+    }
+    else if (ENOENT != errno)
+    {
+        return invalid_socket;
+    }
+#endif
+
+    auto const listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (invalid_socket == listener)
+    {
+        return invalid_socket;
+    }
+
+    // The socket file is created with no access for group or others, rather than changed after
+    // it is bound, which would leave a moment in which anyone could connect. The mask is shared
+    // by the whole process, so it is put back straight away.
+
+#ifdef _WIN32
+    auto const bound = !bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+#else
+    auto const mask = umask(S_IRWXG | S_IRWXO);
+    auto const bound = !bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(mask);
+#endif
+
+    if (!bound ||
+        !local_socket_file(path, file) ||
+        listen(listener, SOMAXCONN) ||
+        !set_nonblocking(listener))
+    {
+        if (bound)
+        {
+            remove(path);
+        }
+
+        close_socket(listener);
+        return invalid_socket;
+    }
+
+    return listener;
+}
+
+// Removes the socket file that listen_local bound, unless it has since been replaced, for
+// example by another process listening at the same path.
+
+inline void remove_local(char const* const path, LocalSocketFile const& file) noexcept
+{
+    LocalSocketFile current;
+
+    if (local_socket_file(path, current) && current == file)
+    {
+        remove(path);
+    }
+}
+
+// Connects a blocking socket to a local path.
+
+inline Socket connect_local(char const* const path) noexcept
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        return invalid_socket;
+    }
+
+    strcpy(address.sun_path, path);
+    auto const connection = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (invalid_socket != connection && connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)))
+    {
+        close_socket(connection);
+        return invalid_socket;
+    }
+
+    return connection;
+}
+
+// A connected pair of loopback sockets, used to wake a thread blocked in poll from another thread
+// on both platforms.
+
+inline bool socket_pair(Socket (&pair)[2]) noexcept
+{
+    pair[0] = pair[1] = invalid_socket;
+    auto const listener = listen_loopback(0);
+
+    if (invalid_socket == listener)
+    {
+        return false;
+    }
+
+    pair[1] = connect_loopback(socket_port(listener));
+
+    if (invalid_socket != pair[1])
+    {
+        PollEntry entry = { listener, POLLIN, 0 };
+        poll_sockets(&entry, 1, 1000);
+        pair[0] = accept(listener, nullptr, nullptr);
+    }
+
+    close_socket(listener);
+
+    if (invalid_socket == pair[0])
+    {
+        if (invalid_socket != pair[1])
+        {
+            close_socket(pair[1]);
+        }
+
+        return false;
+    }
+
+    set_nonblocking(pair[0]);
+    set_nonblocking(pair[1]);
+    return true;
+}
+
+// The skeleton of the embedded servers. One I/O thread polls the listening socket, a socket pair
+// that other threads use to wake it, and every connected client, which is kept by an id that can
+// still be looked up safely once the client has been dropped. The server built on it is the
+// owner passed to run, which provides:
+//
+//   short events(Client const&)                              the events to poll the client for
+//   void woken()                                             after any thread called wake
+//   void accepted(uint64_t id, Client&)                      for each new client
+//   void writable(uint64_t id, Client&)                      when the client can take more output
+//   void received(uint64_t id, Client&, char const*, size_t) with what the client sent
+//
+// A client that hangs up or fails is dropped before the owner hears of it. Client must have a
+// socket member.
+
+template <typename Client>
+struct SocketServer
+{
+    SocketServer() = default;
+
+    ~SocketServer()
+    {
+        for (auto&& client : m_clients)
+        {
+            close_socket(client.second.socket);
+        }
+
+        for (auto const socket : { m_listener, m_wake[0], m_wake[1] })
+        {
+            if (invalid_socket != socket)
+            {
+                close_socket(socket);
+            }
+        }
+    }
+
+    SocketServer(SocketServer const&) = delete;
+    SocketServer& operator=(SocketServer const&) = delete;
+
+    // Takes the listener, even if this fails to make the socket pair.
+
+    bool open(Socket const listener) noexcept
+    {
+        m_listener = listener;
+        return invalid_socket != listener && socket_pair(m_wake);
+    }
+
+    Socket listener() const noexcept
+    {
+        return m_listener;
+    }
+
+    // Called from any thread.
+
+    void wake() noexcept
+    {
+        char const signal = 0;
+        ::send(m_wake[1], &signal, 1, 0);
+    }
+
+    Client* find(uint64_t const id) noexcept
+    {
+        auto const found = m_clients.find(id);
+        return found != m_clients.end() ? &found->second : nullptr;
+    }
+
+    std::map<uint64_t, Client>& clients() noexcept
+    {
+        return m_clients;
+    }
+
+    void drop(uint64_t const id)
+    {
+        auto const found = m_clients.find(id);
+
+        if (found != m_clients.end())
+        {
+            close_socket(found->second.socket);
+            m_clients.erase(found);
+        }
+    }
+
+    // Sends what the socket will take of the buffers, after the first sent bytes, adding what
+    // goes to sent. Returns false if the connection failed, in which case the client is dropped.
+
+    bool send(uint64_t const id, SendBuffer const* buffers, size_t const count, size_t& sent)
+    {
+        auto const client = find(id);
+        size_t total = 0;
+
+        for (size_t i = 0; i != count; ++i)
+        {
+            total += buffers[i].size;
+        }
+
+        while (client && sent != total)
+        {
+            SendBuffer remaining[4];
+            size_t parts = 0;
+            size_t skip = sent;
+
+            for (size_t i = 0; i != count; ++i)
+            {
+                if (skip < buffers[i].size)
+                {
+                    remaining[parts++] = { static_cast<uint8_t const*>(buffers[i].data) + skip, buffers[i].size - skip };
+                }
+
+                skip -= std::min(skip, buffers[i].size);
+            }
+
+            auto const result = send_gather(client->socket, remaining, parts);
+
+            if (result < 0)
+            {
+                if (would_block())
+                {
+                    return true;
+                }
+
+                drop(id);
+                return false;
+            }
+
+            sent += static_cast<size_t>(result);
+        }
+
+        return nullptr != client;
+    }
+
+    template <typename Owner>
+    void run(std::atomic<bool> const& stopping, Owner& owner)
+    {
+        std::vector<PollEntry> entries;
+        std::vector<uint64_t> ids;
+
+        while (!stopping)
+        {
+            entries.clear();
+            ids.clear();
+            entries.push_back({ m_wake[0], POLLIN, 0 });
+            entries.push_back({ m_listener, POLLIN, 0 });
+
+            for (auto&& client : m_clients)
+            {
+                entries.push_back({ client.second.socket, owner.events(client.second), 0 });
+                ids.push_back(client.first);
+            }
+
+            if (poll_sockets(entries.data(), entries.size(), -1) < 0)
+            {
+                continue;
+            }
+
+            if (entries[0].revents)
+            {
+                char drain[64];
+                while (receive(m_wake[0], drain, sizeof(drain)) > 0);
+                owner.woken();
+            }
+
+            if (entries[1].revents & POLLIN)
+            {
+                accept_all(owner);
+            }
+
+            for (size_t i = 0; i != ids.size(); ++i)
+            {
+                auto const events = entries[i + 2].revents;
+
+                if (events & POLLOUT)
+                {
+                    if (auto const client = find(ids[i]))
+                    {
+                        owner.writable(ids[i], *client);
+                    }
+                }
+
+                if (events & (POLLIN | POLLHUP | POLLERR))
+                {
+                    read(ids[i], owner);
+                }
+            }
+        }
+    }
+
+private:
+
+    template <typename Owner>
+    void accept_all(Owner& owner)
+    {
+        while (true)
+        {
+            auto const socket = accept(m_listener, nullptr, nullptr);
+
+            if (invalid_socket == socket)
+            {
+                return;
+            }
+
+            set_nonblocking(socket);
+            auto const id = m_next_id++;
+            auto& client = m_clients[id];
+            client.socket = socket;
+            owner.accepted(id, client);
+        }
+    }
+
+    template <typename Owner>
+    void read(uint64_t const id, Owner& owner)
+    {
+        auto const client = find(id);
+
+        if (!client)
+        {
+            return;
+        }
+
+        char buffer[4096];
+        auto const size = receive(client->socket, buffer, sizeof(buffer));
+
+        if (size <= 0)
+        {
+            if (size < 0 && would_block())
+            {
+                return;
+            }
+
+            drop(id);
+            return;
+        }
+
+        owner.received(id, *client, buffer, static_cast<size_t>(size));
+    }
+
+    Socket m_listener{ invalid_socket };
+    Socket m_wake[2]{ invalid_socket, invalid_socket };
+    std::map<uint64_t, Client> m_clients;
+    uint64_t m_next_id{ 1 };
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+
+// Records how long each stage of bring-up takes, measured from when the timeline is created.
+
+enum class StartupPhase
+{
+    window,      // The window exists.
+    first_pixel, // Something other than an empty window is on screen, possibly rendered on the CPU.
+    gpu_frame,   // The first frame has been presented through the swap chain.
+    count
+};
+
+// How long startup waits for the GPU before putting a CPU-rendered frame on screen instead.
+
+constexpr std::chrono::milliseconds first_pixel_budget{ 50 };
+
+struct StartupTimeline
+{
+    using clock = std::chrono::steady_clock;
+
+    explicit StartupTimeline(clock::time_point const origin = clock::now()) noexcept :
+        m_origin(origin)
+    {
+    }
+
+    // Only the first mark of each phase counts.
+
+    void mark(StartupPhase const phase) noexcept
+    {
+        auto& seconds = m_seconds[static_cast<int>(phase)];
+
+        if (seconds < 0.0)
+        {
+            seconds = std::chrono::duration<double>(clock::now() - m_origin).count();
+        }
+    }
+
+    bool reached(StartupPhase const phase) const noexcept
+    {
+        return m_seconds[static_cast<int>(phase)] >= 0.0;
+    }
+
+    double seconds(StartupPhase const phase) const noexcept
+    {
+        return m_seconds[static_cast<int>(phase)];
+    }
+
+private:
+
+    clock::time_point m_origin;
+    double m_seconds[static_cast<int>(StartupPhase::count)]{ -1.0, -1.0, -1.0 };
+};
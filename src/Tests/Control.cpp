@@ -0,0 +1,166 @@
+// The control socket is a local socket file, whose permissions and replacement are checked here,
+// so only for Linux and the like.
+
+#ifndef _WIN32
+
+#include "Test.h"
+#include "Control.h"
+#include <exception>
+#include <fstream>
+
+static std::string control_path(char const* const use)
+{
+    return "/tmp/clock-tests-" + std::string(use) + "-" + std::to_string(getpid()) + ".sock";
+}
+
+// listen_local replaces a socket an earlier process left behind, but nothing else, and the socket
+// it binds is never open to anyone but its owner. remove_local leaves a socket bound since.
+
+TEST(listen_local_replaces_only_sockets)
+{
+    auto const path = control_path("listen");
+    auto const link = path + ".link";
+    remove(path.c_str());
+    std::ofstream(path) << "keep";
+    LocalSocketFile file{};
+    CHECK(invalid_socket == listen_local(path.c_str(), file));
+    CHECK("keep" == std::string(std::istreambuf_iterator<char>(std::ifstream(path).rdbuf()), {}));
+    remove(path.c_str());
+
+    auto const stale = listen_local(path.c_str(), file);
+    CHECK(invalid_socket != stale);
+    close_socket(stale);
+    auto const earlier = file;
+
+    auto const listener = listen_local(path.c_str(), file);
+    CHECK(invalid_socket != listener && !(earlier == file));
+
+    struct stat status;
+    CHECK(!lstat(path.c_str(), &status) && S_ISSOCK(status.st_mode) && !(status.st_mode & (S_IRWXG | S_IRWXO)));
+
+    auto const client = connect_local(path.c_str());
+    CHECK(invalid_socket != client);
+    close_socket(client);
+
+    // A link to a socket is not a socket left behind.
+
+    CHECK(!symlink(path.c_str(), link.c_str()));
+    LocalSocketFile linked{};
+    CHECK(invalid_socket == listen_local(link.c_str(), linked));
+    CHECK(!lstat(link.c_str(), &status) && S_ISLNK(status.st_mode));
+    remove(link.c_str());
+
+    remove_local(path.c_str(), earlier);
+    CHECK(!lstat(path.c_str(), &status));
+    remove_local(path.c_str(), file);
+    CHECK(lstat(path.c_str(), &status) && ENOENT == errno);
+    close_socket(listener);
+}
+
+// Requests through the shared server skeleton: stats answered on the I/O thread, commands
+// answered once the render loop has served them, and a bad command refused. A server that
+// stops after another has taken its path over must leave the other's socket alone.
+
+TEST(control_server_serves_and_stops_safely)
+{
+    auto const path = control_path("server");
+    std::atomic<uint32_t> wakes{};
+    std::atomic<bool> stopping{};
+    LocalSocketFile file{};
+    Socket replacement = invalid_socket;
+
+    {
+        ControlServer server(path, [&] { ++wakes; });
+        ControlStats stats{};
+        stats.frames = 1234;
+        stats.width = 640;
+        server.stats().store(stats);
+        std::atomic<uint32_t> served{};
+
+        std::thread render([&]
+        {
+            while (!stopping)
+            {
+                served += static_cast<uint32_t>(server.serve([](ControlCommand const command, ControlReader& arguments, std::vector<uint8_t>& result)
+                {
+                    if (ControlCommand::power == command)
+                    {
+                        auto const mode = arguments.get8();
+
+                        if (!arguments.ok)
+                        {
+                            return ControlStatus::bad_request;
+                        }
+
+                        control_put8(result, mode);
+                    }
+
+                    return ControlStatus::ok;
+                }));
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        // Requests are made and the render loop stopped before anything is checked, so that a
+        // failure cannot leave the thread running.
+
+        std::vector<std::vector<uint8_t>> responses;
+        std::exception_ptr failure;
+
+        try
+        {
+            ControlClient client(path);
+            responses.push_back(client.request(ControlCommand::stats));
+            responses.push_back(client.request(ControlCommand::ping));
+            responses.push_back(client.request(ControlCommand::power, { 1 }));
+            responses.push_back(client.request(ControlCommand::power));
+            responses.push_back(client.request(static_cast<ControlCommand>(200)));
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+
+        stopping = true;
+        render.join();
+
+        if (failure)
+        {
+            std::rethrow_exception(failure);
+        }
+
+        ControlReader reader{ responses[0].data() + 1, responses[0].size() - 1 };
+        auto const received = get_stats(reader);
+        CHECK(static_cast<uint8_t>(ControlStatus::ok) == responses[0][0] && reader.ok && 1234 == received.frames && 640 == received.width);
+        CHECK(std::vector<uint8_t>{ 0 } == responses[1]);
+        CHECK((std::vector<uint8_t>{ 0, 1 }) == responses[2]);
+        CHECK(std::vector<uint8_t>{ static_cast<uint8_t>(ControlStatus::bad_request) } == responses[3]);
+        CHECK(std::vector<uint8_t>{ static_cast<uint8_t>(ControlStatus::bad_request) } == responses[4]);
+        CHECK(3 == served && wakes >= 3);
+
+        // Another clock starting at the same path replaces the socket.
+
+        replacement = listen_local(path.c_str(), file);
+        CHECK(invalid_socket != replacement);
+    }
+
+    LocalSocketFile current{};
+    CHECK(local_socket_file(path.c_str(), current) && current == file);
+    auto const client = connect_local(path.c_str());
+    CHECK(invalid_socket != client);
+    close_socket(client);
+    remove_local(path.c_str(), file);
+    close_socket(replacement);
+
+    // And a server stopping normally removes its own.
+
+    {
+        ControlServer server(path, [] {});
+        CHECK(local_socket_file(path.c_str(), current));
+    }
+
+    CHECK(!local_socket_file(path.c_str(), current));
+}
+
+#endif
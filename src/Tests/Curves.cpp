@@ -0,0 +1,159 @@
+#include "Test.h"
+#include "Curves.h"
+#include "DisplayList.h"
+
+// The smaller way round the dial between two angles.
+
+static double angle_error(double const a, double const b)
+{
+    auto const difference = std::fmod(std::abs(a - b), 360.0);
+    return std::min(difference, 360.0 - difference);
+}
+
+static HandTurn hand_turn(HandAngles const& target, HandAngles const& start, uint16_t const slot)
+{
+    return slot_second == slot ? HandTurn{ target.second, start.second, hand_rate_second, 60.0 } :
+        slot_minute == slot ? HandTurn{ target.minute, start.minute, hand_rate_minute, 3600.0 } :
+        HandTurn{ target.hour, start.hour, hand_rate_hour, 43200.0 };
+}
+
+static float hand(HandAngles const& angles, uint16_t const slot)
+{
+    return slot_second == slot ? angles.second : slot_minute == slot ? angles.minute : angles.hour;
+}
+
+// The curves handed to the compositor must follow what the frame-by-frame path draws: the intro
+// swing from apply_swing and then hand_angles, for each hand, from various points in the intro
+// and from times of day that take hands past twelve during it. Every curve is followed through
+// the intro, past its repeat boundary and a few periods beyond.
+
+TEST(hand_curves_follow_the_hands)
+{
+    double const days[] = { 0.0, 36000.0, 43197.5, 86398.0, 52799.0, 12345.678 };
+    double const elapsed_times[] = { 0.0, 0.3, 1.0, 2.5, 4.0, 4.99, 5.0, 20.0 };
+    double worst = 0.0;
+
+    for (auto const day : days)
+    {
+        auto const start = hand_angles(day);
+
+        for (auto const elapsed : elapsed_times)
+        {
+            auto const now = day + elapsed;
+
+            for (auto const slot : { slot_second, slot_minute, slot_hour })
+            {
+                auto const turn = hand_turn(hand_angles(now), start, slot);
+                auto const curve = hand_curve(turn, elapsed);
+                CHECK(curve.repeat_duration == turn.period && curve.repeat_begin > std::max(0.0, intro_duration - elapsed));
+
+                auto const expected = [&](double const time)
+                {
+                    auto const angles = hand_angles(now + time);
+
+                    if (elapsed + time < intro_duration)
+                    {
+                        return double{ hand(apply_swing(angles, start, accelerate_decelerate(elapsed + time)), slot) };
+                    }
+
+                    return double{ hand(angles, slot) };
+                };
+
+                std::vector<double> times;
+
+                for (int sample = 0; sample <= 500; ++sample)
+                {
+                    times.push_back(intro_duration * sample / 500.0);
+                }
+
+                for (int sample = 0; sample <= 2000; ++sample)
+                {
+                    times.push_back(curve.repeat_begin + turn.period * (sample / 500.0 - 1.0));
+                }
+
+                for (auto const offset : { -1e-3, 0.0, 1e-3 })
+                {
+                    times.push_back(curve.repeat_begin + offset);
+                    times.push_back(curve.repeat_begin + turn.period + offset);
+                }
+
+                for (auto const time : times)
+                {
+                    auto const error = angle_error(evaluate(curve, time), expected(time));
+                    worst = std::max(worst, error);
+
+                    if (error > 0.05)
+                    {
+                        printf("  day %.3f elapsed %.2f slot %u at %.4f: %.4f, not %.4f\n", day, elapsed, slot, time, evaluate(curve, time), expected(time));
+                    }
+
+                    CHECK(error <= 0.05);
+                }
+            }
+        }
+    }
+
+    printf("  worst error %.5f degrees\n", worst);
+}
+
+TEST(fit_cubics_meets_tolerance)
+{
+    auto const cubic = [](double const x) { return 1.0 - 2.0 * x + 0.5 * x * x + 0.25 * x * x * x; };
+    std::vector<CubicSegment> segments;
+    fit_cubics(cubic, 0.0, 2.0, 1e-4, segments);
+    CHECK(1 == segments.size());
+
+    segments.clear();
+    fit_cubics([](double const x) { return std::sin(x); }, 0.0, 6.0, 1e-4, segments);
+    CHECK(segments.size() > 1);
+
+    for (int sample = 0; sample <= 600; ++sample)
+    {
+        auto const x = sample / 100.0;
+        auto next = std::upper_bound(segments.begin(), segments.end(), x, [](double const t, CubicSegment const& segment) { return t < segment.begin; });
+        CHECK(std::abs(evaluate(*(next - 1), x) - std::sin(x)) < 2e-4);
+    }
+}
+
+// Curves for the three hands as the compositor path builds them, at the start of the intro,
+// part way through and after it, and fitting a profile that is not piecewise cubic.
+
+BENCHMARK(hand_curve_fitting)
+{
+    auto const start = hand_angles(36000.0);
+
+    for (auto const elapsed : { 0.0, 2.5, 4.9, 6.0 })
+    {
+        auto const target = hand_angles(36000.0 + elapsed);
+        uint32_t const count = 100000;
+        size_t segments = 0;
+        Stopwatch const watch;
+
+        for (uint32_t index = 0; index != count; ++index)
+        {
+            for (auto const slot : { slot_second, slot_minute, slot_hour })
+            {
+                segments += hand_curve(hand_turn(target, start, slot), elapsed).segments.size();
+            }
+        }
+
+        printf("  elapsed %.1f s  %6.3f us for three hands  %.1f segments a hand\n",
+            elapsed, watch.elapsed() * 1e6 / count, segments / (3.0 * count));
+    }
+
+    for (auto const tolerance : { 1e-2, 1e-4 })
+    {
+        uint32_t const count = 10000;
+        size_t segments = 0;
+        Stopwatch const watch;
+
+        for (uint32_t index = 0; index != count; ++index)
+        {
+            std::vector<CubicSegment> fitted;
+            fit_cubics([](double const x) { return 360.0 * std::sin(x); }, 0.0, intro_duration, tolerance, fitted);
+            segments += fitted.size();
+        }
+
+        printf("  sine, tolerance %g  %6.3f us a fit  %zu segments\n", tolerance, watch.elapsed() * 1e6 / count, segments / count);
+    }
+}
@@ -0,0 +1,170 @@
+#include "Test.h"
+#include "Raster.h"
+#include "Wall.h"
+#include <cmath>
+
+TEST(detail_tier_holds_through_jitter)
+{
+    CHECK(DetailTier::sprite == detail_tier(39.9f) && DetailTier::reduced == detail_tier(40.0f));
+    CHECK(DetailTier::reduced == detail_tier(119.9f) && DetailTier::full == detail_tier(120.0f));
+
+    // A live resize wobbling around a threshold by less than the hysteresis keeps its tier.
+
+    auto tier = DetailTier::full;
+    uint32_t changes = 0;
+
+    for (int step = 0; step != 1000; ++step)
+    {
+        auto const next = detail_tier(120.0f + 10.0f * std::sin(step * 0.1f), tier);
+        changes += next != tier;
+        tier = next;
+    }
+
+    CHECK(0 == changes && DetailTier::full == tier);
+
+    // Shrinking steps down at 15% below each threshold and growing steps up at 15% above.
+
+    float downs[2] = {};
+    float ups[2] = {};
+
+    for (float radius = 200.0f; radius > 10.0f; radius -= 0.5f)
+    {
+        auto const next = detail_tier(radius, tier);
+
+        if (next != tier)
+        {
+            downs[static_cast<int>(next)] = radius;
+        }
+
+        tier = next;
+    }
+
+    for (float radius = 10.0f; radius < 200.0f; radius += 0.5f)
+    {
+        auto const next = detail_tier(radius, tier);
+
+        if (next != tier)
+        {
+            ups[static_cast<int>(tier)] = radius;
+        }
+
+        tier = next;
+    }
+
+    CHECK(33.5f == downs[0] && 101.5f == downs[1]);
+    CHECK(46.0f == ups[0] && 138.0f == ups[1]);
+}
+
+// The difference a tier makes to a frame, against the same frame drawn at the full tier.
+
+struct FrameDifference
+{
+    double mean;        // absolute difference per channel, out of 255
+    int max;
+    double psnr;        // in dB
+    double differing;   // fraction of pixels with any channel changed
+};
+
+static FrameDifference frame_difference(Canvas const& reference, Canvas const& frame)
+{
+    auto const count = size_t{ reference.width() } * reference.height();
+    double sum = 0.0;
+    double squares = 0.0;
+    int max = 0;
+    size_t differing = 0;
+
+    for (size_t index = 0; index != count; ++index)
+    {
+        auto changed = false;
+
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            auto const difference = std::abs(static_cast<int>(reference.data()[index] >> shift & 0xff) - static_cast<int>(frame.data()[index] >> shift & 0xff));
+            sum += difference;
+            squares += difference * difference;
+            max = std::max(max, difference);
+            changed = changed || difference;
+        }
+
+        differing += changed;
+    }
+
+    auto const channels = 3.0 * count;
+    auto const psnr = squares ? 10.0 * std::log10(255.0 * 255.0 / (squares / channels)) : 99.0;
+    return { sum / channels, max, psnr, static_cast<double>(differing) / count };
+}
+
+// The reduced tier only blurs the shadows more coarsely, so it stays close to the full one. The
+// sprite tier drops them and the anti-aliasing, which is further off but must still be a clock.
+
+TEST(detail_tiers_stay_close_to_full)
+{
+    auto scene = record_wall(16, 640.0f, 360.0f);
+    std::vector<HandAngles> angles(16);
+    wall_angles(36000.0, wall_offsets(16).data(), 16, angles.data());
+    patch_wall(scene, angles.data());
+
+    Canvas full;
+    SoftwareScene(640, 360, 96.0f, scene.dials, default_theme, DetailTier::full).draw(full, scene.hands);
+
+    Canvas reduced;
+    SoftwareScene(640, 360, 96.0f, scene.dials, default_theme, DetailTier::reduced).draw(reduced, scene.hands);
+    auto const difference = frame_difference(full, reduced);
+    CHECK(difference.psnr > 35.0 && difference.max <= 32);
+
+    Canvas sprite;
+    SoftwareScene(640, 360, 96.0f, scene.dials, default_theme, DetailTier::sprite).draw(sprite, scene.hands);
+    CHECK(frame_difference(full, sprite).psnr > 20.0);
+}
+
+// The cost of each tier for walls of clocks at 1080p, with how far the lower tiers stray from the
+// full one: the mean and largest difference per channel, the PSNR, and the share of pixels that
+// differ at all. The tier the wall would pick for itself is marked.
+
+BENCHMARK(detail_tiers)
+{
+    uint32_t const width = 1920;
+    uint32_t const height = 1080;
+    uint32_t const frames = 30;
+
+    for (auto const count : { 1u, 16u, 100u, 400u, 1024u })
+    {
+        auto scene = record_wall(count, static_cast<float>(width), static_cast<float>(height));
+        auto const offsets = wall_offsets(count);
+        std::vector<HandAngles> angles(count);
+        auto const radius = wall_radius(count, width, height, 96.0f);
+        auto const chosen = detail_tier(radius);
+        Canvas reference;
+
+        printf("  %4u clocks, radius %5.1f px\n", count, radius);
+
+        for (auto const tier : { DetailTier::full, DetailTier::reduced, DetailTier::sprite })
+        {
+            SoftwareScene software(width, height, 96.0f, scene.dials, default_theme, tier);
+            Canvas frame;
+            Stopwatch const watch;
+
+            for (uint32_t index = 0; index != frames; ++index)
+            {
+                wall_angles(36000.0 + index, offsets.data(), count, angles.data());
+                patch_wall(scene, angles.data());
+                software.draw(frame, scene.hands);
+            }
+
+            auto const elapsed = watch.elapsed() / frames;
+            auto const name = DetailTier::full == tier ? "full" : DetailTier::reduced == tier ? "reduced" : "sprite";
+            auto const mark = tier == chosen ? '*' : ' ';
+
+            if (DetailTier::full == tier)
+            {
+                reference = frame;
+                printf("   %c%-8s %7.2f ms/frame\n", mark, name, elapsed * 1000.0);
+                continue;
+            }
+
+            auto const difference = frame_difference(reference, frame);
+            printf("   %c%-8s %7.2f ms/frame  mean |d| %.3f  max %3d  PSNR %5.1f dB  %5.2f%% of pixels differ\n",
+                mark, name, elapsed * 1000.0, difference.mean, difference.max, difference.psnr, difference.differing * 100.0);
+        }
+    }
+}
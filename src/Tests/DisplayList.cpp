@@ -0,0 +1,129 @@
+#include "Test.h"
+#include "Raster.h"
+
+// The calls draw_clock makes each frame, as an immediate-mode renderer makes them.
+
+template <typename Target>
+static void draw_immediate(Target& target, ClockGeometry const& geometry, HandAngles const& angles, FaceTheme const& theme = default_theme)
+{
+    auto const radius = geometry.radius;
+    auto const base = translation(geometry.x, geometry.y);
+
+    target.set_transform(base);
+    target.draw_ellipse(0.0f, 0.0f, radius, radius, radius * theme.dial_stroke);
+    target.set_transform(rotation(angles.second) * base);
+    target.draw_line(0.0f, 0.0f, 0.0f, -(radius * theme.second_length), radius * theme.second_stroke);
+    target.set_transform(rotation(angles.minute) * base);
+    target.draw_line(0.0f, 0.0f, 0.0f, -(radius * theme.minute_length), radius * theme.minute_stroke);
+    target.set_transform(rotation(angles.hour) * base);
+    target.draw_line(0.0f, 0.0f, 0.0f, -(radius * theme.hour_length), radius * theme.hour_stroke);
+}
+
+// Folds every call into a checksum, which leaves only the cost of issuing the calls.
+
+struct ChecksumTarget
+{
+    float sum = 0.0f;
+
+    void set_transform(Transform const& value)
+    {
+        sum += value.m11 + value.m12 + value.m21 + value.m22 + value.dx + value.dy;
+    }
+
+    void draw_ellipse(float const x, float const y, float const rx, float const ry, float const stroke)
+    {
+        sum += x + y + rx + ry + stroke;
+    }
+
+    void draw_line(float const x0, float const y0, float const x1, float const y1, float const stroke)
+    {
+        sum += x0 + y0 + x1 + y1 + stroke;
+    }
+
+    void draw_glyph(uint16_t const slot, float const x0, float const y0, float const x1, float const y1)
+    {
+        sum += slot + x0 + y0 + x1 + y1;
+    }
+};
+
+TEST(display_list_replay_matches_immediate)
+{
+    auto const geometry = clock_geometry(320.0f, 240.0f);
+    auto list = record_clock(geometry);
+    Canvas recorded(320, 240);
+    Canvas immediate(320, 240);
+
+    for (double seconds = 0.0; seconds < 86400.0; seconds += 3721.3)
+    {
+        auto const angles = hand_angles(seconds);
+        patch_hands(list, 0, angles);
+        recorded.clear();
+        recorded.set_color(default_theme.ink, default_theme.opacity);
+        replay(list, recorded);
+        immediate.clear();
+        immediate.set_color(default_theme.ink, default_theme.opacity);
+        draw_immediate(immediate, geometry, angles);
+        CHECK(std::equal(recorded.data(), recorded.data() + 320 * 240, immediate.data()));
+    }
+}
+
+TEST(display_list_round_trips)
+{
+    auto list = record_clock(clock_geometry(640.0f, 480.0f));
+    patch_hands(list, 0, hand_angles(36000.5));
+    auto const blob = serialize(list);
+    DisplayList copy;
+    CHECK(deserialize(blob.data(), blob.size(), copy));
+    CHECK(copy.ops.size() == list.ops.size() && copy.transforms.size() == list.transforms.size());
+    CHECK(!memcmp(copy.ops.data(), list.ops.data(), list.ops.size() * sizeof(DisplayOp)));
+    CHECK(!memcmp(copy.transforms.data(), list.transforms.data(), list.transforms.size() * sizeof(Transform)));
+    CHECK(!deserialize(blob.data(), blob.size() - 1, copy));
+
+    auto corrupt = blob;
+    corrupt[sizeof(DisplayListHeader) + list.transforms.size() * sizeof(Transform)] = 0xff;
+    CHECK(!deserialize(corrupt.data(), corrupt.size(), copy));
+}
+
+// Replays frames a second apart through each target, against making the same calls directly.
+// The checksum target shows the cost of the calls themselves and the canvas what it comes to once
+// the software rasteriser does the drawing.
+
+template <typename Target>
+static void compare_replay(char const* const name, Target& target, uint32_t const frames, float const size)
+{
+    auto const geometry = clock_geometry(size, size);
+    auto list = record_clock(geometry);
+
+    Stopwatch const immediate_watch;
+
+    for (uint32_t frame = 0; frame != frames; ++frame)
+    {
+        draw_immediate(target, geometry, hand_angles(frame * 1.001));
+    }
+
+    auto const immediate = immediate_watch.elapsed();
+    Stopwatch const replay_watch;
+
+    for (uint32_t frame = 0; frame != frames; ++frame)
+    {
+        patch_hands(list, 0, hand_angles(frame * 1.001));
+        replay(list, target);
+    }
+
+    auto const replayed = replay_watch.elapsed();
+
+    printf("  %-8s %8u frames  immediate %9.1f ns/frame  replay %9.1f ns/frame  (%.2fx)\n",
+        name, frames, immediate * 1e9 / frames, replayed * 1e9 / frames, immediate / replayed);
+}
+
+BENCHMARK(display_list_replay)
+{
+    ChecksumTarget checksum;
+    compare_replay("calls", checksum, 864000, 512.0f);
+    keep(checksum.sum);
+
+    Canvas canvas(512, 512);
+    canvas.set_color(default_theme.ink, default_theme.opacity);
+    compare_replay("canvas", canvas, 2000, 512.0f);
+    keep(canvas.data()[256 * 512 + 256]);
+}
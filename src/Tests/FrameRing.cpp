@@ -0,0 +1,217 @@
+#include "Test.h"
+#include "FrameRing.h"
+#include <thread>
+
+static std::string ring_name(char const* const use)
+{
+    return std::string("clock-tests-") + use + "-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+}
+
+// Fills the whole of each frame with its number, so that a read is consistent only if every
+// pixel and the slot's own record agree with the frame the view says it holds.
+
+static uint64_t publish_numbered(FrameRingWriter& writer, uint32_t const width, uint32_t const height, uint64_t const frame)
+{
+    return writer.publish(width, height, { 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) }, [&](uint32_t* pixels, uint32_t const stride, PixelRect const& region)
+    {
+        for (auto y = region.top; y < region.bottom; ++y)
+        {
+            std::fill(pixels + size_t{ static_cast<uint32_t>(y) } * stride + region.left, pixels + size_t{ static_cast<uint32_t>(y) } * stride + region.right, static_cast<uint32_t>(frame));
+        }
+    });
+}
+
+static bool consistent(FrameView const& view)
+{
+    if (view.slot->frame != view.frame)
+    {
+        return false;
+    }
+
+    for (uint32_t y = 0; y != view.height; ++y)
+    {
+        for (uint32_t x = 0; x != view.width; ++x)
+        {
+            if (view.pixels[size_t{ y } * view.stride + x] != static_cast<uint32_t>(view.frame))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+TEST(frame_ring_rejects_lapped_reads)
+{
+    auto const name = ring_name("lapped");
+    FrameRingWriter writer(name, 64, 32, 3);
+    FrameRingReader reader;
+    CHECK(reader.open(name));
+
+    FrameView view;
+    CHECK(!reader.latest(view));
+
+    publish_numbered(writer, 64, 32, 1);
+    CHECK(reader.latest(view) && 1 == view.frame && consistent(view) && reader.valid(view));
+
+    // The next two frames go to the other slots and leave this one alone. The one after starts
+    // to overwrite it, which the view must notice while the copy is under way and after.
+
+    publish_numbered(writer, 64, 32, 2);
+    publish_numbered(writer, 64, 32, 3);
+    CHECK(reader.valid(view) && consistent(view));
+
+    auto during = true;
+
+    writer.publish(64, 32, { 0, 0, 64, 32 }, [&](uint32_t*, uint32_t, PixelRect const&)
+    {
+        during = reader.valid(view);
+
+        FrameView newest;
+        CHECK(reader.latest(newest) && 3 == newest.frame);
+    });
+
+    CHECK(!during);
+    CHECK(!reader.valid(view));
+    CHECK(reader.latest(view) && 4 == view.frame && reader.valid(view));
+}
+
+// A reader racing a writer that never waits for it. Reads that valid() accepts must be whole
+// frames; the reader is far slower than the writer, so many are lapped and must be rejected.
+
+TEST(frame_ring_race)
+{
+    auto const name = ring_name("race");
+    uint32_t const width = 256;
+    uint32_t const height = 128;
+    FrameRingWriter writer(name, width, height, 3);
+    FrameRingReader reader;
+    CHECK(reader.open(name));
+    std::atomic<bool> stopping{};
+
+    std::thread producer([&]
+    {
+        for (uint64_t frame = 1; !stopping; ++frame)
+        {
+            publish_numbered(writer, width, height, frame);
+        }
+    });
+
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;
+    uint64_t torn = 0;
+    uint64_t previous = 0;
+    Stopwatch const watch;
+
+    while (watch.elapsed() < 1.0 || !accepted || !rejected)
+    {
+        FrameView view;
+
+        if (!reader.latest(view))
+        {
+            continue;
+        }
+
+        auto const whole = consistent(view);
+
+        if (reader.valid(view))
+        {
+            ++accepted;
+            torn += !whole;
+            CHECK(view.frame >= previous);
+            previous = view.frame;
+        }
+        else
+        {
+            ++rejected;
+        }
+
+        if (watch.elapsed() > 30.0)
+        {
+            break;
+        }
+    }
+
+    stopping = true;
+    producer.join();
+
+    printf("  %llu reads accepted, %llu rejected as lapped\n", static_cast<unsigned long long>(accepted), static_cast<unsigned long long>(rejected));
+    CHECK(0 == torn);
+    CHECK(accepted && rejected);
+}
+
+// Frames a second the writer publishes at 1080p, copying the whole frame or just a hand-sized
+// region that changed, and the rate a concurrent reader sees whole frames at.
+
+BENCHMARK(frame_ring_throughput)
+{
+    uint32_t const width = 1920;
+    uint32_t const height = 1080;
+    std::vector<uint32_t> source(size_t{ width } * height, 0xff336699);
+
+    for (auto const full : { true, false })
+    {
+        auto const name = ring_name("throughput");
+        FrameRingWriter writer(name, width, height, 3);
+        FrameRingReader reader;
+        CHECK(reader.open(name));
+        std::atomic<bool> stopping{};
+        std::atomic<uint64_t> whole{};
+
+        std::thread consumer([&]
+        {
+            uint64_t sum = 0;
+            uint64_t seen = 0;
+
+            while (!stopping)
+            {
+                FrameView view;
+
+                if (reader.latest(view) && view.frame != seen)
+                {
+                    for (uint32_t y = 0; y < view.height; y += 8)
+                    {
+                        sum += view.pixels[size_t{ y } * view.stride + y % view.width];
+                    }
+
+                    if (reader.valid(view))
+                    {
+                        seen = view.frame;
+                        ++whole;
+                    }
+                }
+            }
+
+            keep(sum);
+        });
+
+        PixelRect const hand{ 900, 300, 1020, 560 };
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        Stopwatch const watch;
+
+        while (watch.elapsed() < 2.0)
+        {
+            writer.publish(width, height, full ? PixelRect{ 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) } : hand, [&](uint32_t* pixels, uint32_t const stride, PixelRect const& region)
+            {
+                for (auto y = region.top; y < region.bottom; ++y)
+                {
+                    auto const row = size_t{ static_cast<uint32_t>(y) };
+                    memcpy(pixels + row * stride + region.left, source.data() + row * width + region.left, size_t(region.right - region.left) * 4);
+                }
+
+                bytes += static_cast<uint64_t>(region.area()) * 4;
+            });
+
+            ++frames;
+        }
+
+        auto const elapsed = watch.elapsed();
+        stopping = true;
+        consumer.join();
+
+        printf("  %-5s  %9.0f frames/s  %6.2f GB/s copied  reader %8.0f whole frames/s\n",
+            full ? "full" : "dirty", frames / elapsed, bytes / elapsed / 1e9, whole / elapsed);
+    }
+}
@@ -0,0 +1,198 @@
+#include "Test.h"
+#include "Raster.h"
+#include <random>
+
+// The built-in font's atlas needs no platform font engine, so it can be checked as it is built.
+// Every glyph must lie within the atlas, clear of every other by the pixel between them, and
+// nothing may be drawn outside the glyphs.
+
+TEST(glyph_atlas_packs_the_builtin_font)
+{
+    for (auto const dpi : { 96.0f, 120.0f, 144.0f, 192.0f })
+    {
+        for (auto const size : { 6.0f, 11.0f, 23.0f, 48.0f })
+        {
+            auto const atlas = builtin_atlas(size, dpi);
+            auto const cell = size * dpi / 96.0f / 10.0f;
+            CHECK(atlas.width >= 16 && 0 == (atlas.width & (atlas.width - 1)));
+            CHECK(atlas.alpha.size() == size_t{ atlas.width } * atlas.height);
+            CHECK(atlas.digit == cell * 6.0f && atlas.ascent >= cell * 7.0f);
+            CHECK(&atlas.glyph(200) == &atlas.glyph(' ') && 0 == atlas.glyph(' ').width && atlas.glyph(' ').advance > 0.0f);
+
+            std::vector<uint8_t> owner(atlas.alpha.size());
+            uint8_t glyph = 0;
+
+            for (auto const character : std::string_view("0123456789:"))
+            {
+                auto const& box = atlas.glyph(static_cast<uint8_t>(character));
+                CHECK(box.width && box.height && box.x + box.width < atlas.width + 1u && box.y + box.height <= atlas.height);
+                uint32_t lit = 0;
+                ++glyph;
+
+                // The box and the pixel right of and below it belong to this glyph alone.
+
+                for (uint32_t y = box.y; y != std::min(atlas.height, box.y + box.height + 1u); ++y)
+                {
+                    for (uint32_t x = box.x; x != std::min(atlas.width, box.x + box.width + 1u); ++x)
+                    {
+                        auto const index = size_t{ y } * atlas.width + x;
+                        CHECK(!owner[index]);
+                        owner[index] = glyph;
+                        lit += 0 != atlas.alpha[index];
+                        CHECK((y < box.y + box.height && x < box.x + box.width) || !atlas.alpha[index]);
+                    }
+                }
+
+                CHECK(lit > 0);
+            }
+
+            for (size_t index = 0; index != atlas.alpha.size(); ++index)
+            {
+                CHECK(owner[index] || !atlas.alpha[index]);
+            }
+        }
+    }
+
+    // At two pixels a cell the font's cells fall on whole pixels, so a digit drawn from the atlas
+    // covers the cells the font lights in full, and nothing else.
+
+    auto const atlas = builtin_atlas(20.0f, 96.0f);
+    Canvas canvas(16, 16);
+    canvas.set_atlas(&atlas);
+    canvas.set_color({ 1.0f, 1.0f, 1.0f, 1.0f }, 1.0f);
+    DisplayList list;
+    list.transforms.push_back(identity());
+    list.ops.push_back({ DisplayCommand::set_transform, 0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    record_text(list, atlas, "4", 0.0f, 14.0f);
+    replay(list, canvas);
+
+    for (int y = 0; y != 16; ++y)
+    {
+        for (int x = 0; x != 16; ++x)
+        {
+            auto const row = y / 2;
+            auto const column = (x - 1) / 2;
+            auto const lit = x >= 1 && column < 5 && row < 7 && (builtin_rows('4')[row] >> (4 - column) & 1);
+            CHECK((lit ? 0xffffffffu : 0u) == canvas.data()[y * 16 + x]);
+        }
+    }
+}
+
+static void readout_canvas(Canvas& canvas, GlyphAtlas const& atlas)
+{
+    canvas.resize(320, 120);
+    canvas.set_dpi(atlas.dpi);
+    canvas.set_atlas(&atlas);
+    canvas.set_color(color_orange, hand_opacity);
+}
+
+// 20,000 updates drawn incrementally, patching only the cells that changed into a layer that
+// keeps the rest, must each give the same pixels as a readout drawn from scratch: first a run of
+// consecutive seconds, crossing minutes and hours, then jumps to random times of day.
+
+TEST(digital_readout_incremental_updates)
+{
+    auto const atlas = builtin_atlas(readout_size(190.0f), 144.0f);
+    DigitalReadout readout(atlas, 106.0f, 55.0f);
+    Canvas layer;
+    Canvas scratch;
+    readout_canvas(layer, atlas);
+    readout_canvas(scratch, atlas);
+    std::mt19937 random(1);
+    uint32_t mismatches = 0;
+    uint32_t previous = 0;
+
+    for (uint32_t update = 0; update != 20000; ++update)
+    {
+        auto const seconds = update < 10000 ? 35000 + update : random() % 86400;
+        auto const changed = readout.update(seconds);
+        draw_readout(layer, readout, changed);
+
+        // Consecutive seconds redraw the last digit and whatever carried into.
+
+        if (update && update < 10000)
+        {
+            CHECK((changed & 0x80) && !(changed & 0x24));
+            CHECK((0 != seconds % 10) == (0x80 == changed));
+        }
+
+        if (update && seconds == previous)
+        {
+            CHECK(!changed);
+        }
+
+        DigitalReadout fresh(atlas, 106.0f, 55.0f);
+        scratch.clear();
+        draw_readout(scratch, fresh, fresh.update(seconds));
+        mismatches += 0 != memcmp(layer.data(), scratch.data(), size_t{ layer.width() } * layer.height() * 4);
+        previous = seconds;
+    }
+
+    CHECK(0 == mismatches);
+
+    // The first update draws every cell, and the readout stays within its bounds.
+
+    DigitalReadout first(atlas, 106.0f, 55.0f);
+    CHECK(0xff == first.update(0));
+    auto const bounds = cell_pixels(first.bounds(), atlas.dpi);
+
+    for (int32_t y = 0; y != static_cast<int32_t>(layer.height()); ++y)
+    {
+        for (int32_t x = 0; x != static_cast<int32_t>(layer.width()); ++x)
+        {
+            auto const inside = x >= bounds.left && x < bounds.right && y >= bounds.top && y < bounds.bottom;
+            CHECK(inside || !layer.data()[size_t{ static_cast<uint32_t>(y) } * layer.width() + x]);
+        }
+    }
+}
+
+// Updating a readout once a second through a day, redrawing the cells that changed, all eight,
+// or rasterising the atlas and laying the readout out afresh every time as text drawn directly
+// would.
+
+BENCHMARK(digital_readout_update)
+{
+    auto const atlas = builtin_atlas(readout_size(190.0f), 144.0f);
+    uint32_t const seconds = 86400;
+
+    for (auto const mode : { 0, 1, 2 })
+    {
+        Canvas layer;
+        readout_canvas(layer, atlas);
+        DigitalReadout readout(atlas, 106.0f, 55.0f);
+        uint64_t cells = 0;
+        uint32_t updates = 0;
+        Stopwatch const watch;
+
+        for (uint32_t second = 0; second < seconds; second += 2 == mode ? 10 : 1, ++updates)
+        {
+            if (2 == mode)
+            {
+                auto const fresh = builtin_atlas(readout_size(190.0f), 144.0f);
+                layer.set_atlas(&fresh);
+                DigitalReadout text(fresh, 106.0f, 55.0f);
+                layer.clear(cell_pixels(text.bounds(), fresh.dpi));
+                draw_readout(layer, text, text.update(second));
+                layer.set_atlas(&atlas);
+                continue;
+            }
+
+            auto const changed = readout.update(second);
+            auto const drawn = 0 == mode ? changed : 0xffu;
+
+            for (auto mask = drawn; mask; mask &= mask - 1)
+            {
+                ++cells;
+            }
+
+            draw_readout(layer, readout, drawn);
+        }
+
+        auto const elapsed = watch.elapsed();
+        keep(layer.data()[0]);
+
+        printf("  %-22s %8.3f us/update  %.2f cells drawn\n",
+            0 == mode ? "changed cells" : 1 == mode ? "all cells" : "rasterise and lay out",
+            elapsed * 1e6 / updates, 2 == mode ? 8.0 : static_cast<double>(cells) / updates);
+    }
+}
@@ -0,0 +1,168 @@
+#include "Test.h"
+#include "Http.h"
+#include <algorithm>
+
+TEST(http_parses_utc_offsets)
+{
+    int32_t offset = 1;
+    CHECK(parse_utc_offset("UTC", offset) && 0 == offset);
+    CHECK(parse_utc_offset("+5", offset) && 5 * 3600 == offset);
+    CHECK(parse_utc_offset("-08", offset) && -8 * 3600 == offset);
+    CHECK(parse_utc_offset("+05:30", offset) && 19800 == offset);
+    CHECK(parse_utc_offset(" 0545", offset) && 20700 == offset);
+    CHECK(!parse_utc_offset("+15", offset));
+    CHECK(!parse_utc_offset("+05:60", offset));
+    CHECK(!parse_utc_offset("+053", offset));
+    CHECK(!parse_utc_offset("Europe/London", offset));
+    CHECK(url_decode("%2B05%3a30+x") == "+05:30 x");
+}
+
+// Sends a request on a blocking connection and reads the whole response, returning the status
+// code and the length of the body, or zero if the connection failed.
+
+static int http_get(Socket const connection, char const* const target, size_t& body)
+{
+    char request[256];
+    auto const size = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", target);
+
+    if (send(connection, request, size, 0) != size)
+    {
+        return 0;
+    }
+
+    std::string input;
+    size_t expected = SIZE_MAX;
+    char buffer[65536];
+
+    while (input.size() < expected)
+    {
+        auto const received = receive(connection, buffer, sizeof(buffer));
+
+        if (received <= 0)
+        {
+            return 0;
+        }
+
+        input.append(buffer, static_cast<size_t>(received));
+        auto const end = input.find("\r\n\r\n");
+
+        if (end != std::string::npos && SIZE_MAX == expected)
+        {
+            auto const length = input.find("Content-Length: ");
+            body = length < end ? strtoul(input.c_str() + length + 16, nullptr, 10) : 0;
+            expected = end + 4 + body;
+        }
+    }
+
+    return atoi(input.c_str() + 9);
+}
+
+TEST(http_serves_clock_images)
+{
+    HttpServer server(0, 0, nullptr, 2);
+    auto const connection = connect_loopback(server.port());
+    CHECK(invalid_socket != connection);
+
+    size_t body = 0;
+    CHECK(200 == http_get(connection, "/clock.png?tz=%2B05:30&size=64", body) && body > 100);
+    CHECK(404 == http_get(connection, "/clock.png?tz=nowhere", body) && 0 == body);
+    CHECK(404 == http_get(connection, "/clock.png?size=8", body));
+    CHECK(404 == http_get(connection, "/index.html", body));
+    CHECK(200 == http_get(connection, "/clock.png", body));
+    close_socket(connection);
+}
+
+TEST(http_coalesces_concurrent_requests)
+{
+    HttpServer server(0, 0, nullptr, 2);
+    std::vector<std::thread> clients;
+    std::atomic<uint32_t> served{};
+
+    for (int client = 0; client != 16; ++client)
+    {
+        clients.emplace_back([&]
+        {
+            auto const connection = connect_loopback(server.port());
+            size_t body = 0;
+            served += 200 == http_get(connection, "/clock.png?tz=-03&size=1024", body);
+            close_socket(connection);
+        });
+    }
+
+    for (auto&& client : clients)
+    {
+        client.join();
+    }
+
+    // One render, or two if the requests straddle a second.
+
+    CHECK(16 == served);
+    CHECK(server.renders() <= 2);
+}
+
+// Keep-alive clients each sending requests back to back for a while. With one key every client
+// wants the same image each second, as dashboards polling one clock do; with a key per client
+// each has a time zone of its own and every second renders once for each.
+
+BENCHMARK(http_load)
+{
+    for (auto const keys : { 1, 16 })
+    {
+        for (auto const size : { 256, 1024 })
+        {
+            HttpServer server(0, 0);
+            uint32_t const count = 16;
+            std::vector<std::thread> clients;
+            std::vector<std::vector<double>> latencies(count);
+            std::atomic<uint32_t> failures{};
+            Stopwatch const watch;
+
+            for (uint32_t client = 0; client != count; ++client)
+            {
+                clients.emplace_back([&, client]
+                {
+                    char target[64];
+                    auto const hours = static_cast<int>(client % keys) - 8;
+                    snprintf(target, sizeof(target), "/clock.png?tz=%s%02d&size=%d", hours < 0 ? "-" : "%2B", abs(hours), size);
+                    auto const connection = connect_loopback(server.port());
+
+                    while (watch.elapsed() < 3.0)
+                    {
+                        Stopwatch const request;
+                        size_t body = 0;
+
+                        if (200 != http_get(connection, target, body))
+                        {
+                            ++failures;
+                            break;
+                        }
+
+                        latencies[client].push_back(request.elapsed());
+                    }
+
+                    close_socket(connection);
+                });
+            }
+
+            for (auto&& client : clients)
+            {
+                client.join();
+            }
+
+            auto const elapsed = watch.elapsed();
+            std::vector<double> all;
+
+            for (auto&& latency : latencies)
+            {
+                all.insert(all.end(), latency.begin(), latency.end());
+            }
+
+            std::sort(all.begin(), all.end());
+
+            printf("  %2d key%s %4dx%-4d %u clients  %8.0f requests/s  p50 %7.2f ms  p99 %7.2f ms  %3llu renders  %u failed\n",
+                keys, 1 == keys ? " " : "s", size, size, count, all.size() / elapsed,
+                all[all.size() / 2] * 1000.0, all[all.size() * 99 / 100] * 1000.0,
+                static_cast<unsigned long long>(server.renders()), failures.load());
+        }
+    }
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "Png.h"
+#include <cstdint>
+#include <vector>
+
+// Decodes the zlib streams that Png.h writes, which only ever hold fixed Huffman and stored
+// blocks, so that tests can check what the encoders produce without depending on zlib. A stream
+// may arrive in pieces that each end on a block boundary, as RFB zlib rectangles do, and blocks
+// may refer back into the output of earlier pieces.
+
+struct Inflater
+{
+    // Decodes the next piece, appending to output, which must hold everything decoded from the
+    // stream so far. The first piece begins with the two byte zlib header. Returns false if the
+    // piece is malformed or uses anything the encoders do not.
+
+    bool inflate(uint8_t const* data, size_t const size, std::vector<uint8_t>& output)
+    {
+        m_data = data;
+        m_size = size;
+        m_position = 0;
+        m_bits = 0;
+        m_count = 0;
+
+        if (!m_started)
+        {
+            if (size < 2 || 0x08 != (data[0] & 0x0f) || (data[0] << 8 | data[1]) % 31 || (data[1] & 0x20))
+            {
+                return false;
+            }
+
+            m_position = 2;
+            m_started = true;
+            m_begin = output.size();
+        }
+
+        while (!m_finished && (m_position != m_size || m_count))
+        {
+            uint32_t header = 0;
+
+            if (m_finished || !read(3, header) || !block(header >> 1, output))
+            {
+                return false;
+            }
+
+            m_finished = header & 1;
+
+            // A piece ends where a block does, on a byte boundary.
+
+            if (!m_finished && m_position == m_size)
+            {
+                m_count = 0;
+            }
+        }
+
+        if (m_finished)
+        {
+            m_count = 0;
+
+            if (m_size - m_position != 4)
+            {
+                return false;
+            }
+
+            auto const expected = uint32_t{ m_data[m_position] } << 24 | uint32_t{ m_data[m_position + 1] } << 16 | uint32_t{ m_data[m_position + 2] } << 8 | m_data[m_position + 3];
+            return expected == adler32(1, output.data() + m_begin, output.size() - m_begin);
+        }
+
+        return true;
+    }
+
+    bool finished() const noexcept
+    {
+        return m_finished;
+    }
+
+private:
+
+    bool read(uint32_t const length, uint32_t& value)
+    {
+        while (m_count < length)
+        {
+            if (m_position == m_size)
+            {
+                return false;
+            }
+
+            m_bits |= uint64_t{ m_data[m_position++] } << m_count;
+            m_count += 8;
+        }
+
+        value = static_cast<uint32_t>(m_bits & ((uint64_t{ 1 } << length) - 1));
+        m_bits >>= length;
+        m_count -= length;
+        return true;
+    }
+
+    // Huffman codes are sent most significant bit first.
+
+    bool code(uint32_t const length, uint32_t& value)
+    {
+        value = 0;
+
+        for (uint32_t i = 0; i != length; ++i)
+        {
+            uint32_t bit = 0;
+
+            if (!read(1, bit))
+            {
+                return false;
+            }
+
+            value = value << 1 | bit;
+        }
+
+        return true;
+    }
+
+    bool symbol(uint32_t& value)
+    {
+        uint32_t prefix = 0;
+        uint32_t bit = 0;
+
+        if (!code(7, prefix))
+        {
+            return false;
+        }
+
+        if (prefix <= 0x17)
+        {
+            value = 256 + prefix;
+            return true;
+        }
+
+        if (!read(1, bit))
+        {
+            return false;
+        }
+
+        prefix = prefix << 1 | bit;
+
+        if (prefix >= 0x30 && prefix <= 0xbf)
+        {
+            value = prefix - 0x30;
+            return true;
+        }
+
+        if (prefix >= 0xc0 && prefix <= 0xc7)
+        {
+            value = 280 + prefix - 0xc0;
+            return true;
+        }
+
+        if (!read(1, bit))
+        {
+            return false;
+        }
+
+        value = 144 + (prefix << 1 | bit) - 0x190;
+        return true;
+    }
+
+    bool block(uint32_t const type, std::vector<uint8_t>& output)
+    {
+        if (0 == type)
+        {
+            m_bits >>= m_count % 8;
+            m_count -= m_count % 8;
+            uint32_t length = 0;
+            uint32_t inverse = 0;
+
+            if (!read(16, length) || !read(16, inverse) || (length ^ 0xffff) != inverse || m_count || m_size - m_position < length)
+            {
+                return false;
+            }
+
+            output.insert(output.end(), m_data + m_position, m_data + m_position + length);
+            m_position += length;
+            return true;
+        }
+
+        if (1 != type)
+        {
+            return false;
+        }
+
+        while (true)
+        {
+            uint32_t value = 0;
+
+            if (!symbol(value) || value > 285)
+            {
+                return false;
+            }
+
+            if (value < 256)
+            {
+                output.push_back(static_cast<uint8_t>(value));
+                continue;
+            }
+
+            if (256 == value)
+            {
+                return true;
+            }
+
+            uint32_t extra = 0;
+            uint32_t distance_code = 0;
+            auto const length_code = value - 257;
+
+            if (!read(FixedHuffman::length_extra[length_code], extra))
+            {
+                return false;
+            }
+
+            auto const length = FixedHuffman::length_base[length_code] + extra;
+
+            if (!code(5, distance_code) || distance_code >= 30 || !read(FixedHuffman::distance_extra[distance_code], extra))
+            {
+                return false;
+            }
+
+            auto const distance = FixedHuffman::distance_base[distance_code] + extra;
+
+            if (distance > output.size())
+            {
+                return false;
+            }
+
+            for (uint32_t i = 0; i != length; ++i)
+            {
+                output.push_back(output[output.size() - distance]);
+            }
+        }
+    }
+
+    uint8_t const* m_data{};
+    size_t m_size{};
+    size_t m_position{};
+    uint64_t m_bits{};
+    uint32_t m_count{};
+    size_t m_begin{};
+    bool m_started{};
+    bool m_finished{};
+};
@@ -0,0 +1,59 @@
+// clock-tests: runs the tests of the portable modules, or with --bench their benchmarks, and
+// optionally only those whose names contain the given text:
+//
+//   clock-tests
+//   clock-tests --bench replay
+//
+// On Linux the Makefile alongside builds and runs them with make test and make bench.
+
+#include "Test.h"
+#include <cstdint>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+    auto benchmarks = false;
+    char const* filter = nullptr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--bench"))
+        {
+            benchmarks = true;
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    uint32_t passed = 0;
+    uint32_t failed = 0;
+
+    for (auto&& test : test_cases())
+    {
+        if (test.benchmark != benchmarks || (filter && !strstr(test.name, filter)))
+        {
+            continue;
+        }
+
+        printf("%s\n", test.name);
+        fflush(stdout);
+
+        try
+        {
+            Stopwatch const watch;
+            test.run();
+            printf("  passed in %.3f s\n", watch.elapsed());
+            ++passed;
+        }
+        catch (std::exception const& e)
+        {
+            printf("  FAILED: %s\n", e.what());
+            ++failed;
+        }
+    }
+
+    printf("%u passed, %u failed\n", passed, failed);
+    return failed ? 1 : 0;
+}
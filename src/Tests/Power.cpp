@@ -0,0 +1,191 @@
+#include "Test.h"
+#include "Power.h"
+#include <random>
+
+static std::vector<PowerInputs> every_input()
+{
+    std::vector<PowerInputs> inputs;
+
+    for (auto const source : { PowerSource::ac, PowerSource::battery })
+    {
+        for (auto const display : { DisplayState::off, DisplayState::on, DisplayState::dimmed })
+        {
+            for (auto const saver : { false, true })
+            {
+                for (auto const hidden : { false, true })
+                {
+                    for (auto const foreground : { false, true })
+                    {
+                        inputs.push_back({ source, display, saver, hidden, foreground });
+                    }
+                }
+            }
+        }
+    }
+
+    return inputs;
+}
+
+// Whether b is at least as bad for power as a in every input: on battery if a is, saving if a
+// is, hidden if a is, in the background if a is, and with the display as dim or off.
+
+static bool no_better(PowerInputs const& a, PowerInputs const& b)
+{
+    auto const display = a.display == b.display || DisplayState::off == b.display ||
+        (DisplayState::on == a.display && DisplayState::dimmed == b.display);
+
+    return b.source >= a.source && b.saver >= a.saver && b.hidden >= a.hidden && b.foreground <= a.foreground && display;
+}
+
+// Every combination of inputs: nothing is drawn with the display off or the window hidden, full
+// power needs mains, a bright display, no saver and the foreground, and taking anything away
+// never asks for more.
+
+TEST(power_level_covers_every_input)
+{
+    auto const inputs = every_input();
+    CHECK(48 == inputs.size());
+    uint32_t counts[4] = {};
+
+    for (auto&& a : inputs)
+    {
+        auto const level = power_level(a);
+        ++counts[static_cast<uint8_t>(level)];
+
+        CHECK((PowerLevel::paused == level) == (DisplayState::off == a.display || a.hidden));
+        CHECK((PowerLevel::full == level) == (PowerSource::ac == a.source && DisplayState::on == a.display && !a.saver && !a.hidden && a.foreground));
+
+        if (PowerLevel::paused != level)
+        {
+            CHECK((PowerLevel::saving == level) == (a.saver || DisplayState::dimmed == a.display || (PowerSource::battery == a.source && !a.foreground)));
+        }
+
+        for (auto&& b : inputs)
+        {
+            CHECK(!no_better(a, b) || power_level(b) >= level);
+        }
+    }
+
+    CHECK(1 == counts[0] && 2 == counts[1] && 13 == counts[2] && 32 == counts[3]);
+}
+
+// From every settled level to every other: saving more applies at once, as does anything out of
+// paused, while spending more waits out the dwell and says when it will be due.
+
+TEST(power_policy_dwells_before_spending_more)
+{
+    auto const inputs = every_input();
+
+    for (auto&& a : inputs)
+    {
+        for (auto&& b : inputs)
+        {
+            PowerPolicy policy;
+            policy.update(a, 0.0);
+            policy.update(a, 100.0);
+            CHECK(policy.level() == power_level(a) && std::isinf(policy.due()));
+
+            auto const from = policy.level();
+            auto const to = power_level(b);
+            auto const changed = policy.update(b, 200.0);
+
+            if (to >= from || PowerLevel::paused == from)
+            {
+                CHECK(policy.level() == to && changed == (to != from) && std::isinf(policy.due()));
+                continue;
+            }
+
+            CHECK(policy.level() == from && !changed && 205.0 == policy.due());
+            CHECK(!policy.update(b, 204.999) && policy.level() == from);
+            CHECK(policy.update(b, 205.0) && policy.level() == to && std::isinf(policy.due()));
+        }
+    }
+}
+
+TEST(power_policy_restarts_the_wait_when_the_wanted_level_changes)
+{
+    PowerInputs const dimmed{ PowerSource::ac, DisplayState::dimmed };
+    PowerInputs const battery{ PowerSource::battery };
+    PowerInputs const full{};
+    PowerInputs const off{ PowerSource::ac, DisplayState::off };
+
+    PowerPolicy policy;
+    CHECK(policy.update(dimmed, 0.0) && PowerLevel::saving == policy.level());
+
+    // Asking again for the same level keeps the time it was first asked for.
+
+    CHECK(!policy.update(battery, 10.0) && 15.0 == policy.due());
+    CHECK(!policy.update(battery, 13.0) && 15.0 == policy.due());
+
+    // Asking for a different one starts the wait again, even though it is further from saving.
+
+    CHECK(!policy.update(full, 14.0) && 19.0 == policy.due());
+    CHECK(!policy.update(full, 18.9) && PowerLevel::saving == policy.level());
+    CHECK(policy.update(full, 19.0) && PowerLevel::full == policy.level() && 2 == policy.changes());
+
+    // A wait cut short by saving more starts from scratch afterwards.
+
+    CHECK(policy.update(dimmed, 20.0) && !policy.update(full, 21.0) && 26.0 == policy.due());
+    CHECK(!policy.update(dimmed, 22.0) && std::isinf(policy.due()));
+    CHECK(!policy.update(full, 23.0) && 28.0 == policy.due());
+    CHECK(!policy.update(full, 26.0) && PowerLevel::saving == policy.level());
+
+    // Nothing is drawn while paused, so leaving it goes straight to the level asked for.
+
+    CHECK(policy.update(off, 27.0) && PowerLevel::paused == policy.level() && std::isinf(policy.due()));
+    CHECK(policy.update(full, 27.5) && PowerLevel::full == policy.level());
+    CHECK(!policy.update(full, 28.0) && PowerLevel::full == policy.level());
+}
+
+// Inputs flapping at random for a couple of days of virtual time: the level never spends more
+// than the inputs ask for, and never saves more than they ask for once the dwell has passed.
+
+TEST(power_policy_follows_flapping_inputs)
+{
+    auto const inputs = every_input();
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> gaps(0.0, 3.0);
+    PowerPolicy policy;
+    auto wanted = PowerLevel::full;
+    double time = 0.0;
+    double since = 0.0;
+    uint64_t held = 0;
+    uint64_t late = 0;
+
+    for (uint32_t step = 0; step != 100000; ++step)
+    {
+        time += gaps(random);
+        auto const& input = inputs[random() % inputs.size()];
+
+        if (power_level(input) != wanted)
+        {
+            wanted = power_level(input);
+            since = time;
+        }
+
+        policy.update(input, time);
+        CHECK(policy.level() >= wanted);
+        held += policy.level() != wanted;
+        late += policy.level() != wanted && time - since >= 5.0;
+    }
+
+    printf("  %llu level changes, %llu of 100000 updates held back by the dwell\n",
+        static_cast<unsigned long long>(policy.changes()), static_cast<unsigned long long>(held));
+
+    CHECK(held && 0 == late);
+}
+
+TEST(power_present_interval)
+{
+    CHECK(1 == present_interval(0.0f, 60.0f) && 1 == present_interval(60.0f, 60.0f) && 1 == present_interval(30.0f, 30.0f));
+    CHECK(2 == present_interval(30.0f, 60.0f) && 2 == present_interval(30.0f, 59.94f) && 3 == present_interval(20.0f, 60.0f));
+    CHECK(4 == present_interval(15.0f, 60.0f) && 4 == present_interval(30.0f, 144.0f) && 4 == present_interval(1.0f, 240.0f));
+
+    PowerPolicySettings const settings;
+    TickStyle const tick;
+    CHECK(60.0 == policy_frame_rate(settings.levels[0], HandMotion::sweep, 60.0f, tick));
+    CHECK(10.0 == policy_frame_rate(settings.levels[0], HandMotion::tick, 60.0f, tick));
+    CHECK(30.0 == policy_frame_rate(settings.levels[1], HandMotion::sweep, 60.0f, tick));
+    CHECK(4.0 == policy_frame_rate(settings.levels[2], HandMotion::tick, 60.0f, tick));
+    CHECK(0.0 == policy_frame_rate(settings.levels[3], HandMotion::tick, 60.0f, tick));
+}
@@ -0,0 +1,162 @@
+#include "Test.h"
+#include "Rcu.h"
+#include <thread>
+
+// A version that records being freed in a table kept apart from it, so a reader can tell that the
+// version it holds has gone without touching the freed memory.
+
+struct RcuVersion
+{
+    uint64_t number;
+    uint64_t check;
+    std::atomic<bool>* freed;
+
+    RcuVersion(uint64_t const number, std::atomic<bool>* const freed) :
+        number(number),
+        check(~number),
+        freed(freed)
+    {
+    }
+
+    ~RcuVersion()
+    {
+        freed[number] = true;
+    }
+};
+
+TEST(rcu_keeps_versions_readers_hold)
+{
+    std::vector<std::atomic<bool>> freed(4);
+    RcuPointer<RcuVersion> pointer(std::make_unique<RcuVersion>(0, freed.data()));
+
+    {
+        RcuReader<RcuVersion> reader(pointer);
+        auto const held = reader.read();
+        CHECK(0 == held->number);
+
+        // The reader may still be using version 0, so it is retired rather than freed, and so
+        // is version 1 as the reader has not passed a quiescent point since either was replaced.
+
+        CHECK(1 == pointer.publish(std::make_unique<RcuVersion>(1, freed.data())));
+        CHECK(2 == pointer.publish(std::make_unique<RcuVersion>(2, freed.data())));
+        CHECK(!freed[0] && !freed[1] && 2 == pointer.reclaim());
+
+        CHECK(2 == reader.read()->number);
+        CHECK(0 == pointer.reclaim() && freed[0] && freed[1] && !freed[2]);
+
+        // Offline readers hold nothing.
+
+        reader.offline();
+        CHECK(0 == pointer.publish(std::make_unique<RcuVersion>(3, freed.data())) && freed[2]);
+        CHECK(3 == pointer.published() && 3 == pointer.reclaimed());
+    }
+
+    std::vector<std::unique_ptr<RcuReader<RcuVersion>>> readers;
+
+    while (readers.size() != RcuPointer<RcuVersion>::max_readers)
+    {
+        readers.push_back(std::make_unique<RcuReader<RcuVersion>>(pointer));
+    }
+
+    auto thrown = false;
+
+    try
+    {
+        RcuReader<RcuVersion> reader(pointer);
+    }
+    catch (std::runtime_error const&)
+    {
+        thrown = true;
+    }
+
+    CHECK(thrown);
+    readers.pop_back();
+    RcuReader<RcuVersion> reader(pointer);
+    CHECK(3 == reader.read()->number);
+}
+
+// Readers on their own threads read, use the version for a while and now and then go offline to
+// sleep, while a writer publishes and reclaims as fast as it can. No reader may ever find the
+// version it holds freed, and each must see versions in the order they were published. Once the
+// readers are gone every version but the current one must have been freed.
+
+TEST(rcu_readers_race_a_writer)
+{
+    uint64_t const versions = 200000;
+    uint32_t const reader_count = 8;
+    std::vector<std::atomic<bool>> freed(versions + 1);
+    RcuPointer<RcuVersion> pointer(std::make_unique<RcuVersion>(0, freed.data()));
+    std::atomic<bool> stopping{};
+    std::atomic<uint64_t> reads{};
+    std::atomic<uint64_t> freed_while_held{};
+    std::atomic<uint64_t> torn{};
+    std::atomic<uint64_t> backwards{};
+    std::atomic<uint64_t> offline{};
+    std::vector<std::thread> threads;
+
+    for (uint32_t index = 0; index != reader_count; ++index)
+    {
+        threads.emplace_back([&, index]
+        {
+            RcuReader<RcuVersion> reader(pointer);
+            uint64_t previous = 0;
+            uint64_t count = 0;
+
+            while (!stopping)
+            {
+                auto const version = reader.read();
+                auto const number = version->number;
+                backwards += number < previous;
+                previous = number;
+
+                for (uint32_t use = 0; use != 64 + index * 16; ++use)
+                {
+                    torn += version->check != ~number;
+                    freed_while_held += freed[number].load();
+                }
+
+                if (0 == ++count % (256 + index))
+                {
+                    reader.offline();
+                    ++offline;
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+
+            reads += count;
+        });
+    }
+
+    size_t most_waiting = 0;
+
+    for (uint64_t number = 1; number <= versions; ++number)
+    {
+        most_waiting = std::max(most_waiting, pointer.publish(std::make_unique<RcuVersion>(number, freed.data())));
+
+        if (0 == number % 16)
+        {
+            pointer.reclaim();
+        }
+    }
+
+    stopping = true;
+
+    for (auto&& thread : threads)
+    {
+        thread.join();
+    }
+
+    printf("  %llu reads, %llu times offline, at most %zu versions waiting\n",
+        static_cast<unsigned long long>(reads.load()), static_cast<unsigned long long>(offline.load()), most_waiting);
+
+    CHECK(0 == freed_while_held && 0 == torn && 0 == backwards);
+    CHECK(0 == pointer.reclaim());
+    CHECK(versions == pointer.published() && versions == pointer.reclaimed());
+
+    for (uint64_t number = 0; number != versions; ++number)
+    {
+        CHECK(freed[number]);
+    }
+
+    CHECK(!freed[versions]);
+}
@@ -0,0 +1,166 @@
+#include "Test.h"
+#include "Rebuild.h"
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// Stands in for the device backend: the same steps as device_steps in Clock.cpp, each taking a
+// set time and any of them able to fail as a lost device does.
+
+struct FakeBackend
+{
+    enum { device, target, brush, shadow, count };
+
+    double delays[count] = { 0.05, 0.03, 0.08, 0.08 };
+    int fail = -1;
+    std::atomic<uint32_t> built{};
+
+    std::vector<RebuildStep> steps()
+    {
+        char const* const names[count] = { "device", "target", "brush", "shadow" };
+        uint32_t const after[count] = { 0, 1 << device, 1 << target, 1 << target };
+        std::vector<RebuildStep> steps;
+
+        for (int step = 0; step != count; ++step)
+        {
+            steps.push_back({ names[step], after[step], [this, step]
+            {
+                std::this_thread::sleep_for(std::chrono::duration<double>(delays[step]));
+
+                if (step == fail)
+                {
+                    throw std::runtime_error("device removed");
+                }
+
+                built |= 1u << step;
+            }});
+        }
+
+        return steps;
+    }
+};
+
+TEST(rebuild_runs_independent_steps_together)
+{
+    FakeBackend backend;
+    Stopwatch const watch;
+    auto const timings = rebuild(backend.steps());
+    auto const elapsed = watch.elapsed();
+
+    CHECK(backend.built == 0xf);
+    CHECK(4 == timings.size());
+
+    for (auto&& timing : timings)
+    {
+        CHECK(timing.finish >= timing.start);
+    }
+
+    // Each step starts only once its dependencies finish, and the brush and shadow overlap.
+
+    CHECK(timings[FakeBackend::target].start >= timings[FakeBackend::device].finish);
+    CHECK(timings[FakeBackend::brush].start >= timings[FakeBackend::target].finish);
+    CHECK(timings[FakeBackend::shadow].start >= timings[FakeBackend::target].finish);
+    CHECK(timings[FakeBackend::brush].start < timings[FakeBackend::shadow].finish);
+    CHECK(timings[FakeBackend::shadow].start < timings[FakeBackend::brush].finish);
+
+    // The critical path is 160 ms against 240 ms one step at a time.
+
+    CHECK(elapsed >= 0.16);
+    CHECK(elapsed < 0.22);
+}
+
+TEST(rebuild_propagates_failure)
+{
+    FakeBackend backend;
+    backend.fail = FakeBackend::target;
+    auto pending = rebuild_async(backend.steps());
+
+    try
+    {
+        pending.get();
+        CHECK(!"expected the rebuild to fail");
+    }
+    catch (std::runtime_error const& e)
+    {
+        CHECK(!strcmp(e.what(), "device removed"));
+    }
+
+    // Nothing that depends on the failed step is built.
+
+    CHECK(backend.built == 1u << FakeBackend::device);
+}
+
+TEST(rebuild_waits_for_a_wave_before_failing)
+{
+    FakeBackend backend;
+    backend.fail = FakeBackend::brush;
+    backend.delays[FakeBackend::brush] = 0.0;
+    backend.delays[FakeBackend::shadow] = 0.05;
+
+    try
+    {
+        rebuild(backend.steps());
+        CHECK(!"expected the rebuild to fail");
+    }
+    catch (std::runtime_error const&)
+    {
+    }
+
+    // The shadow was running alongside the brush and is finished rather than abandoned.
+
+    CHECK(backend.built == 0xb);
+}
+
+TEST(rebuild_recovers_after_loss)
+{
+    FakeBackend backend;
+
+    for (int attempt = 0; attempt != FakeBackend::count; ++attempt)
+    {
+        backend.fail = attempt;
+        backend.built = 0;
+        auto failed = false;
+
+        try
+        {
+            rebuild_async(backend.steps()).get();
+        }
+        catch (std::runtime_error const&)
+        {
+            failed = true;
+        }
+
+        CHECK(failed);
+        CHECK(!(backend.built >> attempt & 1));
+
+        backend.fail = -1;
+        CHECK(4 == rebuild_async(backend.steps()).get().size());
+        CHECK(backend.built == 0xf);
+    }
+}
+
+TEST(rebuild_rejects_bad_step_lists)
+{
+    auto const expect_logic_error = [](std::vector<RebuildStep> const& steps)
+    {
+        try
+        {
+            rebuild(steps);
+            return false;
+        }
+        catch (std::logic_error const&)
+        {
+            return true;
+        }
+    };
+
+    std::vector<RebuildStep> steps(32, RebuildStep{ "step", 0, [] {} });
+    CHECK(32 == rebuild(steps).size());
+
+    steps.push_back({ "step", 0, [] {} });
+    CHECK(expect_logic_error(steps));
+
+    CHECK(expect_logic_error({ { "a", 2, [] {} }, { "b", 1, [] {} } }));
+    CHECK(expect_logic_error({ { "a", 1, [] {} } }));
+}
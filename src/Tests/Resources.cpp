@@ -0,0 +1,187 @@
+#include "Test.h"
+#include "Raster.h"
+#include "Resources.h"
+#include <cmath>
+
+TEST(size_bucket_rounds_up_to_powers_of_two)
+{
+    CHECK(256 == size_bucket(0));
+    CHECK(256 == size_bucket(1));
+    CHECK(256 == size_bucket(256));
+    CHECK(512 == size_bucket(257));
+    CHECK(2048 == size_bucket(1920));
+    CHECK(4096 == size_bucket(3840));
+    CHECK(64 == size_bucket(33, 64));
+
+    for (uint32_t size = 1; size != 5000; ++size)
+    {
+        auto const bucket = size_bucket(size);
+        CHECK(bucket >= size && (bucket == 256 || bucket / 2 < size));
+    }
+}
+
+// A window of 800x600 device-independent pixels taken between monitors, as WM_DPICHANGED moves it:
+// each monitor's bitmaps are built once and found again on the way back, until a fourth monitor
+// pushes out the one least recently used.
+
+TEST(dpi_cache_follows_the_window_between_monitors)
+{
+    struct Bitmaps
+    {
+        DpiKey key;
+        uint32_t serial;
+    };
+
+    DpiResourceCache<Bitmaps> cache;
+    uint32_t created = 0;
+
+    auto const show = [&](float const dpi) -> Bitmaps&
+    {
+        auto const scale = dpi / 96.0f;
+        DpiKey const key{ dpi, size_bucket(static_cast<uint32_t>(800 * scale)), size_bucket(static_cast<uint32_t>(600 * scale)) };
+
+        auto& bitmaps = cache.get(key, [&] { return Bitmaps{ key, ++created }; });
+        CHECK(bitmaps.key == key);
+        return bitmaps;
+    };
+
+    auto& laptop = show(96.0f);
+    auto& external = show(144.0f);
+    CHECK(&show(96.0f) == &laptop && 1 == laptop.serial);
+    CHECK(&show(144.0f) == &external && 2 == external.serial);
+    CHECK(2 == cache.misses() && 2 == cache.hits() && 0 == cache.evictions() && 2 == cache.size());
+
+    // A third monitor fits; a fourth releases the laptop's, which was used least recently.
+
+    auto& projector = show(120.0f);
+    show(144.0f);
+    show(120.0f);
+    CHECK(3 == cache.size() && 0 == cache.evictions());
+    CHECK(4 == show(192.0f).serial);
+    CHECK(1 == cache.evictions() && 3 == cache.size());
+
+    // The others stay where they were; the laptop's are rebuilt on the way back, at the expense
+    // of the external monitor's, now the oldest.
+
+    CHECK(&show(120.0f) == &projector && &show(192.0f) != &projector);
+    CHECK(5 == show(96.0f).serial);
+    CHECK(2 == cache.evictions() && 6 == show(144.0f).serial);
+    CHECK(6 == created && 6 == cache.misses() && 6 == cache.hits() && 3 == cache.evictions());
+
+    // Resizing within a bucket keeps the key, and losing the device releases everything.
+
+    DpiKey const resized{ 96.0f, size_bucket(900), size_bucket(700) };
+    CHECK(5 == cache.get(resized, [&] { return Bitmaps{ resized, ++created }; }).serial);
+
+    cache.clear();
+    CHECK(0 == cache.size() && 7 == show(96.0f).serial);
+}
+
+// A live drag as the window sees it: WM_SIZE arrives with each mouse move, at 125 a second, while
+// frames are presented at 60. The edge is pulled out from 640x480 to about 1600x1000, pushed back
+// in past where it began and let go, with the jitter of a hand on a mouse.
+
+struct DragEvent
+{
+    double seconds;
+    uint32_t width;
+    uint32_t height;
+};
+
+static std::vector<DragEvent> drag_events()
+{
+    std::vector<DragEvent> trace;
+    uint32_t seed = 1;
+
+    for (double seconds = 0.0; seconds < 4.0; seconds += 0.008)
+    {
+        seed = seed * 1664525 + 1013904223;
+        auto const pull = std::sin(seconds / 4.0 * 3.14159265 * 1.1);
+        auto const jitter = static_cast<int32_t>(seed >> 29) - 4;
+        trace.push_back({ seconds, static_cast<uint32_t>(640 + 960 * pull + jitter), static_cast<uint32_t>(480 + 520 * pull + jitter / 2) });
+    }
+
+    return trace;
+}
+
+struct DragResult
+{
+    uint32_t frames;
+    uint32_t resizes;
+    uint32_t reallocations;
+    double worst;
+    double total;
+};
+
+// Replays the trace against the software backend. The frame stands in for the swap chain and the
+// layer for the offscreen clock bitmap. Left as it was, every WM_SIZE resizes the swap chain and
+// reallocates the bitmap; coalesced, the swap chain is resized at most once a frame to the latest
+// size and the bitmap only when that crosses a size bucket.
+
+static DragResult replay_drag(std::vector<DragEvent> const& trace, bool const coalesce)
+{
+    DragResult result{};
+    Canvas frame;
+    Canvas layer;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    size_t next = 0;
+
+    for (double present = 0.0; next != trace.size(); present += 1.0 / 60.0)
+    {
+        Stopwatch const watch;
+
+        for (; next != trace.size() && trace[next].seconds <= present; ++next)
+        {
+            width = trace[next].width;
+            height = trace[next].height;
+
+            if (!coalesce)
+            {
+                frame.resize(width, height);
+                layer.resize(width, height);
+                result.resizes += 1;
+                result.reallocations += 2;
+            }
+        }
+
+        if (coalesce && (frame.width() != width || frame.height() != height))
+        {
+            frame.resize(width, height);
+            result.resizes += 1;
+            result.reallocations += 1;
+
+            if (layer.width() != size_bucket(width) || layer.height() != size_bucket(height))
+            {
+                layer.resize(size_bucket(width), size_bucket(height));
+                result.reallocations += 1;
+            }
+        }
+
+        auto scene = record_clock(clock_geometry(static_cast<float>(width), static_cast<float>(height)));
+        patch_hands(scene, 0, hand_angles(present));
+        draw_scene(frame, layer, default_theme, scene);
+
+        auto const elapsed = watch.elapsed();
+        result.worst = std::max(result.worst, elapsed);
+        result.total += elapsed;
+        result.frames += 1;
+    }
+
+    return result;
+}
+
+BENCHMARK(drag_trace)
+{
+    auto const trace = drag_events();
+    printf("  %zu WM_SIZE events\n", trace.size());
+
+    for (auto const coalesce : { false, true })
+    {
+        auto const result = replay_drag(trace, coalesce);
+
+        printf("  %-9s %3u frames  %3u resizes  %3u reallocations  mean %6.2f ms  worst %6.2f ms\n",
+            coalesce ? "coalesced" : "each", result.frames, result.resizes, result.reallocations,
+            result.total * 1000.0 / result.frames, result.worst * 1000.0);
+    }
+}
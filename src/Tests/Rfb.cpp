@@ -0,0 +1,448 @@
+#include "Test.h"
+#include "Inflate.h"
+#include "Raster.h"
+#include "Rfb.h"
+#include <algorithm>
+
+// A minimal viewer speaking RFB 3.8, or 3.7 or 3.3 if asked, with no security. It keeps the server's default pixel format,
+// which is the frame's own, so its copy of the framebuffer can be compared with what was
+// published.
+
+struct RfbViewer
+{
+    Socket socket{ invalid_socket };
+    uint32_t width{};
+    uint32_t height{};
+    std::vector<uint32_t> pixels;
+    Inflater inflater;
+    std::vector<uint8_t> inflated;
+    uint64_t bytes{};
+    uint64_t rects{};
+    bool header{};  // whether the last zlib update began a new stream
+
+    RfbViewer() = default;
+    RfbViewer(RfbViewer const&) = delete;
+    RfbViewer& operator=(RfbViewer const&) = delete;
+
+    ~RfbViewer()
+    {
+        close_socket(socket);
+    }
+
+    bool read(void* buffer, size_t size)
+    {
+        auto output = static_cast<char*>(buffer);
+
+        while (size)
+        {
+            auto const received = receive(socket, output, size);
+
+            if (received <= 0)
+            {
+                return false;
+            }
+
+            output += received;
+            size -= static_cast<size_t>(received);
+        }
+
+        return true;
+    }
+
+    bool write(std::vector<uint8_t> const& message)
+    {
+        SendBuffer const buffer{ message.data(), message.size() };
+        return send_gather(socket, &buffer, 1) == static_cast<int64_t>(message.size());
+    }
+
+    // 3.3 has the server choose the security type, and only 3.8 sends the result of None.
+
+    bool connect(uint16_t const port, uint8_t const minor = 8)
+    {
+        socket = connect_loopback(port);
+        char version[12];
+        uint8_t count = 0;
+        uint8_t types[8];
+        uint8_t result[4];
+        uint8_t init[24];
+
+        if (invalid_socket == socket || !read(version, sizeof(version)) || memcmp(version, "RFB 003.008\n", 12) ||
+            !write({ 'R', 'F', 'B', ' ', '0', '0', '3', '.', '0', '0', static_cast<uint8_t>('0' + minor), '\n' }))
+        {
+            return false;
+        }
+
+        if (minor < 7)
+        {
+            if (!read(result, sizeof(result)) || 1 != rfb_get32(result))
+            {
+                return false;
+            }
+        }
+        else if (!read(&count, 1) || !count || count > sizeof(types) || !read(types, count) || !write({ 1 }) ||
+            (minor >= 8 && (!read(result, sizeof(result)) || rfb_get32(result))))
+        {
+            return false;
+        }
+
+        if (!write({ 1 }) || !read(init, sizeof(init)))
+        {
+            return false;
+        }
+
+        std::string name(rfb_get32(init + 20), '\0');
+        resize(rfb_get16(init), rfb_get16(init + 2));
+        return read(&name[0], name.size()) && "Clock" == name;
+    }
+
+    void resize(uint32_t const new_width, uint32_t const new_height)
+    {
+        width = new_width;
+        height = new_height;
+        pixels.assign(size_t{ width } * height, 0);
+    }
+
+    static std::vector<uint8_t> set_encodings(std::initializer_list<int32_t> const encodings)
+    {
+        std::vector<uint8_t> message = { 2, 0 };
+        rfb_put16(message, static_cast<uint32_t>(encodings.size()));
+
+        for (auto const encoding : encodings)
+        {
+            rfb_put32(message, static_cast<uint32_t>(encoding));
+        }
+
+        return message;
+    }
+
+    std::vector<uint8_t> request(bool const incremental) const
+    {
+        std::vector<uint8_t> message = { 3, incremental };
+        rfb_put16(message, 0);
+        rfb_put16(message, 0);
+        rfb_put16(message, width);
+        rfb_put16(message, height);
+        return message;
+    }
+
+    // Reads one FramebufferUpdate into the copy of the framebuffer.
+
+    bool update()
+    {
+        uint8_t start[4];
+
+        if (!read(start, sizeof(start)) || start[0])
+        {
+            return false;
+        }
+
+        bytes += sizeof(start);
+        header = false;
+        std::vector<uint8_t> data;
+
+        for (uint32_t count = rfb_get16(start + 2); count; --count)
+        {
+            uint8_t rect[12];
+
+            if (!read(rect, sizeof(rect)))
+            {
+                return false;
+            }
+
+            auto const x = rfb_get16(rect);
+            auto const y = rfb_get16(rect + 2);
+            auto const w = rfb_get16(rect + 4);
+            auto const h = rfb_get16(rect + 6);
+            auto const encoding = static_cast<int32_t>(rfb_get32(rect + 8));
+            auto const size = size_t{ w } * h * 4;
+            bytes += sizeof(rect);
+
+            if (rfb_encoding_desktop_size == encoding)
+            {
+                resize(w, h);
+                continue;
+            }
+
+            if (x + w > width || y + h > height)
+            {
+                return false;
+            }
+
+            if (rfb_encoding_zlib == encoding)
+            {
+                uint8_t length[4];
+
+                if (!read(length, sizeof(length)))
+                {
+                    return false;
+                }
+
+                data.resize(rfb_get32(length));
+                header = header || (data.size() >= 2 && 0x78 == data[0] && 0x5e == data[1]);
+                auto const before = inflated.size();
+
+                if (!read(data.data(), data.size()) || !inflater.inflate(data.data(), data.size(), inflated) || inflated.size() - before != size)
+                {
+                    return false;
+                }
+
+                copy(x, y, w, h, inflated.data() + before);
+                bytes += sizeof(length) + data.size();
+
+                // Later rects only refer back as far as the deflate window.
+
+                if (inflated.size() > 16 * deflate_window)
+                {
+                    inflated.erase(inflated.begin(), inflated.end() - deflate_window);
+                }
+            }
+            else if (rfb_encoding_raw == encoding)
+            {
+                data.resize(size);
+
+                if (!read(data.data(), size))
+                {
+                    return false;
+                }
+
+                copy(x, y, w, h, data.data());
+                bytes += size;
+            }
+            else
+            {
+                return false;
+            }
+
+            ++rects;
+        }
+
+        return true;
+    }
+
+    void copy(uint32_t const x, uint32_t const y, uint32_t const w, uint32_t const h, uint8_t const* source)
+    {
+        for (uint32_t row = 0; row != h; ++row)
+        {
+            memcpy(pixels.data() + size_t{ y + row } * width + x, source + size_t{ row } * w * 4, size_t{ w } * 4);
+        }
+    }
+};
+
+// A frame with something different on every row, so a rect in the wrong place shows.
+
+static std::vector<uint32_t> test_frame(uint32_t const width, uint32_t const height, uint32_t const seed)
+{
+    std::vector<uint32_t> pixels(size_t{ width } * height);
+
+    for (uint32_t y = 0; y != height; ++y)
+    {
+        for (uint32_t x = 0; x != width; ++x)
+        {
+            pixels[size_t{ y } * width + x] = 0xff000000 | ((x / 16 * 0x10101 + y * 0x300 + seed) & 0xffffff);
+        }
+    }
+
+    return pixels;
+}
+
+// Waits for the encoders and then requests, so that every frame published before is in the
+// update the viewer gets back.
+
+static void settle()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+TEST(rfb_viewer_sees_the_frame)
+{
+    for (auto const encoding : { rfb_encoding_zlib, rfb_encoding_raw })
+    {
+        uint32_t const width = 320;
+        uint32_t const height = 600;
+        RfbServer server(0, 2);
+        auto frame = test_frame(width, height, 0);
+        server.publish(frame.data(), width, height, width, { 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) });
+
+        RfbViewer viewer;
+        CHECK(viewer.connect(server.port()) && width == viewer.width && height == viewer.height);
+        CHECK(viewer.write(RfbViewer::set_encodings({ encoding, rfb_encoding_desktop_size })));
+        CHECK(viewer.write(viewer.request(false)) && viewer.update());
+        CHECK(viewer.pixels == frame);
+        CHECK(viewer.rects > 1);
+        CHECK((rfb_encoding_zlib == encoding) == viewer.header);
+
+        // Damage that the viewer then asks for, and a resize that it learns of along the way.
+
+        for (uint32_t y = 200; y != 260; ++y)
+        {
+            for (uint32_t x = 10; x != 100; ++x)
+            {
+                frame[size_t{ y } * width + x] ^= 0xffffff;
+            }
+        }
+
+        server.publish(frame.data(), width, height, width, { 10, 200, 100, 260 });
+        settle();
+        CHECK(viewer.write(viewer.request(true)) && viewer.update());
+        CHECK(viewer.pixels == frame && !viewer.header);
+
+        frame = test_frame(width * 2, height / 2, 3);
+        server.publish(frame.data(), width * 2, height / 2, width * 2, {});
+        settle();
+        CHECK(viewer.write(viewer.request(true)) && viewer.update());
+        CHECK(width * 2 == viewer.width && viewer.pixels == frame);
+    }
+}
+
+// Viewers of each version the server accepts get to the same framebuffer. A 3.7 viewer given the
+// 3.8 SecurityResult would read it as the start of ServerInit and see a zero-sized frame.
+
+TEST(rfb_viewers_of_each_version)
+{
+    uint32_t const width = 64;
+    uint32_t const height = 48;
+    RfbServer server(0, 1);
+    auto const frame = test_frame(width, height, 1);
+    server.publish(frame.data(), width, height, width, { 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) });
+
+    for (uint8_t const minor : { 3, 7, 8 })
+    {
+        RfbViewer viewer;
+        CHECK(viewer.connect(server.port(), minor) && width == viewer.width && height == viewer.height);
+        CHECK(viewer.write(viewer.request(false)) && viewer.update());
+        CHECK(viewer.pixels == frame);
+    }
+}
+
+// An update started while the viewer asked for raw rects must not count as the start of a zlib
+// stream once it is sent, even if the viewer has switched to zlib in the meantime; the first zlib
+// update needs the stream header all the same.
+
+TEST(rfb_zlib_stream_starts_with_the_first_zlib_update)
+{
+    uint32_t const width = 256;
+    uint32_t const height = 256;
+    RfbServer server(0, 1);
+    auto frame = test_frame(width, height, 0);
+    server.publish(frame.data(), width, height, width, { 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) });
+
+    RfbViewer viewer;
+    CHECK(viewer.connect(server.port()));
+    auto messages = RfbViewer::set_encodings({ rfb_encoding_raw });
+    auto const request = viewer.request(false);
+    auto const zlib = RfbViewer::set_encodings({ rfb_encoding_zlib });
+    messages.insert(messages.end(), request.begin(), request.end());
+    messages.insert(messages.end(), zlib.begin(), zlib.end());
+    CHECK(viewer.write(messages));
+    CHECK(viewer.update() && !viewer.header && viewer.pixels == frame);
+
+    frame = test_frame(width, height, 9);
+    server.publish(frame.data(), width, height, width, { 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) });
+    settle();
+    CHECK(viewer.write(viewer.request(true)) && viewer.update());
+    CHECK(viewer.header && viewer.pixels == frame);
+}
+
+TEST(rfb_drops_oversized_cut_text)
+{
+    uint32_t const width = 64;
+    uint32_t const height = 64;
+    RfbServer server(0, 1);
+    auto const frame = test_frame(width, height, 0);
+    server.publish(frame.data(), width, height, width, { 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) });
+
+    for (auto const length : { size_t{ 100 }, size_t{ RfbServer::max_cut_text }, size_t{ RfbServer::max_cut_text } + 1 })
+    {
+        RfbViewer viewer;
+        CHECK(viewer.connect(server.port()));
+        std::vector<uint8_t> message = { 6, 0, 0, 0 };
+        rfb_put32(message, static_cast<uint32_t>(length));
+        CHECK(viewer.write(message));
+
+        // The text itself never needs to arrive for the viewer to be dropped.
+
+        if (length > RfbServer::max_cut_text)
+        {
+            uint8_t byte;
+            CHECK(!viewer.read(&byte, 1));
+            continue;
+        }
+
+        message.assign(length, 'x');
+        auto const request = viewer.request(false);
+        message.insert(message.end(), request.begin(), request.end());
+        CHECK(viewer.write(message) && viewer.update() && viewer.pixels == frame);
+    }
+}
+
+// Replaces the standalone client once used to measure the server: a clock at 60 frames a second,
+// damage bounded to the hands, and a viewer asking for updates back to back for a few seconds
+// with each encoding. The wait is from a request to the update that answers it, so it includes
+// waiting for the next frame.
+
+BENCHMARK(rfb_loopback)
+{
+    uint32_t const width = 1280;
+    uint32_t const height = 720;
+    ClockGeometry const geometry{ width / 2.0f, height / 2.0f, height * 0.4f };
+    DisplayList dial;
+    DisplayList hands;
+    record_dial(dial, geometry);
+    record_clock(hands, geometry, false);
+
+    for (auto const encoding : { rfb_encoding_zlib, rfb_encoding_raw })
+    {
+        RfbServer server(0);
+        std::atomic<bool> stopping{};
+        std::atomic<uint64_t> published{};
+        SoftwareScene scene(width, height, 96.0f, dial);
+        Canvas frame;
+
+        auto const render = [&](double const seconds)
+        {
+            patch_hands(hands, 0, hand_angles(seconds));
+            scene.draw(frame, hands);
+            return damage_bounds(hands, 96.0f);
+        };
+
+        auto previous = render(36000.0);
+        server.publish(frame.data(), width, height, width, { 0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height) });
+
+        std::thread publisher([&]
+        {
+            auto const began = std::chrono::steady_clock::now();
+
+            for (uint64_t index = 1; !stopping; ++index)
+            {
+                std::this_thread::sleep_until(began + std::chrono::microseconds(index * 1000000 / 60));
+                auto const damage = render(36000.0 + index / 60.0);
+                server.publish(frame.data(), width, height, width, unite(previous, damage));
+                previous = damage;
+                ++published;
+            }
+        });
+
+        RfbViewer viewer;
+        std::vector<double> waits;
+        CHECK(viewer.connect(server.port()));
+        CHECK(viewer.write(RfbViewer::set_encodings({ encoding, rfb_encoding_desktop_size })));
+        Stopwatch const watch;
+
+        for (auto incremental = false; watch.elapsed() < 3.0; incremental = true)
+        {
+            Stopwatch const wait;
+            CHECK(viewer.write(viewer.request(incremental)) && viewer.update());
+            waits.push_back(wait.elapsed());
+        }
+
+        auto const elapsed = watch.elapsed();
+        stopping = true;
+        publisher.join();
+        std::sort(waits.begin(), waits.end());
+
+        printf("  %-4s  %5zu updates  %6llu rects  %9.1f KB/s  wait p50 %6.2f ms  p99 %6.2f ms  (%llu frames published)\n",
+            rfb_encoding_zlib == encoding ? "zlib" : "raw", waits.size(), static_cast<unsigned long long>(viewer.rects),
+            viewer.bytes / elapsed / 1e3, waits[waits.size() / 2] * 1000.0, waits[waits.size() * 99 / 100] * 1000.0,
+            static_cast<unsigned long long>(published.load()));
+    }
+}
@@ -0,0 +1,210 @@
+#include "Test.h"
+#include "Snapshot.h"
+
+static uint32_t read_be32(uint8_t const* bytes)
+{
+    return uint32_t{ bytes[0] } << 24 | uint32_t{ bytes[1] } << 16 | uint32_t{ bytes[2] } << 8 | bytes[3];
+}
+
+// Walks the chunks of a PNG, checking each one's CRC, and returns the image data they hold.
+
+static bool read_png(std::vector<uint8_t> const& png, uint32_t& width, uint32_t& height, std::vector<uint8_t>& data)
+{
+    uint8_t const signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    if (png.size() < 8 || memcmp(png.data(), signature, 8))
+    {
+        return false;
+    }
+
+    for (size_t offset = 8; offset + 12 <= png.size();)
+    {
+        auto const length = read_be32(&png[offset]);
+        auto const type = &png[offset + 4];
+
+        if (offset + 12 + length > png.size() || read_be32(&png[offset + 8 + length]) != crc32(0, type, length + 4))
+        {
+            return false;
+        }
+
+        if (!memcmp(type, "IHDR", 4))
+        {
+            width = read_be32(type + 4);
+            height = read_be32(type + 8);
+        }
+        else if (!memcmp(type, "IDAT", 4))
+        {
+            data.insert(data.end(), type + 4, type + 4 + length);
+        }
+        else if (!memcmp(type, "IEND", 4))
+        {
+            return true;
+        }
+
+        offset += 12 + length;
+    }
+
+    return false;
+}
+
+TEST(snapshot_png_is_well_formed)
+{
+    SnapshotKey const key{ 300, 200, 1, 96.0f, 3600, 1700000000 };
+    auto const png = render_snapshot(key);
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> data;
+    CHECK(read_png(png, width, height, data));
+    CHECK(300 == width && 200 == height);
+    CHECK(data.size() > 6 && 0x78 == data[0] && 0 == (data[0] << 8 | data[1]) % 31);
+
+    WorkerPool pool(4);
+    CHECK(render_snapshot(key, &pool) == png);
+}
+
+TEST(snapshot_cache_serves_a_second_once)
+{
+    SnapshotCache cache(nullptr, 2);
+    SnapshotKey key{ 64, 64, 1, 96.0f, 0, 1700000000 };
+    auto const first = cache.snapshot(key);
+    CHECK(cache.snapshot(key) == first);
+    CHECK(1 == cache.hits() && 1 == cache.misses());
+
+    key.second += 1;
+    auto const next = cache.snapshot(key);
+    CHECK(next != first && 2 == cache.misses());
+
+    key.offset = 3600;
+    cache.snapshot(key);
+    key.offset = 0;
+    key.second -= 1;
+    CHECK(cache.snapshot(key) != first);
+    CHECK(4 == cache.misses());
+}
+
+// A reloaded theme may be given the address of the one it replaced, so the cache must tell faces
+// apart by what they hold.
+
+TEST(snapshot_cache_tells_themes_apart_by_contents)
+{
+    SnapshotCache cache(nullptr, 4);
+    auto face = std::make_unique<FaceTheme>(default_theme);
+    SnapshotKey key{ 96, 96, 1, 96.0f, 0, 1700000000, *face };
+    auto const first = cache.snapshot(key);
+
+    face->ink = { 0.0f, 0.5f, 1.0f, 1.0f };
+    key.theme = *face;
+    auto const reloaded = cache.snapshot(key);
+    CHECK(*reloaded != *first && 2 == cache.misses());
+
+    key.theme = default_theme;
+    CHECK(cache.snapshot(key) == first && 1 == cache.hits());
+}
+
+static uint32_t count_differences(Canvas const& a, Canvas const& b, PixelRect const& inside, PixelRect const& outside)
+{
+    uint32_t differences = 0;
+
+    for (int32_t y = inside.top; y < inside.bottom; ++y)
+    {
+        for (int32_t x = inside.left; x < inside.right; ++x)
+        {
+            auto const pixel = size_t{ static_cast<uint32_t>(y) } * a.width() + static_cast<uint32_t>(x);
+            auto const excluded = x >= outside.left && x < outside.right && y >= outside.top && y < outside.bottom;
+            differences += !excluded && a.data()[pixel] != b.data()[pixel];
+        }
+    }
+
+    return differences;
+}
+
+// Snapshots carry the numerals and readout that Window::draw presents. The numerals sit on the
+// dial and the readout below its centre, which is the only other place the two may differ; the
+// readout is drawn over the clock exactly as a layer of its own would be. Walls have no readout.
+
+TEST(snapshot_draws_numerals_and_readout)
+{
+    SnapshotKey key{ 400, 400, 1, 144.0f, 3600, 1700000000 };
+    auto const plain = snapshot_frame(key);
+    key.numerals = true;
+    key.readout = true;
+    auto const text = snapshot_frame(key);
+    key.readout = false;
+    auto const numerals = snapshot_frame(key);
+
+    auto const scale = 96.0f / key.dpi;
+    auto const geometry = wall_geometry(wall_layout(1, key.width * scale, key.height * scale), 0);
+    auto const atlas = builtin_atlas(readout_size(geometry.radius), key.dpi);
+    DigitalReadout readout(atlas, geometry.x, geometry.y + geometry.radius * 0.5f);
+    auto const changed = readout.update(static_cast<uint32_t>((key.second + key.offset) % 86400));
+    auto const cells = cell_pixels(readout.bounds(), key.dpi);
+    PixelRect const everything{ 0, 0, static_cast<int32_t>(key.width), static_cast<int32_t>(key.height) };
+
+    CHECK(count_differences(plain, numerals, everything, {}) > 0);
+    CHECK(0 == count_differences(numerals, text, everything, cells) && count_differences(numerals, text, cells, {}) > 0);
+
+    Canvas layer(key.width, key.height, key.dpi);
+    layer.set_atlas(&atlas);
+    layer.set_color(key.theme.ink, key.theme.opacity);
+    draw_readout(layer, readout, changed);
+    auto expected = numerals;
+    draw_image(expected, layer);
+    CHECK(0 == count_differences(expected, text, everything, {}));
+
+    // Numerals change nothing beyond the dial and its shadow.
+
+    auto const reach = static_cast<int32_t>(std::ceil((geometry.radius + key.theme.shadow_offset + key.theme.shadow_deviation * 3.0f) / scale)) + 2;
+    auto const x = static_cast<int32_t>(geometry.x / scale);
+    auto const y = static_cast<int32_t>(geometry.y / scale);
+    CHECK(0 == count_differences(plain, numerals, everything, { x - reach, y - reach, x + reach, y + reach }));
+
+    SnapshotKey wall{ 400, 400, 4, 96.0f, 0, 1700000000 };
+    auto const without = snapshot_frame(wall);
+    wall.readout = true;
+    CHECK(0 == count_differences(without, snapshot_frame(wall), everything, {}));
+}
+
+// Snapshots a second at each size: rendered and encoded on one thread, with deflate spread over
+// the pool, and served from the cache as a dashboard polling within the second would be.
+
+BENCHMARK(snapshot_rate)
+{
+    struct Size
+    {
+        uint32_t width;
+        uint32_t height;
+    };
+
+    WorkerPool pool;
+    Size const sizes[] = { { 256, 256 }, { 1024, 1024 }, { 3840, 2160 } };
+
+    for (auto&& size : sizes)
+    {
+        auto const rate = [&](WorkerPool* const workers, bool const cached)
+        {
+            SnapshotCache cache(workers);
+            SnapshotKey key{ size.width, size.height, 1, 96.0f, 0, 1700000000 };
+            auto const budget = size.width * size.height > 1 << 20 ? 2.0 : 1.0;
+            uint32_t count = 0;
+            size_t bytes = 0;
+            Stopwatch const watch;
+
+            do
+            {
+                key.second += cached ? 0 : 1;
+                bytes = cached ? cache.snapshot(key)->size() : render_snapshot(key, workers).size();
+                ++count;
+            }
+            while (watch.elapsed() < budget);
+
+            return std::make_pair(count / watch.elapsed(), bytes);
+        };
+
+        auto const serial = rate(nullptr, false);
+        auto const parallel = rate(&pool, false);
+        auto const cached = rate(&pool, true);
+
+        printf("  %4ux%-4u %8zu bytes  serial %7.1f/s  %u threads %7.1f/s  cached %10.0f/s\n",
+            size.width, size.height, parallel.second, serial.first, static_cast<unsigned>(pool.size()), parallel.first, cached.first);
+    }
+}
@@ -0,0 +1,101 @@
+#include "Test.h"
+#include "Raster.h"
+#include "Rebuild.h"
+#include "Startup.h"
+#include <thread>
+
+TEST(startup_timeline_keeps_first_marks)
+{
+    StartupTimeline timeline;
+    CHECK(!timeline.reached(StartupPhase::window));
+    CHECK(timeline.seconds(StartupPhase::gpu_frame) < 0.0);
+
+    timeline.mark(StartupPhase::window);
+    auto const window = timeline.seconds(StartupPhase::window);
+    CHECK(timeline.reached(StartupPhase::window) && window >= 0.0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    timeline.mark(StartupPhase::window);
+    timeline.mark(StartupPhase::first_pixel);
+    CHECK(timeline.seconds(StartupPhase::window) == window);
+    CHECK(timeline.seconds(StartupPhase::first_pixel) > window);
+    CHECK(!timeline.reached(StartupPhase::gpu_frame));
+}
+
+// What present_software_frame does for the first frame, from nothing allocated: record the scene
+// and rasterise it, shadow and all, into a new frame.
+
+static Canvas first_frame(uint32_t const width, uint32_t const height, float const dpi)
+{
+    auto const scale = 96.0f / dpi;
+    auto scene = record_clock(clock_geometry(width * scale, height * scale));
+    patch_hands(scene, 0, hand_angles(10, 8, 0, 0));
+
+    Canvas frame(width, height, dpi);
+    Canvas layer(width, height, dpi);
+    draw_scene(frame, layer, default_theme, scene);
+    return frame;
+}
+
+// The portable part of bring-up: the CPU frame at common window sizes against the budget it has
+// to beat, then the whole sequence with the device built by steps that take as long as a cold
+// hardware device typically does.
+
+BENCHMARK(startup)
+{
+    struct Size
+    {
+        uint32_t width;
+        uint32_t height;
+        float dpi;
+    };
+
+    Size const sizes[] = { { 640, 480, 96 }, { 1280, 720, 96 }, { 1920, 1080, 96 }, { 1920, 1080, 192 }, { 3840, 2160, 192 } };
+    auto const budget = std::chrono::duration<double>(first_pixel_budget).count();
+
+    for (auto&& size : sizes)
+    {
+        auto best = HUGE_VAL;
+
+        for (int run = 0; run != 5; ++run)
+        {
+            Stopwatch const watch;
+            keep(first_frame(size.width, size.height, size.dpi).data()[0]);
+            best = std::min(best, watch.elapsed());
+        }
+
+        printf("  cpu frame %4ux%-4u at %3.0f dpi  %7.2f ms  (%s the %.0f ms budget)\n",
+            size.width, size.height, size.dpi, best * 1000.0, best < budget ? "within" : "over", budget * 1000.0);
+    }
+
+    auto const step = [](double const seconds)
+    {
+        return [seconds] { std::this_thread::sleep_for(std::chrono::duration<double>(seconds)); };
+    };
+
+    StartupTimeline timeline;
+    timeline.mark(StartupPhase::window);
+
+    auto rebuild = rebuild_async(
+    {
+        { "device", 0, step(0.15) },
+        { "target", 1, step(0.02) },
+        { "brush", 2, step(0.001) },
+        { "shadow", 2, step(0.005) },
+    });
+
+    if (std::future_status::ready != rebuild.wait_for(first_pixel_budget))
+    {
+        keep(first_frame(1920, 1080, 96.0f).data()[0]);
+        timeline.mark(StartupPhase::first_pixel);
+    }
+
+    rebuild.get();
+    timeline.mark(StartupPhase::first_pixel);
+    timeline.mark(StartupPhase::gpu_frame);
+
+    printf("  window %.1f ms, first pixel %.1f ms, gpu frame %.1f ms with a 170 ms device\n",
+        timeline.seconds(StartupPhase::window) * 1000.0,
+        timeline.seconds(StartupPhase::first_pixel) * 1000.0,
+        timeline.seconds(StartupPhase::gpu_frame) * 1000.0);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Just enough of a test framework for the portable modules. Each TEST or BENCHMARK registers
+// itself before main runs, and CHECK throws on the first failure so the runner can report it and
+// move on to the next case. Tests are quick and check behaviour; benchmarks only run when asked
+// for and print what they measure.
+
+struct TestCase
+{
+    char const* name;
+    void (*run)();
+    bool benchmark;
+};
+
+inline std::vector<TestCase>& test_cases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+struct TestRegistration
+{
+    TestRegistration(char const* const name, void (*run)(), bool const benchmark)
+    {
+        test_cases().push_back({ name, run, benchmark });
+    }
+};
+
+// Not a std::runtime_error, so that code under test catching those does not swallow a failure.
+
+struct TestFailure : std::exception
+{
+    explicit TestFailure(std::string message) :
+        m_message(std::move(message))
+    {
+    }
+
+    char const* what() const noexcept override
+    {
+        return m_message.c_str();
+    }
+
+private:
+
+    std::string m_message;
+};
+
+inline void check(bool const passed, char const* const expression, char const* const file, int const line)
+{
+    if (!passed)
+    {
+        throw TestFailure(std::string(file) + "(" + std::to_string(line) + "): " + expression);
+    }
+}
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration const name##_registration(#name, name, false); \
+    static void name()
+
+#define BENCHMARK(name) \
+    static void name(); \
+    static TestRegistration const name##_registration(#name, name, true); \
+    static void name()
+
+#define CHECK(expression) check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+// Seconds since the stopwatch was started.
+
+struct Stopwatch
+{
+    double elapsed() const noexcept
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+};
+
+// Keeps the compiler from discarding work whose result a benchmark does not otherwise use.
+
+template <typename T>
+void keep(T const& value) noexcept
+{
+    static T volatile sink;
+    sink = value;
+    static_cast<void>(sink);
+}
@@ -0,0 +1,381 @@
+// Theme libraries compiled by clock-themec, which the Makefile builds alongside, so like the time
+// zone tests only for Linux and the like.
+
+#ifndef _WIN32
+
+#include "Test.h"
+#include "Raster.h"
+#include "Theme.h"
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#ifndef CLOCK_THEMEC
+#define CLOCK_THEMEC "./clock-themec"
+#endif
+
+static std::string theme_path(char const* const use, char const* const extension)
+{
+    return "/tmp/clock-tests-" + std::string(use) + "-" + std::to_string(getpid()) + extension;
+}
+
+static void write_file(std::string const& path, std::string const& text)
+{
+    std::ofstream(path, std::ios::binary) << text;
+}
+
+static std::string read_file(std::string const& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+// Compiles the description into a library, returning clock-themec's exit status.
+
+static int compile_themes(std::string const& text, std::string const& library)
+{
+    auto const source = library + ".txt";
+    write_file(source, text);
+    auto const command = std::string(CLOCK_THEMEC) + " " + source + " " + library + " > /dev/null 2>&1";
+    auto const status = std::system(command.c_str());
+    remove(source.c_str());
+    return status;
+}
+
+static char const faces[] =
+    "# Three faces, listed out of order.\n"
+    "theme midnight\n"
+    "ink 0.9 0.9 1 1\n"
+    "background #101820\n"
+    "shadow-offset -2\n"
+    "theme harbour\n"
+    "ink #1f4e79\n"
+    "background #f4f1ea80\n"
+    "opacity 0.9\n"
+    "hour-stroke 0.12          # fractions of the radius\n"
+    "theme default\n";
+
+TEST(theme_library_compiles_and_opens)
+{
+    auto const path = theme_path("themes", ".theme");
+    CHECK(0 == compile_themes(faces, path));
+
+    ThemeLibrary library;
+    CHECK(library.open(path) && library && 3 == library.size());
+    remove(path.c_str());
+
+    CHECK("default" == library.name(0) && "harbour" == library.name(1) && "midnight" == library.name(2));
+    CHECK(1 == library.find("harbour") && -1 == library.find("harbor") && -1 == library.find(""));
+    CHECK(!memcmp(&library.face(0), &default_theme, sizeof(FaceTheme)));
+
+    auto const& harbour = library.face(static_cast<uint32_t>(library.find("harbour")));
+    CHECK(0x1f / 255.0f == harbour.ink.r && 0x79 / 255.0f == harbour.ink.b && 1.0f == harbour.ink.a);
+    CHECK(0x80 / 255.0f == harbour.background.a);
+    CHECK(0.9f == harbour.opacity && 0.12f == harbour.hour_stroke && default_theme.minute_stroke == harbour.minute_stroke);
+
+    auto const& midnight = library.face(static_cast<uint32_t>(library.find("midnight")));
+    CHECK(0.9f == midnight.ink.r && 1.0f == midnight.ink.b && -2.0f == midnight.shadow_offset);
+}
+
+TEST(theme_compiler_rejects_bad_descriptions)
+{
+    auto const path = theme_path("bad", ".theme");
+    CHECK(0 != compile_themes("ink #ffffff\n", path));
+    CHECK(0 != compile_themes("theme a\nopacity 2\n", path));
+    CHECK(0 != compile_themes("theme a\nwidth 3\n", path));
+    CHECK(0 != compile_themes("theme a\nink #fff\n", path));
+    CHECK(0 != compile_themes("theme a\ntheme a\n", path));
+    CHECK(0 != compile_themes("# nothing\n", path));
+    CHECK(read_file(path).empty());
+}
+
+// Opening only checks that the tables lie within the file, which must catch any file that is
+// not a whole library without reading past its end.
+
+TEST(theme_library_rejects_damaged_files)
+{
+    auto const path = theme_path("damaged", ".theme");
+    CHECK(0 == compile_themes(faces, path));
+    auto const good = read_file(path);
+    ThemeFileHeader header;
+    memcpy(&header, good.data(), sizeof(header));
+
+    auto const opens = [&](std::string const& bytes)
+    {
+        write_file(path, bytes);
+        ThemeLibrary library;
+        return library.open(path);
+    };
+
+    auto const patched = [&](auto const change)
+    {
+        auto copy = header;
+        change(copy);
+        auto bytes = good;
+        memcpy(&bytes[0], &copy, sizeof(copy));
+        return bytes;
+    };
+
+    CHECK(opens(good));
+    CHECK(!opens(""));
+
+    for (size_t size = 1; size < good.size(); size += 7)
+    {
+        CHECK(!opens(good.substr(0, size)));
+    }
+
+    CHECK(!opens(patched([](ThemeFileHeader& h) { h.magic ^= 1; })));
+    CHECK(!opens(patched([](ThemeFileHeader& h) { h.version += 1; })));
+    CHECK(!opens(patched([](ThemeFileHeader& h) { h.entries_offset += 4; })));
+    CHECK(!opens(patched([](ThemeFileHeader& h) { h.theme_count = 0x10000000; })));
+    CHECK(!opens(patched([](ThemeFileHeader& h) { h.names_offset = ~uint64_t{ 7 }; })));
+    CHECK(!opens(patched([](ThemeFileHeader& h) { h.names_size += 1; })));
+
+    // A name reaching past the names.
+
+    auto bytes = good;
+    ThemeEntry entry;
+    memcpy(&entry, &bytes[header.entries_offset], sizeof(entry));
+    entry.name_length = static_cast<uint32_t>(header.names_size) + 1;
+    memcpy(&bytes[header.entries_offset], &entry, sizeof(entry));
+    CHECK(!opens(bytes));
+
+    remove(path.c_str());
+}
+
+// The software renderer's cached dials must give what draw_scene does, for an opaque background
+// and for a translucent one, where the hand shadow cannot simply be subtracted.
+
+TEST(software_scene_matches_draw_scene)
+{
+    ClockGeometry const geometry{ 160.0f, 120.0f, 100.0f };
+    DisplayList dial;
+    DisplayList hands;
+    record_dial(dial, geometry);
+    record_clock(hands, geometry, false);
+    patch_hands(hands, 0, hand_angles(36000.0 + 37.5));
+
+    auto translucent = default_theme;
+    translucent.background = { 0.2f, 0.4f, 0.6f, 0.5f };
+
+    for (auto const& theme : { default_theme, translucent })
+    {
+        Canvas expected(320, 240);
+        Canvas layer(320, 240);
+        draw_scene(expected, layer, theme, dial, hands);
+
+        Canvas frame;
+        SoftwareScene(320, 240, 96.0f, dial, theme).draw(frame, hands);
+        int worst = 0;
+
+        for (size_t index = 0; index != size_t{ 320 } * 240; ++index)
+        {
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                worst = std::max(worst, std::abs(static_cast<int>(expected.data()[index] >> shift & 0xff) - static_cast<int>(frame.data()[index] >> shift & 0xff)));
+            }
+        }
+
+        CHECK(worst <= 1);
+    }
+}
+
+// Just enough of a JSON reader to load the same faces from a JSON document, as a clock reading
+// its faces from a settings file at startup would: an object of faces, each an object of colors
+// as strings and numbers.
+
+struct JsonFaces
+{
+    char const* at;
+    char const* end;
+
+    void space()
+    {
+        while (at != end && (' ' == *at || '\n' == *at || '\r' == *at || '\t' == *at))
+        {
+            ++at;
+        }
+    }
+
+    bool expect(char const c)
+    {
+        space();
+        return at != end && c == *at++;
+    }
+
+    bool string(std::string& value)
+    {
+        value.clear();
+
+        if (!expect('"'))
+        {
+            return false;
+        }
+
+        while (at != end && '"' != *at)
+        {
+            if ('\\' == *at && ++at == end)
+            {
+                return false;
+            }
+
+            value += *at++;
+        }
+
+        return at++ != end;
+    }
+
+    bool number(float& value)
+    {
+        space();
+        std::string const text(at, std::min<size_t>(end - at, 32));
+        char* stop = nullptr;
+        value = strtof(text.c_str(), &stop);
+        at += stop - text.c_str();
+        return stop != text.c_str();
+    }
+
+    // Calls member for each member of an object, with at on its value.
+
+    template <typename Member>
+    bool object(Member&& member)
+    {
+        std::string key;
+
+        if (!expect('{'))
+        {
+            return false;
+        }
+
+        space();
+
+        if (at != end && '}' == *at)
+        {
+            return ++at, true;
+        }
+
+        do
+        {
+            if (!string(key) || !expect(':') || !member(key))
+            {
+                return false;
+            }
+        }
+        while (expect(','));
+
+        return '}' == at[-1];
+    }
+
+    bool color(Color& color)
+    {
+        std::string text;
+
+        if (!string(text) || 9 != text.size() || '#' != text[0])
+        {
+            return false;
+        }
+
+        auto const channel = [&](size_t const offset) { return strtoul(text.substr(offset, 2).c_str(), nullptr, 16) / 255.0f; };
+        color = { channel(1), channel(3), channel(5), channel(7) };
+        return true;
+    }
+
+    bool face(FaceTheme& face)
+    {
+        face = default_theme;
+
+        return object([&](std::string const& key)
+        {
+            if ("ink" == key || "background" == key)
+            {
+                return color("ink" == key ? face.ink : face.background);
+            }
+
+            float* const fields[] = { &face.opacity, &face.hour_stroke, &face.shadow_offset };
+            char const* const names[] = { "opacity", "hour-stroke", "shadow-offset" };
+
+            for (size_t index = 0; index != 3; ++index)
+            {
+                if (names[index] == key)
+                {
+                    return number(*fields[index]);
+                }
+            }
+
+            return false;
+        });
+    }
+};
+
+// Starting up with one face out of a library of 1 to 1,024: mapping the compiled library and
+// looking it up, against reading and parsing the same faces from JSON.
+
+BENCHMARK(theme_startup)
+{
+    for (auto const count : { 1u, 16u, 256u, 1024u })
+    {
+        std::string text;
+        std::string json = "{";
+
+        for (uint32_t index = 0; index != count; ++index)
+        {
+            char name[16];
+            snprintf(name, sizeof(name), "face%04u", index);
+            auto const opacity = 0.5f + index % 50 / 100.0f;
+
+            text += "theme " + std::string(name) + "\nink #1f4e79ff\nbackground #f4f1eaff\nopacity " + std::to_string(opacity) + "\nhour-stroke 0.12\nshadow-offset 3\n";
+            json += std::string(index ? ",\n" : "\n") + "  \"" + name + "\": { \"ink\": \"#1f4e79ff\", \"background\": \"#f4f1eaff\", \"opacity\": " +
+                std::to_string(opacity) + ", \"hour-stroke\": 0.12, \"shadow-offset\": 3 }";
+        }
+
+        json += "\n}\n";
+        auto const library_path = theme_path("startup", ".theme");
+        auto const json_path = theme_path("startup", ".json");
+        CHECK(0 == compile_themes(text, library_path));
+        write_file(json_path, json);
+
+        char wanted[16];
+        snprintf(wanted, sizeof(wanted), "face%04u", count / 2);
+        uint32_t const runs = 2000;
+        float sum = 0.0f;
+        Stopwatch const mapped_watch;
+
+        for (uint32_t run = 0; run != runs; ++run)
+        {
+            ThemeLibrary library;
+            CHECK(library.open(library_path));
+            sum += library.face(static_cast<uint32_t>(library.find(wanted))).opacity;
+        }
+
+        auto const mapped = mapped_watch.elapsed() / runs;
+        Stopwatch const json_watch;
+
+        for (uint32_t run = 0; run != runs; ++run)
+        {
+            auto const document = read_file(json_path);
+            JsonFaces reader{ document.data(), document.data() + document.size() };
+            std::vector<std::pair<std::string, FaceTheme>> themes;
+
+            CHECK(reader.object([&](std::string const& name)
+            {
+                themes.push_back({ name, {} });
+                return reader.face(themes.back().second);
+            }));
+
+            auto const found = std::find_if(themes.begin(), themes.end(), [&](auto const& theme) { return theme.first == wanted; });
+            CHECK(found != themes.end());
+            sum += found->second.opacity;
+        }
+
+        auto const parsed = json_watch.elapsed() / runs;
+        auto const library_size = read_file(library_path).size();
+        keep(sum);
+        remove(library_path.c_str());
+        remove(json_path.c_str());
+
+        printf("  %4u faces  mapped library %8.2f us (%7zu bytes)  JSON %9.2f us (%7zu bytes)  %6.1fx\n",
+            count, mapped * 1e6, library_size, parsed * 1e6, json.size(), parsed / mapped);
+    }
+}
+
+#endif
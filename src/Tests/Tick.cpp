@@ -0,0 +1,146 @@
+#include "Test.h"
+#include "Scene.h"
+#include "Tick.h"
+#include "TimeSource.h"
+
+// Drives the render loop's schedule through virtual time as Clock.cpp does on a 60 Hz display:
+// at each vblank a frame is drawn if its wake time has come, and a sweeping clock then wants the
+// next vblank while a ticking one sleeps until next_tick. Calls frame(utc, drawn) for every
+// vblank and returns the number drawn.
+
+template <typename Frame>
+uint64_t run_schedule(int64_t const start, int64_t const duration, HandMotion const motion, TickStyle const& style, Frame&& frame)
+{
+    uint64_t drawn = 0;
+    int64_t wake = 0;
+
+    for (int64_t vblank = 0; vblank * 1000000 / 60 < duration; ++vblank)
+    {
+        auto const utc = start + vblank * 1000000 / 60;
+        auto const draw = utc >= wake;
+
+        if (draw)
+        {
+            ++drawn;
+            wake = HandMotion::tick == motion ? next_tick(utc, style) : 0;
+        }
+
+        frame(utc, draw);
+    }
+
+    return drawn;
+}
+
+static double seconds_shown(int64_t const utc, HandMotion const motion, TickStyle const& style)
+{
+    auto const seconds = day_seconds({ 0.0, utc, 0, 0 }, 0);
+    return HandMotion::tick == motion ? tick_seconds(seconds, style) : seconds;
+}
+
+static float angle_difference(float const a, float const b)
+{
+    auto const difference = std::fmod(std::abs(a - b), 360.0f);
+    return std::min(difference, 360.0f - difference);
+}
+
+// An hour from half past eleven at night, so that it takes in the step from 59 seconds to 0 at
+// midnight. Sweeping draws every vblank; ticking draws the nine vblanks of each step and the one
+// on which it settles, or only the one at each second with no settle. A ticking clock must show
+// exactly the same hands at every vblank it sleeps through as at the frame it drew last.
+
+TEST(tick_schedule_frames_per_hour)
+{
+    int64_t const midnight = int64_t{ 19800 } * 86400 * 1000000;
+    int64_t const start = midnight - int64_t{ 1800 } * 1000000;
+    int64_t const hour = int64_t{ 3600 } * 1000000;
+    TickStyle const instant{ 0.0f };
+
+    struct Mode
+    {
+        HandMotion motion;
+        TickStyle style;
+        uint64_t expected;
+    };
+
+    Mode const modes[] =
+    {
+        { HandMotion::sweep, {}, 216000 },
+        { HandMotion::tick, {}, 36000 },
+        { HandMotion::tick, instant, 3600 },
+    };
+
+    for (auto&& mode : modes)
+    {
+        HandAngles shown{};
+        uint64_t stale = 0;
+        uint64_t around_midnight = 0;
+
+        auto const drawn = run_schedule(start, hour, mode.motion, mode.style, [&](int64_t const utc, bool const draw)
+        {
+            auto const angles = hand_angles(seconds_shown(utc, mode.motion, mode.style));
+
+            if (draw)
+            {
+                shown = angles;
+                around_midnight += utc >= midnight - 1000000 && utc < midnight + 1000000;
+            }
+            else
+            {
+                stale += angle_difference(shown.second, angles.second) > 0.0f ||
+                    angle_difference(shown.minute, angles.minute) > 0.0f ||
+                    angle_difference(shown.hour, angles.hour) > 0.0f;
+            }
+        });
+
+        printf("  %-22s %6llu frames an hour\n", HandMotion::sweep == mode.motion ? "sweep" : mode.style.settle ? "tick, 0.15 s settle" : "tick, no settle",
+            static_cast<unsigned long long>(drawn));
+
+        CHECK(mode.expected == drawn && 0 == stale);
+        CHECK(mode.expected / 3600 * 2 == around_midnight);
+    }
+}
+
+// The step into midnight goes from the 59 second mark to 0, swinging past it and settling on it
+// as every other step does, with the minute and hour hands moving on to twelve along with it. The
+// zone clocks take the same step as the previous second plus a progress that runs past 1, which
+// must give the same hands.
+
+TEST(tick_steps_through_midnight)
+{
+    TickStyle const style;
+    int64_t const midnight = int64_t{ 19800 } * 86400 * 1000000;
+    float furthest = 0.0f;
+
+    for (int64_t utc = midnight - 500000; utc < midnight + 1000000; utc += 1000)
+    {
+        TimeSample const sample{ 0.0, utc, 0, 0 };
+        auto const angles = hand_angles(tick_seconds(day_seconds(sample, 0), style));
+        auto const zone = static_cast<uint32_t>((utc_seconds(sample) - 1) % 86400);
+        auto const zoned = hand_angles(zone, tick_progress(utc_fraction(sample), style));
+        CHECK(angle_difference(angles.second, zoned.second) < 0.01f && angle_difference(angles.minute, zoned.minute) < 0.01f &&
+            angle_difference(angles.hour, zoned.hour) < 0.01f);
+
+        auto const into = utc - midnight;
+
+        if (into < 0)
+        {
+            CHECK(354.0f == angles.second);
+        }
+        else if (into < static_cast<int64_t>(style.settle * 1000000.0f))
+        {
+            // On its way forwards from 354 degrees, through 360 and back.
+
+            auto const forward = std::fmod(angles.second - 354.0f + 360.0f, 360.0f);
+            CHECK(forward < 6.8f || forward > 359.99f);
+            furthest = std::max(furthest, forward < 6.8f ? forward - 6.0f : 0.0f);
+        }
+        else
+        {
+            CHECK(0.0f == angles.second && 0.0f == angles.minute && 0.0f == angles.hour);
+        }
+    }
+
+    // About a tenth of a step past the mark.
+
+    CHECK(furthest > 0.4f && furthest < 0.8f);
+}
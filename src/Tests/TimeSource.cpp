@@ -0,0 +1,28 @@
+#include "Test.h"
+#include "TimeSource.h"
+#include <thread>
+
+// Between frames a real source's sample() moves on with the system clocks while now() stays on
+// the frame, and advance() catches now() up. Virtual sources only move from frame to frame.
+
+TEST(time_source_samples_between_frames)
+{
+    auto real = TimeSource::real([] { return 3600; });
+    auto const frame = real.now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    auto const fresh = real.sample();
+    CHECK(real.now().utc == frame.utc && real.now().elapsed == frame.elapsed);
+    CHECK(fresh.utc - frame.utc >= 20000 && fresh.elapsed - frame.elapsed >= 0.02 && 3600 == fresh.offset);
+    CHECK(0 == real.frame());
+
+    CHECK(real.advance() && real.now().utc >= fresh.utc && 1 == real.frame());
+
+    auto stepped = TimeSource::stepped(1000000, 1000000, 30, -18000);
+    CHECK(stepped.advance());
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CHECK(stepped.sample().utc == stepped.now().utc && stepped.sample().elapsed == stepped.now().elapsed && -18000 == stepped.sample().offset);
+
+    auto replayed = TimeSource::replay({ { 0.0, 5000000, 60, 0 }, { 0.5, 5500000, 60, 0 } });
+    CHECK(5000000 == replayed.sample().utc && replayed.advance() && 5500000 == replayed.sample().utc);
+}
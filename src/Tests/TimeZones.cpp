@@ -0,0 +1,162 @@
+// The system's zoneinfo, compiled by clock-tzc, checked against the C library reading the same
+// files. Both only exist on Linux and the like.
+
+#ifndef _WIN32
+
+#include "Zoneinfo.h"
+#include <ctime>
+#include <random>
+
+static int32_t offset_of(TimeZoneDatabase const& database, char const* const name, int64_t const time)
+{
+    auto const zone = database.find(name);
+    CHECK(zone >= 0);
+    return database.offset(static_cast<uint32_t>(zone), time);
+}
+
+TEST(time_zones_known_transitions)
+{
+    TimeZoneDatabase database;
+    open_system_zones(database);
+    CHECK(database.find("Europe/London") >= 0 && database.find("Europe/Nowhere") < 0 && database.find("") < 0);
+
+    // British Summer Time began at 01:00 UTC on 2024-03-31.
+
+    CHECK(0 == offset_of(database, "Europe/London", 1711846799));
+    CHECK(3600 == offset_of(database, "Europe/London", 1711846800));
+
+    // The United States moved the start of daylight saving to March in 2007.
+
+    CHECK(-5 * 3600 == offset_of(database, "America/New_York", 1173596399));
+    CHECK(-4 * 3600 == offset_of(database, "America/New_York", 1173596400));
+
+    // Samoa skipped 2011-12-30, going from UTC-10 in daylight saving to UTC+14.
+
+    CHECK(-10 * 3600 == offset_of(database, "Pacific/Apia", 1325239199));
+    CHECK(14 * 3600 == offset_of(database, "Pacific/Apia", 1325239200));
+
+    // Lord Howe Island keeps half an hour of daylight saving, in January but not in July.
+
+    CHECK(11 * 3600 == offset_of(database, "Australia/Lord_Howe", 1704067200));
+    CHECK(10 * 3600 + 1800 == offset_of(database, "Australia/Lord_Howe", 1719792000));
+}
+
+// Random instants from 1900 to 2100 in every zone, 180,000 in all, compared with localtime_r
+// given the same zone through TZ.
+
+TEST(time_zones_match_the_c_library)
+{
+    TimeZoneDatabase database;
+    open_system_zones(database);
+    TimeZoneCache cache(database);
+
+    auto const saved = getenv("TZ");
+    std::string const previous = saved ? saved : "";
+    std::mt19937_64 random(1900);
+    std::uniform_int_distribution<int64_t> instants(-2208988800, 4102444799);
+    uint32_t const lookups = 180000;
+    uint32_t compared = 0;
+    uint32_t mismatches = 0;
+
+    for (uint32_t zone = 0; zone != database.size(); ++zone)
+    {
+        auto const name = ":" + std::string(database.name(zone));
+        setenv("TZ", name.c_str(), 1);
+        tzset();
+
+        for (auto count = lookups / database.size() + (zone < lookups % database.size()); count; --count)
+        {
+            auto const time = instants(random);
+            auto const seconds = static_cast<time_t>(time);
+            tm local{};
+            CHECK(localtime_r(&seconds, &local));
+            ++compared;
+
+            if (local.tm_gmtoff != database.offset(zone, time) || local.tm_gmtoff != cache.offset(zone, time))
+            {
+                if (++mismatches <= 10)
+                {
+                    printf("  %s at %lld: %ld, not %d\n", name.c_str() + 1, static_cast<long long>(time), local.tm_gmtoff, database.offset(zone, time));
+                }
+            }
+        }
+    }
+
+    saved ? setenv("TZ", previous.c_str(), 1) : unsetenv("TZ");
+    tzset();
+
+    printf("  %u lookups in %u zones\n", compared, database.size());
+    CHECK(lookups == compared);
+    CHECK(0 == mismatches);
+}
+
+// Lookups as a wall of clocks makes them, each zone once a frame as time moves forward, and at
+// random, by binary search and through the cache.
+
+BENCHMARK(time_zone_offset)
+{
+    TimeZoneDatabase database;
+    open_system_zones(database);
+
+    uint32_t const clocks = 64;
+    uint32_t const frames = 200000;
+    int64_t const start = 1711800000;
+    std::vector<uint32_t> zones(clocks);
+
+    for (uint32_t index = 0; index != clocks; ++index)
+    {
+        zones[index] = index * database.size() / clocks;
+    }
+
+    for (auto const cached : { false, true })
+    {
+        TimeZoneCache cache(database);
+        int64_t sum = 0;
+        Stopwatch const watch;
+
+        for (uint32_t frame = 0; frame != frames; ++frame)
+        {
+            auto const time = start + frame / 60;
+
+            for (auto const zone : zones)
+            {
+                sum += cached ? cache.offset(zone, time) : database.offset(zone, time);
+            }
+        }
+
+        auto const elapsed = watch.elapsed();
+        keep(sum);
+
+        printf("  frames  %-8s %6.2f ns/lookup  %llu misses\n", cached ? "cache" : "database",
+            elapsed * 1e9 / (double{ frames } * clocks), static_cast<unsigned long long>(cache.misses()));
+    }
+
+    std::mt19937_64 random(2100);
+    std::uniform_int_distribution<int64_t> instants(-2208988800, 4102444799);
+    std::vector<std::pair<uint32_t, int64_t>> queries(1 << 20);
+
+    for (auto&& query : queries)
+    {
+        query = { static_cast<uint32_t>(random() % database.size()), instants(random) };
+    }
+
+    for (auto const cached : { false, true })
+    {
+        TimeZoneCache cache(database);
+        int64_t sum = 0;
+        Stopwatch const watch;
+
+        for (auto&& query : queries)
+        {
+            sum += cached ? cache.offset(query.first, query.second) : database.offset(query.first, query.second);
+        }
+
+        auto const elapsed = watch.elapsed();
+        keep(sum);
+
+        printf("  random  %-8s %6.2f ns/lookup  %llu misses\n", cached ? "cache" : "database",
+            elapsed * 1e9 / queries.size(), static_cast<unsigned long long>(cache.misses()));
+    }
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include "Test.h"
+#include "Power.h"
+#include "Visibility.h"
+
+// Every sequence of up to eight reports a second apart, each hiding or lifting one of the four
+// reasons, against a model of the reasons that hold. The window is hidden when the first reason
+// arrives and revealed only when the last is lifted, reports that change nothing say so, and the
+// totals count the time hidden and the frames not drawn at the rate given as each hide began.
+
+TEST(visibility_tracker_follows_every_sequence)
+{
+    uint64_t sequences = 0;
+    uint64_t reports = 0;
+
+    for (uint32_t length = 0; length <= 8; ++length)
+    {
+        uint32_t count = 1;
+
+        for (uint32_t report = 0; report != length; ++report)
+        {
+            count *= 8;
+        }
+
+        for (uint32_t code = 0; code != count; ++code)
+        {
+            VisibilityTracker tracker;
+            uint8_t model = 0;
+            double hidden_seconds = 0.0;
+            double saved = 0.0;
+            double since = 0.0;
+            double rate = 0.0;
+            uint64_t hides = 0;
+            uint64_t reveals = 0;
+            uint32_t bad = 0;
+
+            for (uint32_t report = 0, rest = code; report != length; ++report, rest /= 8)
+            {
+                auto const reason = static_cast<HiddenBy>(1 << rest % 4);
+                auto const hidden = 0 != rest / 4 % 2;
+                auto const now = report + 1.0;
+                auto const frame_rate = 10.0 * (report + 1);
+                auto const before = model;
+                model = hidden ? (model | static_cast<uint8_t>(reason)) : (model & ~static_cast<uint8_t>(reason));
+                auto const change = tracker.update(reason, hidden, now, frame_rate);
+
+                if (!before && model)
+                {
+                    bad += VisibilityChange::hidden != change;
+                    since = now;
+                    rate = frame_rate;
+                    ++hides;
+                }
+                else if (before && !model)
+                {
+                    bad += VisibilityChange::revealed != change;
+                    hidden_seconds += now - since;
+                    saved += (now - since) * rate;
+                    ++reveals;
+                }
+                else
+                {
+                    bad += VisibilityChange::none != change;
+                }
+
+                bad += tracker.hidden() != model || tracker.visible() != !model;
+
+                for (auto const each : { HiddenBy::occlusion, HiddenBy::minimized, HiddenBy::display, HiddenBy::cloaked })
+                {
+                    bad += tracker.hidden_by(each) != (0 != (model & static_cast<uint8_t>(each)));
+                }
+
+                ++reports;
+            }
+
+            // Totals part way through a hide include it so far.
+
+            auto const end = length + 1.5;
+            CHECK(0 == bad);
+            CHECK(std::abs(tracker.hidden_seconds(end) - (hidden_seconds + (model ? end - since : 0.0))) < 1e-9);
+            CHECK(tracker.frames_saved(end) == static_cast<uint64_t>(saved + (model ? (end - since) * rate : 0.0)));
+            CHECK(tracker.hides() == hides && tracker.reveals() == reveals && hides - reveals == (model ? 1u : 0u));
+            ++sequences;
+        }
+    }
+
+    printf("  %llu sequences, %llu reports\n", static_cast<unsigned long long>(sequences), static_cast<unsigned long long>(reports));
+}
+
+// An hour hidden behind two overlapping reasons saves the frames of that hour at the rate drawn
+// as it began: every vblank at 60 Hz while sweeping, and ten a second while ticking. Rates given
+// with later reports, while already hidden, change nothing.
+
+TEST(visibility_counts_frames_saved)
+{
+    PowerPolicy const policy;
+    TickStyle const tick;
+
+    for (auto const motion : { HandMotion::sweep, HandMotion::tick })
+    {
+        VisibilityTracker tracker;
+        CHECK(VisibilityChange::hidden == tracker.update(HiddenBy::minimized, true, 100.0, policy_frame_rate(policy.policy(), motion, 60.0f, tick)));
+        CHECK(VisibilityChange::none == tracker.update(HiddenBy::cloaked, true, 200.0, 1000.0));
+        CHECK(VisibilityChange::none == tracker.update(HiddenBy::minimized, false, 300.0, 1000.0) && !tracker.visible());
+        CHECK(VisibilityChange::revealed == tracker.update(HiddenBy::cloaked, false, 3700.0, 0.0) && tracker.visible());
+
+        auto const expected = HandMotion::sweep == motion ? 216000u : 36000u;
+        CHECK(expected == tracker.frames_saved(4000.0) && 3600.0 == tracker.hidden_seconds(4000.0));
+        CHECK(1 == tracker.hides() && 1 == tracker.reveals());
+    }
+}
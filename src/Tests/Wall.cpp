@@ -0,0 +1,81 @@
+#include "Test.h"
+#include "Raster.h"
+#include "Wall.h"
+
+TEST(wall_layout_fits_every_clock)
+{
+    for (uint32_t count = 1; count <= 1024; ++count)
+    {
+        auto const layout = wall_layout(count, 1920.0f, 1080.0f);
+        CHECK(layout.columns * layout.rows >= count);
+        CHECK(layout.columns * layout.cell <= 1920.001f && layout.rows * layout.cell <= 1080.001f);
+
+        auto const scene = record_wall(count, 1920.0f, 1080.0f);
+        CHECK(scene.dials.transforms.size() == count && scene.hands.transforms.size() == count * 4);
+    }
+}
+
+// A wall of N clocks in one 1080p frame, drawn as the wall mode draws it: dials cached, the hands
+// of every clock patched in one pass and drawn with one shadow, at the tier their radius calls
+// for. Alongside is the total of drawing each clock as a window of its own, at the cell size,
+// with its own shadow pass, which is what one window per clock comes to.
+
+BENCHMARK(wall_sweep)
+{
+    uint32_t const width = 1920;
+    uint32_t const height = 1080;
+    uint32_t const frames = 20;
+    double single = 0.0;
+
+    for (uint32_t count = 1; count <= 1024; count *= 2)
+    {
+        auto scene = record_wall(count, width, height);
+        auto const offsets = wall_offsets(count);
+        std::vector<HandAngles> angles(count);
+        auto const tier = detail_tier(wall_radius(count, width, height, 96.0f));
+        SoftwareScene software(width, height, 96.0f, scene.dials, default_theme, tier);
+        Canvas frame;
+
+        Stopwatch const watch;
+
+        for (uint32_t index = 0; index != frames; ++index)
+        {
+            wall_angles(36000.0 + index, offsets.data(), count, angles.data());
+            patch_wall(scene, angles.data());
+            software.draw(frame, scene.hands);
+        }
+
+        auto const wall = watch.elapsed() / frames;
+
+        if (1 == count)
+        {
+            single = wall;
+        }
+
+        // The windows are all alike but for the time, so one is timed and multiplied out.
+
+        auto const layout = wall_layout(count, static_cast<float>(width), static_cast<float>(height));
+        auto const cell = std::max(1u, static_cast<uint32_t>(layout.cell));
+        ClockGeometry const geometry{ cell / 2.0f, cell / 2.0f, layout.cell * 0.4f };
+        DisplayList dial;
+        DisplayList hands;
+        record_dial(dial, geometry);
+        record_clock(hands, geometry, false);
+        SoftwareScene window(cell, cell, 96.0f, dial, default_theme, detail_tier(geometry.radius));
+        Canvas small;
+
+        Stopwatch const windows_watch;
+
+        for (uint32_t index = 0; index != frames; ++index)
+        {
+            patch_hands(hands, 0, angles[index % count]);
+            window.draw(small, hands);
+        }
+
+        auto const windows = windows_watch.elapsed() / frames * count;
+
+        printf("  %4u clocks  %-7s  wall %8.2f ms/frame (%5.2fx one clock)  %7.1f us/clock  windows %9.2f ms/frame\n",
+            count, DetailTier::full == tier ? "full" : DetailTier::reduced == tier ? "reduced" : "sprite",
+            wall * 1000.0, wall / single, wall * 1e6 / count, windows * 1000.0);
+    }
+}
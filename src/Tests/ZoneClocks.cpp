@@ -0,0 +1,124 @@
+// Walls of clocks in the system's time zones, so like the time zone tests only for Linux and the
+// like.
+
+#ifndef _WIN32
+
+#include "Zoneinfo.h"
+#include "ZoneClocks.h"
+#include <random>
+
+// What update must give for one clock: its zone's offset and hand_angles(day, fraction).
+
+static HandAngles expected_angles(TimeZoneDatabase const& database, uint32_t const zone, int64_t const time, float const fraction)
+{
+    auto const day = ((time + database.offset(zone, time)) % 86400 + 86400) % 86400;
+    return hand_angles(static_cast<uint32_t>(day), fraction);
+}
+
+static std::vector<uint32_t> random_zones(TimeZoneDatabase const& database, uint32_t const count, uint64_t const seed)
+{
+    std::mt19937_64 random(seed);
+    std::vector<uint32_t> zones(count);
+
+    for (auto&& zone : zones)
+    {
+        zone = static_cast<uint32_t>(random() % database.size());
+    }
+
+    return zones;
+}
+
+// Bit for bit, for 100,000 clocks over every zone, at random instants either side of 1970 and
+// through a second at a time across London's change to summer time.
+
+TEST(zone_clocks_match_hand_angles)
+{
+    TimeZoneDatabase database;
+    open_system_zones(database);
+    auto const zones = random_zones(database, 100000, 39);
+    ZoneClocks clocks(database, zones);
+    CHECK(100000 == clocks.size() && clocks.distinct() == database.size());
+
+    std::mt19937_64 random(86400);
+    std::uniform_int_distribution<int64_t> instants(-2208988800, 4102444799);
+    std::uniform_real_distribution<float> fractions(0.0f, 1.0f);
+    std::vector<std::pair<int64_t, float>> times = { { 0, 0.0f }, { -1, 0.999f }, { 1711846800, 0.5f } };
+
+    for (int index = 0; index != 20; ++index)
+    {
+        times.push_back({ instants(random), fractions(random) });
+    }
+
+    for (int64_t second = 1711846790; second != 1711846810; ++second)
+    {
+        times.push_back({ second, 0.25f });
+    }
+
+    ClockAngles angles;
+    uint32_t mismatches = 0;
+
+    for (auto&& time : times)
+    {
+        clocks.update(time.first, time.second, angles);
+        CHECK(angles.second.size() == zones.size());
+
+        for (size_t index = 0; index != zones.size(); ++index)
+        {
+            auto const expected = expected_angles(database, zones[index], time.first, time.second);
+            auto const actual = angles[index];
+            mismatches += expected.second != actual.second || expected.minute != actual.minute || expected.hour != actual.hour;
+        }
+    }
+
+    CHECK(0 == mismatches);
+}
+
+// One update a frame for walls of 10, 1,000 and 100,000 clocks, against looking up each clock's
+// offset and working out its angles one at a time.
+
+BENCHMARK(zone_clocks_update)
+{
+    TimeZoneDatabase database;
+    open_system_zones(database);
+    int64_t const start = 1711800000;
+
+    for (auto const count : { 10u, 1000u, 100000u })
+    {
+        auto const zones = random_zones(database, count, count);
+        auto const frames = std::max(60u, 20000000u / count);
+        ZoneClocks clocks(database, zones);
+        ClockAngles angles;
+        Stopwatch const watch;
+
+        for (uint32_t frame = 0; frame != frames; ++frame)
+        {
+            clocks.update(start + frame / 60, frame % 60 / 60.0f, angles);
+        }
+
+        auto const batched = watch.elapsed() / frames;
+        keep(angles.hour[count - 1]);
+
+        TimeZoneCache cache(database);
+        std::vector<HandAngles> each(count);
+        Stopwatch const each_watch;
+
+        for (uint32_t frame = 0; frame != frames; ++frame)
+        {
+            auto const time = start + frame / 60;
+
+            for (uint32_t index = 0; index != count; ++index)
+            {
+                auto const day = ((time + cache.offset(zones[index], time)) % 86400 + 86400) % 86400;
+                each[index] = hand_angles(static_cast<uint32_t>(day), frame % 60 / 60.0f);
+            }
+        }
+
+        auto const single = each_watch.elapsed() / frames;
+        keep(each[count - 1].hour);
+
+        printf("  %6u clocks (%3u zones)  batched %9.2f us/frame %6.2f ns/clock  one at a time %9.2f us/frame %6.2f ns/clock\n",
+            count, clocks.distinct(), batched * 1e6, batched * 1e9 / count, single * 1e6, single * 1e9 / count);
+    }
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Test.h"
+#include "TimeZones.h"
+#include <cstdlib>
+
+#ifndef CLOCK_TZC
+#define CLOCK_TZC "./clock-tzc"
+#endif
+
+// Compiles /usr/share/zoneinfo with clock-tzc, which the Makefile builds alongside, and maps the
+// result. The file can go as soon as it is mapped. Only for Linux and the like, where both exist.
+
+inline void open_system_zones(TimeZoneDatabase& database)
+{
+    auto const path = "/tmp/clock-tests-zones-" + std::to_string(getpid()) + ".tzdb";
+    auto const command = std::string(CLOCK_TZC) + " /usr/share/zoneinfo " + path + " > /dev/null 2>&1";
+    CHECK(0 == std::system(command.c_str()));
+    auto const opened = database.open(path);
+    remove(path.c_str());
+    CHECK(opened);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "MappedTables.h"
+#include "Scene.h"
+#include "SharedMemory.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// A library of precompiled clock faces, as written by clock-themec from a text description. Like
+// the time zone database, the file is mapped read-only and used in place: opening it only checks
+// that the tables lie within the file, and each face is a FaceTheme record exactly as the
+// renderer takes it, so switching faces is a matter of pointing at another record. Native
+// endianness, as the file is built on the machine that uses it.
+//
+// The file holds the header, then the entries sorted by name, then the names, each table 8-byte
+// aligned.
+
+constexpr uint32_t theme_magic = 0x4854434b; // "KCTH"
+constexpr uint32_t theme_version = 1;
+
+struct ThemeFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t theme_count;
+    uint32_t reserved;
+    uint64_t entries_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+struct ThemeEntry
+{
+    uint32_t name;          // offset into the names
+    uint32_t name_length;
+    FaceTheme face;
+};
+
+static_assert(sizeof(ThemeEntry) % 8 == 0);
+
+struct ThemeLibrary
+{
+    bool open(std::string const& path)
+    {
+        m_memory = SharedMemory::map_file(path);
+        m_header = nullptr;
+
+        if (!m_memory || m_memory.size() < sizeof(ThemeFileHeader))
+        {
+            return false;
+        }
+
+        auto const header = static_cast<ThemeFileHeader const*>(m_memory.data());
+        auto const size = m_memory.size();
+
+        if (header->magic != theme_magic || header->version != theme_version ||
+            !table_fits(size, header->entries_offset, header->theme_count, sizeof(ThemeEntry)) ||
+            !table_fits(size, header->names_offset, header->names_size, 1))
+        {
+            return false;
+        }
+
+        auto const base = static_cast<uint8_t const*>(m_memory.data());
+        m_entries = reinterpret_cast<ThemeEntry const*>(base + header->entries_offset);
+        m_names = reinterpret_cast<char const*>(base + header->names_offset);
+
+        for (uint32_t theme = 0; theme != header->theme_count; ++theme)
+        {
+            auto const& entry = m_entries[theme];
+
+            if (uint64_t{ entry.name } + entry.name_length > header->names_size)
+            {
+                return false;
+            }
+        }
+
+        m_header = header;
+        return true;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return nullptr != m_header;
+    }
+
+    uint32_t size() const noexcept
+    {
+        return m_header ? m_header->theme_count : 0;
+    }
+
+    std::string_view name(uint32_t const theme) const noexcept
+    {
+        return { m_names + m_entries[theme].name, m_entries[theme].name_length };
+    }
+
+    // The face lives in the mapping, so the reference stays valid for as long as the library
+    // stays open.
+
+    FaceTheme const& face(uint32_t const theme) const noexcept
+    {
+        return m_entries[theme].face;
+    }
+
+    // Returns the theme with the given name, or -1.
+
+    int32_t find(std::string_view const name) const noexcept
+    {
+        return find_by_name(size(), name, [this](uint32_t const theme) { return this->name(theme); });
+    }
+
+private:
+
+    SharedMemory m_memory;
+    ThemeFileHeader const* m_header{};
+    ThemeEntry const* m_entries{};
+    char const* m_names{};
+};
@@ -0,0 +1,303 @@
+// clock-themec: compiles a text description of clock faces into the theme library that the clock
+// maps at startup (see Theme.h):
+//
+//   clock-themec faces.txt faces.theme
+//
+// Each face begins with a theme line naming it and is followed by any of its settings, one per
+// line. Settings left out keep the default face's values, and # begins a comment:
+//
+//   theme harbour
+//   ink #1f4e79
+//   background #f4f1ea
+//   opacity 0.9
+//   hour-stroke 0.12          # fractions of the radius
+//   shadow-offset 3           # DIPs
+//
+// Colors are #rrggbb, #rrggbbaa or four numbers from 0 to 1. Only the standard library is needed,
+// so it also builds elsewhere, for example:
+//
+//   g++ -std=c++17 -O2 ThemeCompiler.cpp -o clock-themec
+
+#include "Theme.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+struct Theme
+{
+    std::string name;
+    FaceTheme face;
+    uint32_t line;
+};
+
+static bool parse_hex(std::string const& text, Color& color)
+{
+    if ((7 != text.size() && 9 != text.size()) || '#' != text[0] ||
+        text.find_first_not_of("0123456789abcdefABCDEF", 1) != std::string::npos)
+    {
+        return false;
+    }
+
+    auto const channel = [&](size_t const at)
+    {
+        return static_cast<float>(strtoul(text.substr(at, 2).c_str(), nullptr, 16)) / 255.0f;
+    };
+
+    color = { channel(1), channel(3), channel(5), 9 == text.size() ? channel(7) : 1.0f };
+    return true;
+}
+
+static bool parse_number(std::string const& text, float& value)
+{
+    char* end = nullptr;
+    value = strtof(text.c_str(), &end);
+    return !text.empty() && '\0' == *end && std::isfinite(value);
+}
+
+static bool parse_color(std::vector<std::string> const& values, Color& color)
+{
+    if (1 == values.size())
+    {
+        return parse_hex(values[0], color);
+    }
+
+    float channels[4];
+
+    if (4 != values.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i != 4; ++i)
+    {
+        if (!parse_number(values[i], channels[i]) || channels[i] < 0.0f || channels[i] > 1.0f)
+        {
+            return false;
+        }
+    }
+
+    color = { channels[0], channels[1], channels[2], channels[3] };
+    return true;
+}
+
+// Settings that are a single number, with the range each must lie within.
+
+struct NumberSetting
+{
+    char const* name;
+    float FaceTheme::* field;
+    float minimum;
+    float maximum;
+};
+
+static NumberSetting const number_settings[] =
+{
+    { "opacity", &FaceTheme::opacity, 0.0f, 1.0f },
+    { "dial-stroke", &FaceTheme::dial_stroke, 0.0f, 1.0f },
+    { "second-stroke", &FaceTheme::second_stroke, 0.0f, 1.0f },
+    { "minute-stroke", &FaceTheme::minute_stroke, 0.0f, 1.0f },
+    { "hour-stroke", &FaceTheme::hour_stroke, 0.0f, 1.0f },
+    { "second-length", &FaceTheme::second_length, 0.0f, 1.0f },
+    { "minute-length", &FaceTheme::minute_length, 0.0f, 1.0f },
+    { "hour-length", &FaceTheme::hour_length, 0.0f, 1.0f },
+    { "shadow-deviation", &FaceTheme::shadow_deviation, 0.0f, 100.0f },
+    { "shadow-offset", &FaceTheme::shadow_offset, -100.0f, 100.0f },
+};
+
+static bool parse_themes(char const* const path, std::vector<Theme>& themes)
+{
+    std::ifstream file(path);
+
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+
+    std::string text;
+    uint32_t line = 0;
+
+    auto const error = [&](char const* const message)
+    {
+        fprintf(stderr, "%s(%u): %s\n", path, line, message);
+        return false;
+    };
+
+    while (std::getline(file, text))
+    {
+        ++line;
+        std::istringstream words(text);
+        std::string key;
+        std::vector<std::string> values;
+
+        if (!(words >> key) || '#' == key[0])
+        {
+            continue;
+        }
+
+        // A word beginning with # starts a comment, unless it is the color itself.
+
+        auto const color = "ink" == key || "background" == key;
+
+        for (std::string value; words >> value;)
+        {
+            if ('#' == value[0] && !(color && values.empty()))
+            {
+                break;
+            }
+
+            values.push_back(std::move(value));
+        }
+
+        if ("theme" == key)
+        {
+            if (1 != values.size())
+            {
+                return error("expected a single name after theme");
+            }
+
+            themes.push_back({ values[0], default_theme, line });
+            continue;
+        }
+
+        if (themes.empty())
+        {
+            return error("settings must follow a theme line");
+        }
+
+        auto& face = themes.back().face;
+
+        if (color)
+        {
+            if (!parse_color(values, "ink" == key ? face.ink : face.background))
+            {
+                return error("expected #rrggbb, #rrggbbaa or four numbers from 0 to 1");
+            }
+
+            continue;
+        }
+
+        auto const setting = std::find_if(std::begin(number_settings), std::end(number_settings), [&](NumberSetting const& setting)
+        {
+            return key == setting.name;
+        });
+
+        if (setting == std::end(number_settings))
+        {
+            return error("unknown setting");
+        }
+
+        float value;
+
+        if (1 != values.size() || !parse_number(values[0], value))
+        {
+            return error("expected a number");
+        }
+
+        if (value < setting->minimum || value > setting->maximum)
+        {
+            return error("value out of range");
+        }
+
+        face.*setting->field = value;
+    }
+
+    return true;
+}
+
+static void usage()
+{
+    fputs("usage: clock-themec INPUT OUTPUT\n"
+        "  INPUT             text description of the faces\n"
+        "  OUTPUT            theme library to write\n",
+        stderr);
+}
+
+int main(int argc, char** argv)
+{
+    if (3 != argc)
+    {
+        usage();
+        return 1;
+    }
+
+    std::vector<Theme> themes;
+
+    if (!parse_themes(argv[1], themes))
+    {
+        return 1;
+    }
+
+    if (themes.empty())
+    {
+        fprintf(stderr, "clock-themec: no themes found in %s\n", argv[1]);
+        return 1;
+    }
+
+    std::stable_sort(themes.begin(), themes.end(), [](Theme const& a, Theme const& b) { return a.name < b.name; });
+
+    for (size_t i = 1; i < themes.size(); ++i)
+    {
+        if (themes[i - 1].name == themes[i].name)
+        {
+            fprintf(stderr, "%s(%u): theme %s is already defined on line %u\n", argv[1], themes[i].line, themes[i].name.c_str(), themes[i - 1].line);
+            return 1;
+        }
+    }
+
+    std::vector<ThemeEntry> entries;
+    std::string names;
+
+    for (auto&& theme : themes)
+    {
+        entries.push_back({ static_cast<uint32_t>(names.size()), static_cast<uint32_t>(theme.name.size()), theme.face });
+        names += theme.name;
+    }
+
+    auto const align = [](uint64_t const offset) { return (offset + 7) & ~uint64_t{ 7 }; };
+
+    ThemeFileHeader header = {};
+    header.magic = theme_magic;
+    header.version = theme_version;
+    header.theme_count = static_cast<uint32_t>(entries.size());
+    header.entries_offset = align(sizeof(header));
+    header.names_offset = align(header.entries_offset + entries.size() * sizeof(ThemeEntry));
+    header.names_size = names.size();
+
+    std::vector<uint8_t> file(header.names_offset + names.size());
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + header.entries_offset, entries.data(), entries.size() * sizeof(ThemeEntry));
+    memcpy(file.data() + header.names_offset, names.data(), names.size());
+
+    // The library is written beside the output and renamed over it, so that a clock with the
+    // old one mapped keeps it intact and one watching for changes sees a whole file.
+
+    auto const temporary = std::string(argv[2]) + ".new";
+    auto const output = fopen(temporary.c_str(), "wb");
+
+    if (!output || file.size() != fwrite(file.data(), 1, file.size(), output) || fclose(output))
+    {
+        perror(temporary.c_str());
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, argv[2], error);
+
+    if (error)
+    {
+        fprintf(stderr, "clock-themec: cannot replace %s: %s\n", argv[2], error.message().c_str());
+        std::filesystem::remove(temporary, error);
+        return 1;
+    }
+
+    fprintf(stderr, "clock-themec: %zu themes, %zu bytes\n", entries.size(), file.size());
+    return 0;
+}
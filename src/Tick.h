@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// The second hand either sweeps, moving a little every frame, or ticks like a quartz movement,
+// stepping once a second and resting in between. A tick takes a short, fixed time to make:
+// the hand sets off at speed, swings a little past the mark and settles back onto it, following
+// an analytic curve so that every frame of the step is exact whenever it lands. Outside that
+// window the hands do not move at all, so a ticking clock need only draw the few frames of each
+// step and can sleep until the next second begins.
+
+enum class HandMotion : uint8_t
+{
+    sweep,
+    tick,
+};
+
+struct TickStyle
+{
+    float settle = 0.15f;           // seconds to make each step, zero to jump straight there
+    float overshoot = 1.70158f;     // how far past the mark the hand swings, about a tenth of a step
+};
+
+// How far the second hand has stepped from the previous mark towards the current one, a fraction
+// of a second into the second. This is the back ease-out curve, which leaves at speed, peaks past
+// 1 when there is overshoot, and arrives at exactly 1 with zero velocity at the end of the step.
+
+inline float tick_progress(float const fraction, TickStyle const& style) noexcept
+{
+    if (!(fraction < style.settle))
+    {
+        return 1.0f;
+    }
+
+    auto const remaining = fraction / style.settle - 1.0f;
+    return 1.0f + remaining * remaining * ((style.overshoot + 1.0f) * remaining + style.overshoot);
+}
+
+// Seconds as the hands show them in tick mode, as hand_angles and wall_angles take them.
+
+inline double tick_seconds(double const seconds, TickStyle const& style) noexcept
+{
+    auto const whole = std::floor(seconds);
+    return whole - 1.0 + tick_progress(static_cast<float>(seconds - whole), style);
+}
+
+// When the hands next move after a frame drawn at utc, in microseconds since 1970: straight away
+// while a step is still being made, otherwise at the start of the next second. Zone offsets are
+// whole seconds, so every clock of a wall steps together.
+
+inline int64_t next_tick(int64_t const utc, TickStyle const& style) noexcept
+{
+    auto const into = (utc % 1000000 + 1000000) % 1000000;
+
+    if (into < static_cast<int64_t>(style.settle * 1000000.0f))
+    {
+        return utc;
+    }
+
+    return utc - into + 1000000;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Everything that moves with time reads it from a TimeSource rather than from the system: the
+// intro animation, the hands, and the scheduling of frames. A source holds one sample per frame,
+// so every reader within a frame sees the same instant, and advance() moves to the next frame.
+//
+// - real time samples the system clocks on every advance.
+// - stepped time moves on by a fixed step per frame, independent of how long frames take, so a
+//   day of clock motion renders as fast as the frames can be drawn and always the same way.
+// - a trace replays the samples recorded from another source, frame for frame.
+//
+// Stepped and replayed sources do all their arithmetic in whole microseconds, so the same source
+// always yields the same samples and hence bit-identical frames.
+
+struct TimeSample
+{
+    double elapsed;     // seconds since the source started, for animation and scheduling
+    int64_t utc;        // microseconds since 1970
+    int32_t offset;     // local time zone, in seconds east of UTC
+    uint32_t reserved;
+};
+
+constexpr uint32_t time_trace_magic = 0x5454434b; // "KCTT"
+constexpr uint32_t time_trace_version = 1;
+
+// Whole seconds and the fraction of a second, as ZoneClocks takes them.
+
+inline int64_t utc_seconds(TimeSample const& sample) noexcept
+{
+    return sample.utc / 1000000 - (sample.utc % 1000000 < 0);
+}
+
+inline float utc_fraction(TimeSample const& sample) noexcept
+{
+    return static_cast<float>((sample.utc % 1000000 + 1000000) % 1000000) / 1000000.0f;
+}
+
+// Seconds since midnight in a zone offset from UTC, as hand_angles and wall_angles take them.
+
+inline double day_seconds(TimeSample const& sample, int32_t const offset) noexcept
+{
+    auto const local = sample.utc + int64_t{ offset } * 1000000;
+    return static_cast<double>((local % 86400000000 + 86400000000) % 86400000000) / 1000000.0;
+}
+
+enum class TimeKind
+{
+    real,
+    stepped,
+    trace,
+};
+
+struct TimeSource
+{
+    // offset, if given, is called on every advance for the local time zone in effect.
+
+    static TimeSource real(int32_t (*offset)() = nullptr)
+    {
+        TimeSource source(TimeKind::real);
+        source.m_offset = offset;
+        source.m_began = std::chrono::steady_clock::now();
+        source.m_now = source.sample_real();
+        return source;
+    }
+
+    // Frame n is at start + n * step / divisor microseconds, so that rates such as 30 frames per
+    // second need not round their step.
+
+    static TimeSource stepped(int64_t const start, int64_t const step, int64_t const divisor = 1, int32_t const offset = 0)
+    {
+        TimeSource source(TimeKind::stepped);
+        source.m_start = start;
+        source.m_step = step;
+        source.m_divisor = divisor;
+        source.m_now = { 0.0, start, offset, 0 };
+        return source;
+    }
+
+    static TimeSource replay(std::vector<TimeSample> trace)
+    {
+        TimeSource source(TimeKind::trace);
+        source.m_trace = std::move(trace);
+
+        if (!source.m_trace.empty())
+        {
+            source.m_now = source.m_trace.front();
+        }
+
+        return source;
+    }
+
+    TimeKind kind() const noexcept
+    {
+        return m_kind;
+    }
+
+    TimeSample const& now() const noexcept
+    {
+        return m_now;
+    }
+
+    // The time as it is now rather than as of the current frame, for what is drawn between
+    // frames. Real time samples the system clocks again; stepped and replayed time only move
+    // from frame to frame, so they give the current frame's sample.
+
+    TimeSample sample() const
+    {
+        return TimeKind::real == m_kind ? sample_real() : m_now;
+    }
+
+    uint64_t frame() const noexcept
+    {
+        return m_frame;
+    }
+
+    // The number of frames a trace holds, or zero for sources that never run out.
+
+    uint64_t frames() const noexcept
+    {
+        return m_trace.size();
+    }
+
+    // Moves to the next frame. Returns false once a trace has run out, leaving its last sample
+    // current.
+
+    bool advance()
+    {
+        if (TimeKind::trace == m_kind)
+        {
+            if (m_frame + 1 >= m_trace.size())
+            {
+                return false;
+            }
+
+            m_now = m_trace[++m_frame];
+        }
+        else if (TimeKind::stepped == m_kind)
+        {
+            ++m_frame;
+            auto const elapsed = static_cast<int64_t>(m_frame) * m_step / m_divisor;
+            m_now.utc = m_start + elapsed;
+            m_now.elapsed = static_cast<double>(elapsed) / 1000000.0;
+        }
+        else
+        {
+            ++m_frame;
+            m_now = sample_real();
+        }
+
+        if (m_record)
+        {
+            m_failed = m_failed || 1 != fwrite(&m_now, sizeof(m_now), 1, m_record);
+        }
+
+        return true;
+    }
+
+    // Appends every sample from now on to a trace file, starting with the current one. The file
+    // is left open for the caller to close.
+
+    bool record(FILE* const file)
+    {
+        uint32_t const header[2] = { time_trace_magic, time_trace_version };
+        m_record = file;
+        m_failed = 1 != fwrite(header, sizeof(header), 1, file) || 1 != fwrite(&m_now, sizeof(m_now), 1, file);
+        return !m_failed;
+    }
+
+    bool failed() const noexcept
+    {
+        return m_failed;
+    }
+
+private:
+
+    explicit TimeSource(TimeKind const kind) noexcept :
+        m_kind(kind)
+    {
+    }
+
+    TimeSample sample_real() const
+    {
+        auto const now = std::chrono::steady_clock::now();
+        TimeSample sample{};
+        sample.elapsed = std::chrono::duration<double>(now - m_began).count();
+        sample.utc = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        sample.offset = m_offset ? m_offset() : 0;
+        return sample;
+    }
+
+    TimeKind m_kind;
+    TimeSample m_now{};
+    uint64_t m_frame{};
+    int32_t (*m_offset)() {};
+    std::chrono::steady_clock::time_point m_began;
+    int64_t m_start{};
+    int64_t m_step{};
+    int64_t m_divisor{ 1 };
+    std::vector<TimeSample> m_trace;
+    FILE* m_record{};
+    bool m_failed{};
+};
+
+// Reads a trace written by TimeSource::record. Returns no samples if the file is missing or
+// malformed.
+
+inline std::vector<TimeSample> read_time_trace(std::string const& path)
+{
+    std::vector<TimeSample> trace;
+    auto const file = fopen(path.c_str(), "rb");
+
+    if (!file)
+    {
+        return trace;
+    }
+
+    uint32_t header[2] = {};
+
+    if (1 == fread(header, sizeof(header), 1, file) && time_trace_magic == header[0] && time_trace_version == header[1])
+    {
+        TimeSample sample;
+
+        while (1 == fread(&sample, sizeof(sample), 1, file))
+        {
+            trace.push_back(sample);
+        }
+    }
+
+    fclose(file);
+    return trace;
+}
@@ -0,0 +1,522 @@
+// clock-tzc: compiles a directory of zoneinfo files, as built from tzdata by zic and installed
+// in /usr/share/zoneinfo on most systems, into the single precompiled database that the clock
+// maps at startup (see TimeZones.h):
+//
+//   clock-tzc /usr/share/zoneinfo zones.tzdb --until 2100
+//
+// Each file's 64-bit transitions are read, changes of abbreviation alone are dropped, and the
+// POSIX TZ rule at the end of the file is expanded into explicit transitions up to the given
+// year, since newer zoneinfo files leave future daylight saving to that rule. Only the standard
+// library is needed, so it also builds elsewhere, for example:
+//
+//   g++ -std=c++17 -O2 TimeZoneCompiler.cpp -o clock-tzc
+
+#include "TimeZones.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <utility>
+
+struct Zone
+{
+    std::string name;
+    int32_t initial{};
+    std::vector<std::pair<int64_t, int32_t>> transitions;
+};
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar.
+
+static int64_t days_from_civil(int64_t year, uint32_t const month, uint32_t const day)
+{
+    year -= month <= 2;
+    auto const era = (year >= 0 ? year : year - 399) / 400;
+    auto const year_of_era = year - era * 400;
+    auto const day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    auto const day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+static bool leap_year(int64_t const year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int64_t year_of(int64_t const time)
+{
+    auto days = time / 86400 - (time % 86400 < 0);
+    days += 719468;
+    auto const era = (days >= 0 ? days : days - 146096) / 146097;
+    auto const day_of_era = days - era * 146097;
+    auto const year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    auto const day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    auto const month = (5 * day_of_year + 2) / 153;
+    return year_of_era + era * 400 + (month >= 10);
+}
+
+// A POSIX TZ string such as "CET-1CEST,M3.5.0,M10.5.0/3". Offsets are kept in seconds east of
+// UTC, the opposite sign to the string.
+
+struct PosixRule
+{
+    enum class Kind { julian, zero_based, month_week_day };
+
+    struct Date
+    {
+        Kind kind;
+        uint32_t day;
+        uint32_t week;
+        uint32_t month;
+        int32_t time;
+    };
+
+    int32_t standard;
+    int32_t daylight;
+    bool has_daylight;
+    Date start;
+    Date end;
+};
+
+struct RuleParser
+{
+    char const* p;
+
+    bool name()
+    {
+        if ('<' == *p)
+        {
+            while (*p && '>' != *p) ++p;
+            return '>' == *p++;
+        }
+
+        auto const begin = p;
+        while (isalpha(static_cast<unsigned char>(*p))) ++p;
+        return p - begin >= 3;
+    }
+
+    bool number(int32_t& value)
+    {
+        if (!isdigit(static_cast<unsigned char>(*p)))
+        {
+            return false;
+        }
+
+        value = static_cast<int32_t>(strtol(p, const_cast<char**>(&p), 10));
+        return true;
+    }
+
+    // [+-]hh[:mm[:ss]], in seconds.
+
+    bool time(int32_t& seconds)
+    {
+        auto const sign = '-' == *p ? -1 : 1;
+        p += '-' == *p || '+' == *p;
+        int32_t hours = 0, minutes = 0, rest = 0;
+
+        if (!number(hours))
+        {
+            return false;
+        }
+
+        if (':' == *p && (++p, !number(minutes)))
+        {
+            return false;
+        }
+
+        if (':' == *p && (++p, !number(rest)))
+        {
+            return false;
+        }
+
+        seconds = sign * (hours * 3600 + minutes * 60 + rest);
+        return true;
+    }
+
+    bool date(PosixRule::Date& date)
+    {
+        int32_t day = 0, week = 0, month = 0;
+        date.time = 7200;
+
+        if ('M' == *p)
+        {
+            ++p;
+
+            if (!number(month) || '.' != *p++ || !number(week) || '.' != *p++ || !number(day) ||
+                month < 1 || month > 12 || week < 1 || week > 5 || day > 6)
+            {
+                return false;
+            }
+
+            date.kind = PosixRule::Kind::month_week_day;
+        }
+        else if ('J' == *p)
+        {
+            ++p;
+
+            if (!number(day) || day < 1 || day > 365)
+            {
+                return false;
+            }
+
+            date.kind = PosixRule::Kind::julian;
+        }
+        else
+        {
+            if (!number(day) || day > 365)
+            {
+                return false;
+            }
+
+            date.kind = PosixRule::Kind::zero_based;
+        }
+
+        date.day = static_cast<uint32_t>(day);
+        date.week = static_cast<uint32_t>(week);
+        date.month = static_cast<uint32_t>(month);
+        return '/' != *p || (++p, time(date.time));
+    }
+};
+
+static bool parse_rule(std::string const& text, PosixRule& rule)
+{
+    RuleParser parser{ text.c_str() };
+    int32_t offset = 0;
+
+    if (!parser.name() || !parser.time(offset))
+    {
+        return false;
+    }
+
+    rule = {};
+    rule.standard = -offset;
+    rule.daylight = rule.standard;
+
+    if (!*parser.p)
+    {
+        return true;
+    }
+
+    if (!parser.name())
+    {
+        return false;
+    }
+
+    rule.has_daylight = true;
+    rule.daylight = rule.standard + 3600;
+
+    if (',' != *parser.p && parser.time(offset))
+    {
+        rule.daylight = -offset;
+    }
+
+    // Daylight saving with no dates defaults to the US rules.
+
+    if (!*parser.p)
+    {
+        rule.start = { PosixRule::Kind::month_week_day, 0, 2, 3, 7200 };
+        rule.end = { PosixRule::Kind::month_week_day, 0, 1, 11, 7200 };
+        return true;
+    }
+
+    return ',' == *parser.p++ && parser.date(rule.start) && ',' == *parser.p++ && parser.date(rule.end) && !*parser.p;
+}
+
+// The UTC instant at which a rule's date and local time falls in a year, given the offset in
+// effect just before it.
+
+static int64_t rule_instant(PosixRule::Date const& date, int64_t const year, int32_t const offset)
+{
+    auto days = days_from_civil(year, 1, 1);
+
+    if (PosixRule::Kind::julian == date.kind)
+    {
+        days += date.day - 1 + (leap_year(year) && date.day > 59);
+    }
+    else if (PosixRule::Kind::zero_based == date.kind)
+    {
+        days += date.day;
+    }
+    else
+    {
+        static uint32_t const lengths[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        auto const first = days_from_civil(year, date.month, 1);
+        auto const weekday = static_cast<uint32_t>(((first + 4) % 7 + 7) % 7);
+        auto day = 1 + (date.day + 7 - weekday) % 7 + (date.week - 1) * 7;
+        auto const length = lengths[date.month - 1] + (2 == date.month && leap_year(year));
+
+        while (day > length)
+        {
+            day -= 7;
+        }
+
+        days = first + day - 1;
+    }
+
+    return days * 86400 + date.time - offset;
+}
+
+static bool read_file(std::filesystem::path const& path, std::vector<uint8_t>& bytes)
+{
+    std::ifstream file(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+static uint32_t be32(uint8_t const* data)
+{
+    return uint32_t{ data[0] } << 24 | uint32_t{ data[1] } << 16 | uint32_t{ data[2] } << 8 | data[3];
+}
+
+// Reads a TZif file of version 2 or later, whose second header and data use 64-bit times.
+
+static bool parse_zoneinfo(std::vector<uint8_t> const& bytes, int64_t const until, Zone& zone)
+{
+    auto const counts = [&](size_t const at, uint32_t (&values)[6])
+    {
+        if (bytes.size() < at + 44 || memcmp(bytes.data() + at, "TZif", 4))
+        {
+            return false;
+        }
+
+        for (int i = 0; i != 6; ++i)
+        {
+            values[i] = be32(bytes.data() + at + 20 + i * 4);
+        }
+
+        return true;
+    };
+
+    enum { utc_flags, standard_flags, leaps, times, types, characters };
+    uint32_t first[6];
+
+    if (!counts(0, first) || bytes[4] < '2')
+    {
+        return false;
+    }
+
+    auto const second_header = size_t{ 44 } + first[times] * 5 + first[types] * 6 + first[characters] + first[leaps] * 8 + first[standard_flags] + first[utc_flags];
+    uint32_t count[6];
+
+    if (!counts(second_header, count) || !count[types])
+    {
+        return false;
+    }
+
+    auto const data = bytes.data() + second_header + 44;
+    auto const indices = data + size_t{ count[times] } * 8;
+    auto const infos = indices + count[times];
+    auto const footer = second_header + 44 + size_t{ count[times] } * 9 + count[types] * 6 + count[characters] + count[leaps] * 12 + count[standard_flags] + count[utc_flags];
+
+    if (bytes.size() < footer)
+    {
+        return false;
+    }
+
+    auto const offset_of = [&](uint32_t const type)
+    {
+        return static_cast<int32_t>(be32(infos + type * 6));
+    };
+
+    zone.initial = offset_of(0);
+    zone.transitions.clear();
+    auto current = zone.initial;
+
+    for (uint32_t i = 0; i != count[times]; ++i)
+    {
+        auto const time = static_cast<int64_t>(uint64_t{ be32(data + i * 8) } << 32 | be32(data + i * 8 + 4));
+
+        if (indices[i] >= count[types])
+        {
+            return false;
+        }
+
+        auto const offset = offset_of(indices[i]);
+
+        if (offset != current)
+        {
+            zone.transitions.emplace_back(time, offset);
+            current = offset;
+        }
+    }
+
+    // The footer's rule governs everything after the last transition.
+
+    std::string rule_text;
+
+    if (footer + 1 < bytes.size() && '\n' == bytes[footer])
+    {
+        auto const end = std::find(bytes.begin() + static_cast<ptrdiff_t>(footer) + 1, bytes.end(), '\n');
+        rule_text.assign(bytes.begin() + static_cast<ptrdiff_t>(footer) + 1, end);
+    }
+
+    PosixRule rule;
+
+    if (rule_text.empty() || !parse_rule(rule_text, rule))
+    {
+        return true;
+    }
+
+    auto const last = zone.transitions.empty() ? std::numeric_limits<int64_t>::min() : zone.transitions.back().first;
+
+    if (!rule.has_daylight)
+    {
+        if (rule.standard != current && zone.transitions.empty())
+        {
+            zone.initial = rule.standard;
+        }
+
+        return true;
+    }
+
+    std::vector<std::pair<int64_t, int32_t>> expanded;
+    auto const first_year = zone.transitions.empty() ? int64_t{ 1970 } : year_of(last);
+
+    for (auto year = first_year; year <= year_of(until); ++year)
+    {
+        expanded.emplace_back(rule_instant(rule.start, year, rule.standard), rule.daylight);
+        expanded.emplace_back(rule_instant(rule.end, year, rule.daylight), rule.standard);
+    }
+
+    std::sort(expanded.begin(), expanded.end());
+
+    for (auto&& transition : expanded)
+    {
+        if (transition.first > last && transition.first < until && transition.second != current)
+        {
+            zone.transitions.push_back(transition);
+            current = transition.second;
+        }
+    }
+
+    return true;
+}
+
+static void usage()
+{
+    fputs("usage: clock-tzc ZONEINFO OUTPUT [--until YEAR]\n"
+        "  ZONEINFO          directory of compiled zoneinfo files, such as /usr/share/zoneinfo\n"
+        "  OUTPUT            database file to write\n"
+        "  --until YEAR      expand daylight saving rules up to this year (2100)\n",
+        stderr);
+}
+
+int main(int argc, char** argv)
+{
+    if (3 != argc && !(5 == argc && !strcmp(argv[3], "--until")))
+    {
+        usage();
+        return 1;
+    }
+
+    auto const year = 5 == argc ? strtol(argv[4], nullptr, 10) : 2100;
+
+    if (year < 1970 || year > 9999)
+    {
+        usage();
+        return 1;
+    }
+
+    auto const until = days_from_civil(year + 1, 1, 1) * 86400;
+    std::filesystem::path const root(argv[1]);
+    std::vector<Zone> zones;
+    std::error_code error;
+    std::vector<uint8_t> bytes;
+
+    // The posix and right trees repeat every zone, the latter counting leap seconds.
+
+    for (std::filesystem::recursive_directory_iterator it(root, error), end; !error && it != end; it.increment(error))
+    {
+        auto const name = it->path().lexically_relative(root).generic_string();
+
+        if (it->is_directory(error))
+        {
+            if ("posix" == name || "right" == name)
+            {
+                it.disable_recursion_pending();
+            }
+
+            continue;
+        }
+
+        Zone zone;
+        zone.name = name;
+
+        if (read_file(it->path(), bytes) && parse_zoneinfo(bytes, until, zone))
+        {
+            zones.push_back(std::move(zone));
+        }
+    }
+
+    if (error || zones.empty())
+    {
+        fprintf(stderr, "clock-tzc: no zoneinfo files found in %s\n", argv[1]);
+        return 1;
+    }
+
+    std::sort(zones.begin(), zones.end(), [](Zone const& a, Zone const& b) { return a.name < b.name; });
+
+    // Identical runs of transitions are stored once.
+
+    std::map<std::vector<std::pair<int64_t, int32_t>>, uint32_t> shared;
+    std::vector<TimeZoneEntry> entries;
+    std::vector<int64_t> instants;
+    std::vector<int32_t> offsets;
+    std::string names;
+
+    for (auto&& zone : zones)
+    {
+        auto const found = shared.emplace(zone.transitions, static_cast<uint32_t>(instants.size()));
+
+        if (found.second)
+        {
+            for (auto&& transition : zone.transitions)
+            {
+                instants.push_back(transition.first);
+                offsets.push_back(transition.second);
+            }
+        }
+
+        entries.push_back({ static_cast<uint32_t>(names.size()), static_cast<uint32_t>(zone.name.size()),
+            found.first->second, static_cast<uint32_t>(zone.transitions.size()), zone.initial, 0 });
+
+        names += zone.name;
+    }
+
+    auto const align = [](uint64_t const offset) { return (offset + 7) & ~uint64_t{ 7 }; };
+
+    TimeZoneFileHeader header = {};
+    header.magic = time_zone_magic;
+    header.version = time_zone_version;
+    header.zone_count = static_cast<uint32_t>(entries.size());
+    header.transition_count = static_cast<uint32_t>(instants.size());
+    header.valid_until = until;
+    header.zones_offset = align(sizeof(header));
+    header.instants_offset = align(header.zones_offset + entries.size() * sizeof(TimeZoneEntry));
+    header.offsets_offset = align(header.instants_offset + instants.size() * sizeof(int64_t));
+    header.names_offset = align(header.offsets_offset + offsets.size() * sizeof(int32_t));
+    header.names_size = names.size();
+
+    std::vector<uint8_t> file(header.names_offset + names.size());
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + header.zones_offset, entries.data(), entries.size() * sizeof(TimeZoneEntry));
+    memcpy(file.data() + header.instants_offset, instants.data(), instants.size() * sizeof(int64_t));
+    memcpy(file.data() + header.offsets_offset, offsets.data(), offsets.size() * sizeof(int32_t));
+    memcpy(file.data() + header.names_offset, names.data(), names.size());
+
+    auto const output = fopen(argv[2], "wb");
+
+    if (!output || file.size() != fwrite(file.data(), 1, file.size(), output) || fclose(output))
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    fprintf(stderr, "clock-tzc: %zu zones, %zu transitions (%zu shared runs), %zu bytes\n",
+        entries.size(), instants.size(), shared.size(), file.size());
+
+    return 0;
+}
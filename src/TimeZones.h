@@ -0,0 +1,202 @@
+#pragma once
+
+#include "MappedTables.h"
+#include "SharedMemory.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A precompiled time zone database, as written by clock-tzc from tzdata's compiled zoneinfo
+// files. The file is mapped read-only and used in place: opening it only checks that the tables
+// lie within the file. Each zone is a run of UTC instants, sorted, at which its offset changes,
+// with the offset that takes effect at each. Rules for future daylight saving are expanded into
+// transitions up to valid_until, after which the last offset simply persists. Zones whose
+// transitions are identical, such as links, share one run. Native endianness, like the display
+// list blob, as the file is built on the machine that uses it.
+//
+// The file holds the header, then the zones sorted by name, the instants, the offsets, and the
+// names, each table 8-byte aligned.
+
+constexpr uint32_t time_zone_magic = 0x5a54434b; // "KCTZ"
+constexpr uint32_t time_zone_version = 1;
+
+struct TimeZoneFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t zone_count;
+    uint32_t transition_count;
+    int64_t valid_until;
+    uint64_t zones_offset;
+    uint64_t instants_offset;
+    uint64_t offsets_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+struct TimeZoneEntry
+{
+    uint32_t name;          // offset into the names
+    uint32_t name_length;
+    uint32_t first;         // first transition
+    uint32_t count;
+    int32_t initial;        // offset before the first transition, in seconds east of UTC
+    uint32_t reserved;
+};
+
+// An offset from UTC and the instants between which it holds: from <= t < until.
+
+struct TimeSpan
+{
+    int64_t from;
+    int64_t until;
+    int32_t offset;
+};
+
+struct TimeZoneDatabase
+{
+    bool open(std::string const& path)
+    {
+        m_memory = SharedMemory::map_file(path);
+        m_header = nullptr;
+
+        if (!m_memory || m_memory.size() < sizeof(TimeZoneFileHeader))
+        {
+            return false;
+        }
+
+        auto const header = static_cast<TimeZoneFileHeader const*>(m_memory.data());
+        auto const size = m_memory.size();
+
+        if (header->magic != time_zone_magic || header->version != time_zone_version ||
+            !table_fits(size, header->zones_offset, header->zone_count, sizeof(TimeZoneEntry)) ||
+            !table_fits(size, header->instants_offset, header->transition_count, sizeof(int64_t)) ||
+            !table_fits(size, header->offsets_offset, header->transition_count, sizeof(int32_t)) ||
+            !table_fits(size, header->names_offset, header->names_size, 1))
+        {
+            return false;
+        }
+
+        auto const base = static_cast<uint8_t const*>(m_memory.data());
+        m_zones = reinterpret_cast<TimeZoneEntry const*>(base + header->zones_offset);
+        m_instants = reinterpret_cast<int64_t const*>(base + header->instants_offset);
+        m_offsets = reinterpret_cast<int32_t const*>(base + header->offsets_offset);
+        m_names = reinterpret_cast<char const*>(base + header->names_offset);
+
+        for (uint32_t zone = 0; zone != header->zone_count; ++zone)
+        {
+            auto const& entry = m_zones[zone];
+
+            if (uint64_t{ entry.first } + entry.count > header->transition_count ||
+                uint64_t{ entry.name } + entry.name_length > header->names_size)
+            {
+                return false;
+            }
+        }
+
+        m_header = header;
+        return true;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return nullptr != m_header;
+    }
+
+    uint32_t size() const noexcept
+    {
+        return m_header ? m_header->zone_count : 0;
+    }
+
+    int64_t valid_until() const noexcept
+    {
+        return m_header->valid_until;
+    }
+
+    std::string_view name(uint32_t const zone) const noexcept
+    {
+        return { m_names + m_zones[zone].name, m_zones[zone].name_length };
+    }
+
+    // Returns the zone with the given name, such as "Europe/London", or -1.
+
+    int32_t find(std::string_view const name) const noexcept
+    {
+        return find_by_name(size(), name, [this](uint32_t const zone) { return this->name(zone); });
+    }
+
+    // Finds the offset in effect at a UTC instant, in seconds since 1970, by binary search.
+
+    TimeSpan span(uint32_t const zone, int64_t const time) const noexcept
+    {
+        auto const& entry = m_zones[zone];
+        auto const instants = m_instants + entry.first;
+        auto const index = static_cast<uint32_t>(std::upper_bound(instants, instants + entry.count, time) - instants);
+
+        return
+        {
+            index ? instants[index - 1] : std::numeric_limits<int64_t>::min(),
+            index != entry.count ? instants[index] : std::numeric_limits<int64_t>::max(),
+            index ? m_offsets[entry.first + index - 1] : entry.initial
+        };
+    }
+
+    int32_t offset(uint32_t const zone, int64_t const time) const noexcept
+    {
+        return span(zone, time).offset;
+    }
+
+private:
+
+    SharedMemory m_memory;
+    TimeZoneFileHeader const* m_header{};
+    TimeZoneEntry const* m_zones{};
+    int64_t const* m_instants{};
+    int32_t const* m_offsets{};
+    char const* m_names{};
+};
+
+// Remembers the span last found for each zone, so that while time moves forward through the
+// same span, as it does frame after frame, a lookup is a pair of compares. Not thread safe: each
+// thread that looks up zones keeps its own cache.
+
+struct TimeZoneCache
+{
+    explicit TimeZoneCache(TimeZoneDatabase const& database) :
+        m_database(database),
+        m_spans(database.size(), TimeSpan{ 0, 0, 0 })
+    {
+    }
+
+    int32_t offset(uint32_t const zone, int64_t const time) noexcept
+    {
+        auto& span = m_spans[zone];
+
+        if (time < span.from || time >= span.until)
+        {
+            span = m_database.span(zone, time);
+            ++m_misses;
+        }
+
+        return span.offset;
+    }
+
+    TimeZoneDatabase const& database() const noexcept
+    {
+        return m_database;
+    }
+
+    uint64_t misses() const noexcept
+    {
+        return m_misses;
+    }
+
+private:
+
+    TimeZoneDatabase const& m_database;
+    std::vector<TimeSpan> m_spans;
+    uint64_t m_misses{};
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+
+// Whether anyone can see the clock, from everything that can hide it. Each reason is reported on
+// its own as the system notices it: the swap chain finds the window occluded, the window is
+// minimised, the display is switched off, or the window is cloaked, as it is on another virtual
+// desktop. The window is visible only while none of them holds, and is revealed only once the
+// last of them is lifted, so that for example restoring a window whose display is off draws
+// nothing.
+//
+// While hidden the render loop does no work at all, and on being revealed it draws at once from
+// the current time rather than presenting whatever it last drew. The frames it did not draw are
+// counted at the rate it was drawing when it was hidden. The tracker is pure and takes the time
+// rather than reading a clock, so that every sequence of reports can be checked away from Windows.
+
+enum class HiddenBy : uint8_t
+{
+    occlusion = 1,
+    minimized = 2,
+    display = 4,
+    cloaked = 8,
+};
+
+enum class VisibilityChange : uint8_t
+{
+    none,
+    hidden,
+    revealed,
+};
+
+inline char const* hidden_by_name(HiddenBy const reason) noexcept
+{
+    switch (reason)
+    {
+    case HiddenBy::occlusion: return "occluded";
+    case HiddenBy::minimized: return "minimized";
+    case HiddenBy::display: return "display off";
+    case HiddenBy::cloaked: return "cloaked";
+    default: return "?";
+    }
+}
+
+struct VisibilityTracker
+{
+    // Reports whether one reason now hides the window, at the given time in seconds from any
+    // fixed point, and while visible the frames a second the render loop is drawing.
+
+    VisibilityChange update(HiddenBy const reason, bool const hidden, double const seconds, double const frame_rate) noexcept
+    {
+        auto const was = m_hidden;
+        m_hidden = hidden ? (m_hidden | static_cast<uint8_t>(reason)) : (m_hidden & ~static_cast<uint8_t>(reason));
+
+        if (!was && m_hidden)
+        {
+            m_since = seconds;
+            m_rate = frame_rate;
+            ++m_hides;
+            return VisibilityChange::hidden;
+        }
+
+        if (was && !m_hidden)
+        {
+            m_seconds += seconds - m_since;
+            m_saved += (seconds - m_since) * m_rate;
+            ++m_reveals;
+            return VisibilityChange::revealed;
+        }
+
+        return VisibilityChange::none;
+    }
+
+    bool visible() const noexcept
+    {
+        return !m_hidden;
+    }
+
+    // The reasons that hide the window, as HiddenBy flags.
+
+    uint8_t hidden() const noexcept
+    {
+        return m_hidden;
+    }
+
+    bool hidden_by(HiddenBy const reason) const noexcept
+    {
+        return 0 != (m_hidden & static_cast<uint8_t>(reason));
+    }
+
+    uint64_t hides() const noexcept
+    {
+        return m_hides;
+    }
+
+    uint64_t reveals() const noexcept
+    {
+        return m_reveals;
+    }
+
+    // Totals up to the given time, including any time hidden so far.
+
+    double hidden_seconds(double const seconds) const noexcept
+    {
+        return m_seconds + (m_hidden ? seconds - m_since : 0.0);
+    }
+
+    uint64_t frames_saved(double const seconds) const noexcept
+    {
+        return static_cast<uint64_t>(m_saved + (m_hidden ? (seconds - m_since) * m_rate : 0.0));
+    }
+
+private:
+
+    uint8_t m_hidden{};
+    double m_since{};
+    double m_rate{};
+    double m_seconds{};
+    double m_saved{};
+    uint64_t m_hides{};
+    uint64_t m_reveals{};
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "DisplayList.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Lays out many clocks in a grid sharing one swap chain. The dials never move so they are
+// recorded separately, to be drawn once into a cached layer, while the hands of every clock
+// live in a single list whose transforms are patched in one pass per frame.
+
+struct WallLayout
+{
+    uint32_t count;
+    uint32_t columns;
+    uint32_t rows;
+    float width;
+    float height;
+    float cell;
+};
+
+inline WallLayout wall_layout(uint32_t const count, float const width, float const height)
+{
+    WallLayout layout{ count, 1, 1, width, height, 0.0f };
+
+    for (uint32_t columns = 1; columns <= count; ++columns)
+    {
+        auto const rows = (count + columns - 1) / columns;
+        auto const cell = std::min(width / columns, height / rows);
+
+        if (cell > layout.cell)
+        {
+            layout.columns = columns;
+            layout.rows = rows;
+            layout.cell = cell;
+        }
+    }
+
+    return layout;
+}
+
+// A wall of one is the familiar single clock filling the window.
+
+inline ClockGeometry wall_geometry(WallLayout const& layout, uint32_t const index)
+{
+    if (layout.count == 1)
+    {
+        return clock_geometry(layout.width, layout.height);
+    }
+
+    auto const left = (layout.width - layout.columns * layout.cell) / 2.0f;
+    auto const top = (layout.height - layout.rows * layout.cell) / 2.0f;
+    auto const column = index % layout.columns;
+    auto const row = index / layout.columns;
+
+    return
+    {
+        left + (column + 0.5f) * layout.cell,
+        top + (row + 0.5f) * layout.cell,
+        layout.cell * 0.4f
+    };
+}
+
+// The radius in pixels of each clock on a wall, from which its level of detail is chosen.
+
+inline float wall_radius(uint32_t const count, float const width, float const height, float const dpi)
+{
+    return wall_geometry(wall_layout(count, width, height), 0).radius * dpi / 96.0f;
+}
+
+struct WallScene
+{
+    DisplayList dials;
+    DisplayList hands;
+    uint32_t count;
+};
+
+inline WallScene record_wall(uint32_t const count, float const width, float const height, bool const second = true, FaceTheme const& theme = default_theme)
+{
+    auto const layout = wall_layout(count, width, height);
+    WallScene scene{ {}, {}, count };
+    scene.dials.transforms.reserve(count);
+    scene.dials.ops.reserve(count * 2);
+    scene.hands.transforms.reserve(count * 4);
+    scene.hands.ops.reserve(count * 6);
+
+    for (uint32_t index = 0; index != count; ++index)
+    {
+        auto const geometry = wall_geometry(layout, index);
+        record_dial(scene.dials, geometry, theme);
+        record_clock(scene.hands, geometry, false, second, theme);
+    }
+
+    return scene;
+}
+
+// Fills angles for every clock from one instant, in seconds since midnight, plus a per-clock
+// offset in seconds.
+
+inline void wall_angles(double const seconds, int32_t const* offsets, uint32_t const count, HandAngles* angles)
+{
+    for (uint32_t index = 0; index != count; ++index)
+    {
+        angles[index] = hand_angles(seconds + offsets[index]);
+    }
+}
+
+inline void patch_wall(WallScene& scene, HandAngles const* angles, Transform const& orientation = identity())
+{
+    for (uint32_t index = 0; index != scene.count; ++index)
+    {
+        patch_hands(scene.hands, static_cast<uint16_t>(index * 4), angles[index], orientation);
+    }
+}
+
+// Unless its clocks name their time zones, a wall spreads them across whole-hour UTC offsets.
+
+inline std::vector<int32_t> wall_offsets(uint32_t const count)
+{
+    std::vector<int32_t> offsets(count);
+
+    if (count > 1)
+    {
+        for (uint32_t index = 0; index != count; ++index)
+        {
+            offsets[index] = (static_cast<int32_t>(index % 24) - 11) * 3600;
+        }
+    }
+
+    return offsets;
+}
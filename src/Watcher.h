@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Waits for any of a few files to change: inotify on Linux and ReadDirectoryChangesW on Windows.
+// The directories holding the files are watched rather than the files themselves, since editors
+// and compilers often save by writing a new file and renaming it over the old one. Only whole
+// writes are reported where the system can tell, but callers should still let a burst of changes
+// settle before reading the files.
+
+enum class WatchResult
+{
+    changed,
+    timeout,
+    cancelled,
+};
+
+struct FileWatcher
+{
+    FileWatcher()
+    {
+#ifdef _WIN32
+        m_cancel = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+#else
+        m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        m_cancel = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    }
+
+    FileWatcher(FileWatcher const&) = delete;
+    FileWatcher& operator=(FileWatcher const&) = delete;
+
+    ~FileWatcher()
+    {
+        clear();
+
+#ifdef _WIN32
+        CloseHandle(m_cancel);
+#else
+        ::close(m_inotify);
+        ::close(m_cancel);
+#endif
+    }
+
+    // Replaces the files watched. Files in directories that cannot be watched are left out.
+
+    void watch(std::vector<std::string> const& paths)
+    {
+        clear();
+
+        for (auto&& path : paths)
+        {
+            std::filesystem::path const file(path);
+            auto const directory = file.has_parent_path() ? file.parent_path().string() : std::string(".");
+            auto const name = file.filename().string();
+
+            auto found = std::find_if(m_directories.begin(), m_directories.end(), [&](std::unique_ptr<Directory> const& watched)
+            {
+                return watched->path == directory;
+            });
+
+            if (found == m_directories.end())
+            {
+                auto added = std::make_unique<Directory>();
+                added->path = directory;
+
+                if (!open(*added))
+                {
+                    continue;
+                }
+
+                m_directories.push_back(std::move(added));
+                found = m_directories.end() - 1;
+            }
+
+            (*found)->names.push_back(name);
+        }
+    }
+
+    // Waits up to timeout milliseconds, or for ever if it is negative, for a watched file to
+    // change or for cancel to be called from another thread.
+
+    WatchResult wait(int const timeout)
+    {
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+        while (true)
+        {
+            auto remaining = -1;
+
+            if (timeout >= 0)
+            {
+                remaining = static_cast<int>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count()));
+            }
+
+#ifdef _WIN32
+            std::vector<HANDLE> events{ m_cancel };
+
+            for (auto&& directory : m_directories)
+            {
+                events.push_back(directory->overlapped.hEvent);
+            }
+
+            auto const signalled = WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, remaining < 0 ? INFINITE : static_cast<DWORD>(remaining));
+
+            if (WAIT_TIMEOUT == signalled)
+            {
+                return WatchResult::timeout;
+            }
+
+            if (WAIT_OBJECT_0 == signalled || signalled >= WAIT_OBJECT_0 + events.size())
+            {
+                return WatchResult::cancelled;
+            }
+
+            if (changed(*m_directories[signalled - WAIT_OBJECT_0 - 1]))
+            {
+                return WatchResult::changed;
+            }
+#else
+            pollfd entries[] = { { m_cancel, POLLIN, 0 }, { m_inotify, POLLIN, 0 } };
+            auto const ready = poll(entries, 2, remaining);
+
+            if (0 == ready)
+            {
+                return WatchResult::timeout;
+            }
+
+            if (ready < 0 || entries[0].revents)
+            {
+                if (ready < 0 && EINTR == errno)
+                {
+                    continue;
+                }
+
+                return WatchResult::cancelled;
+            }
+
+            if (changed())
+            {
+                return WatchResult::changed;
+            }
+#endif
+        }
+    }
+
+    // Wakes the waiting thread, and any later wait, with WatchResult::cancelled.
+
+    void cancel() noexcept
+    {
+#ifdef _WIN32
+        SetEvent(m_cancel);
+#else
+        uint64_t const one = 1;
+        [[maybe_unused]] auto const written = write(m_cancel, &one, sizeof(one));
+#endif
+    }
+
+private:
+
+    // Directories stay put while they are watched, as Windows completes reads into them.
+
+    struct Directory
+    {
+        std::string path;
+        std::vector<std::string> names;
+#ifdef _WIN32
+        HANDLE handle{ INVALID_HANDLE_VALUE };
+        OVERLAPPED overlapped{};
+        std::vector<DWORD> buffer;
+#else
+        int descriptor{ -1 };
+#endif
+    };
+
+#ifdef _WIN32
+    bool open(Directory& directory)
+    {
+        directory.handle = CreateFileA(directory.path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+
+        if (INVALID_HANDLE_VALUE == directory.handle)
+        {
+            return false;
+        }
+
+        directory.overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        directory.buffer.resize(16384 / sizeof(DWORD));
+
+        if (!directory.overlapped.hEvent || !listen(directory))
+        {
+            close(directory);
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool listen(Directory& directory)
+    {
+        ResetEvent(directory.overlapped.hEvent);
+
+        return ReadDirectoryChangesW(directory.handle, directory.buffer.data(), static_cast<DWORD>(directory.buffer.size() * sizeof(DWORD)), FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, &directory.overlapped, nullptr);
+    }
+
+    static void close(Directory& directory)
+    {
+        if (INVALID_HANDLE_VALUE != directory.handle)
+        {
+            CancelIoEx(directory.handle, &directory.overlapped);
+            DWORD bytes;
+            GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, TRUE);
+            CloseHandle(directory.handle);
+        }
+
+        if (directory.overlapped.hEvent)
+        {
+            CloseHandle(directory.overlapped.hEvent);
+        }
+    }
+
+    // An overflowed buffer returns no entries, so it counts as a change.
+
+    static bool changed(Directory& directory)
+    {
+        DWORD bytes = 0;
+        auto const completed = GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, FALSE);
+        auto found = !completed || !bytes;
+
+        for (auto offset = size_t{}; completed && bytes && !found;)
+        {
+            auto const info = reinterpret_cast<FILE_NOTIFY_INFORMATION const*>(reinterpret_cast<uint8_t const*>(directory.buffer.data()) + offset);
+            std::wstring const name(info->FileName, info->FileNameLength / sizeof(wchar_t));
+
+            for (auto&& watched : directory.names)
+            {
+                wchar_t wide[MAX_PATH];
+                auto const length = MultiByteToWideChar(CP_ACP, 0, watched.c_str(), -1, wide, MAX_PATH);
+                found = found || (length > 0 && CSTR_EQUAL == CompareStringOrdinal(name.c_str(), static_cast<int>(name.size()), wide, length - 1, TRUE));
+            }
+
+            if (!info->NextEntryOffset)
+            {
+                break;
+            }
+
+            offset += info->NextEntryOffset;
+        }
+
+        listen(directory);
+        return found;
+    }
+#else
+    bool open(Directory& directory)
+    {
+        directory.descriptor = inotify_add_watch(m_inotify, directory.path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        return directory.descriptor >= 0;
+    }
+
+    void close(Directory& directory)
+    {
+        inotify_rm_watch(m_inotify, directory.descriptor);
+    }
+
+    // Reads every pending event, as poll only reports that there are some. An overflowed queue
+    // counts as a change.
+
+    bool changed()
+    {
+        alignas(inotify_event) char buffer[16384];
+        auto found = false;
+        ssize_t size;
+
+        while ((size = read(m_inotify, buffer, sizeof(buffer))) > 0)
+        {
+            for (ssize_t offset = 0; offset < size;)
+            {
+                auto const event = reinterpret_cast<inotify_event const*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    found = true;
+                    continue;
+                }
+
+                for (auto&& directory : m_directories)
+                {
+                    if (directory->descriptor == event->wd && event->len)
+                    {
+                        found = found || std::find(directory->names.begin(), directory->names.end(), event->name) != directory->names.end();
+                    }
+                }
+            }
+        }
+
+        return found;
+    }
+#endif
+
+    void clear()
+    {
+        for (auto&& directory : m_directories)
+        {
+            close(*directory);
+        }
+
+        m_directories.clear();
+    }
+
+    std::vector<std::unique_ptr<Directory>> m_directories;
+#ifdef _WIN32
+    HANDLE m_cancel{};
+#else
+    int m_inotify{ -1 };
+    int m_cancel{ -1 };
+#endif
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed pool of threads for CPU-bound work such as encoding. parallel_for runs part of the work
+// on the calling thread as well, so it makes progress even when called from one of the workers.
+
+struct WorkerPool
+{
+    explicit WorkerPool(unsigned const count = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned i = 0; i != count; ++i)
+        {
+            m_threads.emplace_back([this] { run(); });
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stopping = true;
+        }
+
+        m_changed.notify_all();
+
+        for (auto&& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    WorkerPool(WorkerPool const&) = delete;
+    WorkerPool& operator=(WorkerPool const&) = delete;
+
+    size_t size() const noexcept
+    {
+        return m_threads.size();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_tasks.push_back(std::move(task));
+        }
+
+        m_changed.notify_one();
+    }
+
+    // Calls action(index) for every index in [0, count) and returns once all have completed.
+
+    template <typename Action>
+    void parallel_for(size_t const count, Action&& action)
+    {
+        struct State
+        {
+            std::atomic<size_t> next{ 0 };
+            std::mutex lock;
+            std::condition_variable finished;
+            size_t completed{ 0 };
+        };
+
+        auto const state = std::make_shared<State>();
+        auto const function = std::function<void(size_t)>(std::forward<Action>(action));
+
+        auto const work = [state, function, count]
+        {
+            for (size_t index; (index = state->next++) < count;)
+            {
+                function(index);
+                std::lock_guard<std::mutex> lock(state->lock);
+
+                if (++state->completed == count)
+                {
+                    state->finished.notify_all();
+                }
+            }
+        };
+
+        for (size_t i = 1; i < std::min(count, size() + 1); ++i)
+        {
+            submit(work);
+        }
+
+        work();
+        std::unique_lock<std::mutex> lock(state->lock);
+        state->finished.wait(lock, [&] { return state->completed == count; });
+    }
+
+private:
+
+    void run()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_changed.wait(lock, [&] { return m_stopping || !m_tasks.empty(); });
+
+                if (m_tasks.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    std::deque<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_threads;
+    bool m_stopping{};
+};
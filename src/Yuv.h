@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLOCK_SSE2
+#endif
+
+// Converts opaque BGRA to planar I420 using BT.601 limited range coefficients, as expected by
+// most encoders reading Y4M. Width and height must be even. Luma is computed four pixels at a
+// time with SSE2 where available; chroma averages each 2x2 block.
+
+inline uint8_t luma(uint32_t const pixel) noexcept
+{
+    auto const b = static_cast<int>(pixel & 0xff);
+    auto const g = static_cast<int>(pixel >> 8 & 0xff);
+    auto const r = static_cast<int>(pixel >> 16 & 0xff);
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline void convert_luma_row(uint32_t const* source, uint8_t* y, uint32_t const width) noexcept
+{
+    uint32_t x = 0;
+
+#ifdef CLOCK_SSE2
+    auto const zero = _mm_setzero_si128();
+    auto const coefficients = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+    auto const round = _mm_set1_epi32(128);
+    auto const offset = _mm_set1_epi32(16);
+
+    for (; x + 4 <= width; x += 4)
+    {
+        auto const pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + x));
+        auto low = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coefficients);
+        auto high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coefficients);
+        low = _mm_add_epi32(low, _mm_srli_epi64(low, 32));
+        high = _mm_add_epi32(high, _mm_srli_epi64(high, 32));
+
+        auto sums = _mm_unpacklo_epi64(_mm_shuffle_epi32(low, _MM_SHUFFLE(3, 3, 2, 0)),
+            _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 3, 2, 0)));
+
+        sums = _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(sums, round), 8), offset);
+        auto const words = _mm_packs_epi32(sums, sums);
+        auto const bytes = _mm_packus_epi16(words, words);
+        auto const packed = static_cast<uint32_t>(_mm_cvtsi128_si32(bytes));
+        y[x + 0] = static_cast<uint8_t>(packed);
+        y[x + 1] = static_cast<uint8_t>(packed >> 8);
+        y[x + 2] = static_cast<uint8_t>(packed >> 16);
+        y[x + 3] = static_cast<uint8_t>(packed >> 24);
+    }
+#endif
+
+    for (; x < width; ++x)
+    {
+        y[x] = luma(source[x]);
+    }
+}
+
+inline void convert_i420(uint32_t const* source, uint32_t const width, uint32_t const height, uint8_t* planes) noexcept
+{
+    auto y = planes;
+    auto u = y + size_t{ width } * height;
+    auto v = u + size_t{ width / 2 } * (height / 2);
+
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        convert_luma_row(source + size_t{ row } * width, y + size_t{ row } * width, width);
+    }
+
+    for (uint32_t row = 0; row < height; row += 2)
+    {
+        auto const top = source + size_t{ row } * width;
+        auto const bottom = top + width;
+
+        for (uint32_t x = 0; x < width; x += 2)
+        {
+            // Blue and red are summed side by side in 16-bit lanes of one register.
+
+            auto const rb = (top[x] & 0xff00ff) + (top[x + 1] & 0xff00ff) + (bottom[x] & 0xff00ff) + (bottom[x + 1] & 0xff00ff);
+            auto const gs = (top[x] >> 8 & 0xff) + (top[x + 1] >> 8 & 0xff) + (bottom[x] >> 8 & 0xff) + (bottom[x + 1] >> 8 & 0xff);
+
+            auto const b = static_cast<int>(((rb & 0xffff) + 2) >> 2);
+            auto const g = static_cast<int>((gs + 2) >> 2);
+            auto const r = static_cast<int>(((rb >> 16) + 2) >> 2);
+
+            *u++ = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            *v++ = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+constexpr size_t i420_size(uint32_t const width, uint32_t const height) noexcept
+{
+    return size_t{ width } * height * 3 / 2;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Scene.h"
+#include "TimeZones.h"
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLOCK_SSE2
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Hand angles for a wall of clocks, each showing a named time zone, from a single UTC instant.
+// Thousands of clocks share a few hundred zones at most, so the work is done once per distinct
+// zone: its offset comes from a TimeZoneCache, and its angles are worked out four zones at a time
+// with SSE2. Each clock then gathers the angles of its zone into structure-of-arrays output,
+// eight at a time with AVX2 where it is available. The results are exactly those of
+// hand_angles(day, fraction) for each clock in turn.
+
+struct ClockAngles
+{
+    std::vector<float> second;
+    std::vector<float> minute;
+    std::vector<float> hour;
+
+    HandAngles operator[](size_t const index) const noexcept
+    {
+        return { second[index], minute[index], hour[index] };
+    }
+};
+
+struct ZoneClocks
+{
+    ZoneClocks(TimeZoneDatabase const& database, std::vector<uint32_t> const& zones) :
+        m_cache(database),
+        m_slots(zones.size())
+    {
+        std::vector<int32_t> slot_of(database.size(), -1);
+
+        for (size_t index = 0; index != zones.size(); ++index)
+        {
+            auto& slot = slot_of[zones[index]];
+
+            if (slot < 0)
+            {
+                slot = static_cast<int32_t>(m_zones.size());
+                m_zones.push_back(zones[index]);
+            }
+
+            m_slots[index] = slot;
+        }
+
+        // Padded to a whole number of SSE2 vectors so the last few zones need no scalar tail.
+
+        auto const padded = (m_zones.size() + 3) & ~size_t{ 3 };
+        m_days.resize(padded);
+        m_angles.second.resize(padded);
+        m_angles.minute.resize(padded);
+        m_angles.hour.resize(padded);
+    }
+
+    uint32_t size() const noexcept
+    {
+        return static_cast<uint32_t>(m_slots.size());
+    }
+
+    uint32_t distinct() const noexcept
+    {
+        return static_cast<uint32_t>(m_zones.size());
+    }
+
+    TimeZoneCache const& cache() const noexcept
+    {
+        return m_cache;
+    }
+
+    // Fills angles for every clock at a UTC instant given as whole seconds since 1970 and a
+    // fraction of a second.
+
+    void update(int64_t const time, float const fraction, ClockAngles& angles)
+    {
+        auto const base = static_cast<int32_t>((time % 86400 + 86400) % 86400);
+
+        // Offsets are reduced to within a day so that base + offset needs one correction at most.
+
+        for (size_t slot = 0; slot != m_zones.size(); ++slot)
+        {
+            m_days[slot] = base + m_cache.offset(m_zones[slot], time) % 86400;
+        }
+
+        zone_angles(fraction);
+
+        auto const count = m_slots.size();
+        angles.second.resize(count);
+        angles.minute.resize(count);
+        angles.hour.resize(count);
+        gather(m_angles.second.data(), angles.second.data());
+        gather(m_angles.minute.data(), angles.minute.data());
+        gather(m_angles.hour.data(), angles.hour.data());
+    }
+
+private:
+
+    void zone_angles(float const fraction) noexcept
+    {
+        size_t slot = 0;
+
+#ifdef CLOCK_SSE2
+        auto const day = _mm_set1_epi32(86400);
+        auto const fractions = _mm_set1_ps(fraction);
+
+        for (; slot != m_days.size(); slot += 4)
+        {
+            auto days = _mm_loadu_si128(reinterpret_cast<__m128i const*>(m_days.data() + slot));
+            days = _mm_add_epi32(days, _mm_and_si128(_mm_cmplt_epi32(days, _mm_setzero_si128()), day));
+            days = _mm_sub_epi32(days, _mm_andnot_si128(_mm_cmplt_epi32(days, day), day));
+
+            auto const seconds = _mm_cvtepi32_ps(days);
+            auto const second = _mm_add_ps(remainder(seconds, 60.0f), fractions);
+            auto const minute = _mm_add_ps(remainder(seconds, 3600.0f), fractions);
+            auto const hour = _mm_add_ps(remainder(seconds, 43200.0f), fractions);
+            _mm_storeu_ps(m_angles.second.data() + slot, _mm_mul_ps(second, _mm_set1_ps(6.0f)));
+            _mm_storeu_ps(m_angles.minute.data() + slot, _mm_div_ps(minute, _mm_set1_ps(10.0f)));
+            _mm_storeu_ps(m_angles.hour.data() + slot, _mm_div_ps(hour, _mm_set1_ps(120.0f)));
+        }
+#endif
+
+        for (; slot != m_days.size(); ++slot)
+        {
+            auto const day = (m_days[slot] + 86400) % 86400;
+            auto const angles = hand_angles(static_cast<uint32_t>(day), fraction);
+            m_angles.second[slot] = angles.second;
+            m_angles.minute[slot] = angles.minute;
+            m_angles.hour[slot] = angles.hour;
+        }
+    }
+
+#ifdef CLOCK_SSE2
+
+    // Whole seconds below 2^24 are exact in single precision, as is every step here, so the
+    // estimated quotient is off by one at most and a single correction gives the exact remainder.
+
+    static __m128 remainder(__m128 const seconds, float const divisor) noexcept
+    {
+        auto const divisors = _mm_set1_ps(divisor);
+        auto const quotient = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(seconds, _mm_set1_ps(1.0f / divisor))));
+        auto result = _mm_sub_ps(seconds, _mm_mul_ps(quotient, divisors));
+        result = _mm_add_ps(result, _mm_and_ps(_mm_cmplt_ps(result, _mm_setzero_ps()), divisors));
+        return _mm_sub_ps(result, _mm_and_ps(_mm_cmpge_ps(result, divisors), divisors));
+    }
+
+#endif
+
+    void gather(float const* zones, float* clocks) const noexcept
+    {
+        size_t index = 0;
+        auto const count = m_slots.size();
+
+#ifdef __AVX2__
+        for (; index + 8 <= count; index += 8)
+        {
+            auto const slots = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(m_slots.data() + index));
+            _mm256_storeu_ps(clocks + index, _mm256_i32gather_ps(zones, slots, 4));
+        }
+#endif
+
+        for (; index != count; ++index)
+        {
+            clocks[index] = zones[m_slots[index]];
+        }
+    }
+
+    TimeZoneCache m_cache;
+    std::vector<uint32_t> m_zones;
+    std::vector<int32_t> m_slots;
+    std::vector<int32_t> m_days;
+    ClockAngles m_angles;
+};
@@ -2,15 +2,22 @@
 
 #define NOMINMAX
 
+#include <winsock2.h> // must precede windows.h
 #include <algorithm>
 #include <d2d1_1.h>
 #include <d3d11_1.h>
+#include <dcomp.h>
+#include <dwmapi.h>
+#include <dwrite.h>
 #include <uianimation.h>
 #include <wincodec.h>
 #include <winrt/base.h>
 
 #pragma comment(lib, "d2d1")
 #pragma comment(lib, "d3d11")
+#pragma comment(lib, "dcomp")
+#pragma comment(lib, "dwmapi")
+#pragma comment(lib, "dwrite")
 #pragma comment(lib, "dxgi")
 
 #pragma warning(disable: 4706)